@@ -0,0 +1,485 @@
+#! /usr/bin/env python
+
+'''
+    File: st_bench.py
+
+    Purpose: Runs st_generate_products end to end on the benchmark fixture
+             without MODTRAN, the NARR archive, or the ASTER GED server, and
+             compares the time of each stage and the checksum of each output
+             band against the baseline stored with the fixture.
+
+             MODTRAN is replaced by the stand-in beside this script, the NARR
+             archive by the slice in the fixture, and the ASTER GED server by
+             a local HTTP server of the tiles in the fixture.  The run uses
+             the st_generate_products found on the PATH, so the tree is built
+             and installed first.
+
+    Project: Land Satellites Data Systems Science Research and Development
+             (LSRD) at the USGS EROS
+
+    License: NASA Open Source Agreement 1.3
+'''
+
+import os
+import sys
+import json
+import time
+import shutil
+import hashlib
+import logging
+import threading
+import subprocess
+import urllib
+import posixpath
+from argparse import ArgumentParser
+from BaseHTTPServer import HTTPServer
+from SimpleHTTPServer import SimpleHTTPRequestHandler
+from collections import defaultdict
+
+
+BENCH_DIRECTORY = os.path.dirname(os.path.realpath(__file__))
+
+# The static data of the tree the benchmark is in
+STATIC_DATA_DIRECTORY = os.path.join(BENCH_DIRECTORY, os.pardir,
+                                     'static_data')
+
+# Written by st_bench_fixture.py
+FIXTURE_FILENAME = 'fixture.json'
+SCENE_DIRECTORY = 'scene'
+NARR_DIRECTORY = 'narr'
+ASTER_DIRECTORY = 'aster'
+
+# Kept with the fixture
+BASELINE_FILENAME = 'baseline.json'
+
+# Written in the work directory
+RESULTS_FILENAME = 'bench_results.json'
+LOG_FILENAME = 'st_generate_products.log'
+
+# Written in the scene directory by --trace
+TRACE_FILENAME = 'st_trace.json'
+
+# Read by the MODTRAN stand-in
+MODTRAN_SECONDS_ENV = 'ST_BENCH_MODTRAN_SECONDS'
+
+PROC_CFG_TEMPLATE = '''[processing]
+omp_num_threads = {process_count}
+st_data_path = {data_path}
+st_aux_path = {aux_path}
+modtran_data_path = {modtran_data_path}
+aster_ged_server_name = {server_name}
+aster_ged_server_path = /
+'''
+
+
+def retrieve_command_line_arguments():
+    """Read arguments from the command line
+
+    Returns:
+        args <arguments>: The arguments read from the command line
+    """
+
+    parser = ArgumentParser(description='Benchmarks the ST pipeline on the'
+                                        ' fixture and compares it against the'
+                                        ' baseline')
+
+    parser.add_argument('--fixture',
+                        action='store', dest='fixture_directory',
+                        required=False, default=None,
+                        help='The fixture prepared by st_bench_fixture.py')
+
+    parser.add_argument('--work-directory',
+                        action='store', dest='work_directory',
+                        required=False, default='st_bench_run',
+                        help='The directory the pipeline is run in, which'
+                             ' is replaced (default st_bench_run)')
+
+    parser.add_argument('--process-count',
+                        action='store', dest='process_count',
+                        required=False, default=4, type=int,
+                        help='The omp_num_threads of the run (default 4)')
+
+    parser.add_argument('--modtran-seconds',
+                        action='store', dest='modtran_seconds',
+                        required=False, default=0.0, type=float,
+                        help='The seconds each MODTRAN run takes'
+                             ' (default 0)')
+
+    parser.add_argument('--tolerance',
+                        action='store', dest='tolerance',
+                        required=False, default=0.25, type=float,
+                        help='The fraction a stage may be slower than the'
+                             ' baseline (default 0.25)')
+
+    parser.add_argument('--slack',
+                        action='store', dest='slack',
+                        required=False, default=1.0, type=float,
+                        help='The seconds a stage may be slower than the'
+                             ' baseline regardless of the tolerance'
+                             ' (default 1.0)')
+
+    parser.add_argument('--update-baseline',
+                        action='store_true', dest='update_baseline',
+                        required=False, default=False,
+                        help='Store the results as the baseline of the'
+                             ' fixture instead of comparing them')
+
+    parser.add_argument('--options',
+                        action='store', dest='options',
+                        required=False, default='',
+                        help='Further options for st_generate_products.py')
+
+    parser.add_argument('--debug',
+                        action='store_true', dest='debug',
+                        required=False, default=False,
+                        help='Output debug messages and/or keep debug data')
+
+    args = parser.parse_args()
+
+    if args.fixture_directory is None:
+        raise Exception('--fixture must be specified on the command line')
+
+    return args
+
+
+class AsterRequestHandler(SimpleHTTPRequestHandler):
+    '''
+    Description:
+        Serves the ASTER GED tiles of the fixture, and answers 404 for the
+        tiles the ASTER GED does not have, as the server does.
+    '''
+
+    directory = None
+
+    def translate_path(self, path):
+        path = posixpath.normpath(urllib.unquote(path.split('?', 1)[0]))
+        return os.path.join(self.directory, os.path.basename(path))
+
+    def log_message(self, format, *args):
+        logger = logging.getLogger(__name__)
+        logger.debug(format % args)
+
+
+def start_aster_server(directory):
+    """Serve the ASTER GED tiles on a free local port
+
+    Args:
+        directory <str>: The fixture ASTER directory
+
+    Returns:
+        <HTTPServer>: The server, which is shut down by the caller
+    """
+
+    AsterRequestHandler.directory = os.path.realpath(directory)
+
+    server = HTTPServer(('127.0.0.1', 0), AsterRequestHandler)
+
+    thread = threading.Thread(target=server.serve_forever)
+    thread.daemon = True
+    thread.start()
+
+    return server
+
+
+def prepare_run(fixture_directory, work_directory, process_count,
+                server_name):
+    """Copy the fixture scene to the work directory and write the processing
+       configuration of the run
+
+    Args:
+        fixture_directory <str>: The fixture
+        work_directory <str>: The directory the pipeline is run in
+        process_count <int>: The omp_num_threads of the run
+        server_name <str>: The host and port of the ASTER GED stand-in
+
+    Returns:
+        <str>: The scene directory
+        <str>: The home directory holding the processing configuration
+    """
+
+    if os.path.isdir(work_directory):
+        shutil.rmtree(work_directory)
+
+    scene_directory = os.path.join(work_directory, SCENE_DIRECTORY)
+    shutil.copytree(os.path.join(fixture_directory, SCENE_DIRECTORY),
+                    scene_directory)
+
+    # MODTRAN needs a DATA directory, the stand-in never reads it
+    modtran_data_path = os.path.join(work_directory, 'DATA')
+    os.makedirs(modtran_data_path)
+
+    home_directory = os.path.realpath(os.path.join(work_directory, 'home'))
+    cfg_directory = os.path.join(home_directory, '.usgs', 'espa')
+    os.makedirs(cfg_directory)
+
+    with open(os.path.join(cfg_directory, 'processing.conf'), 'w') as cfg_fd:
+        cfg_fd.write(PROC_CFG_TEMPLATE.format(
+            process_count=process_count,
+            data_path=os.path.realpath(STATIC_DATA_DIRECTORY),
+            aux_path=os.path.realpath(os.path.join(fixture_directory,
+                                                   NARR_DIRECTORY)),
+            modtran_data_path=os.path.realpath(modtran_data_path),
+            server_name=server_name))
+
+    return (scene_directory, home_directory)
+
+
+def run_pipeline(xml_filename, scene_directory, home_directory,
+                 modtran_seconds, options, log_filename):
+    """Run st_generate_products on the scene with the stand-ins
+
+    Args:
+        xml_filename <str>: The XML metadata filename of the scene
+        scene_directory <str>: The scene directory
+        home_directory <str>: The home directory holding the processing
+                              configuration
+        modtran_seconds <float>: The seconds each MODTRAN run takes
+        options <str>: Further options for st_generate_products.py
+        log_filename <str>: The file the output of the run is written to
+
+    Returns:
+        <float>: The seconds the run took
+    """
+
+    logger = logging.getLogger(__name__)
+
+    environment = dict(os.environ)
+    environment['HOME'] = home_directory
+    environment['ST_DATA_DIR'] = os.path.realpath(STATIC_DATA_DIRECTORY)
+    environment[MODTRAN_SECONDS_ENV] = str(modtran_seconds)
+
+    # The stand-in is found before any real MODTRAN
+    environment['PATH'] = os.pathsep.join([BENCH_DIRECTORY,
+                                           environment.get('PATH', '')])
+
+    cmd = ['st_generate_products.py', '--xml', xml_filename, '--trace']
+    cmd.extend(options.split())
+
+    logger.info('Running [{0}] in [{1}]'.format(' '.join(cmd),
+                                                 scene_directory))
+
+    start_time = time.time()
+    with open(log_filename, 'w') as log_fd:
+        status = subprocess.call(cmd, cwd=scene_directory, env=environment,
+                                 stdout=log_fd, stderr=subprocess.STDOUT)
+    elapsed = time.time() - start_time
+
+    if status != 0:
+        raise Exception('st_generate_products failed, see [{0}]'
+                        .format(log_filename))
+
+    return elapsed
+
+
+def stage_timings(trace_filename):
+    """The seconds each stage took, from the trace of the run
+
+    Args:
+        trace_filename <str>: The trace
+
+    Returns:
+        <dict>: Seconds of each stage
+    """
+
+    with open(trace_filename, 'r') as trace_fd:
+        events = json.load(trace_fd)['traceEvents']
+
+    timings = defaultdict(float)
+    for event in events:
+        if event['ph'] == 'X' and event['cat'] == 'stage':
+            timings[event['name']] += event['dur'] / 1000000.0
+
+    return dict(timings)
+
+
+def output_checksums(scene_directory, input_files):
+    """The SHA1 of each band the run produced
+
+    The XML metadata and the logs hold the processing times, so only the
+    band data is compared.
+
+    Args:
+        scene_directory <str>: The scene directory
+        input_files set(<str>): The files of the fixture scene
+
+    Returns:
+        <dict>: SHA1 of each band file
+    """
+
+    checksums = dict()
+    for filename in sorted(os.listdir(scene_directory)):
+        if filename in input_files or not filename.endswith('.img'):
+            continue
+
+        digest = hashlib.sha1()
+        with open(os.path.join(scene_directory, filename), 'rb') as band_fd:
+            for block in iter(lambda: band_fd.read(1048576), ''):
+                digest.update(block)
+
+        checksums[filename] = digest.hexdigest()
+
+    return checksums
+
+
+def compare_results(results, baseline, tolerance, slack):
+    """Compare the results of the run against the baseline
+
+    Args:
+        results <dict>: The results of the run
+        baseline <dict>: The baseline
+        tolerance <float>: The fraction a stage may be slower
+        slack <float>: The seconds a stage may be slower regardless
+
+    Returns:
+        [<str>]: The differences which fail the benchmark
+    """
+
+    logger = logging.getLogger(__name__)
+
+    failures = list()
+
+    if results['modtran_seconds'] != baseline['modtran_seconds']:
+        logger.warning('The baseline was run with MODTRAN taking [{0}]'
+                       ' seconds, the timings are not comparable'
+                       .format(baseline['modtran_seconds']))
+
+    checksums = results['checksums']
+    expected = baseline['checksums']
+    for filename in sorted(set(checksums) | set(expected)):
+        if filename not in checksums:
+            failures.append('Band [{0}] was not produced'.format(filename))
+        elif filename not in expected:
+            failures.append('Band [{0}] is not in the baseline'
+                            .format(filename))
+        elif checksums[filename] != expected[filename]:
+            failures.append('Band [{0}] differs from the baseline'
+                            .format(filename))
+
+    logger.info('Stage timings (seconds):')
+    logger.info('  {0:<32} {1:>10} {2:>10} {3:>8}'
+                .format('stage', 'baseline', 'run', 'change'))
+
+    timings = results['stages']
+    expected = baseline['stages']
+    for name in sorted(set(timings) | set(expected)):
+        seconds = timings.get(name, 0.0)
+        expected_seconds = expected.get(name, 0.0)
+
+        change = ''
+        if expected_seconds > 0.0:
+            change = '{0:+7.1%}'.format(float(seconds) / expected_seconds -
+                                              1.0)
+
+        logger.info('  {0:<32} {1:10.2f} {2:10.2f} {3:>8}'
+                    .format(name, expected_seconds, seconds, change))
+
+        if seconds > expected_seconds * (1.0 + tolerance) + slack:
+            failures.append('Stage [{0}] took [{1:.2f}] seconds, the'
+                            ' baseline is [{2:.2f}]'
+                            .format(name, seconds, expected_seconds))
+
+    logger.info('  {0:<32} {1:10.2f} {2:10.2f}'
+                .format('total', baseline['elapsed'], results['elapsed']))
+
+    return failures
+
+
+def main():
+    """Main processing for benchmarking the pipeline
+    """
+
+    # Command Line Arguments
+    args = retrieve_command_line_arguments()
+
+    # Check logging level
+    logging_level = logging.INFO
+    if args.debug:
+        logging_level = logging.DEBUG
+
+    # Setup the default logger format and level.  Log to STDOUT.
+    logging.basicConfig(format=('%(asctime)s.%(msecs)03d %(process)d'
+                                ' %(levelname)-8s'
+                                ' %(filename)s:%(lineno)d:'
+                                '%(funcName)s -- %(message)s'),
+                        datefmt='%Y-%m-%d %H:%M:%S',
+                        level=logging_level,
+                        stream=sys.stdout)
+    logger = logging.getLogger(__name__)
+
+    logger.info('*** Begin ST Bench ***')
+
+    with open(os.path.join(args.fixture_directory,
+                           FIXTURE_FILENAME), 'r') as fixture_fd:
+        fixture = json.load(fixture_fd)
+
+    server = start_aster_server(os.path.join(args.fixture_directory,
+                                             ASTER_DIRECTORY))
+    try:
+        server_name = '{0}:{1}'.format(*server.server_address)
+
+        (scene_directory, home_directory) = prepare_run(
+            fixture_directory=args.fixture_directory,
+            work_directory=args.work_directory,
+            process_count=args.process_count,
+            server_name=server_name)
+
+        input_files = set(os.listdir(scene_directory))
+
+        elapsed = run_pipeline(
+            xml_filename=fixture['xml'],
+            scene_directory=scene_directory,
+            home_directory=home_directory,
+            modtran_seconds=args.modtran_seconds,
+            options=args.options,
+            log_filename=os.path.join(args.work_directory, LOG_FILENAME))
+    finally:
+        server.shutdown()
+        server.server_close()
+
+    results = {'elapsed': elapsed,
+               'modtran_seconds': args.modtran_seconds,
+               'process_count': args.process_count,
+               'stages': stage_timings(os.path.join(scene_directory,
+                                                    TRACE_FILENAME)),
+               'checksums': output_checksums(scene_directory, input_files)}
+
+    with open(os.path.join(args.work_directory,
+                           RESULTS_FILENAME), 'w') as results_fd:
+        json.dump(results, results_fd, indent=4, sort_keys=True)
+        results_fd.write('\n')
+
+    baseline_filename = os.path.join(args.fixture_directory,
+                                     BASELINE_FILENAME)
+
+    if args.update_baseline:
+        shutil.copyfile(os.path.join(args.work_directory, RESULTS_FILENAME),
+                        baseline_filename)
+        logger.info('Stored the results as the baseline [{0}]'
+                    .format(baseline_filename))
+        logger.info('*** ST Bench - Complete ***')
+        return
+
+    if not os.path.isfile(baseline_filename):
+        raise Exception('The fixture has no baseline, run with'
+                        ' --update-baseline to store one')
+
+    with open(baseline_filename, 'r') as baseline_fd:
+        baseline = json.load(baseline_fd)
+
+    failures = compare_results(results=results,
+                               baseline=baseline,
+                               tolerance=args.tolerance,
+                               slack=args.slack)
+
+    for failure in failures:
+        logger.error(failure)
+
+    if len(failures) > 0:
+        logger.error('*** ST Bench - Failed ***')
+        sys.exit(1)
+
+    logger.info('*** ST Bench - Complete ***')
+
+
+if __name__ == '__main__':
+    main()
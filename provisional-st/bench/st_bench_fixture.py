@@ -0,0 +1,281 @@
+#! /usr/bin/env python
+
+'''
+    File: st_bench_fixture.py
+
+    Purpose: Prepares the fixture st_bench.py runs the pipeline on.  A window
+             of a real scene is clipped, and the NARR files and ASTER GED
+             tiles the window needs are copied from the archive and the ASTER
+             GED server into the fixture, so the benchmark never needs them
+             again.
+
+             The fixture is prepared once, on a system which has the data,
+             and is not part of the repository.
+
+    Project: Land Satellites Data Systems Science Research and Development
+             (LSRD) at the USGS EROS
+
+    License: NASA Open Source Agreement 1.3
+'''
+
+import os
+import sys
+import json
+import shutil
+import logging
+from argparse import ArgumentParser
+
+# The fixture is made with the modules of the tree the benchmark is in
+sys.path.insert(0, os.path.join(os.path.dirname(os.path.realpath(__file__)),
+                                os.pardir, 'scripts'))
+
+from espa import Metadata
+
+import st_utilities as util
+import st_window
+import emissivity_utilities as emis_util
+from st_extract_auxiliary_narr_data import aux_filenames, PARMS_TO_EXTRACT
+from estimate_landsat_emissivity import aster_tile_names
+
+
+FIXTURE_FILENAME = 'fixture.json'
+
+# Directories within the fixture
+SCENE_DIRECTORY = 'scene'
+NARR_DIRECTORY = 'narr'
+ASTER_DIRECTORY = 'aster'
+
+
+def retrieve_command_line_arguments():
+    """Read arguments from the command line
+
+    Returns:
+        args <arguments>: The arguments read from the command line
+    """
+
+    parser = ArgumentParser(description='Prepares the ST benchmark fixture'
+                                        ' from a real scene')
+
+    parser.add_argument('--version',
+                        action='version',
+                        version=util.Version.version_text())
+
+    parser.add_argument('--xml',
+                        action='store', dest='xml_filename',
+                        required=False, default=None,
+                        help='The XML metadata file of the real scene')
+
+    parser.add_argument('--window',
+                        action='store', dest='window',
+                        required=False, default=None,
+                        type=st_window.parse_window,
+                        help='The window of the scene to clip, as'
+                             ' line0,sample0,lines,samples')
+
+    parser.add_argument('--fixture',
+                        action='store', dest='fixture_directory',
+                        required=False, default=None,
+                        help='The directory to prepare the fixture in')
+
+    parser.add_argument('--aux-path',
+                        action='store', dest='aux_path',
+                        required=False, default=None,
+                        help='The NARR archive to copy the files from')
+
+    parser.add_argument('--aster-ged-server-name',
+                        action='store', dest='aster_ged_server_name',
+                        required=False, default=None,
+                        help='The ASTER GED server to copy the tiles from')
+
+    parser.add_argument('--aster-ged-server-path',
+                        action='store', dest='aster_ged_server_path',
+                        required=False, default=None,
+                        help='The path on the ASTER GED server')
+
+    parser.add_argument('--debug',
+                        action='store_true', dest='debug',
+                        required=False, default=False,
+                        help='Output debug messages and/or keep debug data')
+
+    args = parser.parse_args()
+
+    if args.xml_filename is None:
+        raise Exception('--xml must be specified on the command line')
+
+    if args.window is None:
+        raise Exception('--window must be specified on the command line')
+
+    if args.fixture_directory is None:
+        raise Exception('--fixture must be specified on the command line')
+
+    if args.aux_path is None:
+        raise Exception('--aux-path must be specified on the command line')
+
+    if (args.aster_ged_server_name is None or
+            args.aster_ged_server_path is None):
+        raise Exception('--aster-ged-server-name and --aster-ged-server-path'
+                        ' must be specified on the command line')
+
+    return args
+
+
+def copy_scene(xml_filename, window, directory):
+    """Clip the window of the scene into the fixture
+
+    Args:
+        xml_filename <str>: XML metadata filename of the real scene
+        window <st_window.Window>: The window
+        directory <str>: The fixture scene directory
+
+    Returns:
+        <espa.Metadata>: The metadata of the fixture scene
+    """
+
+    logger = logging.getLogger(__name__)
+
+    window_directory = st_window.create_window_scene(
+        xml_filename=xml_filename, window=window)
+
+    logger.info('Copying the window scene to [{0}]'.format(directory))
+    shutil.copytree(window_directory, directory)
+
+    espa_metadata = Metadata(os.path.join(directory,
+                                          os.path.basename(xml_filename)))
+    espa_metadata.parse()
+
+    return espa_metadata
+
+
+def copy_narr_slice(espa_metadata, aux_path, directory):
+    """Copy the NARR files the scene needs, in the layout of the archive
+
+    Args:
+        espa_metadata <espa.Metadata>: The metadata of the fixture scene
+        aux_path <str>: The NARR archive
+        directory <str>: The fixture NARR directory
+
+    Returns:
+        [<str>]: The files, relative to the fixture NARR directory
+    """
+
+    logger = logging.getLogger(__name__)
+
+    (dummy, t0_date, t1_date) = util.NARR.dates(espa_metadata)
+
+    filenames = list()
+    for aux_set in aux_filenames(aux_path, PARMS_TO_EXTRACT,
+                                 t0_date, t1_date):
+        for source in (aux_set.hdr, aux_set.grb):
+            if not os.path.exists(source):
+                raise Exception('Missing NARR file [{0}]'.format(source))
+
+            filename = os.path.relpath(source, aux_path)
+            destination = os.path.join(directory, filename)
+
+            util.System.create_directory(os.path.dirname(destination))
+            logger.info('Copying [{0}]'.format(filename))
+            shutil.copyfile(source, destination)
+
+            filenames.append(filename)
+
+    return filenames
+
+
+def copy_aster_tiles(espa_metadata, server_name, server_path, directory):
+    """Copy the ASTER GED tiles the scene needs
+
+    Args:
+        espa_metadata <espa.Metadata>: The metadata of the fixture scene
+        server_name <str>: Name of the ASTER GED server
+        server_path <str>: Path on the ASTER GED server
+        directory <str>: The fixture ASTER directory
+
+    Returns:
+        [<str>]: The tiles the server has
+    """
+
+    logger = logging.getLogger(__name__)
+
+    util.System.create_directory(directory)
+
+    url = ''.join(['http://', server_name, server_path])
+    bound = emis_util.bound_info(espa_metadata)
+
+    tiles = list()
+    for name in aster_tile_names(bound, os.environ.get('ST_DATA_DIR', '')):
+        h5_file_path = ''.join([name, '.h5'])
+
+        if emis_util.transfer_aster_ged_tile(
+                url, h5_file_path, os.path.join(directory, h5_file_path)):
+            tiles.append(h5_file_path)
+        else:
+            logger.warning('The ASTER GED server does not have [{0}]'
+                           .format(h5_file_path))
+
+    return tiles
+
+
+def main():
+    """Main processing for preparing the benchmark fixture
+    """
+
+    # Command Line Arguments
+    args = retrieve_command_line_arguments()
+
+    # Check logging level
+    logging_level = logging.INFO
+    if args.debug:
+        logging_level = logging.DEBUG
+
+    # Setup the default logger format and level.  Log to STDOUT.
+    logging.basicConfig(format=('%(asctime)s.%(msecs)03d %(process)d'
+                                ' %(levelname)-8s'
+                                ' %(filename)s:%(lineno)d:'
+                                '%(funcName)s -- %(message)s'),
+                        datefmt='%Y-%m-%d %H:%M:%S',
+                        level=logging_level,
+                        stream=sys.stdout)
+    logger = logging.getLogger(__name__)
+
+    logger.info('*** Begin ST Bench Fixture ***')
+
+    if os.path.exists(args.fixture_directory):
+        raise Exception('The fixture [{0}] already exists'
+                        .format(args.fixture_directory))
+
+    espa_metadata = copy_scene(
+        xml_filename=args.xml_filename,
+        window=args.window,
+        directory=os.path.join(args.fixture_directory, SCENE_DIRECTORY))
+
+    narr_files = copy_narr_slice(
+        espa_metadata=espa_metadata,
+        aux_path=args.aux_path,
+        directory=os.path.join(args.fixture_directory, NARR_DIRECTORY))
+
+    aster_tiles = copy_aster_tiles(
+        espa_metadata=espa_metadata,
+        server_name=args.aster_ged_server_name,
+        server_path=args.aster_ged_server_path,
+        directory=os.path.join(args.fixture_directory, ASTER_DIRECTORY))
+
+    fixture = {'xml': os.path.basename(args.xml_filename),
+               'source': os.path.realpath(args.xml_filename),
+               'window': list(args.window),
+               'narr': narr_files,
+               'aster': aster_tiles}
+
+    with open(os.path.join(args.fixture_directory, FIXTURE_FILENAME),
+              'w') as fixture_fd:
+        json.dump(fixture, fixture_fd, indent=4, sort_keys=True)
+        fixture_fd.write('\n')
+
+    logger.info('Prepared [{0}] with [{1}] NARR files and [{2}] ASTER GED'
+                ' tiles'.format(args.fixture_directory, len(narr_files),
+                                len(aster_tiles)))
+
+    logger.info('*** ST Bench Fixture - Complete ***')
+
+
+if __name__ == '__main__':
+    main()
@@ -176,19 +176,19 @@ class BuildSTData(object):
         x_dim = dataset.RasterXSize  # They are all the same size
         y_dim = dataset.RasterYSize
 
-        thermal_data = dataset.GetRasterBand(1).ReadAsArray(0, 0, x_dim, y_dim)
+        del dataset
+
+        thermal_data = util.RasterCache.read(self.thermal_name, 1)
 
         # Atmospheric transmittance
         self.logger.info('Loading intermediate transmittance band data [{0}]'
                          .format(self.transmittance_name))
-        dataset = gdal.Open(self.transmittance_name)
-        trans_data = dataset.GetRasterBand(1).ReadAsArray(0, 0, x_dim, y_dim)
+        trans_data = util.RasterCache.read(self.transmittance_name, 1)
 
         # Atmospheric path radiance - upwelled radiance
         self.logger.info('Loading intermediate upwelled band data [{0}]'
                          .format(self.upwelled_name))
-        dataset = gdal.Open(self.upwelled_name)
-        upwelled_data = dataset.GetRasterBand(1).ReadAsArray(0, 0, x_dim, y_dim)
+        upwelled_data = util.RasterCache.read(self.upwelled_name, 1)
 
         self.logger.info('Calculating surface radiance')
         # Surface radiance
@@ -214,16 +214,14 @@ class BuildSTData(object):
         # Downwelling sky irradiance
         self.logger.info('Loading intermediate downwelled band data [{0}]'
                          .format(self.downwelled_name))
-        dataset = gdal.Open(self.downwelled_name)
-        downwelled_data = dataset.GetRasterBand(1).ReadAsArray(0, 0, x_dim,
-                                                               y_dim)
+        downwelled_data = util.RasterCache.read(self.downwelled_name, 1)
 
         # Landsat emissivity estimated from ASTER GED data
         self.logger.info('Loading intermediate emissivity band data [{0}]'
                          .format(self.emissivity_name))
+        emissivity_data = util.RasterCache.read(self.emissivity_name, 1)
+
         dataset = gdal.Open(self.emissivity_name)
-        emissivity_data = dataset.GetRasterBand(1).ReadAsArray(0, 0, x_dim,
-                                                               y_dim)
 
         # Save for the output product
         ds_srs = osr.SpatialReference()
@@ -278,8 +276,10 @@ class BuildSTData(object):
             self.logger.info('Using Landsat 4 Brightness Temperature LUT')
             bt_name = 'L4_Brightness_Temperature_LUT.txt'
 
-        bt_data = np.loadtxt(os.path.join(self.st_data_dir, bt_name),
-                             dtype=float, delimiter=' ')
+        bt_filename = os.path.join(self.st_data_dir, bt_name)
+        bt_data = util.SharedDataCache.load(
+            [bt_filename],
+            lambda: np.loadtxt(bt_filename, dtype=float, delimiter=' '))
         bt_radiance_lut = bt_data[:, 1]
         bt_temp_lut = bt_data[:, 0]
 
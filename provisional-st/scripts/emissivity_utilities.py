@@ -28,6 +28,7 @@ import os
 import logging
 import math
 import datetime
+import tempfile
 from argparse import ArgumentParser
 from collections import namedtuple
 
@@ -40,6 +41,8 @@ from st_exceptions import MissingBandError
 
 # Import local modules
 import st_utilities as util
+import st_trace
+from st_node_scheduler import SlotLease
 
 
 def extract_raster_data(name, band_number):
@@ -53,6 +56,11 @@ def extract_raster_data(name, band_number):
         <raster>: 2D raster array data
     """
 
+    # Bands handed over in memory by an earlier stage are used directly
+    raster = util.RasterCache.get(name, band_number)
+    if raster is not None:
+        return raster
+
     dataset = gdal.Open(name)
     if dataset is None:
         raise RuntimeError('GDAL failed to open {0}'.format(name))
@@ -253,12 +261,49 @@ def retrieve_metadata_information(espa_metadata):
                                   bt=bi_bt))
 
 
-def download_aster_ged_tile(url, h5_file_path):
-    """Retrieves the specified tile from the host
+class AsterTileStore(object):
+    '''
+    Description:
+        Keeps the downloaded ASTER GED tiles in a directory, so that later
+        scenes covering the same tiles link to them instead of downloading
+        them again.  Tiles the server does not have are remembered as well.
+        It is disabled by default, in which case each tile is downloaded
+        into the current directory.
+    '''
+
+    directory = None
+
+    @staticmethod
+    def enable(directory):
+        '''
+        Description:
+            Turns on keeping the tiles in the directory.
+        '''
+
+        util.System.create_directory(directory)
+        AsterTileStore.directory = os.path.realpath(directory)
+
+    @staticmethod
+    def disable():
+        '''
+        Description:
+            Turns off keeping the tiles.  The stored tiles are left in place.
+        '''
+
+        AsterTileStore.directory = None
+
+
+def transfer_aster_ged_tile(url, h5_file_path, destination):
+    """Transfers the specified tile from the host
 
     Args:
         url <str>: URL to retrieve the file from
         h5_file_path <str>: Full path on the remote system
+        destination <str>: File to write the tile to
+
+    Returns:
+        <bool>: True if the tile was transferred, False if the ASTER GED does
+                not have it
 
     Raises:
         Exception: If issue transfering data
@@ -266,13 +311,66 @@ def download_aster_ged_tile(url, h5_file_path):
 
     # Build the complete URL and download the tile
     url_path = ''.join([url, h5_file_path])
-    status_code = util.Web.http_transfer_file(url_path, h5_file_path)
+    status_code = util.Web.http_transfer_file(url_path, destination)
 
     # Check for and handle tiles that are not available in the
     # ASTER data
     if status_code != requests.codes['ok']:
         if status_code != requests.codes['not_found']:
             raise Exception('HTTP - Transfer Failed')
+        return False
+
+    return True
+
+
+def download_aster_ged_tile(url, h5_file_path):
+    """Retrieves the specified tile from the host, or links to it when it is
+       already held by the tile store
+
+    Args:
+        url <str>: URL to retrieve the file from
+        h5_file_path <str>: Full path on the remote system
+
+    Raises:
+        Exception: If issue transfering data
+    """
+
+    logger = logging.getLogger(__name__)
+
+    if AsterTileStore.directory is None:
+        with st_trace.span('download', 'aster', tile=h5_file_path):
+            transfer_aster_ged_tile(url, h5_file_path, h5_file_path)
+        return
+
+    stored_path = os.path.join(AsterTileStore.directory, h5_file_path)
+    missing_path = ''.join([stored_path, '.missing'])
+
+    if not os.path.exists(stored_path) and not os.path.exists(missing_path):
+        # Transferred under a temporary name, so a failed transfer does not
+        # leave a partial tile in the store
+        (temp_fd, temp_path) = tempfile.mkstemp(
+            dir=AsterTileStore.directory, suffix='.h5')
+        os.close(temp_fd)
+        try:
+            with st_trace.span('download', 'aster', tile=h5_file_path):
+                transferred = transfer_aster_ged_tile(url, h5_file_path,
+                                                      temp_path)
+            if transferred:
+                os.rename(temp_path, stored_path)
+            else:
+                open(missing_path, 'w').close()
+        finally:
+            if os.path.exists(temp_path):
+                os.unlink(temp_path)
+    else:
+        logger.info('Using the stored ASTER GED tile [{0}]'
+                    .format(h5_file_path))
+
+    if os.path.lexists(h5_file_path):
+        os.unlink(h5_file_path)
+
+    if os.path.exists(stored_path):
+        util.System.create_link(stored_path, h5_file_path)
 
 
 def warp_raster(target_info, src_proj4, no_data_value, src_name, dest_name):
@@ -302,12 +400,18 @@ def warp_raster(target_info, src_proj4, no_data_value, src_name, dest_name):
     cmd.append(src_name)
     cmd.append(dest_name)
 
-    cmd = ' '.join(cmd)
-
     output = ''
     try:
-        logger.info('Executing [{0}]'.format(cmd))
-        output = util.System.execute_cmd(cmd)
+        # gdalwarp -multi uses two threads, but can run with one
+        with SlotLease(slots=2, minimum=1) as slots:
+            if slots < 2:
+                cmd.remove('-multi')
+
+            cmd = ' '.join(cmd)
+            logger.info('Executing [{0}]'.format(cmd))
+            with st_trace.span('warp', 'aster', source=src_name,
+                               threads=slots):
+                output = util.System.execute_cmd(cmd)
     except Exception:
         logger.error('Failed during warping')
         raise
@@ -349,6 +453,9 @@ def write_emissivity_product(samps, lines, transform, wkt, no_data_value,
                                   no_data_value,
                                   gdal.GDT_Float32)
 
+    # Keep it available for any later stage in this process
+    util.RasterCache.put(filename, 1, file_data, gdal.GDT_Float32)
+
     hdr_filename = filename.replace('.img', '.hdr')
     logger.info('Updating {0}'.format(hdr_filename))
     util.Geo.update_envi_header(hdr_filename, no_data_value)
@@ -437,11 +544,8 @@ def add_emissivity_band_to_xml(espa_metadata, filename, sensor_code,
     # Append the band to the XML
     espa_metadata.xml_object.bands.append(emis_band)
 
-    # Validate the XML
-    espa_metadata.validate()
-
-    # Write it to the XML file
-    espa_metadata.write()
+    # Validate and write the XML, unless a transaction defers it
+    util.MetadataTransaction.save(espa_metadata)
 
 
 def retrieve_command_line_arguments():
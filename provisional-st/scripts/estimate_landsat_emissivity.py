@@ -42,6 +42,8 @@ from st_exceptions import NoTilesError, InaccessibleTileError
 # Import local modules
 import st_utilities as util
 import emissivity_utilities as emis_util
+import st_trace
+from st_node_scheduler import SlotLease
 
 
 CoefficientInfo = namedtuple('CoefficientInfo',
@@ -251,28 +253,39 @@ def extract_aster_data(url, filename):
     logger.debug(lat_ds_name)
     logger.debug(lon_ds_name)
 
-    aster_b13_data = emis_util.extract_raster_data(emis_ds_name, 4)
-    aster_b14_data = emis_util.extract_raster_data(emis_ds_name, 5)
-    aster_ndvi_data = emis_util.extract_raster_data(ndvi_ds_name, 1)
-    aster_lat_data = emis_util.extract_raster_data(lat_ds_name, 1)
-    aster_lon_data = emis_util.extract_raster_data(lon_ds_name, 1)
+    @st_trace.traced('decode', 'aster', tile=h5_file_path)
+    def read_tile():
+        aster_b13_data = emis_util.extract_raster_data(emis_ds_name, 4)
+        aster_b14_data = emis_util.extract_raster_data(emis_ds_name, 5)
+        aster_ndvi_data = emis_util.extract_raster_data(ndvi_ds_name, 1)
+        aster_lat_data = emis_util.extract_raster_data(lat_ds_name, 1)
+        aster_lon_data = emis_util.extract_raster_data(lon_ds_name, 1)
 
-    # Determine the minimum and maximum latitude and longitude
-    x_min = aster_lon_data.min()
-    x_max = aster_lon_data.max()
-    y_min = aster_lat_data.min()
-    y_max = aster_lat_data.max()
+        # Determine the minimum and maximum latitude and longitude
+        x_min = aster_lon_data.min()
+        x_max = aster_lon_data.max()
+        y_min = aster_lat_data.min()
+        y_max = aster_lat_data.max()
 
-    del aster_lon_data
-    del aster_lat_data
+        del aster_lon_data
+        del aster_lat_data
 
-    # Determine the resolution and dimensions of the ASTER data
-    (x_res, y_res, samps, lines) = (
-        emis_util.data_resolution_and_size(lat_ds_name,
-                                           x_min, x_max, y_min, y_max))
+        # Determine the resolution and dimensions of the ASTER data
+        (x_res, y_res, samps, lines) = (
+            emis_util.data_resolution_and_size(lat_ds_name,
+                                               x_min, x_max, y_min, y_max))
 
-    # Build the geo transform
-    geo_transform = [x_min, x_res, 0, y_max, 0, -y_res]
+        # Build the geo transform
+        geo_transform = [x_min, x_res, 0, y_max, 0, -y_res]
+
+        return (aster_b13_data, aster_b14_data, aster_ndvi_data, samps,
+                lines, geo_transform)
+
+    # A tile linked from the tile store is read once for every scene
+    # covering it while the shared data cache is enabled
+    (aster_b13_data, aster_b14_data, aster_ndvi_data, samps, lines,
+     geo_transform) = util.SharedDataCache.load([h5_file_path], read_tile,
+                                                name='aster_mean')
 
     return (aster_b13_data, aster_b14_data, aster_ndvi_data, samps, lines,
             geo_transform, True)
@@ -395,6 +408,48 @@ def generate_aster_ndvi_tile(tile_name, ndvi_data,
     del data
 
 
+def aster_tile_names(bound, st_data_dir):
+    """Determine the ASTER GED tiles covering the scene
+
+    Args:
+        bound <BoundInfo>: Geographic bounds of the scene
+        st_data_dir <str>: Location of the ST data files
+
+    Returns:
+        list(<str>): Base names of the tiles which are in the ASTER GED
+    """
+
+    logger = logging.getLogger(__name__)
+
+    # Read the ASTER GED tile list
+    ged_tile_file = 'aster_ged_tile_list.txt'
+    with open(os.path.join(st_data_dir, ged_tile_file)) as ged_file: 
+        tiles = [os.path.splitext(line.rstrip('\n'))[0] for line in ged_file] 
+
+    names = list()
+    for (lat, lon) in [(lat, lon)
+                       for lat in xrange(int(bound.south),
+                                         int(bound.north)+1)
+                       for lon in xrange(int(bound.west),
+                                         int(bound.east)+1)]:
+
+        # Build the base filename using the correct format
+        filename = ''
+        if lon < 0:
+            filename = ASTER_GED_N_FORMAT.format(lat, lon)
+        else:
+            filename = ASTER_GED_P_FORMAT.format(lat, lon)
+
+        # Skip the tile if it isn't in the ASTER GED database 
+        if filename not in tiles:
+            logger.info('Skipping tile {} not in ASTER GED'.format(filename))
+            continue
+
+        names.append(filename)
+
+    return names
+
+
 def generate_tiles(src_info, coefficients, st_data_dir, url, wkt,
                    no_data_value):
     """Generate tiles for emissivity mean and NDVI from ASTER data
@@ -421,33 +476,9 @@ def generate_tiles(src_info, coefficients, st_data_dir, url, wkt,
     - Generate the Landsat EMIS from the 13 and 14 band data
     '''
 
-    logger = logging.getLogger(__name__)
-
-    # Read the ASTER GED tile list
-    ged_tile_file = 'aster_ged_tile_list.txt'
-    with open(os.path.join(st_data_dir, ged_tile_file)) as ged_file: 
-        tiles = [os.path.splitext(line.rstrip('\n'))[0] for line in ged_file] 
-
     ls_emis_mean_filenames = list()
     aster_ndvi_mean_filenames = list()
-    for (lat, lon) in [(lat, lon)
-                       for lat in xrange(int(src_info.bound.south),
-                                         int(src_info.bound.north)+1)
-                       for lon in xrange(int(src_info.bound.west),
-                                         int(src_info.bound.east)+1)]:
-
-        # Build the base filename using the correct format
-        filename = ''
-        if lon < 0:
-            filename = ASTER_GED_N_FORMAT.format(lat, lon)
-        else:
-            filename = ASTER_GED_P_FORMAT.format(lat, lon)
-
-        # Skip the tile if it isn't in the ASTER GED database 
-        if filename not in tiles:
-            logger.info('Skipping tile {} not in ASTER GED'.format(filename))
-            continue
-
+    for filename in aster_tile_names(src_info.bound, st_data_dir):
         # Build the output tile names
         ls_emis_tile_name = ''.join([filename, '_emis.tif'])
         aster_ndvi_tile_name = ''.join([filename, '_ndvi.tif'])
@@ -540,15 +571,19 @@ def build_ls_emis_data(server_name, server_path, st_data_dir, src_info,
 
     # Mosaic the estimated Landsat EMIS tiles into the temp EMIS
     logger.info('Building mosaic for estimated Landsat EMIS')
-    util.Geo.mosaic_tiles_into_one_raster(ls_emis_mean_filenames,
-                                          ls_emis_mosaic_name,
-                                          no_data_value)
+    with SlotLease(slots=2, minimum=1) as slots:
+        util.Geo.mosaic_tiles_into_one_raster(ls_emis_mean_filenames,
+                                              ls_emis_mosaic_name,
+                                              no_data_value,
+                                              multi=slots > 1)
 
     # Mosaic the ASTER NDVI tiles into the temp NDVI
     logger.info('Building mosaic for ASTER NDVI')
-    util.Geo.mosaic_tiles_into_one_raster(aster_ndvi_mean_filenames,
-                                          aster_ndvi_mosaic_name,
-                                          no_data_value)
+    with SlotLease(slots=2, minimum=1) as slots:
+        util.Geo.mosaic_tiles_into_one_raster(aster_ndvi_mean_filenames,
+                                              aster_ndvi_mosaic_name,
+                                              no_data_value,
+                                              multi=slots > 1)
 
     if not intermediate:
         # Cleanup the estimated Landsat EMIS tiles
@@ -626,7 +661,8 @@ def extract_warped_data(ls_emis_warped_name, aster_ndvi_warped_name,
 
 
 def generate_emissivity_data(xml_filename, server_name, server_path,
-                             st_data_dir, no_data_value, intermediate):
+                             st_data_dir, no_data_value, intermediate,
+                             espa_metadata=None):
     """Provides the main processing algorithm for generating the estimated
        Landsat emissivity product.  It produces the final emissivity product.
 
@@ -637,13 +673,16 @@ def generate_emissivity_data(xml_filename, server_name, server_path,
         st_data_dir <str>: Location of the ST data files
         no_data_value <int>: No data (fill) value to use
         intermediate <bool>: Keep any intermediate products generated
+        espa_metadata <espa.Metadata>: Parsed XML metadata to use instead
+                                       of parsing xml_filename
     """
 
     logger = logging.getLogger(__name__)
 
-    # XML metadata
-    espa_metadata = Metadata(xml_filename)
-    espa_metadata.parse()
+    # XML metadata, unless the caller already has it parsed
+    if espa_metadata is None:
+        espa_metadata = Metadata(xml_filename)
+        espa_metadata.parse()
 
     src_info = emis_util.retrieve_metadata_information(espa_metadata)
 
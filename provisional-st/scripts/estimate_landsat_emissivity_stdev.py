@@ -41,6 +41,8 @@ from st_exceptions import NoTilesError, InaccessibleTileError
 # Import local modules
 import st_utilities as util
 import emissivity_utilities as emis_util
+import st_trace
+from st_node_scheduler import SlotLease
 
 
 ASTER_GED_N_FORMAT = 'AG100.v003.{0:02}.{1:04}.0001'
@@ -100,33 +102,45 @@ def extract_aster_data(url, filename, intermediate):
     logger.debug(lat_ds_name)
     logger.debug(lon_ds_name)
 
-    aster_b13_sdev_data = emis_util.extract_raster_data(emis_sdev_ds_name, 4)
-    aster_b14_sdev_data = emis_util.extract_raster_data(emis_sdev_ds_name, 5)
-    aster_lat_data = emis_util.extract_raster_data(lat_ds_name, 1)
-    aster_lon_data = emis_util.extract_raster_data(lon_ds_name, 1)
+    @st_trace.traced('decode_stdev', 'aster', tile=h5_file_path)
+    def read_tile():
+        aster_b13_sdev_data = emis_util.extract_raster_data(
+            emis_sdev_ds_name, 4)
+        aster_b14_sdev_data = emis_util.extract_raster_data(
+            emis_sdev_ds_name, 5)
+        aster_lat_data = emis_util.extract_raster_data(lat_ds_name, 1)
+        aster_lon_data = emis_util.extract_raster_data(lon_ds_name, 1)
 
-    # Determine the minimum and maximum latitude and longitude
-    x_min = aster_lon_data.min()
-    x_max = aster_lon_data.max()
-    y_min = aster_lat_data.min()
-    y_max = aster_lat_data.max()
+        # Determine the minimum and maximum latitude and longitude
+        x_min = aster_lon_data.min()
+        x_max = aster_lon_data.max()
+        y_min = aster_lat_data.min()
+        y_max = aster_lat_data.max()
 
-    del aster_lon_data
-    del aster_lat_data
+        del aster_lon_data
+        del aster_lat_data
 
-    # Determine the resolution and dimensions of the ASTER data
-    (x_res, y_res, samps, lines) = (
-        emis_util.data_resolution_and_size(lat_ds_name,
-                                           x_min, x_max, y_min, y_max))
+        # Determine the resolution and dimensions of the ASTER data
+        (x_res, y_res, samps, lines) = (
+            emis_util.data_resolution_and_size(lat_ds_name,
+                                               x_min, x_max, y_min, y_max))
+
+        # Build the geo transform
+        geo_transform = [x_min, x_res, 0, y_max, 0, -y_res]
+
+        return (aster_b13_sdev_data, aster_b14_sdev_data, samps, lines,
+                geo_transform)
+
+    # Held apart from the means read from the same tile
+    (aster_b13_sdev_data, aster_b14_sdev_data, samps, lines,
+     geo_transform) = util.SharedDataCache.load([h5_file_path], read_tile,
+                                                name='aster_sdev')
 
     # Remove the HDF5 tile since we no longer need it
     if not intermediate:
         if os.path.exists(h5_file_path):
             os.unlink(h5_file_path)
 
-    # Build the geo transform
-    geo_transform = [x_min, x_res, 0, y_max, 0, -y_res]
-
     return (aster_b13_sdev_data, aster_b14_sdev_data, samps, lines,
             geo_transform, True)
 
@@ -321,9 +335,11 @@ def build_ls_emis_data(server_name, server_path, st_data_dir, src_info,
 
     # Mosaic the estimated Landsat EMIS stdev tiles into the temp EMIS stdev
     logger.info('Building mosaic for estimated Landsat EMIS standard deviation')
-    util.Geo.mosaic_tiles_into_one_raster(ls_emis_stdev_filenames,
-                                          ls_emis_stdev_mosaic_name,
-                                          no_data_value)
+    with SlotLease(slots=2, minimum=1) as slots:
+        util.Geo.mosaic_tiles_into_one_raster(ls_emis_stdev_filenames,
+                                              ls_emis_stdev_mosaic_name,
+                                              no_data_value,
+                                              multi=slots > 1)
 
     if not intermediate:
 
@@ -371,7 +387,8 @@ def extract_warped_data(ls_emis_stdev_warped_name, no_data_value, intermediate):
 
 
 def generate_emissivity_data(xml_filename, server_name, server_path,
-                             st_data_dir, no_data_value, intermediate):
+                             st_data_dir, no_data_value, intermediate,
+                             espa_metadata=None):
     """Provides the main processing algorithm for generating the estimated
        Landsat emissivity product.  It produces the final emissivity product.
 
@@ -382,13 +399,16 @@ def generate_emissivity_data(xml_filename, server_name, server_path,
         st_data_dir <str>: Location of the ST data files
         no_data_value <int>: No data (fill) value to use
         intermediate <bool>: Keep any intermediate products generated
+        espa_metadata <espa.Metadata>: Parsed XML metadata to use instead
+                                       of parsing xml_filename
     """
 
     logger = logging.getLogger(__name__)
 
-    # XML metadata
-    espa_metadata = Metadata(xml_filename)
-    espa_metadata.parse()
+    # XML metadata, unless the caller already has it parsed
+    if espa_metadata is None:
+        espa_metadata = Metadata(xml_filename)
+        espa_metadata.parse()
 
     src_info = emis_util.retrieve_metadata_information(espa_metadata)
 
@@ -0,0 +1,434 @@
+'''
+    File: libst.py
+
+    Purpose: Python binding to the atmospheric engine in libst.so.  Numpy
+             arrays are handed to the library by reference, so the engine
+             reads and writes them in place without copies.
+
+    Project: Land Satellites Data Systems Science Research and Development
+             (LSRD) at the USGS EROS
+
+    License: NASA Open Source Agreement 1.3
+'''
+
+import os
+import ctypes
+import ctypes.util
+
+import numpy as np
+from numpy.ctypeslib import ndpointer
+
+
+LIBRARY_NAME = 'libst.so'
+
+SUCCESS = 0
+
+# Cell of a pixel which has not been determined
+CELL_UNKNOWN = -1
+
+# Columns of a MODTRAN radiance table row
+MODTRAN_WAVELENGTH = 0
+MODTRAN_RADIANCE_273 = 1
+MODTRAN_RADIANCE_310 = 2
+MODTRAN_RADIANCE_000 = 3
+MODTRAN_NUM_COLUMNS = 4
+
+
+class LibSTError(Exception):
+    '''
+    Description:
+        Raised when a libst routine reports a failure.
+    '''
+    pass
+
+
+class ST_ATMOS_GRID(ctypes.Structure):
+    '''
+    Description:
+        Mirrors the ST_ATMOS_GRID structure from atmospheric_engine.h.
+    '''
+
+    _fields_ = [('count', ctypes.c_int),
+                ('rows', ctypes.c_int),
+                ('cols', ctypes.c_int),
+                ('num_elevations', ctypes.c_int),
+                ('lon', ctypes.POINTER(ctypes.c_double)),
+                ('lat', ctypes.POINTER(ctypes.c_double)),
+                ('map_x', ctypes.POINTER(ctypes.c_double)),
+                ('map_y', ctypes.POINTER(ctypes.c_double)),
+                ('elevation', ctypes.POINTER(ctypes.c_double)),
+                ('transmission', ctypes.POINTER(ctypes.c_double)),
+                ('upwelled_radiance', ctypes.POINTER(ctypes.c_double)),
+                ('downwelled_radiance', ctypes.POINTER(ctypes.c_double))]
+
+
+def _array_type(dtype):
+    '''Returns the argument type for a C contiguous array of dtype'''
+    return ndpointer(dtype=dtype, flags='C_CONTIGUOUS')
+
+
+def _load_library():
+    '''Locates and loads libst.so
+
+    The library is installed next to the scripts, so that location is tried
+    first, followed by the normal library search path.
+    '''
+
+    path = os.path.join(os.path.dirname(os.path.realpath(__file__)),
+                        LIBRARY_NAME)
+    if not os.path.isfile(path):
+        path = ctypes.util.find_library('st')
+        if path is None:
+            raise LibSTError('Unable to locate {0}'.format(LIBRARY_NAME))
+
+    library = ctypes.CDLL(path)
+
+    library.st_calculate_lt.restype = ctypes.c_int
+    library.st_calculate_lt.argtypes = [ctypes.c_double,
+                                        _array_type(np.float64),
+                                        ctypes.c_int,
+                                        ctypes.POINTER(ctypes.c_double)]
+
+    library.st_point_parameters.restype = ctypes.c_int
+    library.st_point_parameters.argtypes = [_array_type(np.float64),
+                                            ctypes.c_int,
+                                            _array_type(np.float64),
+                                            ctypes.c_int,
+                                            ctypes.c_double,
+                                            ctypes.POINTER(ctypes.c_double),
+                                            ctypes.POINTER(ctypes.c_double),
+                                            ctypes.POINTER(ctypes.c_double)]
+
+    library.st_pixel_cells.restype = ctypes.c_int
+    library.st_pixel_cells.argtypes = [ctypes.POINTER(ST_ATMOS_GRID),
+                                       ctypes.c_int,
+                                       ctypes.c_int,
+                                       _array_type(np.float32),
+                                       _array_type(np.float32),
+                                       _array_type(np.float32),
+                                       _array_type(np.int16)]
+
+    library.st_pixel_cells_map.restype = ctypes.c_int
+    library.st_pixel_cells_map.argtypes = [ctypes.POINTER(ST_ATMOS_GRID),
+                                           ctypes.c_int,
+                                           ctypes.c_int,
+                                           ctypes.c_int,
+                                           ctypes.c_double,
+                                           ctypes.c_double,
+                                           ctypes.c_float,
+                                           ctypes.c_float,
+                                           _array_type(np.float32),
+                                           _array_type(np.int16)]
+
+    library.st_pixel_parameters.restype = ctypes.c_int
+    library.st_pixel_parameters.argtypes = [ctypes.POINTER(ST_ATMOS_GRID),
+                                            ctypes.c_int,
+                                            ctypes.c_int,
+                                            ctypes.c_int,
+                                            ctypes.c_double,
+                                            ctypes.c_double,
+                                            ctypes.c_float,
+                                            ctypes.c_float,
+                                            _array_type(np.float32),
+                                            _array_type(np.float32),
+                                            _array_type(np.float32),
+                                            _array_type(np.int16),
+                                            _array_type(np.float32),
+                                            _array_type(np.float32),
+                                            _array_type(np.float32),
+                                            ctypes.c_void_p]
+
+    for name in ('st_radiance_to_temperature', 'st_temperature_to_radiance'):
+        function = getattr(library, name)
+        function.restype = None
+        function.argtypes = [_array_type(np.float32),
+                             ctypes.c_long,
+                             ctypes.c_double,
+                             ctypes.c_double,
+                             _array_type(np.float32)]
+
+    return library
+
+
+_library = None
+
+
+def library():
+    '''Returns the loaded library, loading it on first use'''
+
+    global _library
+
+    if _library is None:
+        _library = _load_library()
+
+    return _library
+
+
+def _check_array(name, data, dtype):
+    '''Verifies an array can be handed to the library without a copy'''
+
+    if data.dtype != dtype or not data.flags['C_CONTIGUOUS']:
+        raise LibSTError('{0} must be a C contiguous {1} array'
+                         .format(name, np.dtype(dtype).name))
+
+
+def calculate_lt(temperature, srs):
+    """Calculate the band blackbody radiance for a temperature
+
+    Args:
+        temperature <float>: Temperature in Kelvin
+        srs <numpy.ndarray>: float64 spectral response, shape (2, num_srs)
+                             wavelengths then responses
+
+    Returns:
+        <float>: Band blackbody radiance
+    """
+
+    _check_array('srs', srs, np.float64)
+
+    radiance = ctypes.c_double()
+    if library().st_calculate_lt(temperature, srs, srs.shape[-1],
+                                 ctypes.byref(radiance)) != SUCCESS:
+        raise LibSTError('st_calculate_lt failed')
+
+    return radiance.value
+
+
+def point_parameters(srs, modtran, zero_temp):
+    """Atmospheric parameters for one elevation of a grid point
+
+    Args:
+        srs <numpy.ndarray>: float64 spectral response, shape (2, num_srs)
+        modtran <numpy.ndarray>: float64 MODTRAN table, shape
+                                 (num_entries, MODTRAN_NUM_COLUMNS)
+        zero_temp <float>: Target surface temperature of the 0K run
+
+    Returns:
+        <tuple>: (transmission, upwelled radiance, downwelled radiance)
+    """
+
+    _check_array('srs', srs, np.float64)
+    _check_array('modtran', modtran, np.float64)
+
+    transmission = ctypes.c_double()
+    upwelled = ctypes.c_double()
+    downwelled = ctypes.c_double()
+
+    if library().st_point_parameters(srs, srs.shape[-1],
+                                     modtran, modtran.shape[0], zero_temp,
+                                     ctypes.byref(transmission),
+                                     ctypes.byref(upwelled),
+                                     ctypes.byref(downwelled)) != SUCCESS:
+        raise LibSTError('st_point_parameters failed')
+
+    return (transmission.value, upwelled.value, downwelled.value)
+
+
+class AtmosphericGrid(object):
+    '''
+    Description:
+        Holds the grid point arrays for the pixel stage, keeping them alive
+        for as long as the library references them.
+
+        The elevation arrays have shape (count, num_elevations) with the
+        elevations of each point in ascending order.
+    '''
+
+    def __init__(self, rows, cols, lon, lat, map_x, map_y, elevation,
+                 transmission, upwelled_radiance, downwelled_radiance):
+        super(AtmosphericGrid, self).__init__()
+
+        self.arrays = dict()
+        for (name, data) in (('lon', lon), ('lat', lat),
+                             ('map_x', map_x), ('map_y', map_y),
+                             ('elevation', elevation),
+                             ('transmission', transmission),
+                             ('upwelled_radiance', upwelled_radiance),
+                             ('downwelled_radiance', downwelled_radiance)):
+            # Copies only when the caller's array is not already usable
+            self.arrays[name] = np.ascontiguousarray(data, dtype=np.float64)
+
+        count = self.arrays['lon'].shape[0]
+        num_elevations = self.arrays['elevation'].size // count
+
+        self.structure = ST_ATMOS_GRID()
+        self.structure.count = count
+        self.structure.rows = rows
+        self.structure.cols = cols
+        self.structure.num_elevations = num_elevations
+        for (name, data) in self.arrays.items():
+            setattr(self.structure, name,
+                    data.ctypes.data_as(ctypes.POINTER(ctypes.c_double)))
+
+
+def pixel_cells(grid, longitude, latitude, thermal, cells):
+    """Determine the interpolation cell of each pixel of a block of scene
+       lines from the pixel longitude and latitude
+
+    All of the pixel arrays have shape (lines, samples).  Only the cells
+    which are CELL_UNKNOWN are determined, in place.
+
+    Args:
+        grid <AtmosphericGrid>: Grid point locations
+        longitude <numpy.ndarray>: float32 pixel longitude in degrees
+        latitude <numpy.ndarray>: float32 pixel latitude in degrees
+        thermal <numpy.ndarray>: float32 thermal radiance, for the fill
+        cells <numpy.ndarray>: int16 lower left grid point of the cell of
+                               each pixel
+    """
+
+    for (name, data, dtype) in (('longitude', longitude, np.float32),
+                                ('latitude', latitude, np.float32),
+                                ('thermal', thermal, np.float32),
+                                ('cells', cells, np.int16)):
+        _check_array(name, data, dtype)
+
+    (lines, samples) = thermal.shape
+
+    if library().st_pixel_cells(ctypes.byref(grid.structure),
+                                lines, samples, longitude, latitude,
+                                thermal, cells) != SUCCESS:
+        raise LibSTError('st_pixel_cells failed')
+
+
+def pixel_cells_map(grid, first_line, ul_map_x, ul_map_y,
+                    x_pixel_size, y_pixel_size, thermal, cells):
+    """Determine the interpolation cell of each pixel of a block of scene
+       lines from the pixel map coordinates
+
+    All of the pixel arrays have shape (lines, samples).  Only the cells
+    which are CELL_UNKNOWN are determined, in place.
+
+    Args:
+        grid <AtmosphericGrid>: Grid point locations
+        first_line <int>: Scene line of the first line in the block
+        ul_map_x <float>: Map x of the scene upper left pixel
+        ul_map_y <float>: Map y of the scene upper left pixel
+        x_pixel_size <float>: Pixel size in map x
+        y_pixel_size <float>: Pixel size in map y
+        thermal <numpy.ndarray>: float32 thermal radiance, for the fill
+        cells <numpy.ndarray>: int16 lower left grid point of the cell of
+                               each pixel
+    """
+
+    _check_array('thermal', thermal, np.float32)
+    _check_array('cells', cells, np.int16)
+
+    (lines, samples) = thermal.shape
+
+    if library().st_pixel_cells_map(ctypes.byref(grid.structure),
+                                    lines, samples, first_line,
+                                    ul_map_x, ul_map_y,
+                                    x_pixel_size, y_pixel_size,
+                                    thermal, cells) != SUCCESS:
+        raise LibSTError('st_pixel_cells_map failed')
+
+
+def pixel_parameters(grid, first_line, ul_map_x, ul_map_y,
+                     x_pixel_size, y_pixel_size,
+                     longitude, latitude, thermal, elevation,
+                     transmission, upwelled_radiance, downwelled_radiance,
+                     cell=None):
+    """Interpolate the grid point parameters to a block of scene lines
+
+    All of the pixel arrays have shape (lines, samples).  The output arrays
+    are filled in place.
+
+    Args:
+        grid <AtmosphericGrid>: Grid point parameters
+        first_line <int>: Scene line of the first line in the block
+        ul_map_x <float>: Map x of the scene upper left pixel
+        ul_map_y <float>: Map y of the scene upper left pixel
+        x_pixel_size <float>: Pixel size in map x
+        y_pixel_size <float>: Pixel size in map y
+        longitude <numpy.ndarray>: float32 pixel longitude in degrees
+        latitude <numpy.ndarray>: float32 pixel latitude in degrees
+        thermal <numpy.ndarray>: float32 thermal radiance
+        elevation <numpy.ndarray>: int16 pixel elevation in meters
+        transmission <numpy.ndarray>: float32 output transmission
+        upwelled_radiance <numpy.ndarray>: float32 output upwelled radiance
+        downwelled_radiance <numpy.ndarray>: float32 output downwelled
+                                             radiance
+        cell <numpy.ndarray>: Optional int32 output lower left point of
+                              the interpolation cell, CELL_UNKNOWN where
+                              none is found
+    """
+
+    for (name, data, dtype) in (('longitude', longitude, np.float32),
+                                ('latitude', latitude, np.float32),
+                                ('thermal', thermal, np.float32),
+                                ('elevation', elevation, np.int16),
+                                ('transmission', transmission, np.float32),
+                                ('upwelled_radiance', upwelled_radiance,
+                                 np.float32),
+                                ('downwelled_radiance', downwelled_radiance,
+                                 np.float32)):
+        _check_array(name, data, dtype)
+
+    cell_pointer = None
+    if cell is not None:
+        _check_array('cell', cell, np.int32)
+        cell_pointer = cell.ctypes.data
+
+    (lines, samples) = thermal.shape
+
+    if library().st_pixel_parameters(ctypes.byref(grid.structure),
+                                     lines, samples, first_line,
+                                     ul_map_x, ul_map_y,
+                                     x_pixel_size, y_pixel_size,
+                                     longitude, latitude,
+                                     thermal, elevation,
+                                     transmission, upwelled_radiance,
+                                     downwelled_radiance,
+                                     cell_pointer) != SUCCESS:
+        raise LibSTError('st_pixel_parameters failed')
+
+
+def radiance_to_temperature(radiance, k1, k2, temperature=None):
+    """Convert thermal radiance to brightness temperature
+
+    Args:
+        radiance <numpy.ndarray>: float32 thermal radiance
+        k1 <float>: K1 thermal conversion constant
+        k2 <float>: K2 thermal conversion constant
+        temperature <numpy.ndarray>: Optional float32 output array, which
+                                     may be the radiance array itself
+
+    Returns:
+        <numpy.ndarray>: Brightness temperature in Kelvin
+    """
+
+    _check_array('radiance', radiance, np.float32)
+    if temperature is None:
+        temperature = np.empty_like(radiance)
+    _check_array('temperature', temperature, np.float32)
+
+    library().st_radiance_to_temperature(radiance, radiance.size, k1, k2,
+                                         temperature)
+
+    return temperature
+
+
+def temperature_to_radiance(temperature, k1, k2, radiance=None):
+    """Convert brightness temperature to thermal radiance
+
+    Args:
+        temperature <numpy.ndarray>: float32 brightness temperature
+        k1 <float>: K1 thermal conversion constant
+        k2 <float>: K2 thermal conversion constant
+        radiance <numpy.ndarray>: Optional float32 output array, which may be
+                                  the temperature array itself
+
+    Returns:
+        <numpy.ndarray>: Thermal radiance
+    """
+
+    _check_array('temperature', temperature, np.float32)
+    if radiance is None:
+        radiance = np.empty_like(temperature)
+    _check_array('radiance', radiance, np.float32)
+
+    library().st_temperature_to_radiance(temperature, temperature.size,
+                                         k1, k2, radiance)
+
+    return radiance
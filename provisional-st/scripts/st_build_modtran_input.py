@@ -24,10 +24,14 @@ import numpy as np
 from espa import Metadata
 import st_utilities as util
 
-from st_grid_points import read_grid_points
+from st_grid_points import read_grid_points, point_directory
+from st_store import (ELEVATION_STORE_NAME, SECTION_ALTITUDES,
+                      SECTION_GROUND_ELEVATION, SECTION_GROUND_DIRECTORY,
+                      write_store)
 
-GRID_ELEVATION_NAME = 'grid_elevations.txt'
-MODTRAN_ELEVATION_NAME = 'modtran_elevations.txt'
+# Each line names a point directory and the point directory whose profile
+# and location its MODTRAN runs use, when points are clustered
+CLUSTER_NAME = 'modtran_clusters.txt'
 
 
 class InvalidNarrDataPointError(Exception):
@@ -107,6 +111,14 @@ def retrieve_command_line_arguments():
                         required=False, default=None,
                         help='Specify the ST Data directory')
 
+    parser.add_argument('--cluster-tolerance',
+                        action='store', dest='cluster_tolerance',
+                        required=False, default=None,
+                        metavar='TEMPERATURE,HUMIDITY,HEIGHT',
+                        help='Run MODTRAN once for points whose profiles are'
+                             ' within these K, %% and km of each other at'
+                             ' every pressure layer')
+
     parser.add_argument('--debug',
                         action='store_true', dest='debug',
                         required=False, default=False,
@@ -132,6 +144,10 @@ def retrieve_command_line_arguments():
     if args.data_path == '':
         raise Exception('The ST data directory provided was empty')
 
+    if args.cluster_tolerance is not None:
+        args.cluster_tolerance = parse_profile_tolerance(
+            args.cluster_tolerance)
+
     return args
 
 
@@ -147,12 +163,12 @@ def load_modtran_template_file(data_path, filename):
     """
 
     filename = os.path.join(data_path, filename)
-    file_data = None
 
-    with open(filename, 'r') as file_fd:
-        file_data = file_fd.read()
+    def read_template():
+        with open(filename, 'r') as file_fd:
+            return file_fd.read()
 
-    return file_data
+    return util.SharedDataCache.load([filename], read_template)
 
 
 def load_narr_pressure_file(parameter, layer):
@@ -191,14 +207,21 @@ def load_narr_pressure_layers(parameters, layers):
         <dict>: dict[parameters]->dict[layers]->[<col>[<row>]]
     """
 
-    data = dict()
-    for parameter in parameters:
-        data[parameter] = dict()
-        for layer in layers:
-            data[parameter][layer] = dict()
-            data[parameter][layer] = load_narr_pressure_file(parameter, layer)
+    def read_layers():
+        data = dict()
+        for parameter in parameters:
+            data[parameter] = dict()
+            for layer in layers:
+                data[parameter][layer] = load_narr_pressure_file(parameter,
+                                                                 layer)
+        return data
 
-    return data
+    # Scenes sharing the extracted NARR data share the loaded layers
+    filenames = [os.path.join(parameter, '.'.join([str(layer), 'txt']))
+                 for parameter in parameters
+                 for layer in layers]
+
+    return util.SharedDataCache.load(filenames, read_layers)
 
 
 def determine_interp_factor(value, before, after):
@@ -246,13 +269,17 @@ def load_std_atmosphere(data_path):
     logger = logging.getLogger(__name__)
 
     filename = os.path.join(data_path, STD_ATMOS_FILENAME)
-    logger.debug('Reading Standard Atmosphere File [{}]'.format(filename))
 
-    with open(filename, 'r') as data_fd:
-        for line in data_fd.readlines():
-            (hgt, pressure, temp, rel_hj) = line.strip().split()
-            yield(StdAtmosInfo(hgt=float(hgt), pressure=float(pressure),
-                               temp=float(temp), rh=float(rel_hj)))
+    def read_std_atmosphere():
+        logger.debug('Reading Standard Atmosphere File [{}]'.format(filename))
+
+        with open(filename, 'r') as data_fd:
+            return [StdAtmosInfo(hgt=float(hgt), pressure=float(pressure),
+                                 temp=float(temp), rh=float(rel_hj))
+                    for (hgt, pressure, temp, rel_hj) in
+                    [line.strip().split() for line in data_fd.readlines()]]
+
+    return util.SharedDataCache.load([filename], read_std_atmosphere)
 
 
 EQUATORIAL_RADIUS = 6378137.0
@@ -418,6 +445,138 @@ def interpolate_to_pressure_layers(data, point, layers, interp_factor):
     return interpolated_values
 
 
+ProfileTolerance = namedtuple('ProfileTolerance',
+                              ('temperature', 'humidity', 'height'))
+
+
+def parse_profile_tolerance(text):
+    """Parse a profile clustering tolerance
+
+    Args:
+        text <str>: 'temperature,humidity,height' in K, % and km
+
+    Returns:
+        <ProfileTolerance>: The tolerance
+    """
+
+    try:
+        tolerance = ProfileTolerance(*[float(value)
+                                       for value in text.split(',')])
+    except (ValueError, TypeError):
+        raise Exception('The cluster tolerance must be given as'
+                        ' temperature,humidity,height')
+
+    if min(tolerance) < 0.0:
+        raise Exception('The cluster tolerance can not be negative')
+
+    return tolerance
+
+
+def profiles_match(values, other, tolerance):
+    """Determine if two profiles are within the tolerance at every layer
+
+    Args:
+        values <dict>: dict[layers]->LayerInfo of one point
+        other <dict>: dict[layers]->LayerInfo of the other point
+        tolerance <ProfileTolerance>: The largest differences allowed
+
+    Returns:
+        <bool>: True if the profiles match
+    """
+
+    for layer in PRESSURE_LAYERS:
+        if (abs(values[layer].temp - other[layer].temp) >
+                tolerance.temperature or
+                abs(values[layer].rh - other[layer].rh) >
+                tolerance.humidity or
+                abs(values[layer].hgt - other[layer].hgt) >
+                tolerance.height):
+            return False
+
+    return True
+
+
+def cluster_points(data, points, interp_factor, tolerance):
+    """Group the points whose profiles match
+
+    Each point joins the first cluster whose first point, its
+    representative, has a matching profile, otherwise it starts a cluster.
+    The elevations run for a point follow from the height of its bottom
+    layer, so a point shares all of its runs with its representative.
+
+    Args:
+        data <dict>: Data structure for the parameters and pressure layers
+        points [<GridPointInfo>]: The points MODTRAN is run for
+        interp_factor <float>: The interpolation factor to use
+        tolerance <ProfileTolerance>: The largest differences allowed
+
+    Returns:
+        <dict>: Point directory to the representative <GridPointInfo>
+    """
+
+    logger = logging.getLogger(__name__)
+
+    # Representative points and their profiles
+    representatives = list()
+    clusters = dict()
+    for point in points:
+        values = interpolate_to_pressure_layers(data=data,
+                                                point=point,
+                                                layers=PRESSURE_LAYERS,
+                                                interp_factor=interp_factor)
+
+        for (representative, other) in representatives:
+            if profiles_match(values, other, tolerance):
+                break
+        else:
+            (representative, other) = (point, values)
+            representatives.append((representative, other))
+
+        clusters[point_directory(point)] = representative
+
+    logger.info('Clustered [{0}] points into [{1}] MODTRAN points'
+                .format(len(points), len(representatives)))
+
+    return clusters
+
+
+def write_clusters(clusters, directory=os.curdir):
+    """Write the representative of each clustered point
+
+    Args:
+        clusters <dict>: Point directory to the representative
+        directory <str>: Directory holding the point directories
+    """
+
+    with open(os.path.join(directory, CLUSTER_NAME), 'w') as cluster_fd:
+        for (point_path, representative) in sorted(clusters.items()):
+            cluster_fd.write('{0} {1}\n'
+                             .format(point_path,
+                                     point_directory(representative)))
+
+
+def read_clusters(directory=os.curdir):
+    """Read the representative of each clustered point
+
+    Args:
+        directory <str>: Directory holding the point directories
+
+    Returns:
+        <dict>: Point directory to the representative point directory,
+                empty when the points were not clustered
+    """
+
+    clusters = dict()
+    filename = os.path.join(directory, CLUSTER_NAME)
+    if os.path.isfile(filename):
+        with open(filename, 'r') as cluster_fd:
+            for line in cluster_fd:
+                (point_path, representative) = line.split()
+                clusters[point_path] = representative
+
+    return clusters
+
+
 def get_latitude_longitude_strings(point):
     """Determine string versions of the latitude and longitude
 
@@ -756,11 +915,10 @@ def generate_tape5_for_elevation(std_atmos, layers, head_template, tail_data,
                                 tail_data=tail_data)
 
 
-def determine_elevations(grid_elevation_file, elevations, height):
+def determine_elevations(elevations, height):
     """Determine a list of adjusted elevations to use
 
     Args:
-        grid_elevation_file <file>: File where 0 elevations are to be written
         elevations [<float>]: Initial list of elevations
         height <float>: Height for the bottom pressure layer
 
@@ -778,22 +936,17 @@ def determine_elevations(grid_elevation_file, elevations, height):
     else:
         new_elevations[0] = height
 
-    # Write the first elevation to the elevation file.  Write it with more
-    # precision for science calculations and less to exactly match the
-    # directory name
-    grid_elevation_file.write('{0:05.8f} {0:05.3f}\n'.format(new_elevations[0]))
-
     return new_elevations
 
 
-def build_ground_altitudes(ground_altitudes, espa_metadata):
-
-    """Build list of ground altitudes based on the standard ground altitudes
-       and the scene.  Also, write these altitudes to a file for later use
+def determine_ground_altitudes(espa_metadata):
+    """Determine the standard ground altitudes needed for the scene
 
     Args:
-        ground_altitudes <file>: List of altitudes to process
         espa_metadata <espa.metadata>: The metadata information for the input
+
+    Returns:
+        [<float>]: The altitudes to process
     """
 
     # Determine the minimum and maximum scene elevations, excluding fill
@@ -840,25 +993,52 @@ def build_ground_altitudes(ground_altitudes, espa_metadata):
     # Build the elevations list like the standard elevations list, but only
     # with elevations we need to process based on this scene's elevations.
     # We always need the 0 elevation
-    ground_altitudes.append(0.0)
+    ground_altitudes = [0.0]
     for index in range(min_index, max_index + 1):
         ground_altitudes.append(GROUND_ALT[index])
 
-    # Make a file that shows what elevations are actually being used
-    with open(MODTRAN_ELEVATION_NAME, 'w') as modtran_elevation_file:
-        modtran_elevation_file.write('{0}\n'.format(len(ground_altitudes)))
-        for altitude in ground_altitudes:
-            modtran_elevation_file.write('{0}\n'.format(altitude))
-    modtran_elevation_file.close()
+    return ground_altitudes
 
 
-def generate_tape5_files_for_point(grid_elevation_file, std_atmos, data, point,
-                                   interp_factor, doy_str, head_template,
-                                   tail_template, ground_altitudes):
+def write_elevations(ground_altitudes, ground_elevations, grid_points,
+                     output_directory=os.curdir):
+    """Write the elevations MODTRAN is run at to the elevation store
+
+    Args:
+        ground_altitudes [<float>]: The standard altitudes being processed
+        ground_elevations <dict>: Point directory to the ground elevation of
+                                  each point MODTRAN is run for
+        grid_points [GridPointInfo]: List of the grid point information
+        output_directory <str>: Directory to write the store in
+    """
+
+    # Points MODTRAN is not run for have no ground elevation
+    elevations = np.empty(len(grid_points), dtype=np.float64)
+    elevations.fill(np.nan)
+    directories = elevations.copy()
+
+    # The ground elevation keeps the precision the science calculations have
+    # always used, and its directory is rounded to exactly match the name
+    for (position, point) in enumerate(grid_points):
+        if point.run_modtran:
+            elevation = ground_elevations[point_directory(point)]
+            elevations[position] = float('{0:.8f}'.format(elevation))
+            directories[position] = float('{0:.3f}'.format(elevation))
+
+    write_store(os.path.join(output_directory, ELEVATION_STORE_NAME),
+                [(SECTION_ALTITUDES,
+                  np.array(ground_altitudes, dtype=np.float64)),
+                 (SECTION_GROUND_ELEVATION, elevations),
+                 (SECTION_GROUND_DIRECTORY, directories)])
+
+
+def generate_tape5_files_for_point(std_atmos, data, point, interp_factor,
+                                   doy_str, head_template, tail_template,
+                                   ground_altitudes, representative=None,
+                                   output_directory=os.curdir):
     """Generate tape5 file for the current point
 
     Args:
-        grid_elevation_file <file>: File where 0 elevations are to be written
         std_atmos [StdAtmosInfo]: The standard atmosphere
         data <dict>: Data structure for the parameters and pressure layers
         point <GridPointInfo>: The current point information
@@ -866,14 +1046,23 @@ def generate_tape5_files_for_point(grid_elevation_file, std_atmos, data, point,
         head_template <str>: The template for the head of the tape5 file
         tail_template <str>: The template for the tail of the tape5 file
         ground_altitudes [<float>]: The standard altitudes we need to process
+        representative <GridPointInfo>: Point whose profile and location are
+                                        used instead, when clustered
+        output_directory <str>: Directory to create the point directory in
+
+    Returns:
+        <float>: The ground elevation of the point
     """
 
     logger = logging.getLogger(__name__)
 
     # Define the point directory
-    point_path = ('{0:03}_{1:03}_{2:03}_{3:03}'
-                  .format(point.row, point.col,
-                          point.narr_row, point.narr_col))
+    point_path = os.path.join(output_directory, point_directory(point))
+
+    # A clustered point gets the same tape5 files as its representative,
+    # so the runs are only made once
+    if representative is not None:
+        point = representative
 
     (latitude, longitude) = get_latitude_longitude_strings(point=point)
     logger.debug('MODTRAN latitude [{}]'.format(latitude))
@@ -890,8 +1079,7 @@ def generate_tape5_files_for_point(grid_elevation_file, std_atmos, data, point,
                                             layers=PRESSURE_LAYERS,
                                             interp_factor=interp_factor)
 
-    elevations = determine_elevations(grid_elevation_file,
-                                      elevations=ground_altitudes,
+    elevations = determine_elevations(elevations=ground_altitudes,
                                       height=values[PRESSURE_LAYERS[0]].hgt)
 
     for elevation in elevations:
@@ -903,15 +1091,22 @@ def generate_tape5_files_for_point(grid_elevation_file, std_atmos, data, point,
                                      values=values,
                                      elevation=elevation)
 
+    return elevations[0]
+
 
 def generate_modtran_tape5_files(espa_metadata, data_path, std_atmos,
-                                 grid_points):
+                                 grid_points, cluster_tolerance=None,
+                                 output_directory=os.curdir):
     """
     Args:
         espa_metadata <espa.metadata>: The metadata information for the input
         data_path <str>: The directory for the NARR data files
         std_atmos [StdAtmosInfo]: The standard atmosphere
         grid_points [GridPointInfo]: List of the grid point information
+        cluster_tolerance <ProfileTolerance>: Largest profile differences of
+                                              points sharing MODTRAN runs,
+                                              or None to run every point
+        output_directory <str>: Directory to create the point directories in
     """
 
     # Load the MODTRAN head and tail template files
@@ -931,22 +1126,39 @@ def generate_modtran_tape5_files(espa_metadata, data_path, std_atmos,
                      float((t1_date - t0_date).seconds))
 
     # Build the list of altitudes to process based on scene elevations
-    ground_alts = []
-    build_ground_altitudes(ground_alts, espa_metadata)
-
-    with open(GRID_ELEVATION_NAME, 'w') as grid_elevation_file:
-        for point in grid_points:
-            if point.run_modtran:
-                generate_tape5_files_for_point(grid_elevation_file,
-                                               std_atmos=std_atmos,
-                                               data=data,
-                                               point=point,
-                                               interp_factor=interp_factor,
-                                               doy_str=doy_str,
-                                               head_template=head_template,
-                                               tail_template=tail_template,
-                                               ground_altitudes=ground_alts)
-    grid_elevation_file.close()
+    ground_alts = determine_ground_altitudes(espa_metadata)
+
+    clusters = dict()
+    if cluster_tolerance is not None:
+        clusters = cluster_points(data=data,
+                                  points=[point for point in grid_points
+                                          if point.run_modtran],
+                                  interp_factor=interp_factor,
+                                  tolerance=cluster_tolerance)
+        write_clusters(clusters, output_directory)
+    elif os.path.exists(os.path.join(output_directory, CLUSTER_NAME)):
+        os.unlink(os.path.join(output_directory, CLUSTER_NAME))
+
+    ground_elevations = dict()
+    for point in grid_points:
+        if point.run_modtran:
+            ground_elevations[point_directory(point)] = (
+                generate_tape5_files_for_point(
+                    std_atmos=std_atmos,
+                    data=data,
+                    point=point,
+                    interp_factor=interp_factor,
+                    doy_str=doy_str,
+                    head_template=head_template,
+                    tail_template=tail_template,
+                    ground_altitudes=ground_alts,
+                    representative=clusters.get(point_directory(point)),
+                    output_directory=output_directory))
+
+    write_elevations(ground_altitudes=ground_alts,
+                     ground_elevations=ground_elevations,
+                     grid_points=grid_points,
+                     output_directory=output_directory)
 
 
 def main():
@@ -987,7 +1199,8 @@ def main():
     generate_modtran_tape5_files(espa_metadata=espa_metadata,
                                  data_path=args.data_path,
                                  std_atmos=std_atmos,
-                                 grid_points=grid_points)
+                                 grid_points=grid_points,
+                                 cluster_tolerance=args.cluster_tolerance)
 
     logger.info('*** MODTRAN Tape5 Generation - Complete ***')
 
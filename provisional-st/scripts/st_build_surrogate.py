@@ -0,0 +1,184 @@
+#! /usr/bin/env python
+
+'''
+    File: st_build_surrogate.py
+
+    Purpose: Builds the surrogate table st_surrogate.py predicts the
+             atmospheric parameters at the MODTRAN points from.
+
+             The table is fitted to scenes processed with their temporary
+             data kept, pairing the profile in the tape5 file of each point
+             and elevation with the parameters st_atmospheric_parameters
+             derived from its MODTRAN results.
+
+    Project: Land Satellites Data Systems Science Research and Development
+             (LSRD) at the USGS EROS
+
+    License: NASA Open Source Agreement 1.3
+'''
+
+import os
+import sys
+import json
+import logging
+from argparse import ArgumentParser
+
+import st_utilities as util
+import st_surrogate
+
+
+def retrieve_command_line_arguments():
+    """Read arguments from the command line
+
+    Returns:
+        args <arguments>: The arguments read from the command line
+    """
+
+    parser = ArgumentParser(description='Builds a surrogate table from the'
+                                        ' MODTRAN results of processed'
+                                        ' scenes')
+
+    parser.add_argument('--version',
+                        action='version',
+                        version=util.Version.version_text())
+
+    parser.add_argument('--satellite',
+                        action='store', dest='satellite',
+                        required=False, default=None,
+                        help='Satellite the scenes are from'
+                             ' (e.g.: LANDSAT_8)')
+
+    parser.add_argument('--output',
+                        action='store', dest='output_filename',
+                        required=False, default=None,
+                        help='The surrogate table to write')
+
+    parser.add_argument('--debug',
+                        action='store_true', dest='debug',
+                        required=False, default=False,
+                        help='Output debug messages and/or keep debug data')
+
+    parser.add_argument('scene_directories',
+                        nargs='+', metavar='SCENE_DIRECTORY',
+                        help='Scene directories processed with'
+                             ' --keep-temporary-data')
+
+    args = parser.parse_args()
+
+    if args.satellite is None:
+        raise Exception('--satellite must be specified on the command line')
+
+    if args.output_filename is None:
+        raise Exception('--output must be specified on the command line')
+
+    return args
+
+
+def scene_samples():
+    """The descriptors and parameters of each elevation run in the scene in
+       the current directory
+
+    Returns:
+        [(<tuple>, <tuple>)]: The samples
+    """
+
+    runs = st_surrogate.scene_elevation_runs()
+    parameters = st_surrogate.read_point_parameters(
+        st_surrogate.SCENE_ATMOSPHERE_STORE_NAME)
+
+    if len(parameters) != len(runs):
+        raise Exception('[{0}] has {1} parameters for {2} elevation runs'
+                        .format(st_surrogate.SCENE_ATMOSPHERE_STORE_NAME,
+                                len(parameters), len(runs)))
+
+    samples = list()
+    for (run, values) in zip(runs, parameters):
+        if abs(run.elevation - values[0]) > 0.00001:
+            raise Exception('[{0}] does not match the elevation runs'
+                            .format(st_surrogate.SCENE_ATMOSPHERE_STORE_NAME))
+
+        samples.append((st_surrogate.profile_descriptors(
+                            st_surrogate.read_tape5_profile(run.tape5)),
+                        values[1:]))
+
+    return samples
+
+
+def collect_samples(scene_directories):
+    """The samples of every usable scene
+
+    Args:
+        scene_directories [<str>]: The scene directories
+
+    Returns:
+        [(<tuple>, <tuple>)]: The samples
+    """
+
+    logger = logging.getLogger(__name__)
+
+    samples = list()
+    working_directory = os.getcwd()
+    for directory in scene_directories:
+        os.chdir(directory)
+        try:
+            # Predicted parameters must not be learned from
+            if os.path.exists(st_surrogate.SURROGATE_PARAMETERS_NAME):
+                logger.warning('Skipping [{0}], which was processed with a'
+                               ' surrogate table'.format(directory))
+            elif not os.path.exists(
+                    st_surrogate.SCENE_ATMOSPHERE_STORE_NAME):
+                logger.warning('Skipping [{0}], which has no temporary data'
+                               .format(directory))
+            else:
+                scene = scene_samples()
+                logger.info('[{0}] samples from [{1}]'
+                            .format(len(scene), directory))
+                samples.extend(scene)
+        finally:
+            os.chdir(working_directory)
+
+    return samples
+
+
+def main():
+    """Main processing for building the surrogate table
+    """
+
+    # Command Line Arguments
+    args = retrieve_command_line_arguments()
+
+    # Check logging level
+    logging_level = logging.INFO
+    if args.debug:
+        logging_level = logging.DEBUG
+
+    # Setup the default logger format and level.  Log to STDOUT.
+    logging.basicConfig(format=('%(asctime)s.%(msecs)03d %(process)d'
+                                ' %(levelname)-8s'
+                                ' %(filename)s:%(lineno)d:'
+                                '%(funcName)s -- %(message)s'),
+                        datefmt='%Y-%m-%d %H:%M:%S',
+                        level=logging_level,
+                        stream=sys.stdout)
+    logger = logging.getLogger(__name__)
+
+    logger.info('*** Begin Build ST Surrogate ***')
+
+    samples = collect_samples(args.scene_directories)
+
+    table = st_surrogate.fit_table(samples=samples,
+                                   satellite=args.satellite)
+
+    with open(args.output_filename, 'w') as table_fd:
+        json.dump(table, table_fd, indent=4, sort_keys=True)
+        table_fd.write('\n')
+
+    for name in st_surrogate.PARAMETER_NAMES:
+        logger.info('{0} RMSE [{1:.9f}]'
+                    .format(name, table['rmse'][name]))
+
+    logger.info('*** Build ST Surrogate - Complete ***')
+
+
+if __name__ == '__main__':
+    main()
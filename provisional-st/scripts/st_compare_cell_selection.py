@@ -0,0 +1,225 @@
+#! /usr/bin/env python
+
+'''
+    File: st_compare_cell_selection.py
+
+    Purpose: Compares the grid cell each pixel is interpolated in when the
+             cells are selected from longitude and latitude, as
+             st_atmospheric_parameters does by default, and when they are
+             selected in map coordinates with --map-space-cells.
+
+             Run in a scene directory after the grid points are determined.
+             Every pixel whose cell differs is written to a CSV file.
+
+    Project: Land Satellites Data Systems Science Research and Development
+             (LSRD) at the USGS EROS
+
+    License: NASA Open Source Agreement 1.3
+'''
+
+import sys
+import logging
+from argparse import ArgumentParser
+
+import numpy as np
+
+from espa import Metadata
+
+import st_utilities as util
+import libst
+from st_grid_points import read_grid_points
+from st_determine_grid_points import initialize_gdal_objects
+
+
+# Written in the scene directory with a line for each differing pixel
+DIFFERENCES_NAME = 'cell_selection_differences.csv'
+
+NO_DATA_VALUE = -9999.0
+
+
+def retrieve_command_line_arguments():
+    """Read arguments from the command line
+
+    Returns:
+        args <arguments>: The arguments read from the command line
+    """
+
+    parser = ArgumentParser(description='Reports the pixels whose'
+                                        ' interpolation cell differs between'
+                                        ' geodetic and map space selection')
+
+    parser.add_argument('--version',
+                        action='version',
+                        version=util.Version.version_text())
+
+    parser.add_argument('--xml',
+                        action='store', dest='xml_filename',
+                        required=False, default=None,
+                        help='The XML metadata file to use')
+
+    parser.add_argument('--output',
+                        action='store', dest='output_filename',
+                        required=False, default=DIFFERENCES_NAME,
+                        help='The CSV file of the differing pixels'
+                             ' (default {0})'.format(DIFFERENCES_NAME))
+
+    parser.add_argument('--debug',
+                        action='store_true', dest='debug',
+                        required=False, default=False,
+                        help='Output debug messages and/or keep debug data')
+
+    args = parser.parse_args()
+
+    if args.xml_filename is None:
+        raise Exception('--xml must be specified on the command line')
+
+    return args
+
+
+def build_location_grid():
+    """The grid point locations for the engine
+
+    Only the locations are used to select cells, so the parameters are
+    zero.
+
+    Returns:
+        <libst.AtmosphericGrid>: The grid
+    """
+
+    (grid_points, grid_rows, grid_cols) = read_grid_points()
+
+    zeros = np.zeros((len(grid_points), 1), dtype=np.float64)
+
+    return libst.AtmosphericGrid(
+        rows=grid_rows, cols=grid_cols,
+        lon=[point.lon for point in grid_points],
+        lat=[point.lat for point in grid_points],
+        map_x=[point.map_x for point in grid_points],
+        map_y=[point.map_y for point in grid_points],
+        elevation=zeros, transmission=zeros, upwelled_radiance=zeros,
+        downwelled_radiance=zeros)
+
+
+def compare_cell_selection(espa_metadata, output_filename):
+    """Select the cells both ways and write the pixels which differ
+
+    The pixel longitude and latitude are converted from the same map
+    coordinates the interpolation uses.
+
+    Args:
+        espa_metadata <espa.Metadata>: The metadata for the scene
+        output_filename <str>: The CSV file of the differing pixels
+
+    Returns:
+        (<int>, <int>): The number of valid and of differing pixels
+    """
+
+    logger = logging.getLogger(__name__)
+
+    gdal_objs = initialize_gdal_objects(espa_metadata=espa_metadata)
+    grid = build_location_grid()
+
+    ul_map_x = gdal_objs.data_transform[0]
+    ul_map_y = gdal_objs.data_transform[3]
+    x_pixel_size = gdal_objs.data_transform[1]
+    y_pixel_size = -gdal_objs.data_transform[5]
+
+    band = gdal_objs.data_ds.GetRasterBand(1)
+
+    map_x = ul_map_x + np.arange(gdal_objs.nsamps) * x_pixel_size
+
+    valid_pixels = 0
+    differing_pixels = 0
+    with open(output_filename, 'w') as output_fd:
+        output_fd.write('line,sample,geodetic_cell,map_cell\n')
+
+        for line in xrange(gdal_objs.nlines):
+            data = band.ReadAsArray(0, line, gdal_objs.nsamps, 1)
+
+            valid = data[0] != gdal_objs.fill_value
+            count = int(np.count_nonzero(valid))
+            if count == 0:
+                continue
+            valid_pixels += count
+
+            thermal = np.zeros((1, gdal_objs.nsamps), dtype=np.float32)
+            thermal[0, ~valid] = NO_DATA_VALUE
+
+            map_y = ul_map_y - line * y_pixel_size
+            locations = gdal_objs.data_to_ll.TransformPoints(
+                [(x, map_y) for x in map_x[valid]])
+
+            longitude = np.zeros((1, gdal_objs.nsamps), dtype=np.float32)
+            latitude = np.zeros((1, gdal_objs.nsamps), dtype=np.float32)
+            longitude[0, valid] = [location[0] for location in locations]
+            latitude[0, valid] = [location[1] for location in locations]
+
+            geodetic_cells = np.full((1, gdal_objs.nsamps), libst.CELL_UNKNOWN,
+                                     dtype=np.int16)
+            map_cells = np.full((1, gdal_objs.nsamps), libst.CELL_UNKNOWN,
+                                dtype=np.int16)
+
+            libst.pixel_cells(grid, longitude, latitude, thermal,
+                              geodetic_cells)
+            libst.pixel_cells_map(grid, line, ul_map_x, ul_map_y,
+                                  x_pixel_size, y_pixel_size, thermal,
+                                  map_cells)
+
+            for sample in np.flatnonzero(geodetic_cells[0] != map_cells[0]):
+                output_fd.write('{0},{1},{2},{3}\n'
+                                .format(line, sample,
+                                        geodetic_cells[0, sample],
+                                        map_cells[0, sample]))
+                differing_pixels += 1
+
+            if line % 1000 == 0:
+                logger.info('Compared line [{0}]'.format(line))
+
+    return (valid_pixels, differing_pixels)
+
+
+def main():
+    """Main processing for comparing the cell selections
+    """
+
+    # Command Line Arguments
+    args = retrieve_command_line_arguments()
+
+    # Check logging level
+    logging_level = logging.INFO
+    if args.debug:
+        logging_level = logging.DEBUG
+
+    # Setup the default logger format and level.  Log to STDOUT.
+    logging.basicConfig(format=('%(asctime)s.%(msecs)03d %(process)d'
+                                ' %(levelname)-8s'
+                                ' %(filename)s:%(lineno)d:'
+                                '%(funcName)s -- %(message)s'),
+                        datefmt='%Y-%m-%d %H:%M:%S',
+                        level=logging_level,
+                        stream=sys.stdout)
+    logger = logging.getLogger(__name__)
+
+    logger.info('*** Begin Compare Cell Selection ***')
+
+    # XML Metadata
+    espa_metadata = Metadata()
+    espa_metadata.parse(xml_filename=args.xml_filename)
+
+    (valid_pixels, differing_pixels) = compare_cell_selection(
+        espa_metadata=espa_metadata, output_filename=args.output_filename)
+
+    fraction = 0.0
+    if valid_pixels > 0:
+        fraction = float(differing_pixels) / valid_pixels
+
+    logger.info('[{0}] of [{1}] valid pixels ({2:.6%}) are in a different'
+                ' cell, written to [{3}]'
+                .format(differing_pixels, valid_pixels, fraction,
+                        args.output_filename))
+
+    logger.info('*** Compare Cell Selection - Complete ***')
+
+
+if __name__ == '__main__':
+    main()
@@ -95,14 +95,8 @@ def extract_raster_data(name, band_number):
         <raster>: 2D raster array data
     """
 
-    dataset = gdal.Open(name)
-    if dataset is None:
-        raise RuntimeError('GDAL failed to open {0}'.format(name))
-
-    raster = (dataset.GetRasterBand(band_number)
-              .ReadAsArray(0, 0, dataset.RasterXSize, dataset.RasterYSize))
-
-    return raster
+    # Bands handed over in memory by an earlier stage are used directly
+    return util.RasterCache.read(name, band_number)
 
 
 def retrieve_command_line_arguments():
@@ -192,11 +186,8 @@ def update_band_xml(espa_metadata, source_product, band_name, filename,
     if base_band is None:
         raise MissingBandError('Failed to find the band in the input data')
 
-    # Validate the XML
-    espa_metadata.validate()
-
-    # Write it to the XML file
-    espa_metadata.write()
+    # Validate and write the XML, unless a transaction defers it
+    util.MetadataTransaction.save(espa_metadata)
 
 
 def write_product(samps, lines, transform, wkt, no_data_value, filename,
@@ -239,6 +230,9 @@ def write_product(samps, lines, transform, wkt, no_data_value, filename,
                                   no_data_value,
                                   gdal.GDT_Int16)
 
+    # Any copy held in memory is now out of date
+    util.RasterCache.release(filename)
+
     hdr_filename = filename.replace('.img', '.hdr')
     logger.info('Updating {0}'.format(hdr_filename))
     util.Geo.update_envi_header(hdr_filename, no_data_value)
@@ -276,8 +270,11 @@ def convert_band(espa_metadata, xml_filename, no_data_value, scale_factor,
     lines = dataset.RasterYSize
     del dataset
 
-    # Read band
+    # Read band, copying it when it is shared with later stages, since it
+    # is converted in place
     data_array = extract_raster_data(src_info.filename, 1)
+    if not data_array.flags.writeable:
+        data_array = data_array.copy()
 
     # Build converted intermediate band filename
     img_filename = ''.join([xml_filename.split('.xml')[0],
@@ -303,94 +300,99 @@ def convert_band(espa_metadata, xml_filename, no_data_value, scale_factor,
                     range_max=range_max)
 
 
-def convert_bands(xml_filename, no_data_value):
+def convert_bands(xml_filename, no_data_value, espa_metadata=None):
     """Convert multiple intermediate bands
 
     Args:
         xml_filename <str>: Filename for the ESPA Metadata XML
         no_data_value <float>: No data (fill) value to use
+        espa_metadata <espa.Metadata>: Parsed XML metadata to use instead
+                                       of parsing xml_filename
     """
 
-    # XML metadata
-    espa_metadata = Metadata(xml_filename)
-    espa_metadata.parse()
-
-    # Convert emissivity band.
-    convert_band(espa_metadata=espa_metadata,
-                 xml_filename=xml_filename,
-                 no_data_value=no_data_value,
-                 scale_factor=str(EMIS_SCALE_FACTOR),
-                 mult_factor=EMIS_MULT_FACTOR,
-                 range_min=str(EMIS_RANGE_MIN),
-                 range_max=str(EMIS_RANGE_MAX),
-                 source_product=EMIS_SOURCE_PRODUCT,
-                 band_name=EMIS_BAND_NAME)
-
-    # Convert emissivity standard deviation band.
-    convert_band(espa_metadata=espa_metadata,
-                 xml_filename=xml_filename,
-                 no_data_value=no_data_value,
-                 scale_factor=str(EMIS_STDEV_SCALE_FACTOR),
-                 mult_factor=EMIS_STDEV_MULT_FACTOR,
-                 range_min=str(EMIS_STDEV_RANGE_MIN),
-                 range_max=str(EMIS_STDEV_RANGE_MAX),
-                 source_product=EMIS_STDEV_SOURCE_PRODUCT,
-                 band_name=EMIS_STDEV_BAND_NAME)
-
-    # Convert cloud distance band.
-    convert_band(espa_metadata=espa_metadata,
-                 xml_filename=xml_filename,
-                 no_data_value=no_data_value,
-                 scale_factor=str(CLOUD_DISTANCE_SCALE_FACTOR),
-                 mult_factor=CLOUD_DISTANCE_MULT_FACTOR,
-                 range_min=str(CLOUD_DISTANCE_RANGE_MIN),
-                 range_max=str(CLOUD_DISTANCE_RANGE_MAX),
-                 source_product=CLOUD_DISTANCE_SOURCE_PRODUCT,
-                 band_name=CLOUD_DISTANCE_BAND_NAME)
-
-    # Convert thermal radiance band.
-    convert_band(espa_metadata=espa_metadata,
-                 xml_filename=xml_filename,
-                 no_data_value=no_data_value,
-                 scale_factor=str(THERMAL_RADIANCE_SCALE_FACTOR),
-                 mult_factor=THERMAL_RADIANCE_MULT_FACTOR,
-                 range_min=str(THERMAL_RADIANCE_RANGE_MIN),
-                 range_max=str(THERMAL_RADIANCE_RANGE_MAX),
-                 source_product=THERMAL_RADIANCE_SOURCE_PRODUCT,
-                 band_name=THERMAL_RADIANCE_BAND_NAME)
-
-    # Convert upwelled radiance band.
-    convert_band(espa_metadata=espa_metadata,
-                 xml_filename=xml_filename,
-                 no_data_value=no_data_value,
-                 scale_factor=str(UPWELLED_RADIANCE_SCALE_FACTOR),
-                 mult_factor=UPWELLED_RADIANCE_MULT_FACTOR,
-                 range_min=str(UPWELLED_RADIANCE_RANGE_MIN),
-                 range_max=str(UPWELLED_RADIANCE_RANGE_MAX),
-                 source_product=UPWELLED_RADIANCE_SOURCE_PRODUCT,
-                 band_name=UPWELLED_RADIANCE_BAND_NAME)
-
-    # Convert downwelled radiance band.
-    convert_band(espa_metadata=espa_metadata,
-                 xml_filename=xml_filename,
-                 no_data_value=no_data_value,
-                 scale_factor=str(DOWNWELLED_RADIANCE_SCALE_FACTOR),
-                 mult_factor=DOWNWELLED_RADIANCE_MULT_FACTOR,
-                 range_min=str(DOWNWELLED_RADIANCE_RANGE_MIN),
-                 range_max=str(DOWNWELLED_RADIANCE_RANGE_MAX),
-                 source_product=DOWNWELLED_RADIANCE_SOURCE_PRODUCT,
-                 band_name=DOWNWELLED_RADIANCE_BAND_NAME)
-
-    # Convert atmospheric transmittance band.
-    convert_band(espa_metadata=espa_metadata,
-                 xml_filename=xml_filename,
-                 no_data_value=no_data_value,
-                 scale_factor=str(ATMOSPHERIC_TRANSMITTANCE_SCALE_FACTOR),
-                 mult_factor=ATMOSPHERIC_TRANSMITTANCE_MULT_FACTOR,
-                 range_min=str(ATMOSPHERIC_TRANSMITTANCE_RANGE_MIN),
-                 range_max=str(ATMOSPHERIC_TRANSMITTANCE_RANGE_MAX),
-                 source_product=ATMOSPHERIC_TRANSMITTANCE_SOURCE_PRODUCT,
-                 band_name=ATMOSPHERIC_TRANSMITTANCE_BAND_NAME)
+    # XML metadata, unless the caller already has it parsed
+    if espa_metadata is None:
+        espa_metadata = Metadata(xml_filename)
+        espa_metadata.parse()
+
+    # The XML is written once, after all of the bands are converted
+    with util.MetadataTransaction(espa_metadata):
+        # Convert emissivity band.
+        convert_band(espa_metadata=espa_metadata,
+                     xml_filename=xml_filename,
+                     no_data_value=no_data_value,
+                     scale_factor=str(EMIS_SCALE_FACTOR),
+                     mult_factor=EMIS_MULT_FACTOR,
+                     range_min=str(EMIS_RANGE_MIN),
+                     range_max=str(EMIS_RANGE_MAX),
+                     source_product=EMIS_SOURCE_PRODUCT,
+                     band_name=EMIS_BAND_NAME)
+
+        # Convert emissivity standard deviation band.
+        convert_band(espa_metadata=espa_metadata,
+                     xml_filename=xml_filename,
+                     no_data_value=no_data_value,
+                     scale_factor=str(EMIS_STDEV_SCALE_FACTOR),
+                     mult_factor=EMIS_STDEV_MULT_FACTOR,
+                     range_min=str(EMIS_STDEV_RANGE_MIN),
+                     range_max=str(EMIS_STDEV_RANGE_MAX),
+                     source_product=EMIS_STDEV_SOURCE_PRODUCT,
+                     band_name=EMIS_STDEV_BAND_NAME)
+
+        # Convert cloud distance band.
+        convert_band(espa_metadata=espa_metadata,
+                     xml_filename=xml_filename,
+                     no_data_value=no_data_value,
+                     scale_factor=str(CLOUD_DISTANCE_SCALE_FACTOR),
+                     mult_factor=CLOUD_DISTANCE_MULT_FACTOR,
+                     range_min=str(CLOUD_DISTANCE_RANGE_MIN),
+                     range_max=str(CLOUD_DISTANCE_RANGE_MAX),
+                     source_product=CLOUD_DISTANCE_SOURCE_PRODUCT,
+                     band_name=CLOUD_DISTANCE_BAND_NAME)
+
+        # Convert thermal radiance band.
+        convert_band(espa_metadata=espa_metadata,
+                     xml_filename=xml_filename,
+                     no_data_value=no_data_value,
+                     scale_factor=str(THERMAL_RADIANCE_SCALE_FACTOR),
+                     mult_factor=THERMAL_RADIANCE_MULT_FACTOR,
+                     range_min=str(THERMAL_RADIANCE_RANGE_MIN),
+                     range_max=str(THERMAL_RADIANCE_RANGE_MAX),
+                     source_product=THERMAL_RADIANCE_SOURCE_PRODUCT,
+                     band_name=THERMAL_RADIANCE_BAND_NAME)
+
+        # Convert upwelled radiance band.
+        convert_band(espa_metadata=espa_metadata,
+                     xml_filename=xml_filename,
+                     no_data_value=no_data_value,
+                     scale_factor=str(UPWELLED_RADIANCE_SCALE_FACTOR),
+                     mult_factor=UPWELLED_RADIANCE_MULT_FACTOR,
+                     range_min=str(UPWELLED_RADIANCE_RANGE_MIN),
+                     range_max=str(UPWELLED_RADIANCE_RANGE_MAX),
+                     source_product=UPWELLED_RADIANCE_SOURCE_PRODUCT,
+                     band_name=UPWELLED_RADIANCE_BAND_NAME)
+
+        # Convert downwelled radiance band.
+        convert_band(espa_metadata=espa_metadata,
+                     xml_filename=xml_filename,
+                     no_data_value=no_data_value,
+                     scale_factor=str(DOWNWELLED_RADIANCE_SCALE_FACTOR),
+                     mult_factor=DOWNWELLED_RADIANCE_MULT_FACTOR,
+                     range_min=str(DOWNWELLED_RADIANCE_RANGE_MIN),
+                     range_max=str(DOWNWELLED_RADIANCE_RANGE_MAX),
+                     source_product=DOWNWELLED_RADIANCE_SOURCE_PRODUCT,
+                     band_name=DOWNWELLED_RADIANCE_BAND_NAME)
+
+        # Convert atmospheric transmittance band.
+        convert_band(espa_metadata=espa_metadata,
+                     xml_filename=xml_filename,
+                     no_data_value=no_data_value,
+                     scale_factor=str(ATMOSPHERIC_TRANSMITTANCE_SCALE_FACTOR),
+                     mult_factor=ATMOSPHERIC_TRANSMITTANCE_MULT_FACTOR,
+                     range_min=str(ATMOSPHERIC_TRANSMITTANCE_RANGE_MIN),
+                     range_max=str(ATMOSPHERIC_TRANSMITTANCE_RANGE_MAX),
+                     source_product=ATMOSPHERIC_TRANSMITTANCE_SOURCE_PRODUCT,
+                     band_name=ATMOSPHERIC_TRANSMITTANCE_BAND_NAME)
 
 
 def main():
@@ -25,8 +25,10 @@ from osgeo import gdal, osr
 from espa import Metadata
 from st_exceptions import MissingBandError
 import st_utilities as util
+import st_geometry_cache
 
 from st_grid_points import PointInfo, write_grid_points
+from st_generate_distance_to_cloud import PQA_CLOUD, PQA_SINGLE_BIT
 
 
 # Name of the static NARR coordinates file
@@ -36,6 +38,14 @@ NARR_COORDINATES_FILENAME = 'narr_coordinates.txt'
 RADIUS_EARTH_IN_METERS = 6378137.0
 DIAMETER_EARTH_IN_METERS = RADIUS_EARTH_IN_METERS * 2
 
+# A pixel is interpolated from the corners of the grid cell around it, so
+# the points it uses are at most a cell diagonal away.  Clear sky pruning
+# keeps the points with a clear pixel within this many grid spacings.
+CLEAR_SKY_RADIUS_SPACINGS = 1.5
+
+# Lines and samples of the blocks clear pixels are counted in when pruning
+CLEAR_SKY_BLOCK_SIZE = 32
+
 
 # Gdal specific information
 GdalInfo = namedtuple('GdalInfo',
@@ -78,6 +88,17 @@ def retrieve_command_line_arguments():
                         required=False, default=None,
                         help='Specify the ST Data directory')
 
+    parser.add_argument('--clear-sky',
+                        action='store_true', dest='clear_sky',
+                        required=False, default=False,
+                        help='Only run MODTRAN for points near clear pixels')
+
+    parser.add_argument('--geometry-cache',
+                        action='store', dest='geometry_cache',
+                        required=False, default=None,
+                        help='Directory of the geometry cache shared by the'
+                             ' scenes of a path/row')
+
     parser.add_argument('--debug',
                         action='store_true', dest='debug',
                         required=False, default=False,
@@ -239,25 +260,20 @@ def check_within_bounds(data_bounds, lon, lat):
     return False
 
 
-def convert_narr_line_to_point_info(gdal_objs, min_max, line):
+def convert_narr_line_to_point_info(gdal_objs, min_max, coordinate):
     """Converts a line of information into a PointInfo
 
     Args:
         gdal_objs <GdalInfo>: Contains GDAL objects and static information
         min_max <MinMaxRowColInfo>: Contains the min and max rows and columns
-        line <str>: The line of information read from the coordinate file
+        coordinate <tuple>: The (col, row, lat, lon) read from the coordinate
+                            file
 
     Returns:
         <PointInfo>: Contains point information from the NARR coordinates file
     """
 
-    (col, row, lat, lon) = line.split()
-
-    # Convert to numerical types
-    col = int(col)
-    row = int(row)
-    lat = float(lat)
-    lon = fix_narr_longitude(float(lon))
+    (col, row, lat, lon) = coordinate
 
     if (min_max.min_row <= row and
             min_max.max_row >= row and
@@ -413,6 +429,118 @@ def find_first_last_valid(mask, lines):
             pass
 
 
+def find_pixel_qa_filename(espa_metadata):
+    """Find the pixel QA band used for clear sky point selection
+
+    Args:
+        espa_metadata <espa.Metadata>: The metadata for the data
+
+    Returns:
+        <str>: The pixel QA band filename
+    """
+
+    for band in espa_metadata.xml_object.bands.band:
+        if (band.get('product') == 'level2_qa' and
+                band.get('name') == 'pixel_qa'):
+            return str(band.file_name)
+
+    raise MissingBandError('Failed to find the PIXEL QA band in the'
+                           ' input data')
+
+
+def exclude_cloud(mask, qa_filename):
+    """Remove the cloud pixels from the mask of valid data
+
+    Args:
+        mask <numpy 2d bool array>: Mask of valid data as bool
+        qa_filename <str>: The pixel QA band filename
+    """
+
+    qa_data = util.RasterCache.read(qa_filename, 1)
+
+    mask[np.bitwise_and(np.right_shift(qa_data, PQA_CLOUD),
+                        PQA_SINGLE_BIT) != 0] = False
+    del qa_data
+
+
+def prune_clouded_points(gdal_objs, grid_points, grid_rows, grid_cols,
+                         mask):
+    """Stop running MODTRAN for points with no clear pixels near them
+
+    Args:
+        gdal_objs <GdalInfo>: Contains GDAL objects and static information
+        grid_points <dict>: Dictionary of the gridded points
+        grid_rows <int>: Number of rows in the grid
+        grid_cols <int>: Number of columns in the grid
+        mask <numpy 2d bool array>: Mask of clear valid data as bool
+
+    Returns:
+        <int>: The number of points which no longer need MODTRAN
+    """
+
+    # The largest spacing between neighboring points, in pixels
+    spacing = 0.0
+    for point in grid_points:
+        neighbors = list()
+        if point['col'] < grid_cols - 1:
+            neighbors.append(grid_points[point['index'] + 1])
+        if point['row'] < grid_rows - 1:
+            neighbors.append(grid_points[point['index'] + grid_cols])
+        for neighbor in neighbors:
+            spacing = max(spacing,
+                          math.hypot(
+                              (neighbor['point'].map_x -
+                               point['point'].map_x) /
+                              gdal_objs.data_transform[1],
+                              (neighbor['point'].map_y -
+                               point['point'].map_y) /
+                              gdal_objs.data_transform[5]))
+    radius = int(math.ceil(CLEAR_SKY_RADIUS_SPACINGS * spacing))
+
+    # Count the clear pixels in blocks, with a summed area table of the
+    # counts, so the clear pixels around each point are counted quickly
+    block = CLEAR_SKY_BLOCK_SIZE
+    block_lines = (gdal_objs.nlines + block - 1) // block
+    block_samps = (gdal_objs.nsamps + block - 1) // block
+    padded = np.zeros((block_lines * block, block_samps * block),
+                      dtype=np.bool)
+    padded[:gdal_objs.nlines, :gdal_objs.nsamps] = mask
+    counts = padded.reshape(block_lines, block, block_samps, block) \
+        .sum(axis=3).sum(axis=1)
+    del padded
+
+    table = np.zeros((block_lines + 1, block_samps + 1), dtype=np.int64)
+    table[1:, 1:] = counts.cumsum(axis=0).cumsum(axis=1)
+    del counts
+
+    skipped = 0
+    for point in grid_points:
+        if not point['run_modtran']:
+            continue
+
+        (data_x, data_y) = (util.Geo
+                            .convert_mapXY_to_imageXY(
+                                point['point'].map_x,
+                                point['point'].map_y,
+                                gdal_objs.data_transform))
+
+        first_line = min(max(0, int(data_y - radius) // block), block_lines)
+        last_line = min(max(0, int(data_y + radius) // block + 1),
+                        block_lines)
+        first_samp = min(max(0, int(data_x - radius) // block), block_samps)
+        last_samp = min(max(0, int(data_x + radius) // block + 1),
+                        block_samps)
+
+        clear = (table[last_line, last_samp] - table[first_line, last_samp] -
+                 table[last_line, first_samp] +
+                 table[first_line, first_samp])
+        if clear == 0:
+            point['run_modtran'] = False
+            skipped += 1
+
+    return skipped
+
+
 def fix_narr_longitude(lon):
     """Fixes the NARR longitude value to be within +-180
 
@@ -440,25 +568,20 @@ def fix_narr_longitude(lon):
         return -lon
 
 
-def extract_narr_row_col(data_bounds, line):
+def extract_narr_row_col(data_bounds, coordinate):
     """Extracts the row and column from a line of NARR coordinate information
 
     Args:
         data_bounds <DataBoundInfo>: Contains adjusted data boundry information
-        line <str>: The line of information read from the coordinate file
+        coordinate <tuple>: The (col, row, lat, lon) read from the coordinate
+                            file
 
     Returns:
         row <int>: The row for the point
         col <int>: The column for the point
     """
 
-    (col, row, lat, lon) = line.split()
-
-    # Convert to numerical types
-    col = int(col)
-    row = int(row)
-    lat = float(lat)
-    lon = fix_narr_longitude(float(lon))
+    (col, row, lat, lon) = coordinate
 
     if not check_within_bounds(data_bounds, lon, lat):
         return None
@@ -466,6 +589,43 @@ def extract_narr_row_col(data_bounds, line):
         return (row, col)
 
 
+def parse_narr_coordinates(data_path):
+    """Reads the NARR coordinates file
+
+    Args:
+        data_path <str>: The full path to the NARR coordinates file
+
+    Returns:
+        [<tuple>]: The (col, row, lat, lon) of each NARR point
+    """
+
+    coordinates = list()
+    with open(data_path, 'r') as coords_fd:
+        for line in coords_fd:
+            (col, row, lat, lon) = line.strip().split()
+
+            # Convert to numerical types
+            coordinates.append((int(col), int(row), float(lat),
+                                fix_narr_longitude(float(lon))))
+
+    return coordinates
+
+
+def read_narr_coordinates(data_path):
+    """Provides the NARR coordinates, parsing the file only once when the
+       shared data cache is enabled
+
+    Args:
+        data_path <str>: The full path to the NARR coordinates file
+
+    Returns:
+        [<tuple>]: The (col, row, lat, lon) of each NARR point
+    """
+
+    return util.SharedDataCache.load(
+        [data_path], lambda: parse_narr_coordinates(data_path))
+
+
 def determine_narr_min_max_row_col(data_bounds, data_path):
     """Determine the NARR points that are within the data bounds
 
@@ -479,10 +639,9 @@ def determine_narr_min_max_row_col(data_bounds, data_path):
     """
 
     # Generate a list of the points [(row, col),] within the defined boundary
-    with open(data_path, 'r') as coords_fd:
-        rows_cols = [extract_narr_row_col(data_bounds=data_bounds,
-                                          line=line.strip())
-                     for line in coords_fd]
+    rows_cols = [extract_narr_row_col(data_bounds=data_bounds,
+                                      coordinate=coordinate)
+                 for coordinate in read_narr_coordinates(data_path)]
 
     # Filter out the None values
     remaining = [point for point in rows_cols if point is not None]
@@ -499,7 +658,7 @@ def determine_narr_min_max_row_col(data_bounds, data_path):
 
 
 def determine_gridded_narr_points(debug, gdal_objs, data_bounds,
-                                  data_path):
+                                  data_path, geometry=None):
     """Determine the grid of NARR points which cover the data
 
     Args:
@@ -508,6 +667,8 @@ def determine_gridded_narr_points(debug, gdal_objs, data_bounds,
         data_bounds <DataBoundInfo>: Contains adjusted data boundry
                                      information
         data_path <str>: The directory for the NARR coodinate file
+        geometry <GridGeometry>: Cached grid geometry of the footprint, or
+                                 None to read the NARR coordinate file
 
     Returns:
         grid_points <dict>: Dictionary of the gridded points
@@ -517,25 +678,34 @@ def determine_gridded_narr_points(debug, gdal_objs, data_bounds,
 
     logger = logging.getLogger(__name__)
 
-    # Determine full path to the file
-    data_path = os.path.join(data_path, NARR_COORDINATES_FILENAME)
+    if geometry is not None:
+        points = geometry.points
+        grid_rows = geometry.grid_rows
+        grid_cols = geometry.grid_cols
+        min_max = MinMaxRowColInfo(
+            min_row=min([point.row for point in points]),
+            max_row=max([point.row for point in points]),
+            min_col=min([point.col for point in points]),
+            max_col=max([point.col for point in points]))
+    else:
+        # Determine full path to the file
+        data_path = os.path.join(data_path, NARR_COORDINATES_FILENAME)
 
-    # Determine buffered points
-    min_max = determine_narr_min_max_row_col(data_bounds, data_path)
+        # Determine buffered points
+        min_max = determine_narr_min_max_row_col(data_bounds, data_path)
 
-    grid_rows = min_max.max_row - min_max.min_row + 1
-    grid_cols = min_max.max_col - min_max.min_col + 1
+        grid_rows = min_max.max_row - min_max.min_row + 1
+        grid_cols = min_max.max_col - min_max.min_col + 1
 
-    # Using the mins and maxs read the coordinates again
-    # but keep a complete rectangular grid of them
-    with open(data_path, 'r') as coords_fd:
+        # Using the mins and maxs read the coordinates again
+        # but keep a complete rectangular grid of them
         points = [convert_narr_line_to_point_info(gdal_objs=gdal_objs,
                                                   min_max=min_max,
-                                                  line=line.strip())
-                  for line in coords_fd]
+                                                  coordinate=coordinate)
+                  for coordinate in read_narr_coordinates(data_path)]
 
-    # Filter out the None values (Only keeps the grid we want)
-    points = [point for point in points if point is not None]
+        # Filter out the None values (Only keeps the grid we want)
+        points = [point for point in points if point is not None]
 
     # Determine the final set of grid points
     # As well as initially mark points to run_modtran or not
@@ -557,8 +727,80 @@ def determine_gridded_narr_points(debug, gdal_objs, data_bounds,
     return (grid_points, grid_rows, grid_cols)
 
 
-def generate_point_grid(debug, gdal_objs, data_bounds, data_path):
-    """Creates a point grid file for later processing
+def select_edge_cell(gdal_objs, grid_points, grid_cols, samp, line):
+    """Determines the grid points an edge pixel needs MODTRAN run for
+
+    Args:
+        gdal_objs <GdalInfo>: Contains GDAL objects and static information
+        grid_points <dict>: Dictionary of the gridded points
+        grid_cols <int>: Number of columns in the grid
+        samp <int>: The sample in the data
+        line <int>: The line in the data
+
+    Returns:
+        (<int>, <int>, <int>): The indexes of the grid points
+    """
+
+    cc_point = center_grid_point(gdal_objs, grid_points, samp, line)
+
+    '''
+        UL UC UR
+        CL CC CR
+        LL LC LR
+    '''
+
+    # Figure out all the remaining possible grid points
+    ul_point = cc_point + grid_cols - 1
+    uc_point = ul_point + 1
+    ur_point = uc_point + 1
+    cl_point = cc_point - 1
+    cr_point = cc_point + 1
+    ll_point = cc_point - grid_cols - 1
+    lc_point = ll_point + 1
+    lr_point = lc_point + 1
+
+    # Get all of the distance to the outer grid points
+    ul_dist = grid_point_distance(gdal_objs, grid_points[ul_point],
+                                  samp, line)
+    uc_dist = grid_point_distance(gdal_objs, grid_points[uc_point],
+                                  samp, line)
+    ur_dist = grid_point_distance(gdal_objs, grid_points[ur_point],
+                                  samp, line)
+
+    cl_dist = grid_point_distance(gdal_objs, grid_points[cl_point],
+                                  samp, line)
+    cr_dist = grid_point_distance(gdal_objs, grid_points[cr_point],
+                                  samp, line)
+
+    ll_dist = grid_point_distance(gdal_objs, grid_points[ll_point],
+                                  samp, line)
+    lc_dist = grid_point_distance(gdal_objs, grid_points[lc_point],
+                                  samp, line)
+    lr_dist = grid_point_distance(gdal_objs, grid_points[lr_point],
+                                  samp, line)
+
+    # Determine quadrant by using the average quadrant distances
+
+    avg_dist_ul = (cl_dist + ul_dist + uc_dist) / 3.0
+    avg_dist_ur = (uc_dist + ur_dist + cr_dist) / 3.0
+    avg_dist_lr = (cr_dist + lr_dist + lc_dist) / 3.0
+    avg_dist_ll = (lc_dist + ll_dist + cl_dist) / 3.0
+
+    min_dist = min(avg_dist_ul, avg_dist_ur, avg_dist_lr, avg_dist_ll)
+
+    if min_dist == avg_dist_ul:
+        return (cl_point, ul_point, uc_point)
+    elif min_dist == avg_dist_ur:
+        return (uc_point, ur_point, cr_point)
+    elif min_dist == avg_dist_lr:
+        return (cr_point, lr_point, lc_point)
+    else:
+        return (lc_point, ll_point, cl_point)
+
+
+def select_modtran_points(debug, gdal_objs, data_bounds, data_path,
+                          qa_filename=None, geometry_cache=None):
+    """Determines the grid points and marks those MODTRAN is run for
 
     Args:
         debug <bool>: Perform debug output or not
@@ -566,22 +808,33 @@ def generate_point_grid(debug, gdal_objs, data_bounds, data_path):
         data_bounds <DataBoundInfo>: Contains adjusted data boundry
                                      information
         data_path <str>: The directory for the NARR coodinate file
+        qa_filename <str>: Pixel QA band, to only run MODTRAN for the points
+                           clear pixels need, or None for all valid pixels
+        geometry_cache <str>: Footprint directory of the geometry cache, or
+                              None to not use the cache
 
-    Notes: The file format contains lines of the following information.
-               'Grid_Column Grid_Row Grid_Latitude Grid_Longitude'
-           With the following format.
-               '%d %d %lf %lf'
-
-           Each line in the file represents for the purpose of this
-           application a (row, col) coodinate pair that coinsides with the
-           rows and cols of the NARR data.
+    Returns:
+        grid_points <dict>: Dictionary of the gridded points
+        grid_rows <int>: Number of rows in the grid
+        grid_cols <int>: Number of columns in the grid
+        valid_pixels <int>: Number of pixels which are not fill
     """
 
     logger = logging.getLogger(__name__)
 
+    # The grid points, and the points selected for each edge pixel, of an
+    # earlier scene of the same footprint
+    geometry = None
+    edge_cells = dict()
+    if geometry_cache is not None:
+        geometry = st_geometry_cache.read_grid_geometry(geometry_cache,
+                                                        data_bounds)
+        if geometry is not None:
+            edge_cells = dict(geometry.edge_cells)
+
     # Determine grid points
     (grid_points, grid_rows, grid_cols) = determine_gridded_narr_points(
-        debug, gdal_objs, data_bounds, data_path)
+        debug, gdal_objs, data_bounds, data_path, geometry)
 
     raster_data = (gdal_objs.data_ds.GetRasterBand(1)
                    .ReadAsArray(0, 0, gdal_objs.nsamps, gdal_objs.nlines))
@@ -591,6 +844,28 @@ def generate_point_grid(debug, gdal_objs, data_bounds, data_path):
     # Set all the valid data points to True
     mask[raster_data != gdal_objs.fill_value] = True
     del raster_data
+    valid_pixels = int(np.count_nonzero(mask))
+
+    # Cloud pixels are left as fill by the pixel stage when the points
+    # around them are not run
+    if qa_filename is not None:
+        exclude_cloud(mask, qa_filename)
+        logger.info('Number of clear pixels [{}]'
+                    .format(np.count_nonzero(mask)))
+
+        # The scene completes with fill ST
+        if not np.any(mask):
+            logger.warning('No clear pixels, so MODTRAN is not run for any'
+                           ' point')
+            for point in grid_points:
+                point['run_modtran'] = False
+
+            return (grid_points, grid_rows, grid_cols, valid_pixels)
+
+        skipped = prune_clouded_points(gdal_objs, grid_points, grid_rows,
+                                       grid_cols, mask)
+        logger.info('Number of points skipped with no clear pixels [{}]'
+                    .format(skipped))
 
     # Process through the mask and generate pairs for the left/right edges
     ew_edges = sorted([pair
@@ -617,70 +892,63 @@ def generate_point_grid(debug, gdal_objs, data_bounds, data_path):
     # For each pair of samp/line find the grid points that will be needed for
     # MODTRAN and mark them as "run_modran" = True so that later when MODTRAN
     # is ran only the required points are ran through it
+    computed = 0
     for pair in ew_edges:
-        cc_point = center_grid_point(gdal_objs, grid_points, pair[1], pair[0])
-
-        '''
-            UL UC UR
-            CL CC CR
-            LL LC LR
-        '''
-
-        # Figure out all the remaining possible grid points
-        ul_point = cc_point + grid_cols - 1
-        uc_point = ul_point + 1
-        ur_point = uc_point + 1
-        cl_point = cc_point - 1
-        cr_point = cc_point + 1
-        ll_point = cc_point - grid_cols - 1
-        lc_point = ll_point + 1
-        lr_point = lc_point + 1
-
-        # Get all of the distance to the outer grid points
-        ul_dist = grid_point_distance(gdal_objs, grid_points[ul_point],
-                                      pair[1], pair[0])
-        uc_dist = grid_point_distance(gdal_objs, grid_points[uc_point],
-                                      pair[1], pair[0])
-        ur_dist = grid_point_distance(gdal_objs, grid_points[ur_point],
-                                      pair[1], pair[0])
-
-        cl_dist = grid_point_distance(gdal_objs, grid_points[cl_point],
-                                      pair[1], pair[0])
-        cr_dist = grid_point_distance(gdal_objs, grid_points[cr_point],
-                                      pair[1], pair[0])
-
-        ll_dist = grid_point_distance(gdal_objs, grid_points[ll_point],
-                                      pair[1], pair[0])
-        lc_dist = grid_point_distance(gdal_objs, grid_points[lc_point],
-                                      pair[1], pair[0])
-        lr_dist = grid_point_distance(gdal_objs, grid_points[lr_point],
-                                      pair[1], pair[0])
-
-        # Determine quadrant by using the average quadrant distances
-
-        avg_dist_ul = (cl_dist + ul_dist + uc_dist) / 3.0
-        avg_dist_ur = (uc_dist + ur_dist + cr_dist) / 3.0
-        avg_dist_lr = (cr_dist + lr_dist + lc_dist) / 3.0
-        avg_dist_ll = (lc_dist + ll_dist + cl_dist) / 3.0
-
-        min_dist = min(avg_dist_ul, avg_dist_ur, avg_dist_lr, avg_dist_ll)
-
-        if min_dist == avg_dist_ul:
-            grid_points[cl_point]['run_modtran'] = True
-            grid_points[ul_point]['run_modtran'] = True
-            grid_points[uc_point]['run_modtran'] = True
-        elif min_dist == avg_dist_ur:
-            grid_points[uc_point]['run_modtran'] = True
-            grid_points[ur_point]['run_modtran'] = True
-            grid_points[cr_point]['run_modtran'] = True
-        elif min_dist == avg_dist_lr:
-            grid_points[cr_point]['run_modtran'] = True
-            grid_points[lr_point]['run_modtran'] = True
-            grid_points[lc_point]['run_modtran'] = True
-        else:
-            grid_points[lc_point]['run_modtran'] = True
-            grid_points[ll_point]['run_modtran'] = True
-            grid_points[cl_point]['run_modtran'] = True
+        cell = edge_cells.get(pair)
+        if cell is None:
+            cell = select_edge_cell(gdal_objs, grid_points, grid_cols,
+                                    pair[1], pair[0])
+            edge_cells[pair] = cell
+            computed += 1
+
+        for index in cell:
+            grid_points[index]['run_modtran'] = True
+
+    if geometry_cache is not None:
+        logger.info('Selected the grid points of [{0}] of [{1}] edge pixels'
+                    ' not in the geometry cache'
+                    .format(computed, len(ew_edges)))
+
+        if computed > 0:
+            st_geometry_cache.write_grid_geometry(
+                directory=geometry_cache, data_bounds=data_bounds,
+                points=[point['point'] for point in grid_points],
+                grid_rows=grid_rows, grid_cols=grid_cols,
+                edge_cells=edge_cells)
+
+    return (grid_points, grid_rows, grid_cols, valid_pixels)
+
+
+def generate_point_grid(debug, gdal_objs, data_bounds, data_path,
+                        qa_filename=None, geometry_cache=None):
+    """Creates a point grid file for later processing
+
+    Args:
+        debug <bool>: Perform debug output or not
+        gdal_objs <GdalInfo>: Contains GDAL objects and static information
+        data_bounds <DataBoundInfo>: Contains adjusted data boundry
+                                     information
+        data_path <str>: The directory for the NARR coodinate file
+        qa_filename <str>: Pixel QA band, to only run MODTRAN for the points
+                           clear pixels need, or None for all valid pixels
+        geometry_cache <str>: Footprint directory of the geometry cache, or
+                              None to not use the cache
+
+    Notes: The file format contains lines of the following information.
+               'Grid_Column Grid_Row Grid_Latitude Grid_Longitude'
+           With the following format.
+               '%d %d %lf %lf'
+
+           Each line in the file represents for the purpose of this
+           application a (row, col) coodinate pair that coinsides with the
+           rows and cols of the NARR data.
+    """
+
+    logger = logging.getLogger(__name__)
+
+    (grid_points, grid_rows, grid_cols, dummy) = select_modtran_points(
+        debug, gdal_objs, data_bounds, data_path, qa_filename,
+        geometry_cache)
 
     if debug:
         with open('point_list.txt', 'w') as points_fd:
@@ -759,11 +1027,22 @@ def main():
                                                  gdal_objs=gdal_objs)
     logger.debug(str(data_bounds))
 
+    qa_filename = None
+    if args.clear_sky:
+        qa_filename = find_pixel_qa_filename(espa_metadata)
+
+    geometry_cache = None
+    if args.geometry_cache is not None:
+        geometry_cache = st_geometry_cache.footprint_directory(
+            args.geometry_cache, espa_metadata)
+
     # Generate the point grid
     generate_point_grid(debug=args.debug,
                         gdal_objs=gdal_objs,
                         data_bounds=data_bounds,
-                        data_path=args.data_path)
+                        data_path=args.data_path,
+                        qa_filename=qa_filename,
+                        geometry_cache=geometry_cache)
 
     logger.info('*** Determine Grid Points - Complete ***')
 
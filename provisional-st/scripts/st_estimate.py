@@ -0,0 +1,269 @@
+'''
+    File: st_estimate.py
+
+    Purpose: Estimates the cost of processing a scene before it is run, from
+             the grid points and elevations MODTRAN would be run for, the
+             size of the scene, and the ASTER GED tiles it covers.
+
+             The wall time is predicted from the timings of the previous
+             runs on this node, which are kept in a local history file.
+
+    Project: Land Satellites Data Systems Science Research and Development
+             (LSRD) at the USGS EROS
+
+    License: NASA Open Source Agreement 1.3
+'''
+
+import os
+import glob
+import json
+import logging
+
+import numpy as np
+
+from espa import Metadata
+
+import emissivity_utilities as emis_util
+import st_determine_grid_points as grid
+from st_build_modtran_input import (determine_ground_altitudes,
+                                    TEMP_ALBEDO_PAIRS)
+from estimate_landsat_emissivity import aster_tile_names
+from st_run_modtran import tape5_digest
+
+
+# Predictor names, in the order of the model coefficients
+PREDICTORS = ('modtran_runs_per_core', 'megapixels', 'aster_tiles',
+              'overhead')
+
+# Seconds for each predictor, used until enough runs have been recorded
+NOMINAL_COEFFICIENTS = (30.0, 20.0, 30.0, 60.0)
+
+# The fit uses the most recent runs, and needs several more runs than it has
+# coefficients before it is trusted
+HISTORY_LIMIT = 200
+MINIMUM_HISTORY = 8
+
+
+def scene_pixels(espa_metadata):
+    """Determine the size of the scene from the brightness temperature band
+
+    Args:
+        espa_metadata <espa.Metadata>: The metadata for the data
+
+    Returns:
+        <int>: The number of pixels in the scene
+    """
+
+    for band in espa_metadata.xml_object.bands.band:
+        if (band.get('product') == 'toa_bt' and
+                band.get('category') == 'image'):
+            return int(band.get('nlines')) * int(band.get('nsamps'))
+
+    return 0
+
+
+def scene_features(xml_filename, data_path):
+    """Determine what processing the scene will require
+
+    Only the grid point determination and elevation selection are performed,
+    and nothing is written.
+
+    Args:
+        xml_filename <str>: XML metadata filename
+        data_path <str>: Directory for ST data files
+
+    Returns:
+        <dict>: The MODTRAN run, grid point, elevation, pixel, valid pixel
+                fraction, and ASTER GED tile counts
+    """
+
+    espa_metadata = Metadata()
+    espa_metadata.parse(xml_filename=xml_filename)
+
+    gdal_objs = grid.initialize_gdal_objects(espa_metadata=espa_metadata)
+    data_bounds = grid.determine_adjusted_data_bounds(
+        espa_metadata=espa_metadata, gdal_objs=gdal_objs)
+
+    (grid_points, dummy, dummy, valid_pixels) = grid.select_modtran_points(
+        debug=False, gdal_objs=gdal_objs, data_bounds=data_bounds,
+        data_path=data_path)
+
+    modtran_points = len([point for point in grid_points.values()
+                          if point['run_modtran']])
+
+    ground_altitudes = determine_ground_altitudes(espa_metadata)
+
+    tiles = aster_tile_names(emis_util.bound_info(espa_metadata), data_path)
+
+    pixels = gdal_objs.nlines * gdal_objs.nsamps
+
+    return {'modtran_runs': (modtran_points * len(ground_altitudes) *
+                             len(TEMP_ALBEDO_PAIRS)),
+            'modtran_points': modtran_points,
+            'ground_altitudes': len(ground_altitudes),
+            'pixels': pixels,
+            'valid_fraction': float(valid_pixels) / max(1, pixels),
+            'aster_tiles': len(tiles)}
+
+
+def predictors(features, modtran_process_count):
+    """Build the model predictors for a scene
+
+    Args:
+        features <dict>: The scene features
+        modtran_process_count <int>: Number of MODTRAN runs made at once
+
+    Returns:
+        [<float>]: The predictors in the order of PREDICTORS
+    """
+
+    return [float(features['modtran_runs']) / max(1, modtran_process_count),
+            features['pixels'] / 1000000.0,
+            float(features['aster_tiles']),
+            1.0]
+
+
+def read_history(history_filename, modtran_executor):
+    """Read the recorded runs made with the MODTRAN executor
+
+    Args:
+        history_filename <str>: The run history file
+        modtran_executor <str>: How the MODTRAN runs were made
+
+    Returns:
+        [<dict>]: The most recent records, oldest first
+    """
+
+    logger = logging.getLogger(__name__)
+
+    if not os.path.isfile(history_filename):
+        return list()
+
+    records = list()
+    with open(history_filename, 'r') as history_fd:
+        for line in history_fd:
+            try:
+                record = json.loads(line)
+            except ValueError:
+                logger.warning('Ignoring a malformed record in [{0}]'
+                               .format(history_filename))
+                continue
+
+            if record.get('modtran_executor') == modtran_executor:
+                records.append(record)
+
+    return records[-HISTORY_LIMIT:]
+
+
+def record_run(history_filename, xml_filename, features, core_budget,
+               modtran_process_count, modtran_executor, graph):
+    """Add a completed run to the history
+
+    Args:
+        history_filename <str>: The run history file
+        xml_filename <str>: XML metadata filename
+        features <dict>: The scene features
+        core_budget <int>: Cores available to the stages
+        modtran_process_count <int>: Number of MODTRAN runs made at once
+        modtran_executor <str>: How the MODTRAN runs were made
+        graph <StageGraph>: The stages which were run
+    """
+
+    record = {'xml_filename': os.path.basename(xml_filename),
+              'core_budget': core_budget,
+              'modtran_process_count': modtran_process_count,
+              'modtran_executor': modtran_executor,
+              'wall_time': graph.end_time - graph.start_time,
+              'stages': dict([(stage.name, stage.elapsed())
+                              for stage in graph.stages])}
+    record.update(features)
+
+    # Single line appends keep records from concurrent jobs intact
+    with open(history_filename, 'a') as history_fd:
+        history_fd.write(''.join([json.dumps(record, sort_keys=True), '\n']))
+
+
+def completed_run_features(xml_filename, data_path, tape5_pattern):
+    """Determine the features of a scene which has been processed
+
+    Args:
+        xml_filename <str>: XML metadata filename
+        data_path <str>: Directory for ST data files
+        tape5_pattern <str>: Pattern matching the MODTRAN run inputs
+
+    Returns:
+        <dict>: The MODTRAN run, pixel, and ASTER GED tile counts
+    """
+
+    espa_metadata = Metadata()
+    espa_metadata.parse(xml_filename=xml_filename)
+
+    tiles = aster_tile_names(emis_util.bound_info(espa_metadata), data_path)
+
+    # Clustered points are given the tape5 of their representative, which
+    # is only run once
+    digests = set([tape5_digest(os.path.dirname(filename))
+                   for filename in glob.glob(tape5_pattern)])
+
+    return {'modtran_runs': len(digests),
+            'pixels': scene_pixels(espa_metadata),
+            'aster_tiles': len(tiles)}
+
+
+def fit_coefficients(records):
+    """Fit the model to the recorded runs
+
+    Args:
+        records [<dict>]: The recorded runs
+
+    Returns:
+        [<float>]: The coefficients, or None if there are too few runs
+    """
+
+    if len(records) < MINIMUM_HISTORY:
+        return None
+
+    design = np.array([predictors(record, record['modtran_process_count'])
+                       for record in records])
+    observed = np.array([record['wall_time'] for record in records])
+
+    (coefficients, dummy, rank, dummy) = np.linalg.lstsq(design, observed)
+
+    # Scenes which all look alike do not determine every coefficient
+    if rank < len(PREDICTORS):
+        return None
+
+    return [float(value) for value in coefficients]
+
+
+def predict(features, modtran_process_count, modtran_executor,
+            history_filename):
+    """Predict the wall time for processing the scene
+
+    Args:
+        features <dict>: The scene features
+        modtran_process_count <int>: Number of MODTRAN runs made at once
+        modtran_executor <str>: How the MODTRAN runs will be made
+        history_filename <str>: The run history file
+
+    Returns:
+        <dict>: The predicted wall time, the coefficients used, and the
+                number of recorded runs they were calibrated from
+    """
+
+    records = read_history(history_filename, modtran_executor)
+
+    coefficients = fit_coefficients(records)
+    calibration_runs = len(records)
+    if coefficients is None:
+        coefficients = list(NOMINAL_COEFFICIENTS)
+        calibration_runs = 0
+
+    wall_time = sum([coefficient * value
+                     for (coefficient, value)
+                     in zip(coefficients,
+                            predictors(features, modtran_process_count))])
+
+    return {'wall_time': max(0.0, wall_time),
+            'coefficients': dict(zip(PREDICTORS, coefficients)),
+            'calibration_runs': calibration_runs}
@@ -29,3 +29,7 @@ class NoTilesError(STError):
 class InaccessibleTileError(STError):
     """Exception to use for not being able to access a tile"""
     pass
+
+class StageGraphError(STError):
+    """Exception to use for stages which can not be scheduled"""
+    pass
@@ -20,6 +20,7 @@ from collections import namedtuple
 
 from espa import Metadata
 import st_utilities as util
+import st_trace
 
 
 PARMS_TO_EXTRACT = ['HGT', 'SPFH', 'TMP']
@@ -168,7 +169,9 @@ def extract_from_grib(aux_set):
             # Extract the pressure data and raise any errors
             output = ''
             try:
-                output = util.System.execute_cmd(cmd)
+                with st_trace.span('wgrib', 'narr', grib=aux_set.grb,
+                                   record=record, pressure=pressure):
+                    output = util.System.execute_cmd(cmd)
             except Exception:
                 logger.error('Failed to unpack NARR Grib data')
                 raise
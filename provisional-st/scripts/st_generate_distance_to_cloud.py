@@ -43,14 +43,8 @@ def extract_raster_data(name, band_number):
         <raster>: 2D raster array data
     """
 
-    dataset = gdal.Open(name)
-    if dataset is None:
-        raise RuntimeError('GDAL failed to open {0}'.format(name))
-
-    raster = (dataset.GetRasterBand(band_number)
-              .ReadAsArray(0, 0, dataset.RasterXSize, dataset.RasterYSize))
-
-    return raster
+    # Bands handed over in memory by an earlier stage are used directly
+    return util.RasterCache.read(name, band_number)
 
 
 def retrieve_command_line_arguments():
@@ -199,6 +193,9 @@ def write_distance_to_cloud_product(samps, lines, transform, wkt, no_data_value,
                                   no_data_value,
                                   gdal.GDT_Float32)
 
+    # Keep it available for any later stage in this process
+    util.RasterCache.put(filename, 1, file_data, gdal.GDT_Float32)
+
     hdr_filename = filename.replace('.img', '.hdr')
     logger.info('Updating {0}'.format(hdr_filename))
     util.Geo.update_envi_header(hdr_filename, no_data_value)
@@ -278,27 +275,27 @@ def add_cloud_distance_band_to_xml(espa_metadata, filename, sensor_code,
     # Append the band to the XML
     espa_metadata.xml_object.bands.append(distance_band)
 
-    # Validate the XML
-    espa_metadata.validate()
-
-    # Write it to the XML file
-    espa_metadata.write()
+    # Validate and write the XML, unless a transaction defers it
+    util.MetadataTransaction.save(espa_metadata)
 
 
-def generate_distance(xml_filename, no_data_value):
+def generate_distance(xml_filename, no_data_value, espa_metadata=None):
     """Provides the main processing algorithm for generating the distance
        to cloud product.
 
     Args:
         xml_filename <str>: Filename for the ESPA Metadata XML
         no_data_value <float>: No data (fill) value to use
+        espa_metadata <espa.Metadata>: Parsed XML metadata to use instead
+                                       of parsing xml_filename
     """
 
     logger = logging.getLogger(__name__)
 
-    # XML metadata
-    espa_metadata = Metadata(xml_filename)
-    espa_metadata.parse()
+    # XML metadata, unless the caller already has it parsed
+    if espa_metadata is None:
+        espa_metadata = Metadata(xml_filename)
+        espa_metadata.parse()
 
     src_info = retrieve_metadata_information(espa_metadata)
 
@@ -14,20 +14,36 @@
 
 import os
 import sys
+import json
 import logging
 import glob
 import shutil
+from functools import partial
 from argparse import ArgumentParser
 from ConfigParser import ConfigParser
 
+from espa import Metadata
+
 import st_utilities as util
 
-from st_grid_points import (GRID_POINT_HEADER_NAME,
-                             GRID_POINT_BINARY_NAME)
+from st_store import (GRID_POINT_STORE_NAME, ELEVATION_STORE_NAME,
+                      SCENE_ATMOSPHERE_STORE_NAME)
 
-from st_build_modtran_input import PARAMETERS
+from st_build_modtran_input import (PARAMETERS, CLUSTER_NAME,
+                                    parse_profile_tolerance)
+from st_run_modtran import LOCAL_EXECUTOR, QUEUE_EXECUTOR
+from st_surrogate import SURROGATE_PARAMETERS_NAME, SURROGATE_REPORT_NAME
 
 import build_st_data
+import st_pipeline
+import st_manifest
+import st_estimate
+import st_window
+import st_preview
+import st_geometry_cache
+import st_trace
+from st_stage_graph import StageGraph, METADATA_READ, METADATA_WRITE
+from st_node_scheduler import SlotLease, JobRegistration
 
 
 def retrieve_command_line_arguments():
@@ -58,6 +74,98 @@ def retrieve_command_line_arguments():
                         required=False, default=False,
                         help='Keep any temporary files generated')
 
+    parser.add_argument('--in-process',
+                        action='store_true', dest='in_process',
+                        required=False, default=False,
+                        help='Run the python processing stages within this'
+                             ' process, sharing the XML metadata')
+
+    parser.add_argument('--in-memory',
+                        action='store_true', dest='in_memory',
+                        required=False, default=False,
+                        help='Hand raster bands between the stages in memory'
+                             ' (implies --in-process)')
+
+    parser.add_argument('--rerun-all',
+                        action='store_true', dest='rerun_all',
+                        required=False, default=False,
+                        help='Run every stage, instead of reusing results'
+                             ' kept from a previous run')
+
+    parser.add_argument('--clear-sky',
+                        action='store_true', dest='clear_sky',
+                        required=False, default=False,
+                        help='Only run MODTRAN for the points clear pixels'
+                             ' need, leaving cloud pixels away from them as'
+                             ' fill')
+
+    parser.add_argument('--cluster-tolerance',
+                        action='store', dest='cluster_tolerance',
+                        required=False, default=None,
+                        metavar='TEMPERATURE,HUMIDITY,HEIGHT',
+                        help='Run MODTRAN once for points whose profiles are'
+                             ' within these K, %% and km of each other at'
+                             ' every pressure layer')
+
+    parser.add_argument('--surrogate',
+                        action='store', dest='surrogate',
+                        required=False, default=None, metavar='TABLE',
+                        help='Predict the atmospheric parameters at the'
+                             ' MODTRAN points from this table built by'
+                             ' st_build_surrogate.py, instead of running'
+                             ' MODTRAN')
+
+    parser.add_argument('--all-thermal-bands',
+                        action='store_true', dest='all_thermal_bands',
+                        required=False, default=False,
+                        help='Also generate the atmospheric parameter bands'
+                             ' of Landsat 8 band 11, sharing the pixel'
+                             ' interpolation with band 10.  Requires {0} in'
+                             ' the ST_DATA_DIR directory'
+                             .format(B11_SPECTRAL_RESPONSE_NAME))
+
+    parser.add_argument('--map-space-cells',
+                        action='store_true', dest='map_space_cells',
+                        required=False, default=False,
+                        help='Select the grid cell each pixel is'
+                             ' interpolated in from map coordinates, instead'
+                             ' of converting every pixel to longitude and'
+                             ' latitude')
+
+    parser.add_argument('--geometry-cache',
+                        action='store', dest='geometry_cache',
+                        required=False, default=None, metavar='DIRECTORY',
+                        help='Reuse the grid points and pixel grid cells of'
+                             ' earlier scenes of the same footprint, kept in'
+                             ' this directory')
+
+    parser.add_argument('--window',
+                        action='store', dest='window',
+                        required=False, default=None,
+                        metavar='LINE0,SAMPLE0,LINES,SAMPLES',
+                        help='Only process a window of the scene, which is'
+                             ' created in its own directory')
+
+    parser.add_argument('--preview',
+                        action='store', dest='preview', type=int,
+                        required=False, default=None, metavar='N',
+                        help='Only process a preview of the scene, averaging'
+                             ' N by N pixels, which is created in its own'
+                             ' directory with a quick look PNG')
+
+    parser.add_argument('--estimate',
+                        action='store_true', dest='estimate',
+                        required=False, default=False,
+                        help='Only estimate the cost of processing the scene'
+                             ' and write it to {0}'.format(ESTIMATE_FILENAME))
+
+    parser.add_argument('--trace',
+                        action='store_true', dest='trace',
+                        required=False, default=False,
+                        help='Trace the stages and the processes they run,'
+                             ' writing {0} for chrome://tracing'
+                             .format(st_trace.TRACE_FILENAME))
+
     parser.add_argument('--debug',
                         action='store_true', dest='debug',
                         required=False, default=False,
@@ -69,9 +177,59 @@ def retrieve_command_line_arguments():
     if args.xml_filename is None:
         raise Exception('--xml must be specified on the command line')
 
+    if args.in_memory:
+        args.in_process = True
+
+    if args.window is not None:
+        args.window = st_window.parse_window(args.window)
+
+    if args.cluster_tolerance is not None:
+        args.cluster_tolerance = parse_profile_tolerance(
+            args.cluster_tolerance)
+
+    # Made absolute before the working directory changes to that of a window
+    # or preview scene
+    if args.surrogate is not None:
+        args.surrogate = os.path.abspath(args.surrogate)
+
+        # The surrogate only predicts the reference thermal band
+        if args.all_thermal_bands:
+            raise Exception('--surrogate and --all-thermal-bands can not be'
+                            ' combined')
+
+    if args.all_thermal_bands:
+        check_all_thermal_bands()
+
+    if args.geometry_cache is not None:
+        args.geometry_cache = os.path.abspath(args.geometry_cache)
+
+    if args.preview is not None:
+        if args.preview < 2:
+            raise Exception('--preview must be at least 2')
+        if args.window is not None:
+            raise Exception('--preview and --window can not be combined')
+
     return args
 
 
+def check_all_thermal_bands():
+    """Verify the band 11 spectral response is present, before any stage
+       is started, since it is not part of the static data
+
+    Raises:
+        Exception(<str>)
+    """
+
+    st_data_dir = os.environ.get('ST_DATA_DIR')
+    if st_data_dir is None:
+        raise Exception('[ST_DATA_DIR] not found in environment')
+
+    srs_filename = os.path.join(st_data_dir, B11_SPECTRAL_RESPONSE_NAME)
+    if not os.path.isfile(srs_filename):
+        raise Exception('--all-thermal-bands requires [{0}], which is not'
+                        ' included in the static data'.format(srs_filename))
+
+
 def get_cfg_file_path(filename):
     """Build the full path to the config file
 
@@ -121,13 +279,16 @@ def retrieve_cfg(cfg_filename):
     return cfg
 
 
-def determine_grid_points(xml_filename, data_path, debug):
+def determine_grid_points(xml_filename, data_path, debug, clear_sky=False,
+                          geometry_cache=None):
     """Determines the grid points to utilize
 
     Args:
         xml_filename <str>: XML metadata filename
         data_path <str>: Directory for ST data files
         debug <bool>: Debug logging and processing
+        clear_sky <bool>: Only run MODTRAN for points near clear pixels
+        geometry_cache <str>: Directory of the geometry cache, or None
     """
 
     output = ''
@@ -136,6 +297,12 @@ def determine_grid_points(xml_filename, data_path, debug):
                '--xml', xml_filename,
                '--data_path', data_path]
 
+        if clear_sky:
+            cmd.append('--clear-sky')
+
+        if geometry_cache is not None:
+            cmd.extend(['--geometry-cache', geometry_cache])
+
         if debug:
             cmd.append('--debug')
 
@@ -171,13 +338,17 @@ def extract_auxiliary_narr_data(xml_filename, aux_path, debug):
             logger.info(output)
 
 
-def build_modtran_input(xml_filename, data_path, debug):
+def build_modtran_input(xml_filename, data_path, debug,
+                        cluster_tolerance=None):
     """Determines the grid points to utilize
 
     Args:
         xml_filename <str>: XML metadata filename
         data_path <str>: Directory for ST data files
         debug <bool>: Debug logging and processing
+        cluster_tolerance <ProfileTolerance>: Largest profile differences of
+                                              points sharing MODTRAN runs,
+                                              or None to run every point
     """
 
     output = ''
@@ -186,6 +357,11 @@ def build_modtran_input(xml_filename, data_path, debug):
                '--xml', xml_filename,
                '--data_path', data_path]
 
+        if cluster_tolerance is not None:
+            cmd.extend(['--cluster-tolerance',
+                        ','.join([repr(value)
+                                  for value in cluster_tolerance])])
+
         if debug:
             cmd.append('--debug')
 
@@ -240,20 +416,27 @@ def generate_emissivity_products(xml_filename, server_name, server_path,
             logger.info(output)
 
 
-def run_modtran(modtran_data_path, process_count, debug):
+def run_modtran(modtran_data_path, process_count, debug,
+                executor=LOCAL_EXECUTOR, queue_directory=None):
     """Determines the grid points to utilize
 
     Args:
         modtran_data_path <str>: Directory for the MODTRAN 'DATA' files
-        process_count <str>: Number of processes to use
+        process_count <int>: Number of processes to use
         debug <bool>: Debug logging and processing
+        executor <str>: How the MODTRAN runs are made
+        queue_directory <str>: Work queue directory for the queue executor
     """
 
     output = ''
     try:
         cmd = ['st_run_modtran.py',
                '--modtran_data_path', modtran_data_path,
-               '--process_count', process_count]
+               '--process_count', str(process_count),
+               '--executor', executor]
+
+        if queue_directory is not None:
+            cmd.extend(['--queue_directory', queue_directory])
 
         if debug:
             cmd.append('--debug')
@@ -265,6 +448,101 @@ def run_modtran(modtran_data_path, process_count, debug):
             logger.info(output)
 
 
+def run_surrogate(xml_filename, table_filename, debug):
+    """Predict the MODTRAN point parameters from a surrogate table
+
+    Args:
+        xml_filename <str>: XML metadata filename
+        table_filename <str>: The surrogate table
+        debug <bool>: Debug logging and processing
+    """
+
+    output = ''
+    try:
+        cmd = ['st_surrogate.py',
+               '--xml', xml_filename,
+               '--table', table_filename]
+
+        if debug:
+            cmd.append('--debug')
+
+        output = util.System.execute_cmd(' '.join(cmd))
+    finally:
+        if len(output) > 0:
+            logger = logging.getLogger(__name__)
+            logger.info(output)
+
+
+def generate_atmospheric_parameters(xml_filename, debug,
+                                    point_parameters=None,
+                                    all_thermal_bands=False,
+                                    geometry_cache=None,
+                                    map_space_cells=False):
+    """Generate the thermal, upwelled, and downwelled radiance bands as well
+       as the atmospheric transmittance band
+
+    Args:
+        xml_filename <str>: XML metadata filename
+        debug <bool>: Debug logging and processing
+        point_parameters <str>: File of the point parameters to use instead
+                                of the MODTRAN results
+        all_thermal_bands <bool>: Also generate the bands of Landsat 8
+                                  band 11
+        geometry_cache <str>: Directory of the geometry cache, or None
+        map_space_cells <bool>: Select the interpolation cells in map
+                                coordinates
+    """
+
+    logger = logging.getLogger(__name__)
+
+    cmd = ['st_atmospheric_parameters', '--xml', xml_filename]
+    if point_parameters is not None:
+        cmd.extend(['--point-parameters', point_parameters])
+    if all_thermal_bands:
+        cmd.append('--all-thermal-bands')
+    if geometry_cache is not None:
+        espa_metadata = Metadata(xml_filename)
+        espa_metadata.parse()
+        cmd.extend(['--geometry-cache', st_geometry_cache.footprint_directory(
+            geometry_cache, espa_metadata)])
+    if map_space_cells:
+        cmd.append('--map-space-cells')
+    if debug:
+        cmd.append('--debug')
+
+    cmd = ' '.join(cmd)
+    output = ''
+    try:
+        logger.info('Calling [{0}]'.format(cmd))
+        with SlotLease(slots=1):
+            output = util.System.execute_cmd(cmd)
+    except Exception:
+        logger.error('Failed creating atmospheric parameters and'
+                     ' generating intermediate data')
+        raise
+    finally:
+        if len(output) > 0:
+            logger.info(output)
+
+
+def generate_surface_temperature(xml_filename):
+    """Generate the Surface Temperature band
+
+    Args:
+        xml_filename <str>: XML metadata filename
+    """
+
+    logger = logging.getLogger(__name__)
+
+    try:
+        current_processor = build_st_data.BuildSTData(
+            xml_filename=xml_filename)
+        current_processor.generate_data()
+    except Exception:
+        logger.error('Failed processing Surface Temperature')
+        raise
+
+
 def generate_distance_to_cloud(xml_filename, debug):
     """Run the tool to create the distance to cloud band
 
@@ -334,21 +612,75 @@ def convert_intermediate_bands(xml_filename, debug):
             logger.info(output)
 
 
-def cleanup_temporary_data():
-    """Cleanup/remove all the ST temporary files and directories 
+# Temporary files and directories, the text point parameters only written
+# with --debug
+ATMOSPHERE_PARAMETERS_NAME = 'atmospheric_parameters.txt'
+USED_POINTS_NAME = 'used_points.txt'
+EMISSIVITY_HEADER_NAME = '*_emis.img.aux.xml'
+EMISSIVITY_STDEV_HEADER_NAME = '*_emis_stdev.img.aux.xml'
+POINT_DIRECTORY_PATTERN = ('[0-9][0-9][0-9]_[0-9][0-9][0-9]_'
+                           '[0-9][0-9][0-9]_[0-9][0-9][0-9]')
+TAPE5_PATTERN = os.path.join(POINT_DIRECTORY_PATTERN, '*', '*', '*',
+                             'tape5')
+MODTRAN_RESULTS_PATTERN = os.path.join(POINT_DIRECTORY_PATTERN,
+                                       '*', '*', '*', 'st_modtran.*')
+
+# Band file patterns, completed by adding an extension
+EMISSIVITY_PATTERN = '*_emis.'
+EMISSIVITY_STDEV_PATTERN = '*_emis_stdev.'
+ATMOSPHERIC_TRANSMITTANCE_PATTERN = '*_st_atmospheric_transmittance.'
+DOWNWELLED_RADIANCE_PATTERN = '*_st_downwelled_radiance.'
+UPWELLED_RADIANCE_PATTERN = '*_st_upwelled_radiance.'
+THERMAL_RADIANCE_PATTERN = '*_st_thermal_radiance.'
+CLOUD_DISTANCE_PATTERN = '*_st_cloud_distance.'
+SURFACE_TEMPERATURE_PATTERN = '*_st.'
+UNCERTAINTY_PATTERN = '*_st_uncertainty.'
+
+# The Landsat 8 band 11 spectral response, which --all-thermal-bands needs
+# and the static data does not include
+B11_SPECTRAL_RESPONSE_NAME = 'L8_B11_Spectral_Response.txt'
+
+# The Landsat 8 band 11 bands made with --all-thermal-bands
+BAND_11_PATTERNS = ['*_st_thermal_radiance_b11.',
+                    '*_st_atmospheric_transmittance_b11.',
+                    '*_st_upwelled_radiance_b11.',
+                    '*_st_downwelled_radiance_b11.']
+
+INTERMEDIATE_PATTERNS = [EMISSIVITY_PATTERN, EMISSIVITY_STDEV_PATTERN,
+                         ATMOSPHERIC_TRANSMITTANCE_PATTERN,
+                         DOWNWELLED_RADIANCE_PATTERN,
+                         UPWELLED_RADIANCE_PATTERN,
+                         THERMAL_RADIANCE_PATTERN,
+                         CLOUD_DISTANCE_PATTERN] + BAND_11_PATTERNS
+
+
+def band_files(patterns):
+    """The image and header filename patterns for the band patterns
+
+    Args:
+        patterns [<str>]: Band file patterns without an extension
+
+    Returns:
+        [<str>]: Filename patterns
     """
 
-    GRID_POINT_ELEVATION_NAME = 'grid_elevations.txt'
-    MODTRAN_ELEVATION_NAME = 'modtran_elevations.txt'
-    ATMOSPHERE_PARAMETERS_NAME = 'atmospheric_parameters.txt'
-    USED_POINTS_NAME = 'used_points.txt'
-    EMISSIVITY_HEADER_NAME = '*_emis.img.aux.xml'
-    EMISSIVITY_STDEV_HEADER_NAME = '*_emis_stdev.img.aux.xml'
+    return [''.join([pattern, extension])
+            for pattern in patterns
+            for extension in ('img', 'hdr')]
+
+
+def cleanup_temporary_data(manifests):
+    """Cleanup/remove all the ST temporary files and directories 
+
+    Args:
+        manifests <ManifestStore>: Stage manifests, which are also temporary
+    """
 
     # File cleanup
-    cleanup_list = [GRID_POINT_HEADER_NAME, GRID_POINT_BINARY_NAME, 
-                    GRID_POINT_ELEVATION_NAME, MODTRAN_ELEVATION_NAME,
-                    ATMOSPHERE_PARAMETERS_NAME, USED_POINTS_NAME]
+    cleanup_list = [GRID_POINT_STORE_NAME, ELEVATION_STORE_NAME,
+                    SCENE_ATMOSPHERE_STORE_NAME,
+                    ATMOSPHERE_PARAMETERS_NAME, USED_POINTS_NAME,
+                    CLUSTER_NAME, SURROGATE_PARAMETERS_NAME]
 
     for filename in cleanup_list:
         if os.path.exists(filename):
@@ -362,45 +694,518 @@ def cleanup_temporary_data():
             os.unlink(filename)
 
     # Directory cleanup
-    for directory in glob.glob('[0-9][0-9][0-9]_[0-9][0-9][0-9]_'
-                               '[0-9][0-9][0-9]_[0-9][0-9][0-9]'):
+    for directory in glob.glob(POINT_DIRECTORY_PATTERN):
         shutil.rmtree(directory)
 
     for directory in PARAMETERS:
-        if os.path.exists(directory):
+        # A batch run links these to the NARR data shared between scenes
+        if os.path.islink(directory):
+            os.unlink(directory)
+        elif os.path.exists(directory):
             shutil.rmtree(directory)
 
+    # Nothing left to reuse, so all of the manifests go as well
+    manifests.remove(ALL_STAGES)
+
 
-def cleanup_intermediate_bands():
+def cleanup_intermediate_bands(manifests):
     """Cleanup/remove the intermediate bands used to make the ST band
+
+    Args:
+        manifests <ManifestStore>: Stage manifests
     """
 
-    # File cleanup
-    EMISSIVITY_PATTERN = '*_emis.'
-    EMISSIVITY_STDEV_PATTERN = '*_emis_stdev.'
-    ATMOSPHERIC_TRANSMITTANCE_PATTERN = '*_st_atmospheric_transmittance.'
-    DOWNWELLED_RADIANCE_PATTERN = '*_st_downwelled_radiance.'
-    UPWELLED_RADIANCE_PATTERN = '*_st_upwelled_radiance.'
-    THERMAL_RADIANCE_PATTERN = '*_st_thermal_radiance.'
-    CLOUD_DISTANCE_PATTERN = '*_st_cloud_distance.'
+    # Only cleanup these extensions
+    for filename in st_manifest.expand_patterns(
+            band_files(INTERMEDIATE_PATTERNS)):
+        os.unlink(filename)
+
+    # The stages which produced the bands can no longer be reused
+    manifests.remove([STAGE_EMISSIVITY, STAGE_DISTANCE_TO_CLOUD,
+                      STAGE_ATMOSPHERIC_PARAMETERS, STAGE_CONVERT])
+
+
+# Processing stages
+STAGE_GRID_POINTS = 'determine_grid_points'
+STAGE_NARR = 'extract_auxiliary_narr_data'
+STAGE_MODTRAN_INPUT = 'build_modtran_input'
+STAGE_EMISSIVITY = 'generate_emissivity_products'
+STAGE_MODTRAN = 'run_modtran'
+STAGE_ATMOSPHERIC_PARAMETERS = 'generate_atmospheric_parameters'
+STAGE_SURFACE_TEMPERATURE = 'generate_surface_temperature'
+STAGE_DISTANCE_TO_CLOUD = 'generate_distance_to_cloud'
+STAGE_QA = 'generate_qa'
+STAGE_CONVERT = 'convert_intermediate_bands'
+
+ALL_STAGES = [STAGE_GRID_POINTS, STAGE_NARR, STAGE_MODTRAN_INPUT,
+              STAGE_EMISSIVITY, STAGE_MODTRAN, STAGE_ATMOSPHERIC_PARAMETERS,
+              STAGE_SURFACE_TEMPERATURE, STAGE_DISTANCE_TO_CLOUD, STAGE_QA,
+              STAGE_CONVERT]
+
+# Bands each stage adds to the XML
+STAGE_BANDS = {
+    STAGE_EMISSIVITY: [EMISSIVITY_PATTERN, EMISSIVITY_STDEV_PATTERN],
+    STAGE_DISTANCE_TO_CLOUD: [CLOUD_DISTANCE_PATTERN],
+    STAGE_ATMOSPHERIC_PARAMETERS: [THERMAL_RADIANCE_PATTERN,
+                                   ATMOSPHERIC_TRANSMITTANCE_PATTERN,
+                                   UPWELLED_RADIANCE_PATTERN,
+                                   DOWNWELLED_RADIANCE_PATTERN] +
+                                  BAND_11_PATTERNS,
+    STAGE_SURFACE_TEMPERATURE: [SURFACE_TEMPERATURE_PATTERN],
+    STAGE_QA: [UNCERTAINTY_PATTERN]
+}
+
+
+def command_stage_functions(xml_filename, data_path, aux_path,
+                            modtran_data_path, modtran_process_count,
+                            server_name, server_path, debug,
+                            modtran_executor=LOCAL_EXECUTOR,
+                            modtran_queue_directory=None, clear_sky=False,
+                            cluster_tolerance=None, surrogate=None,
+                            all_thermal_bands=False, geometry_cache=None,
+                            map_space_cells=False):
+    """Stage functions which run each stage as its own application
 
-    # Cleanup file patterns.
-    cleanup_list = [EMISSIVITY_PATTERN, EMISSIVITY_STDEV_PATTERN,
-                    ATMOSPHERIC_TRANSMITTANCE_PATTERN,
-                    DOWNWELLED_RADIANCE_PATTERN, UPWELLED_RADIANCE_PATTERN,
-                    THERMAL_RADIANCE_PATTERN, CLOUD_DISTANCE_PATTERN]
+    Returns:
+        <dict>: Stage name to function
+    """
 
-    # Only cleanup these extensions
-    extensions = ('hdr', 'img')
-    for extension in extensions:
-        for pattern in cleanup_list:
-            pattern += extension
-            for filename in glob.glob(pattern):
-                os.unlink(filename)
+    functions = {
+        STAGE_GRID_POINTS:
+            partial(determine_grid_points, xml_filename=xml_filename,
+                    data_path=data_path, debug=debug, clear_sky=clear_sky,
+                    geometry_cache=geometry_cache),
+        STAGE_NARR:
+            partial(extract_auxiliary_narr_data, xml_filename=xml_filename,
+                    aux_path=aux_path, debug=debug),
+        STAGE_MODTRAN_INPUT:
+            partial(build_modtran_input, xml_filename=xml_filename,
+                    data_path=data_path, debug=debug,
+                    cluster_tolerance=cluster_tolerance),
+        STAGE_EMISSIVITY:
+            partial(generate_emissivity_products, xml_filename=xml_filename,
+                    server_name=server_name, server_path=server_path,
+                    debug=debug),
+        STAGE_MODTRAN:
+            partial(run_modtran, modtran_data_path=modtran_data_path,
+                    process_count=modtran_process_count, debug=debug,
+                    executor=modtran_executor,
+                    queue_directory=modtran_queue_directory),
+        STAGE_ATMOSPHERIC_PARAMETERS:
+            partial(generate_atmospheric_parameters,
+                    xml_filename=xml_filename, debug=debug,
+                    all_thermal_bands=all_thermal_bands,
+                    geometry_cache=geometry_cache,
+                    map_space_cells=map_space_cells),
+        STAGE_SURFACE_TEMPERATURE:
+            partial(generate_surface_temperature, xml_filename=xml_filename),
+        STAGE_DISTANCE_TO_CLOUD:
+            partial(generate_distance_to_cloud, xml_filename=xml_filename,
+                    debug=debug),
+        STAGE_QA:
+            partial(generate_qa, xml_filename=xml_filename, debug=debug),
+        STAGE_CONVERT:
+            partial(convert_intermediate_bands, xml_filename=xml_filename,
+                    debug=debug)
+    }
+
+    # The surrogate takes the place of the MODTRAN runs
+    if surrogate is not None:
+        functions[STAGE_MODTRAN] = partial(
+            run_surrogate, xml_filename=xml_filename,
+            table_filename=surrogate, debug=debug)
+        functions[STAGE_ATMOSPHERIC_PARAMETERS] = partial(
+            generate_atmospheric_parameters, xml_filename=xml_filename,
+            debug=debug, point_parameters=SURROGATE_PARAMETERS_NAME,
+            geometry_cache=geometry_cache, map_space_cells=map_space_cells)
+
+    return functions
+
+
+def pipeline_stage_functions(context, data_path, aux_path, modtran_data_path,
+                             modtran_process_count, server_name,
+                             server_path, modtran_executor=LOCAL_EXECUTOR,
+                             modtran_queue_directory=None, clear_sky=False,
+                             cluster_tolerance=None, surrogate=None,
+                             all_thermal_bands=False, geometry_cache=None,
+                             map_space_cells=False):
+    """Stage functions which run each stage within this process
+
+    Returns:
+        <dict>: Stage name to function
+    """
+
+    functions = {
+        STAGE_GRID_POINTS:
+            partial(st_pipeline.determine_grid_points, context,
+                    data_path=data_path, clear_sky=clear_sky,
+                    geometry_cache=geometry_cache),
+        STAGE_NARR:
+            partial(st_pipeline.extract_auxiliary_narr_data, context,
+                    aux_path=aux_path),
+        STAGE_MODTRAN_INPUT:
+            partial(st_pipeline.build_modtran_input, context,
+                    data_path=data_path,
+                    cluster_tolerance=cluster_tolerance),
+        STAGE_EMISSIVITY:
+            partial(st_pipeline.generate_emissivity_products, context,
+                    server_name=server_name, server_path=server_path),
+        STAGE_MODTRAN:
+            partial(st_pipeline.run_modtran, context,
+                    modtran_data_path=modtran_data_path,
+                    process_count=modtran_process_count,
+                    executor=modtran_executor,
+                    queue_directory=modtran_queue_directory),
+        STAGE_ATMOSPHERIC_PARAMETERS:
+            partial(st_pipeline.generate_atmospheric_parameters, context,
+                    all_thermal_bands=all_thermal_bands,
+                    geometry_cache=geometry_cache,
+                    map_space_cells=map_space_cells),
+        STAGE_SURFACE_TEMPERATURE:
+            partial(st_pipeline.generate_surface_temperature, context),
+        STAGE_DISTANCE_TO_CLOUD:
+            partial(st_pipeline.generate_distance_to_cloud, context),
+        STAGE_QA:
+            partial(st_pipeline.generate_qa, context),
+        STAGE_CONVERT:
+            partial(st_pipeline.convert_intermediate_bands, context)
+    }
+
+    if surrogate is not None:
+        functions[STAGE_MODTRAN] = partial(
+            st_pipeline.run_surrogate, context, table_filename=surrogate)
+        functions[STAGE_ATMOSPHERIC_PARAMETERS] = partial(
+            st_pipeline.generate_atmospheric_parameters, context,
+            point_parameters=SURROGATE_PARAMETERS_NAME,
+            geometry_cache=geometry_cache, map_space_cells=map_space_cells)
+
+    return functions
+
+
+def build_stage_graph(functions, core_budget, modtran_process_count,
+                      manifests, settings, convert, stage_names=None,
+                      progress=None, surrogate=False):
+    """Define the stages and their dependencies
+
+    Emissivity and distance to cloud only depend on the input bands, so they
+    are free to run while MODTRAN does.  Every stage which adds a band
+    updates the XML metadata, so those are kept from overlapping each other.
+
+    Args:
+        functions <dict>: Stage name to function
+        core_budget <int>: Total number of cores the stages may use
+        modtran_process_count <int>: Number of processes MODTRAN uses
+        manifests <ManifestStore>: Results recorded by previous runs
+        settings <dict>: Stage name to the configuration it depends on
+        convert <bool>: Convert the intermediate bands
+        stage_names [<str>]: Only define these stages, which must include
+                             everything they depend on
+        progress <function>: Called as stages complete
+        surrogate <bool>: The MODTRAN stage predicts the point parameters
+                          from a surrogate table
+
+    Returns:
+        <StageGraph>: The stages to run
+    """
+
+    graph = StageGraph(core_budget=core_budget, manifests=manifests,
+                       progress=progress)
+
+    def add_stage(name, function, **kwargs):
+        if stage_names is None or name in stage_names:
+            graph.add_stage(name, function, **kwargs)
+
+    grid_point_files = [GRID_POINT_STORE_NAME]
+    narr_files = [os.path.join(directory, '*') for directory in PARAMETERS]
+    elevation_files = [ELEVATION_STORE_NAME]
+    atmospheric_bands = STAGE_BANDS[STAGE_ATMOSPHERIC_PARAMETERS]
+    emissivity_bands = STAGE_BANDS[STAGE_EMISSIVITY]
+
+    modtran_cores = modtran_process_count
+    modtran_outputs = [MODTRAN_RESULTS_PATTERN]
+    if surrogate:
+        modtran_cores = 1
+        modtran_outputs = [SURROGATE_PARAMETERS_NAME, SURROGATE_REPORT_NAME]
+
+    add_stage(STAGE_GRID_POINTS, functions[STAGE_GRID_POINTS],
+              metadata_access=METADATA_READ,
+              outputs=grid_point_files,
+              settings=settings[STAGE_GRID_POINTS])
+
+    add_stage(STAGE_NARR, functions[STAGE_NARR],
+              metadata_access=METADATA_READ,
+              outputs=narr_files,
+              settings=settings[STAGE_NARR])
+
+    add_stage(STAGE_MODTRAN_INPUT, functions[STAGE_MODTRAN_INPUT],
+              depends_on=(STAGE_GRID_POINTS, STAGE_NARR),
+              metadata_access=METADATA_READ,
+              inputs=grid_point_files + narr_files,
+              outputs=elevation_files + [TAPE5_PATTERN],
+              settings=settings[STAGE_MODTRAN_INPUT])
+
+    add_stage(STAGE_MODTRAN, functions[STAGE_MODTRAN],
+              depends_on=(STAGE_MODTRAN_INPUT,),
+              cores=modtran_cores,
+              inputs=[TAPE5_PATTERN],
+              outputs=modtran_outputs,
+              settings=settings[STAGE_MODTRAN])
+
+    add_stage(STAGE_EMISSIVITY, functions[STAGE_EMISSIVITY],
+              metadata_access=METADATA_WRITE,
+              outputs=band_files(emissivity_bands),
+              settings=settings[STAGE_EMISSIVITY])
+
+    add_stage(STAGE_DISTANCE_TO_CLOUD,
+              functions[STAGE_DISTANCE_TO_CLOUD],
+              metadata_access=METADATA_WRITE,
+              outputs=band_files(STAGE_BANDS[STAGE_DISTANCE_TO_CLOUD]),
+              settings=settings[STAGE_DISTANCE_TO_CLOUD])
+
+    add_stage(STAGE_ATMOSPHERIC_PARAMETERS,
+              functions[STAGE_ATMOSPHERIC_PARAMETERS],
+              depends_on=(STAGE_MODTRAN,),
+              metadata_access=METADATA_WRITE,
+              inputs=grid_point_files + elevation_files + modtran_outputs,
+              outputs=(band_files(atmospheric_bands) +
+                       [SCENE_ATMOSPHERE_STORE_NAME]),
+              settings=settings[STAGE_ATMOSPHERIC_PARAMETERS])
+
+    add_stage(STAGE_SURFACE_TEMPERATURE,
+              functions[STAGE_SURFACE_TEMPERATURE],
+              depends_on=(STAGE_ATMOSPHERIC_PARAMETERS,
+                          STAGE_EMISSIVITY),
+              metadata_access=METADATA_WRITE,
+              inputs=band_files(atmospheric_bands + emissivity_bands),
+              outputs=band_files(
+                  STAGE_BANDS[STAGE_SURFACE_TEMPERATURE]),
+              settings=settings[STAGE_SURFACE_TEMPERATURE])
+
+    add_stage(STAGE_QA, functions[STAGE_QA],
+              depends_on=(STAGE_SURFACE_TEMPERATURE,
+                          STAGE_DISTANCE_TO_CLOUD),
+              metadata_access=METADATA_WRITE,
+              inputs=band_files(INTERMEDIATE_PATTERNS),
+              outputs=band_files(STAGE_BANDS[STAGE_QA]),
+              settings=settings[STAGE_QA])
+
+    # The conversion rewrites the intermediate bands in place
+    if convert:
+        add_stage(STAGE_CONVERT, functions[STAGE_CONVERT],
+                  depends_on=(STAGE_QA,),
+                  metadata_access=METADATA_WRITE,
+                  inputs=band_files(INTERMEDIATE_PATTERNS),
+                  outputs=band_files(INTERMEDIATE_PATTERNS),
+                  settings=settings[STAGE_CONVERT])
+
+    return graph
+
+
+def fit_modtran_stage(graph, core_budget):
+    """Give the MODTRAN stage the cores which the planned stages able to
+       run beside it leave of the budget
+
+    Args:
+        graph <StageGraph>: The stages, planned
+        core_budget <int>: Total number of cores the stages may use
+
+    Returns:
+        <int>: Number of processes MODTRAN uses
+    """
+
+    for stage in graph.planned:
+        if stage.name == STAGE_MODTRAN:
+            break
+    else:
+        return 1
+
+    # The surrogate makes no MODTRAN runs
+    if 'process_count' not in stage.function.keywords:
+        return stage.cores
+
+    process_count = max(1, min(stage.cores,
+                               core_budget -
+                               graph.beside_cores(STAGE_MODTRAN)))
+
+    stage.cores = process_count
+    stage.function = partial(stage.function, process_count=process_count)
+
+    return process_count
+
+
+def stage_settings(xml_filename, data_path, aux_path, modtran_data_path,
+                   server_name, server_path, clear_sky=False,
+                   cluster_tolerance=None, surrogate=None,
+                   all_thermal_bands=False, map_space_cells=False):
+    """The configuration each stage's results depend on
+
+    Args:
+        xml_filename <str>: XML metadata filename
+        data_path <str>: Directory for ST data files
+        aux_path <str>: Directory for the auxiliary data files
+        modtran_data_path <str>: Directory for the MODTRAN 'DATA' files
+        server_name <str>: Name of the ASTER GED server
+        server_path <str>: Path on the ASTER GED server
+        clear_sky <bool>: Only run MODTRAN for points near clear pixels
+        cluster_tolerance <ProfileTolerance>: Largest profile differences of
+                                              points sharing MODTRAN runs
+        surrogate <str>: Surrogate table used instead of MODTRAN, or None
+        all_thermal_bands <bool>: Also generate the bands of Landsat 8
+                                  band 11
+        map_space_cells <bool>: Select the interpolation cells in map
+                                coordinates
+
+    Returns:
+        <dict>: Stage name to settings
+    """
+
+    common = {'version': util.Version.app_version(),
+              'scene': st_manifest.scene_fingerprint(xml_filename)}
+
+    specific = {
+        STAGE_GRID_POINTS: {'data_path': data_path,
+                            'clear_sky': clear_sky},
+        STAGE_NARR: {'aux_path': aux_path},
+        STAGE_MODTRAN_INPUT: {'data_path': data_path,
+                              'cluster_tolerance':
+                                  None if cluster_tolerance is None
+                                  else list(cluster_tolerance)},
+        STAGE_MODTRAN: {'modtran_data_path': modtran_data_path,
+                        'surrogate': surrogate},
+        STAGE_EMISSIVITY: {'server_name': server_name,
+                           'server_path': server_path},
+        STAGE_ATMOSPHERIC_PARAMETERS: {
+            'st_data_dir': os.environ.get('ST_DATA_DIR', ''),
+            'surrogate': surrogate,
+            'all_thermal_bands': all_thermal_bands,
+            'map_space_cells': map_space_cells}
+    }
+
+    settings = dict()
+    for name in ALL_STAGES:
+        settings[name] = dict(common)
+        settings[name].update(specific.get(name, dict()))
+
+    return settings
 
 
 PROC_CFG_FILENAME = 'processing.conf'
 
+# Timings of the completed runs, kept beside the processing configuration
+RUN_HISTORY_FILENAME = 'st_run_timings.jsonl'
+
+# Written in the scene directory by --estimate
+ESTIMATE_FILENAME = 'st_estimate.json'
+
+
+def modtran_executor_cfg(proc_cfg):
+    """Determine how the MODTRAN runs are made
+
+    The runs are placed on a shared work queue when the optional
+    modtran_queue_path is configured, and are otherwise made locally.
+
+    Args:
+        proc_cfg <ConfigParser>: The processing configuration
+
+    Returns:
+        <str>: The executor
+        <str>: The work queue directory, or None
+    """
+
+    if proc_cfg.has_option('processing', 'modtran_queue_path'):
+        return (QUEUE_EXECUTOR,
+                proc_cfg.get('processing', 'modtran_queue_path'))
+
+    return (LOCAL_EXECUTOR, None)
+
+
+def estimate_scene(xml_filename, data_path, modtran_process_count,
+                   modtran_executor):
+    """Estimate the cost of processing the scene without processing it
+
+    Args:
+        xml_filename <str>: XML metadata filename
+        data_path <str>: Directory for ST data files
+        modtran_process_count <int>: Number of MODTRAN runs made at once
+        modtran_executor <str>: How the MODTRAN runs will be made
+    """
+
+    logger = logging.getLogger(__name__)
+
+    features = st_estimate.scene_features(xml_filename=xml_filename,
+                                          data_path=data_path)
+
+    prediction = st_estimate.predict(
+        features=features,
+        modtran_process_count=modtran_process_count,
+        modtran_executor=modtran_executor,
+        history_filename=get_cfg_file_path(RUN_HISTORY_FILENAME))
+
+    estimate = dict(features)
+    estimate.update({'xml_filename': os.path.basename(xml_filename),
+                     'modtran_process_count': modtran_process_count,
+                     'modtran_executor': modtran_executor,
+                     'predicted_wall_time': prediction['wall_time'],
+                     'coefficients': prediction['coefficients'],
+                     'calibration_runs': prediction['calibration_runs']})
+
+    with open(ESTIMATE_FILENAME, 'w') as estimate_fd:
+        json.dump(estimate, estimate_fd, indent=4, sort_keys=True)
+        estimate_fd.write('\n')
+
+    logger.info('MODTRAN runs: {0} ({1} points at {2} elevations)'
+                .format(features['modtran_runs'],
+                        features['modtran_points'],
+                        features['ground_altitudes']))
+    logger.info('Pixels: {0} ({1:.1%} valid)'
+                .format(features['pixels'], features['valid_fraction']))
+    logger.info('ASTER GED tiles: {0}'.format(features['aster_tiles']))
+    if prediction['calibration_runs'] > 0:
+        logger.info('Predicted wall time: {0:.0f} seconds, calibrated from'
+                    ' {1} previous runs'
+                    .format(prediction['wall_time'],
+                            prediction['calibration_runs']))
+    else:
+        logger.info('Predicted wall time: {0:.0f} seconds, from nominal'
+                    ' coefficients'.format(prediction['wall_time']))
+
+
+def record_run_timings(xml_filename, data_path, core_budget,
+                       modtran_process_count, modtran_executor, graph):
+    """Add the timings of a completed run to the run history
+
+    Args:
+        xml_filename <str>: XML metadata filename
+        data_path <str>: Directory for ST data files
+        core_budget <int>: Cores available to the stages
+        modtran_process_count <int>: Number of MODTRAN runs made at once
+        modtran_executor <str>: How the MODTRAN runs were made
+        graph <StageGraph>: The stages which were run
+    """
+
+    logger = logging.getLogger(__name__)
+
+    # Runs which reused results say little about the cost of a scene
+    if len(graph.planned) != len(graph.stages):
+        return
+
+    features = st_estimate.completed_run_features(
+        xml_filename=xml_filename,
+        data_path=data_path,
+        tape5_pattern=TAPE5_PATTERN)
+
+    try:
+        st_estimate.record_run(
+            history_filename=get_cfg_file_path(RUN_HISTORY_FILENAME),
+            xml_filename=xml_filename,
+            features=features,
+            core_budget=core_budget,
+            modtran_process_count=modtran_process_count,
+            modtran_executor=modtran_executor,
+            graph=graph)
+    except IOError:
+        logger.warning('Unable to record the run timings')
+
 
 def main():
     """Main processing for creating the surface temperature product 
@@ -445,74 +1250,166 @@ def main():
     server_name = proc_cfg.get('processing', 'aster_ged_server_name')
     server_path = proc_cfg.get('processing', 'aster_ged_server_path')
 
+    # The process count is the core budget for all of the stages.  MODTRAN
+    # is given what the stages planned to run beside it leave of it.
+    core_budget = max(1, int(process_count))
+    modtran_process_count = core_budget
+
+    # When a work queue is configured, the MODTRAN runs are made by workers
+    # which may be on other nodes, and this job only waits for them
+    (modtran_executor, modtran_queue_directory) = modtran_executor_cfg(
+        proc_cfg)
+    if modtran_executor == QUEUE_EXECUTOR:
+        modtran_process_count = 1
+
+    # A window is processed as a scene of its own, in its own directory
+    if args.window is not None:
+        directory = st_window.create_window_scene(
+            xml_filename=args.xml_filename, window=args.window)
+        os.chdir(directory)
+        args.xml_filename = os.path.basename(args.xml_filename)
+
+    # As is a preview
+    if args.preview is not None:
+        directory = st_preview.create_preview_scene(
+            xml_filename=args.xml_filename, factor=args.preview)
+        os.chdir(directory)
+        args.xml_filename = os.path.basename(args.xml_filename)
+
+    if args.estimate:
+        # A complete run has the emissivity and distance to cloud stages
+        # beside MODTRAN
+        estimate_scene(xml_filename=args.xml_filename,
+                       data_path=data_path,
+                       modtran_process_count=max(
+                           1, min(modtran_process_count, core_budget - 1)),
+                       modtran_executor=modtran_executor)
+
+        logger.info('*** ST Generate Products - Estimate Complete ***')
+        return
+
+    # The processes the stages start write their events for the trace too
+    if args.trace:
+        st_trace.start()
+
     # -------------- Generate the products --------------
-    determine_grid_points(xml_filename=args.xml_filename,
-                          data_path=data_path,
-                          debug=args.debug)
-
-    extract_auxiliary_narr_data(xml_filename=args.xml_filename,
-                                aux_path=aux_path,
-                                debug=args.debug)
-
-    build_modtran_input(xml_filename=args.xml_filename,
-                        data_path=data_path,
-                        debug=args.debug)
-
-    generate_emissivity_products(xml_filename=args.xml_filename,
-                                 server_name=server_name,
-                                 server_path=server_path,
-                                 debug=args.debug)
-
-    run_modtran(modtran_data_path=modtran_data_path,
-                process_count=process_count,
-                debug=args.debug)
-
-    # Generate the thermal, upwelled, and downwelled radiance bands as well as
-    # the atmospheric transmittance band
-    cmd = ['st_atmospheric_parameters', '--xml', args.xml_filename]
-    if args.debug:
-        cmd.append('--debug')
+    context = None
+    if args.in_process:
+        context = st_pipeline.initialize(xml_filename=args.xml_filename,
+                                         in_memory=args.in_memory,
+                                         debug=args.debug)
+
+        functions = pipeline_stage_functions(
+            context=context,
+            data_path=data_path,
+            aux_path=aux_path,
+            modtran_data_path=modtran_data_path,
+            modtran_process_count=modtran_process_count,
+            server_name=server_name,
+            server_path=server_path,
+            modtran_executor=modtran_executor,
+            modtran_queue_directory=modtran_queue_directory,
+            clear_sky=args.clear_sky,
+            cluster_tolerance=args.cluster_tolerance,
+            surrogate=args.surrogate,
+            all_thermal_bands=args.all_thermal_bands,
+            geometry_cache=args.geometry_cache,
+            map_space_cells=args.map_space_cells)
+    else:
+        functions = command_stage_functions(
+            xml_filename=args.xml_filename,
+            data_path=data_path,
+            aux_path=aux_path,
+            modtran_data_path=modtran_data_path,
+            modtran_process_count=modtran_process_count,
+            server_name=server_name,
+            server_path=server_path,
+            debug=args.debug,
+            modtran_executor=modtran_executor,
+            modtran_queue_directory=modtran_queue_directory,
+            clear_sky=args.clear_sky,
+            cluster_tolerance=args.cluster_tolerance,
+            surrogate=args.surrogate,
+            all_thermal_bands=args.all_thermal_bands,
+            geometry_cache=args.geometry_cache,
+            map_space_cells=args.map_space_cells)
+
+    manifests = st_manifest.ManifestStore()
+    if args.rerun_all:
+        manifests.remove(ALL_STAGES)
+
+    settings = stage_settings(xml_filename=args.xml_filename,
+                              data_path=data_path,
+                              aux_path=aux_path,
+                              modtran_data_path=modtran_data_path,
+                              server_name=server_name,
+                              server_path=server_path,
+                              clear_sky=args.clear_sky,
+                              cluster_tolerance=args.cluster_tolerance,
+                              surrogate=args.surrogate,
+                              all_thermal_bands=args.all_thermal_bands,
+                              map_space_cells=args.map_space_cells)
+
+    # Leases taken by this job are prioritized by the node scheduler, if
+    # one is in use, according to how many of its stages are complete
+    registration = JobRegistration(
+        job='{0}:{1}'.format(os.path.realpath(args.xml_filename),
+                             os.getpid()))
+
+    graph = build_stage_graph(functions=functions,
+                              core_budget=core_budget,
+                              modtran_process_count=modtran_process_count,
+                              manifests=manifests,
+                              settings=settings,
+                              convert=args.intermediate,
+                              progress=registration.progress,
+                              surrogate=args.surrogate is not None)
+
+    # Stages being run again must not add a second copy of their bands
+    band_patterns = list()
+    for stage in graph.plan():
+        band_patterns.extend(band_files(STAGE_BANDS.get(stage.name, [])))
+    if st_manifest.remove_bands(args.xml_filename, band_patterns):
+        if context is not None:
+            context.refresh_metadata()
+
+    modtran_process_count = fit_modtran_stage(graph, core_budget)
 
-    cmd = ' '.join(cmd)
-    output = ''
     try:
-        logger.info('Calling [{0}]'.format(cmd))
-        output = util.System.execute_cmd(cmd)
-    except Exception:
-        logger.error('Failed creating atmospheric parameters and generating '
-                     'intermediate data')
-        raise
+        graph.run()
     finally:
-        if len(output) > 0:
-            logger.info(output)
-
-    # Generate Surface Temperature band
-    try:
-        current_processor = build_st_data.BuildSTData(
-            xml_filename=args.xml_filename)
-        current_processor.generate_data()
-    except Exception:
-        logger.error('Failed processing Surface Temperature')
-        raise
-
-    # Build the distance to cloud band 
-    generate_distance_to_cloud(xml_filename=args.xml_filename,
-                               debug=args.debug)
+        registration.close()
+
+        # A failed run is traced up to the failure
+        if args.trace:
+            events = st_trace.stop()
+            st_trace.write_trace(events)
+            st_trace.log_summary(events)
+
+    # The MODTRAN inputs are counted before they are cleaned up.  Runs which
+    # predicted the parameters made none of the MODTRAN runs counted.
+    if args.surrogate is None:
+        record_run_timings(xml_filename=args.xml_filename,
+                           data_path=data_path,
+                           core_budget=core_budget,
+                           modtran_process_count=modtran_process_count,
+                           modtran_executor=modtran_executor,
+                           graph=graph)
+
+    # Clean up files and directories according to user selections
+    if not args.temporary:
+        cleanup_temporary_data(manifests)
 
-    # Build the surface temperature quality band
-    generate_qa(xml_filename=args.xml_filename,
-                debug=args.debug)
+    if not args.intermediate:
+        cleanup_intermediate_bands(manifests)
 
-    # Clean up files and directories according to user selections, or
-    # for intermediate bands convert them if they are to be kept.
-    if not args.temporary:
-        cleanup_temporary_data()
+    if context is not None:
+        st_pipeline.release(context)
 
-    if args.intermediate:
-        convert_intermediate_bands(xml_filename=args.xml_filename,
-                                   debug=args.debug)
-    else:
-        cleanup_intermediate_bands()
+    if args.preview is not None:
+        st_preview.write_quick_look(
+            xml_filename=args.xml_filename,
+            png_filename=st_preview.QUICK_LOOK_FILENAME)
 
     logger.info('*** ST Generate Products - Complete ***')
 
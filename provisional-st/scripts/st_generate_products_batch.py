@@ -0,0 +1,628 @@
+#! /usr/bin/env python
+
+'''
+    File: st_generate_products_batch.py
+
+    Purpose: Generates ST products for a list of scenes, sharing the static
+             and auxiliary data between them.  Scenes whose acquisitions fall
+             between the same pair of NARR times share one extraction of the
+             NARR data, the static data files are parsed once for the whole
+             batch, and MODTRAN is run once for each distinct tape5 across
+             all of the scenes.  The products of each scene are then
+             generated in the scene's directory, within this process and
+             with the same stage functions as st_generate_products.py
+             --in-process, reusing the results prepared here.  The static
+             data the python stages load, such as the brightness
+             temperature lookup tables and the ASTER GED tiles, are kept
+             for the whole batch.  st_atmospheric_parameters is still run
+             for each scene, and reads the spectral responses each time.
+
+    Project: Land Satellites Data Systems Science Research and Development
+             (LSRD) at the USGS EROS
+
+    License: NASA Open Source Agreement 1.3
+'''
+
+import os
+import sys
+import glob
+import shutil
+import logging
+from collections import defaultdict
+from functools import partial
+from argparse import ArgumentParser
+
+from espa import Metadata
+
+import st_utilities as util
+import emissivity_utilities as emis_util
+
+from st_build_modtran_input import PARAMETERS
+
+import st_pipeline
+import st_manifest
+import st_extract_auxiliary_narr_data
+import st_run_modtran
+import st_generate_products as products
+
+
+# Directory, within the work directory, for each NARR extraction
+NARR_DIRECTORY_TEMPLATE = 'narr_{0:%Y%m%d%H}_{1:%Y%m%d%H}'
+NARR_MARKER = 'narr.done'
+
+# Directory, within the work directory, for the MODTRAN runs
+MODTRAN_DIRECTORY = 'modtran'
+
+# Directory, within the work directory, for the ASTER GED tiles
+ASTER_DIRECTORY = 'aster'
+
+# Stages prepared by the batch for each scene
+PREPARATION_STAGES = [products.STAGE_GRID_POINTS, products.STAGE_NARR,
+                      products.STAGE_MODTRAN_INPUT]
+
+# Options of the stages of a scene, with their defaults
+SCENE_OPTIONS = {'intermediate': False,
+                 'temporary': False,
+                 'rerun_all': False,
+                 'in_memory': False,
+                 'clear_sky': False,
+                 'surrogate': None,
+                 'all_thermal_bands': False,
+                 'map_space_cells': False}
+
+
+def retrieve_command_line_arguments():
+    """Read arguments from the command line
+
+    Returns:
+        args <arguments>: The arguments read from the command line
+    """
+
+    parser = ArgumentParser(description='Creates surface temperature'
+                                        ' products for a list of scenes')
+
+    parser.add_argument('--version',
+                        action='version',
+                        version=util.Version.version_text())
+
+    parser.add_argument('--xml',
+                        action='store', dest='xml_filenames',
+                        nargs='+', required=False, default=list(),
+                        help='The XML metadata files to use, each in the'
+                             ' directory holding its scene')
+
+    parser.add_argument('--xml-list',
+                        action='store', dest='xml_list',
+                        required=False, default=None,
+                        help='A file listing XML metadata files to use,'
+                             ' one per line')
+
+    parser.add_argument('--work-directory',
+                        action='store', dest='work_directory',
+                        required=False, default='st_batch',
+                        help='Directory for the data shared between scenes')
+
+    parser.add_argument('--keep-intermediate-data',
+                        action='store_true', dest='intermediate',
+                        required=False, default=False,
+                        help='Keep any intermediate products generated')
+
+    parser.add_argument('--keep-temporary-data',
+                        action='store_true', dest='temporary',
+                        required=False, default=False,
+                        help='Keep any temporary files generated, including'
+                             ' the work directory')
+
+    parser.add_argument('--in-memory',
+                        action='store_true', dest='in_memory',
+                        required=False, default=False,
+                        help='Hand raster bands between the stages of each'
+                             ' scene in memory')
+
+    parser.add_argument('--rerun-all',
+                        action='store_true', dest='rerun_all',
+                        required=False, default=False,
+                        help='Run every stage, instead of reusing results'
+                             ' kept from a previous run')
+
+    parser.add_argument('--debug',
+                        action='store_true', dest='debug',
+                        required=False, default=False,
+                        help='Output debug messages and/or keep debug data')
+
+    args = parser.parse_args()
+
+    if args.xml_list is not None:
+        with open(args.xml_list, 'r') as list_fd:
+            args.xml_filenames.extend([line.strip() for line in list_fd
+                                       if len(line.strip()) > 0])
+
+    if not args.xml_filenames:
+        raise Exception('--xml or --xml-list must be specified on the'
+                        ' command line')
+
+    return args
+
+
+class Scene(object):
+    '''
+    Description:
+        A scene within the batch.
+    '''
+
+    def __init__(self, xml_filename):
+        super(Scene, self).__init__()
+
+        xml_filename = os.path.realpath(xml_filename)
+        self.directory = os.path.dirname(xml_filename)
+        self.xml_filename = os.path.basename(xml_filename)
+
+        espa_metadata = Metadata(xml_filename)
+        espa_metadata.parse()
+
+        (dummy, self.t0_date, self.t1_date) = util.NARR.dates(espa_metadata)
+
+        self.failed = False
+
+    def __str__(self):
+        return os.path.join(self.directory, self.xml_filename)
+
+
+def group_scenes(scenes):
+    """Groups the scenes which use the same NARR data
+
+    Args:
+        scenes [<Scene>]: The scenes of the batch
+
+    Returns:
+        [(<tuple>, [<Scene>])]: The NARR times and the scenes using them, in
+                                time order
+    """
+
+    groups = defaultdict(list)
+    for scene in scenes:
+        groups[(scene.t0_date, scene.t1_date)].append(scene)
+
+    return sorted(groups.items())
+
+
+def extract_shared_narr_data(scene, narr_directory, aux_path):
+    """Extracts the NARR data for a group of scenes
+
+    An extraction completed by a previous run is used as it is.
+
+    Args:
+        scene <Scene>: A scene of the group
+        narr_directory <str>: Directory to extract into
+        aux_path <str>: Directory for the auxiliary data files
+    """
+
+    logger = logging.getLogger(__name__)
+
+    marker = os.path.join(narr_directory, NARR_MARKER)
+    if os.path.isfile(marker):
+        with open(marker, 'r') as marker_fd:
+            if marker_fd.read().strip() == aux_path:
+                logger.info('Reusing NARR data [{0}]'.format(narr_directory))
+                return
+
+    if os.path.isdir(narr_directory):
+        shutil.rmtree(narr_directory)
+    os.makedirs(narr_directory)
+
+    espa_metadata = Metadata(str(scene))
+    espa_metadata.parse()
+
+    # The extraction writes into the current directory
+    current_directory = os.getcwd()
+    try:
+        os.chdir(narr_directory)
+        st_extract_auxiliary_narr_data.extract_narr_aux_data(espa_metadata,
+                                                             aux_path)
+    finally:
+        os.chdir(current_directory)
+
+    with open(marker, 'w') as marker_fd:
+        marker_fd.write('{0}\n'.format(aux_path))
+
+
+def link_narr_data(narr_directory):
+    """Stage function which links the shared NARR data into the scene
+
+    Args:
+        narr_directory <str>: Directory holding the shared extraction
+    """
+
+    for directory in PARAMETERS:
+        if os.path.islink(directory):
+            os.unlink(directory)
+        elif os.path.exists(directory):
+            shutil.rmtree(directory)
+
+        util.System.create_link(os.path.join(narr_directory, directory),
+                                directory)
+
+
+def prepare_scene(scene, narr_directory, cfg, rerun_all, debug):
+    """Determine the grid points and build the tape5 files for a scene
+
+    Runs in the scene directory, through the same stage definitions as
+    st_generate_products.py, so the manifests written here let it reuse the
+    results.
+
+    Args:
+        scene <Scene>: The scene to prepare
+        narr_directory <str>: Directory holding the shared NARR extraction
+        cfg <dict>: The processing configuration
+        rerun_all <bool>: Ignore the results of previous runs
+        debug <bool>: Debug logging and processing
+    """
+
+    context = st_pipeline.initialize(xml_filename=scene.xml_filename,
+                                     in_memory=False,
+                                     debug=debug)
+
+    functions = products.pipeline_stage_functions(
+        context=context,
+        data_path=cfg['data_path'],
+        aux_path=cfg['aux_path'],
+        modtran_data_path=cfg['modtran_data_path'],
+        modtran_process_count=1,
+        server_name=cfg['server_name'],
+        server_path=cfg['server_path'])
+    functions[products.STAGE_NARR] = partial(link_narr_data, narr_directory)
+
+    manifests = st_manifest.ManifestStore()
+    if rerun_all:
+        manifests.remove(products.ALL_STAGES)
+
+    settings = products.stage_settings(
+        xml_filename=scene.xml_filename,
+        data_path=cfg['data_path'],
+        aux_path=cfg['aux_path'],
+        modtran_data_path=cfg['modtran_data_path'],
+        server_name=cfg['server_name'],
+        server_path=cfg['server_path'])
+
+    graph = products.build_stage_graph(functions=functions,
+                                       core_budget=1,
+                                       modtran_process_count=1,
+                                       manifests=manifests,
+                                       settings=settings,
+                                       convert=False,
+                                       stage_names=PREPARATION_STAGES)
+    graph.run()
+
+    st_pipeline.release(context)
+
+
+def scene_tape5_directories(scene):
+    """The MODTRAN run directories of a scene
+
+    Args:
+        scene <Scene>: The scene
+
+    Returns:
+        [<str>]: The directories holding a tape5 file
+    """
+
+    return [os.path.dirname(filename)
+            for filename in glob.glob(os.path.join(scene.directory,
+                                                   products.TAPE5_PATTERN))]
+
+
+def run_shared_modtran(scenes, modtran_directory, modtran_data_path,
+                       executor):
+    """Run MODTRAN once for each distinct tape5 of the scenes
+
+    Identical tape5 files produce identical results, so each distinct one
+    is run in the work directory and the results are copied to every scene
+    run directory holding it.  Each scene then finds its runs complete.
+    With the queue executor, the work directory must be on the filesystem
+    shared with the workers.
+
+    Args:
+        scenes [<Scene>]: The scenes to run MODTRAN for
+        modtran_directory <str>: Directory for the shared MODTRAN runs
+        modtran_data_path <str>: Directory for the MODTRAN 'DATA' files
+        executor <object>: Makes the runs
+    """
+
+    logger = logging.getLogger(__name__)
+
+    # Digest to the scene run directories holding that tape5
+    runs = defaultdict(list)
+    for scene in scenes:
+        for directory in scene_tape5_directories(scene):
+            runs[st_run_modtran.tape5_digest(directory)].append(directory)
+
+    logger.info('MODTRAN runs required [{0}] distinct [{1}]'
+                .format(sum([len(directories)
+                             for directories in runs.values()]),
+                        len(runs)))
+
+    run_parms = list()
+    for (digest, directories) in sorted(runs.items()):
+        run_directory = os.path.join(modtran_directory, digest)
+        if not os.path.isdir(run_directory):
+            os.makedirs(run_directory)
+        shutil.copyfile(os.path.join(directories[0], st_run_modtran.TAPE5),
+                        os.path.join(run_directory, st_run_modtran.TAPE5))
+        run_parms.append((run_directory, modtran_data_path))
+
+    try:
+        executed = executor.run(run_parms)
+    except:
+        logger.exception('Error processing MODTRAN runs')
+        raise
+
+    logger.info('MODTRAN runs reused [{0}] executed [{1}]'
+                .format(executed.count(False), executed.count(True)))
+
+    for (digest, directories) in runs.items():
+        for directory in directories:
+            st_run_modtran.copy_results(
+                os.path.join(modtran_directory, digest), directory, digest)
+
+
+def run_scene_stages(scene, narr_directory, cfg, options, geometry_cache,
+                     debug):
+    """Run the stages of a scene within this process
+
+    Runs in the scene directory.  Stages completed by a previous run, or
+    when the scene was prepared, are reused.
+
+    Args:
+        scene <Scene>: The scene
+        narr_directory <str>: Directory holding the shared NARR extraction
+        cfg <dict>: The processing configuration
+        options <dict>: The options of the scene, as in SCENE_OPTIONS
+        geometry_cache <str>: Directory of the geometry cache, or None
+        debug <bool>: Debug logging and processing
+
+    Returns:
+        <StageGraph>: The stages which were run
+    """
+
+    context = st_pipeline.initialize(xml_filename=scene.xml_filename,
+                                     in_memory=options['in_memory'],
+                                     debug=debug)
+
+    try:
+        functions = products.pipeline_stage_functions(
+            context=context,
+            data_path=cfg['data_path'],
+            aux_path=cfg['aux_path'],
+            modtran_data_path=cfg['modtran_data_path'],
+            modtran_process_count=cfg['modtran_process_count'],
+            server_name=cfg['server_name'],
+            server_path=cfg['server_path'],
+            modtran_executor=cfg['modtran_executor'],
+            modtran_queue_directory=cfg['modtran_queue_directory'],
+            clear_sky=options['clear_sky'],
+            surrogate=options['surrogate'],
+            all_thermal_bands=options['all_thermal_bands'],
+            geometry_cache=geometry_cache,
+            map_space_cells=options['map_space_cells'])
+        functions[products.STAGE_NARR] = partial(link_narr_data,
+                                                 narr_directory)
+
+        manifests = st_manifest.ManifestStore()
+        if options['rerun_all']:
+            manifests.remove(products.ALL_STAGES)
+
+        settings = products.stage_settings(
+            xml_filename=scene.xml_filename,
+            data_path=cfg['data_path'],
+            aux_path=cfg['aux_path'],
+            modtran_data_path=cfg['modtran_data_path'],
+            server_name=cfg['server_name'],
+            server_path=cfg['server_path'],
+            clear_sky=options['clear_sky'],
+            surrogate=options['surrogate'],
+            all_thermal_bands=options['all_thermal_bands'],
+            map_space_cells=options['map_space_cells'])
+
+        graph = products.build_stage_graph(
+            functions=functions,
+            core_budget=cfg['core_budget'],
+            modtran_process_count=cfg['modtran_process_count'],
+            manifests=manifests,
+            settings=settings,
+            convert=options['intermediate'],
+            surrogate=options['surrogate'] is not None)
+
+        # Stages being run again must not add a second copy of their bands
+        band_patterns = list()
+        for stage in graph.plan():
+            band_patterns.extend(products.band_files(
+                products.STAGE_BANDS.get(stage.name, [])))
+        if st_manifest.remove_bands(scene.xml_filename, band_patterns):
+            context.refresh_metadata()
+
+        products.fit_modtran_stage(graph, cfg['core_budget'])
+
+        graph.run()
+
+        if not options['temporary']:
+            products.cleanup_temporary_data(manifests)
+
+        if not options['intermediate']:
+            products.cleanup_intermediate_bands(manifests)
+    finally:
+        st_pipeline.release(context)
+
+    return graph
+
+
+def run_in_directory(directory, function, *args, **kwargs):
+    """Call the function with the directory as the working directory
+
+    Args:
+        directory <str>: The directory
+        function <function>: The function to call
+
+    Returns:
+        The value returned by the function
+    """
+
+    current_directory = os.getcwd()
+    try:
+        os.chdir(directory)
+        return function(*args, **kwargs)
+    finally:
+        os.chdir(current_directory)
+
+
+def processing_cfg():
+    """Read the processing configuration the scenes are run with
+
+    Returns:
+        <dict>: The processing configuration
+    """
+
+    proc_cfg = products.retrieve_cfg(products.PROC_CFG_FILENAME)
+
+    # As in st_generate_products.py, MODTRAN is given what the stages
+    # planned to run beside it leave of the budget
+    core_budget = max(1, int(proc_cfg.get('processing', 'omp_num_threads')))
+    modtran_process_count = core_budget
+
+    (modtran_executor, modtran_queue_directory) = \
+        products.modtran_executor_cfg(proc_cfg)
+    if modtran_executor == products.QUEUE_EXECUTOR:
+        modtran_process_count = 1
+
+    return {'data_path': proc_cfg.get('processing', 'st_data_path'),
+            'aux_path': proc_cfg.get('processing', 'st_aux_path'),
+            'modtran_data_path': proc_cfg.get('processing',
+                                              'modtran_data_path'),
+            'server_name': proc_cfg.get('processing',
+                                        'aster_ged_server_name'),
+            'server_path': proc_cfg.get('processing',
+                                        'aster_ged_server_path'),
+            'core_budget': core_budget,
+            'modtran_process_count': modtran_process_count,
+            'modtran_executor': modtran_executor,
+            'modtran_queue_directory': modtran_queue_directory}
+
+
+def main():
+    """Main processing for creating the surface temperature products of a
+       batch of scenes
+    """
+
+    # Command Line Arguments
+    args = retrieve_command_line_arguments()
+
+    # Check logging level
+    logging_level = logging.INFO
+    if args.debug:
+        logging_level = logging.DEBUG
+
+    # Setup the default logger format and level.  Log to STDOUT.
+    logging.basicConfig(format=('%(asctime)s.%(msecs)03d %(process)d'
+                                ' %(levelname)-8s'
+                                ' %(filename)s:%(lineno)d:'
+                                '%(funcName)s -- %(message)s'),
+                        datefmt='%Y-%m-%d %H:%M:%S',
+                        level=logging_level,
+                        stream=sys.stdout)
+    logger = logging.getLogger(__name__)
+
+    logger.info('*** Begin ST Generate Products Batch ***')
+
+    # Retrieve the processing configuration
+    cfg = processing_cfg()
+
+    executor = st_run_modtran.make_executor(
+        executor=cfg['modtran_executor'],
+        process_count=cfg['core_budget'],
+        queue_directory=cfg['modtran_queue_directory'])
+
+    work_directory = os.path.realpath(args.work_directory)
+    modtran_directory = os.path.join(work_directory, MODTRAN_DIRECTORY)
+
+    scenes = [Scene(xml_filename) for xml_filename in args.xml_filenames]
+
+    # The static data files are only parsed for the first scene, by the
+    # preparation and by the product generation
+    util.SharedDataCache.enable()
+
+    for ((t0_date, t1_date), group) in group_scenes(scenes):
+        narr_directory = os.path.join(
+            work_directory, NARR_DIRECTORY_TEMPLATE.format(t0_date, t1_date))
+
+        logger.info('Preparing {0} scene(s) using NARR data {1} to {2}'
+                    .format(len(group), t0_date, t1_date))
+
+        extract_shared_narr_data(scene=group[0],
+                                 narr_directory=narr_directory,
+                                 aux_path=cfg['aux_path'])
+
+        for scene in group:
+            try:
+                run_in_directory(scene.directory, prepare_scene,
+                                 scene=scene,
+                                 narr_directory=narr_directory,
+                                 cfg=cfg,
+                                 rerun_all=args.rerun_all,
+                                 debug=args.debug)
+            except Exception:
+                logger.exception('Failed preparing scene [{0}]'
+                                 .format(scene))
+                scene.failed = True
+
+        # The pressure layers of this group are not needed again
+        util.SharedDataCache.release(narr_directory)
+
+    run_shared_modtran(scenes=[scene for scene in scenes
+                               if not scene.failed],
+                       modtran_directory=modtran_directory,
+                       modtran_data_path=cfg['modtran_data_path'],
+                       executor=executor)
+
+    # --rerun-all is not applied again, as it was applied when the scenes
+    # were prepared and would discard the preparation
+    options = dict(SCENE_OPTIONS)
+    options.update({'intermediate': args.intermediate,
+                    'temporary': args.temporary,
+                    'in_memory': args.in_memory})
+
+    # Scenes covering the same ASTER GED tiles download them once
+    emis_util.AsterTileStore.enable(os.path.join(work_directory,
+                                                 ASTER_DIRECTORY))
+
+    for ((t0_date, t1_date), group) in group_scenes(scenes):
+        narr_directory = os.path.join(
+            work_directory, NARR_DIRECTORY_TEMPLATE.format(t0_date, t1_date))
+
+        for scene in [scene for scene in group if not scene.failed]:
+            try:
+                run_in_directory(scene.directory, run_scene_stages,
+                                 scene=scene,
+                                 narr_directory=narr_directory,
+                                 cfg=cfg,
+                                 options=options,
+                                 geometry_cache=None,
+                                 debug=args.debug)
+            except Exception:
+                logger.exception('Failed generating products for scene'
+                                 ' [{0}]'.format(scene))
+                scene.failed = True
+
+    emis_util.AsterTileStore.disable()
+    util.SharedDataCache.disable()
+
+    if not args.temporary and os.path.isdir(work_directory):
+        shutil.rmtree(work_directory)
+
+    failed = [str(scene) for scene in scenes if scene.failed]
+    if failed:
+        raise Exception('Failed processing scenes {0}'.format(failed))
+
+    logger.info('*** ST Generate Products Batch - Complete ***')
+
+
+if __name__ == '__main__':
+    main()
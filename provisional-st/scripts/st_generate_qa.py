@@ -344,14 +344,8 @@ def extract_raster_data(name, band_number):
         <raster>: 2D raster array data
     """
 
-    dataset = gdal.Open(name)
-    if dataset is None:
-        raise RuntimeError('GDAL failed to open {0}'.format(name))
-
-    raster = (dataset.GetRasterBand(band_number)
-              .ReadAsArray(0, 0, dataset.RasterXSize, dataset.RasterYSize))
-
-    return raster
+    # Bands handed over in memory by an earlier stage are used directly
+    return util.RasterCache.read(name, band_number)
 
 
 def retrieve_command_line_arguments():
@@ -453,70 +447,26 @@ def retrieve_thermal_constants(espa_metadata, satellite):
     return ThermalConstantInfo(k1=k1, k2=k2)
 
 
-def calculate_qa(radiance_filename, transmission_filename, upwelled_filename,
-                 downwelled_filename, emis_filename, emis_stdev_filename,
-                 distance_filename, satellite, k1, k2, fill_value):
-    """Calculate QA
+def calculate_uncertainty(Lobs, tau, Lu, Ld, emis, emis_stdev, distance,
+                          satellite, k1, k2):
+    """Calculate the surface temperature uncertainty of non-fill pixels
 
     Args:
-        radiance_filename <str>: Name of radiance file
-        transmission_filename <str>: Name of atmospheric transmission file
-        upwelled_filename <str>: Name of upwelled radiance file
-        downwelled_filename <str>: Name of downwelled radiance file
-        emis_filename <str>: Name of emissivity file
-        emis_stdev_filename <str>: Name of emissivity standard deviation file
-        distance_filename <str>: Name of cloud distance file
+        Lobs <numpy.ndarray>: Thermal radiance
+        tau <numpy.ndarray>: Atmospheric transmission
+        Lu <numpy.ndarray>: Upwelled radiance
+        Ld <numpy.ndarray>: Downwelled radiance
+        emis <numpy.ndarray>: Emissivity
+        emis_stdev <numpy.ndarray>: Emissivity standard deviation
+        distance <numpy.ndarray>: Distance to the nearest cloud in km
         satellite <str>: Name of satellite (e.g.: "LANDSAT_8")
         k1 <float>: K1 thermal conversion constant for the satellite
         k2 <float>: K2 thermal conversion constant for the satellite
-        fill_value <float>: No data (fill) value to use
 
     Returns:
-        <numpy.2darray>: Generated surface temperature QA band data
+        <numpy.ndarray>: Surface temperature uncertainty in K
     """
 
-    logger = logging.getLogger(__name__)
-
-    logger.info('Building QA band')
-
-    # Read the intermediate input
-    # Lobs = thermal radiance
-    # tau = transmission
-    # Lu = upwelled radiance
-    # Ld = downwelled radiance
-    Lobs_array = extract_raster_data(radiance_filename, 1)
-    tau_array = extract_raster_data(transmission_filename, 1)
-    Lu_array = extract_raster_data(upwelled_filename, 1)
-    Ld_array = extract_raster_data(downwelled_filename, 1)
-    emis_array = extract_raster_data(emis_filename, 1)
-    emis_stdev_array = extract_raster_data(emis_stdev_filename, 1)
-    distance_array = extract_raster_data(distance_filename, 1)
-
-    # Find fill locations.  We don't need to do this for transmission,
-    # upwelled radiance, or downwelled radiance since these are created
-    # with fill based on the the thermal radiance fill locations
-    nonfill_locations = np.where(Lobs_array != fill_value)
-    fill_locations = np.where((emis_array == fill_value) |
-                              (emis_stdev_array == fill_value) |
-                              (distance_array == fill_value))
-
-    # Only operate where thermal radiance is non-fill
-    Lobs = Lobs_array[nonfill_locations]
-    tau = tau_array[nonfill_locations]
-    Lu = Lu_array[nonfill_locations]
-    Ld = Ld_array[nonfill_locations]
-    emis = emis_array[nonfill_locations]
-    emis_stdev = emis_stdev_array[nonfill_locations]
-    distance = distance_array[nonfill_locations]
-
-    # Memory cleanup
-    del tau_array
-    del Lu_array
-    del Ld_array
-    del emis_array
-    del emis_stdev_array
-    del distance_array
-
     # Calculate partials
     dLT_dTAU = (Lu - Lobs) / (emis * tau**2)
     dLT_dLU = -1 / (tau * emis)
@@ -691,6 +641,86 @@ def calculate_qa(radiance_filename, transmission_filename, upwelled_filename,
     del Temp_uncertainty_High 
     del Temp_uncertainty_Low 
 
+    return Temp_Uncertainty
+
+
+def calculate_qa(radiance_filename, transmission_filename, upwelled_filename,
+                 downwelled_filename, emis_filename, emis_stdev_filename,
+                 distance_filename, satellite, k1, k2, fill_value):
+    """Calculate QA
+
+    Args:
+        radiance_filename <str>: Name of radiance file
+        transmission_filename <str>: Name of atmospheric transmission file
+        upwelled_filename <str>: Name of upwelled radiance file
+        downwelled_filename <str>: Name of downwelled radiance file
+        emis_filename <str>: Name of emissivity file
+        emis_stdev_filename <str>: Name of emissivity standard deviation file
+        distance_filename <str>: Name of cloud distance file
+        satellite <str>: Name of satellite (e.g.: "LANDSAT_8")
+        k1 <float>: K1 thermal conversion constant for the satellite
+        k2 <float>: K2 thermal conversion constant for the satellite
+        fill_value <float>: No data (fill) value to use
+
+    Returns:
+        <numpy.2darray>: Generated surface temperature QA band data
+    """
+
+    logger = logging.getLogger(__name__)
+
+    logger.info('Building QA band')
+
+    # Read the intermediate input
+    # Lobs = thermal radiance
+    # tau = transmission
+    # Lu = upwelled radiance
+    # Ld = downwelled radiance
+    Lobs_array = extract_raster_data(radiance_filename, 1)
+    tau_array = extract_raster_data(transmission_filename, 1)
+    Lu_array = extract_raster_data(upwelled_filename, 1)
+    Ld_array = extract_raster_data(downwelled_filename, 1)
+    emis_array = extract_raster_data(emis_filename, 1)
+    emis_stdev_array = extract_raster_data(emis_stdev_filename, 1)
+    distance_array = extract_raster_data(distance_filename, 1)
+
+    # Find fill locations.  We don't need to do this for transmission,
+    # upwelled radiance, or downwelled radiance since these are created
+    # with fill based on the the thermal radiance fill locations
+    nonfill_locations = np.where(Lobs_array != fill_value)
+    fill_locations = np.where((emis_array == fill_value) |
+                              (emis_stdev_array == fill_value) |
+                              (distance_array == fill_value))
+
+    # Only operate where thermal radiance is non-fill
+    Lobs = Lobs_array[nonfill_locations]
+    tau = tau_array[nonfill_locations]
+    Lu = Lu_array[nonfill_locations]
+    Ld = Ld_array[nonfill_locations]
+    emis = emis_array[nonfill_locations]
+    emis_stdev = emis_stdev_array[nonfill_locations]
+    distance = distance_array[nonfill_locations]
+
+    # Memory cleanup
+    del tau_array
+    del Lu_array
+    del Ld_array
+    del emis_array
+    del emis_stdev_array
+    del distance_array
+
+    Temp_Uncertainty = calculate_uncertainty(Lobs, tau, Lu, Ld, emis,
+                                             emis_stdev, distance,
+                                             satellite, k1, k2)
+
+    # Memory cleanup
+    del Lobs
+    del tau
+    del Lu
+    del Ld
+    del emis
+    del emis_stdev
+    del distance
+
     # Give st_uncertainty the same dimensions as the original Lobs
     st_uncertainty_array = Lobs_array.copy()
     st_uncertainty_array.fill(fill_value)
@@ -776,11 +806,8 @@ def add_qa_band_to_xml(espa_metadata, filename, sensor_code, no_data_value):
     # Append the band to the XML
     espa_metadata.xml_object.bands.append(qa_band)
 
-    # Validate the XML
-    espa_metadata.validate()
-
-    # Write it to the XML file
-    espa_metadata.write()
+    # Validate and write the XML, unless a transaction defers it
+    util.MetadataTransaction.save(espa_metadata)
 
 
 def write_qa_product(samps, lines, transform, wkt, no_data_value, filename,
@@ -829,19 +856,22 @@ def write_qa_product(samps, lines, transform, wkt, no_data_value, filename,
         os.unlink(aux_filename)
 
 
-def generate_qa(xml_filename, no_data_value):
+def generate_qa(xml_filename, no_data_value, espa_metadata=None):
     """Provides the main processing algorithm for generating the QA product.
 
     Args:
         xml_filename <str>: Filename for the ESPA Metadata XML
         no_data_value <float>: No data (fill) value to use
+        espa_metadata <espa.Metadata>: Parsed XML metadata to use instead
+                                       of parsing xml_filename
     """
 
     logger = logging.getLogger(__name__)
 
-    # XML metadata
-    espa_metadata = Metadata(xml_filename)
-    espa_metadata.parse()
+    # XML metadata, unless the caller already has it parsed
+    if espa_metadata is None:
+        espa_metadata = Metadata(xml_filename)
+        espa_metadata.parse()
 
     radiance_src_info \
         = retrieve_metadata_information(espa_metadata,
@@ -0,0 +1,172 @@
+'''
+    File: st_geometry_cache.py
+
+    Purpose: Keeps the geometry of a scene footprint between acquisitions of
+             the same path/row.  The grid points, the points each edge pixel
+             needs MODTRAN run for, and (written by st_atmospheric_parameters)
+             the grid cell of each pixel only depend on the projection,
+             extent, and pixel size, so later dates reuse them.
+
+    Project: Land Satellites Data Systems Science Research and Development
+             (LSRD) at the USGS EROS
+
+    License: NASA Open Source Agreement 1.3
+'''
+
+import os
+import hashlib
+import logging
+import tempfile
+from collections import namedtuple
+
+import numpy as np
+from lxml import etree
+
+from st_exceptions import MissingBandError
+from st_grid_points import PointInfo
+
+
+# Grid points and edge pixel selections of the footprint
+GRID_GEOMETRY_NAME = 'grid_geometry.npz'
+
+# Geometry read from the cache
+GridGeometry = namedtuple('GridGeometry',
+                          ('points', 'grid_rows', 'grid_cols', 'edge_cells'))
+
+
+def footprint_key(espa_metadata):
+    """The key of the footprint the scene covers
+
+    Args:
+        espa_metadata <espa.Metadata>: The metadata for the data
+
+    Returns:
+        <str>: The key
+    """
+
+    digest = hashlib.sha1(etree.tostring(
+        espa_metadata.xml_object.global_metadata.projection_information))
+
+    for band in espa_metadata.xml_object.bands.band:
+        if (band.get('product') == 'toa_bt' and
+                band.get('category') == 'image'):
+
+            digest.update('{0} {1} {2} {3}'
+                          .format(band.get('nlines'), band.get('nsamps'),
+                                  band.pixel_size.get('x'),
+                                  band.pixel_size.get('y')))
+            return digest.hexdigest()
+
+    raise MissingBandError('Missing TOA Brightness Temperature Band')
+
+
+def footprint_directory(cache_path, espa_metadata):
+    """The cache directory of the footprint the scene covers
+
+    Args:
+        cache_path <str>: The geometry cache directory
+        espa_metadata <espa.Metadata>: The metadata for the data
+
+    Returns:
+        <str>: The directory
+    """
+
+    return os.path.join(cache_path, footprint_key(espa_metadata))
+
+
+def read_grid_geometry(directory, data_bounds):
+    """Read the grid geometry of the footprint
+
+    Args:
+        directory <str>: The footprint cache directory
+        data_bounds <DataBoundInfo>: Contains adjusted data boundry
+                                     information
+
+    Returns:
+        <GridGeometry>: The geometry, or None if it is not cached for these
+                        data bounds
+    """
+
+    logger = logging.getLogger(__name__)
+
+    filename = os.path.join(directory, GRID_GEOMETRY_NAME)
+    if not os.path.exists(filename):
+        logger.info('No grid geometry cached in [{0}]'.format(directory))
+        return None
+
+    with np.load(filename) as geometry:
+        if not np.array_equal(geometry['data_bounds'],
+                              np.array(data_bounds, dtype=np.float64)):
+            logger.warning('Grid geometry cached in [{0}] is for other data'
+                           ' bounds'.format(directory))
+            return None
+
+        points = [PointInfo(col=int(point[0]), row=int(point[1]),
+                            lat=point[2], lon=point[3],
+                            map_y=point[4], map_x=point[5])
+                  for point in geometry['points'].tolist()]
+
+        edge_cells = dict(zip(
+            zip(geometry['edge_lines'].tolist(),
+                geometry['edge_samples'].tolist()),
+            [tuple(cell) for cell in geometry['edge_cells'].tolist()]))
+
+        (grid_rows, grid_cols) = geometry['grid_shape'].tolist()
+
+    logger.info('Using the grid geometry cached in [{0}]'.format(directory))
+
+    return GridGeometry(points=points, grid_rows=grid_rows,
+                        grid_cols=grid_cols, edge_cells=edge_cells)
+
+
+def write_grid_geometry(directory, data_bounds, points, grid_rows,
+                        grid_cols, edge_cells):
+    """Write the grid geometry of the footprint
+
+    The file is replaced in one step, so scenes of the same footprint
+    processed at the same time always read a complete file.
+
+    Args:
+        directory <str>: The footprint cache directory
+        data_bounds <DataBoundInfo>: Contains adjusted data boundry
+                                     information
+        points [<PointInfo>]: The grid points
+        grid_rows <int>: Number of rows in the grid
+        grid_cols <int>: Number of columns in the grid
+        edge_cells <dict>: (line, sample) of each edge pixel to the indexes
+                           of the three points it needs
+    """
+
+    if not os.path.isdir(directory):
+        try:
+            os.makedirs(directory)
+        except OSError:
+            if not os.path.isdir(directory):
+                raise
+
+    edges = sorted(edge_cells.keys())
+
+    (temp_fd, temp_filename) = tempfile.mkstemp(dir=directory,
+                                                suffix='.npz')
+    try:
+        with os.fdopen(temp_fd, 'wb') as geometry_fd:
+            np.savez(geometry_fd,
+                     data_bounds=np.array(data_bounds, dtype=np.float64),
+                     grid_shape=np.array([grid_rows, grid_cols],
+                                         dtype=np.int32),
+                     points=np.array(points, dtype=np.float64),
+                     edge_lines=np.array([edge[0] for edge in edges],
+                                         dtype=np.int32),
+                     edge_samples=np.array([edge[1] for edge in edges],
+                                           dtype=np.int32),
+                     edge_cells=np.array([edge_cells[edge]
+                                          for edge in edges],
+                                         dtype=np.int32).reshape(-1, 3))
+
+        os.chmod(temp_filename, 0664)
+        os.rename(temp_filename,
+                  os.path.join(directory, GRID_GEOMETRY_NAME))
+    except Exception:
+        if os.path.exists(temp_filename):
+            os.unlink(temp_filename)
+        raise
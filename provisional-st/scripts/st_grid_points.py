@@ -13,10 +13,16 @@
 '''
 
 import logging
-import array
-import struct
 from collections import namedtuple
 
+import numpy as np
+
+from st_store import (GRID_POINT_STORE_NAME, SECTION_GRID, SECTION_INDEX,
+                      SECTION_RUN_MODTRAN, SECTION_ROW, SECTION_COL,
+                      SECTION_NARR_ROW, SECTION_NARR_COL, SECTION_LON,
+                      SECTION_LAT, SECTION_MAP_X, SECTION_MAP_Y,
+                      write_store, read_store, store_section)
+
 
 # Grid Point Information
 PointInfo = namedtuple('PointInfo',
@@ -30,52 +36,64 @@ GridPointInfo = namedtuple('GridPointInfo',
                             'lat', 'lon',
                             'map_y', 'map_x'))
 
-GRID_POINT_FMT = 'HBBBHHffff'
-GRID_POINT_HEADER_NAME = 'grid_points.hdr'
-GRID_POINT_BINARY_NAME = 'grid_points.bin'
+# The integer values of each point and the store sections holding them
+GRID_POINT_INTEGERS = ((SECTION_INDEX, 'index'),
+                       (SECTION_RUN_MODTRAN, 'run_modtran'),
+                       (SECTION_ROW, 'row'),
+                       (SECTION_COL, 'col'),
+                       (SECTION_NARR_ROW, 'narr_row'),
+                       (SECTION_NARR_COL, 'narr_col'))
 
+# The coordinates of each point, which are single precision as
+# st_atmospheric_parameters holds them
+GRID_POINT_COORDINATES = ((SECTION_LON, 'lon'),
+                          (SECTION_LAT, 'lat'),
+                          (SECTION_MAP_X, 'map_x'),
+                          (SECTION_MAP_Y, 'map_y'))
 
-def write_grid_points(grid_points, grid_rows, grid_cols):
-    """Writes grid points to a binary file with a header
 
-    Binary is used so tha precision in the floats is not lost.
+def point_directory(point):
+    """The directory holding the MODTRAN runs of a point
 
     Args:
-        grid_points [<PointInfo>]: The list of grid points
+        point <GridPointInfo>: The grid point
+
+    Returns:
+        <str>: The directory name
     """
 
-    with open(GRID_POINT_HEADER_NAME, 'w') as ascii_fd:
-        ascii_fd.write('{}\n'.format(len(grid_points)))
-        ascii_fd.write('{}\n'.format(grid_rows))
-        ascii_fd.write('{}\n'.format(grid_cols))
+    return ('{0:03}_{1:03}_{2:03}_{3:03}'
+            .format(point.row, point.col, point.narr_row, point.narr_col))
+
 
-    with open(GRID_POINT_BINARY_NAME, 'wb') as binary_fd:
-        point_struct = struct.Struct(GRID_POINT_FMT)
+def write_grid_points(grid_points, grid_rows, grid_cols):
+    """Writes grid points to the grid point store
+
+    Args:
+        grid_points [<dict>]: The grid points, with the values of each and
+                              its <PointInfo>
+        grid_rows <int>: Number of rows in the grid
+        grid_cols <int>: Number of columns in the grid
+    """
+
+    sections = [(SECTION_GRID, np.array([len(grid_points), grid_rows,
+                                         grid_cols], dtype=np.int32))]
 
-        # Allocate enough buffer space for all the points we will write
-        buffer_size = '\0' * point_struct.size * len(grid_points)
-        point_buffer = array.array('c', buffer_size)
+    for (name, field) in GRID_POINT_INTEGERS:
+        sections.append((name, np.array([int(point[field])
+                                         for point in grid_points],
+                                        dtype=np.int32)))
 
-        index = 0
-        for point in grid_points:
-            point_struct.pack_into(point_buffer, index * point_struct.size,
-                                   point['index'],
-                                   int(point['run_modtran']),
-                                   point['row'],
-                                   point['col'],
-                                   point['narr_row'],
-                                   point['narr_col'],
-                                   point['point'].lon,
-                                   point['point'].lat,
-                                   point['point'].map_x,
-                                   point['point'].map_y)
-            index += 1
+    for (name, field) in GRID_POINT_COORDINATES:
+        sections.append((name, np.array([getattr(point['point'], field)
+                                         for point in grid_points],
+                                        dtype=np.float32)))
 
-        binary_fd.write(point_buffer)
+    write_store(GRID_POINT_STORE_NAME, sections)
 
 
 def read_grid_points():
-    """Read grid points from the binary file back into a structure
+    """Read grid points from the grid point store back into a structure
 
     Returns:
         grid_points [<GridPointInfo>]: The list of grid points
@@ -83,32 +101,23 @@ def read_grid_points():
 
     logger = logging.getLogger(__name__)
 
-    count = 0
-    grid_rows = 0
-    grid_cols = 0
-    with open(GRID_POINT_HEADER_NAME, 'r') as ascii_fd:
-        count = int(ascii_fd.readline().strip())
-        grid_rows = int(ascii_fd.readline().strip())
-        grid_cols = int(ascii_fd.readline().strip())
+    store = read_store(GRID_POINT_STORE_NAME)
+
+    (count, grid_rows, grid_cols) = [
+        int(value) for value in store_section(store, SECTION_GRID, 3)]
 
     logger.info('Reading [{}] points from grid file'.format(count))
 
-    grid_points = list()
-    with open(GRID_POINT_BINARY_NAME, 'rb') as binary_fd:
-        point_struct = struct.Struct(GRID_POINT_FMT)
-
-        for position in xrange(count):
-            logger.debug('Reading point {}'.format(position))
-            point_buffer = bytearray(binary_fd.read(point_struct.size))
-            (index, run_modtran, row, col, narr_row, narr_col,
-             lon, lat, map_x, map_y) = point_struct.unpack(point_buffer)
-
-            grid_points.append(GridPointInfo(index=index,
-                                             run_modtran=run_modtran,
-                                             row=row, col=col,
-                                             narr_row=narr_row,
-                                             narr_col=narr_col,
-                                             lon=lon, lat=lat,
-                                             map_x=map_x, map_y=map_y))
+    values = dict()
+    for (name, field) in GRID_POINT_INTEGERS:
+        values[field] = [int(value)
+                         for value in store_section(store, name, count)]
+    for (name, field) in GRID_POINT_COORDINATES:
+        values[field] = [float(value)
+                         for value in store_section(store, name, count)]
+
+    grid_points = [GridPointInfo(**dict([(field, values[field][position])
+                                         for field in values]))
+                   for position in xrange(count)]
 
     return (grid_points, grid_rows, grid_cols)
@@ -0,0 +1,235 @@
+'''
+    File: st_manifest.py
+
+    Purpose: Records what each processing stage consumed and produced, so a
+             later run of the same scene can reuse the results of stages
+             whose inputs, outputs, and configuration have not changed.
+
+    Project: Land Satellites Data Systems Science Research and Development
+             (LSRD) at the USGS EROS
+
+    License: NASA Open Source Agreement 1.3
+'''
+
+import os
+import glob
+import json
+import fnmatch
+import hashlib
+import logging
+
+from lxml import etree
+
+from espa import Metadata
+
+
+MANIFEST_DIRECTORY = 'st_manifests'
+
+# Products added to the XML by the ST processing
+ST_PRODUCTS = ('st_intermediate', 'st', 'st_qa')
+
+
+def expand_patterns(patterns):
+    """Expand glob patterns into the list of matching files
+
+    Args:
+        patterns [<str>]: Filename patterns
+
+    Returns:
+        [<str>]: Sorted names of the regular files matched
+    """
+
+    filenames = set()
+    for pattern in patterns:
+        filenames.update([name for name in glob.glob(pattern)
+                          if os.path.isfile(name)])
+
+    return sorted(filenames)
+
+
+def fingerprint_files(patterns):
+    """Size and modification time for each file matching the patterns
+
+    Args:
+        patterns [<str>]: Filename patterns
+
+    Returns:
+        <dict>: Filename to [size, mtime]
+    """
+
+    fingerprints = dict()
+    for filename in expand_patterns(patterns):
+        status = os.stat(filename)
+        fingerprints[filename] = [status.st_size, status.st_mtime]
+
+    return fingerprints
+
+
+def scene_fingerprint(xml_filename):
+    """Fingerprint of the scene being processed
+
+    Covers the global metadata and the input bands, but not the bands added
+    by the ST processing, since every stage which adds a band updates the
+    XML file.
+
+    Args:
+        xml_filename <str>: XML metadata filename
+
+    Returns:
+        <dict>: The fingerprint
+    """
+
+    espa_metadata = Metadata(xml_filename)
+    espa_metadata.parse()
+
+    metadata_digest = hashlib.sha1(etree.tostring(
+        espa_metadata.xml_object.global_metadata)).hexdigest()
+
+    band_filenames = [str(band.file_name)
+                      for band in espa_metadata.xml_object.bands.band
+                      if band.get('product') not in ST_PRODUCTS]
+
+    return {'metadata': metadata_digest,
+            'bands': fingerprint_files(band_filenames)}
+
+
+def remove_bands(xml_filename, patterns):
+    """Remove the ST bands matching the patterns from the XML
+
+    A stage which is run again would otherwise add a second copy of its
+    band.
+
+    Args:
+        xml_filename <str>: XML metadata filename
+        patterns [<str>]: Band filename patterns
+
+    Returns:
+        <bool>: True if the XML file was updated
+    """
+
+    logger = logging.getLogger(__name__)
+
+    espa_metadata = Metadata(xml_filename)
+    espa_metadata.parse()
+
+    bands = espa_metadata.xml_object.bands
+    removed = False
+    for band in list(bands.band):
+        if band.get('product') not in ST_PRODUCTS:
+            continue
+
+        filename = os.path.basename(str(band.file_name))
+        for pattern in patterns:
+            if fnmatch.fnmatch(filename, os.path.basename(pattern)):
+                logger.info('Removing band {0} from the XML'
+                            .format(filename))
+                bands.remove(band)
+                removed = True
+                break
+
+    if removed:
+        espa_metadata.validate()
+        espa_metadata.write()
+
+    return removed
+
+
+class ManifestStore(object):
+    '''
+    Description:
+        Reads and writes the stage manifests.
+
+        A manifest holds the settings a stage ran with, along with the
+        fingerprints of its input files when it started and of its output
+        files when it completed.
+    '''
+
+    def __init__(self, directory=MANIFEST_DIRECTORY):
+        super(ManifestStore, self).__init__()
+
+        self.directory = directory
+
+    def path(self, name):
+        '''
+        Description:
+            Returns the manifest filename for the stage.
+        '''
+
+        return os.path.join(self.directory, '{0}.json'.format(name))
+
+    def load(self, name):
+        '''
+        Description:
+            Returns the manifest for the stage, or None when there is not a
+            usable one.
+        '''
+
+        logger = logging.getLogger(__name__)
+
+        path = self.path(name)
+        if not os.path.isfile(path):
+            return None
+
+        try:
+            with open(path, 'r') as manifest_fd:
+                return json.load(manifest_fd)
+        except ValueError:
+            logger.warning('Ignoring unreadable manifest {0}'.format(path))
+            return None
+
+    def is_current(self, stage):
+        '''
+        Description:
+            Determines if the results recorded for the stage are still valid.
+        '''
+
+        manifest = self.load(stage.name)
+        if manifest is None:
+            return False
+
+        if manifest['settings'] != stage.settings:
+            return False
+
+        if manifest['inputs'] != fingerprint_files(stage.inputs):
+            return False
+
+        outputs = fingerprint_files(stage.outputs)
+        if not outputs or manifest['outputs'] != outputs:
+            return False
+
+        return True
+
+    def save(self, stage, inputs):
+        '''
+        Description:
+            Records a completed stage.  The file is renamed into place so an
+            interrupted write never leaves a partial manifest.
+        '''
+
+        if not os.path.isdir(self.directory):
+            os.makedirs(self.directory)
+
+        manifest = {'settings': stage.settings,
+                    'inputs': inputs,
+                    'outputs': fingerprint_files(stage.outputs)}
+
+        path = self.path(stage.name)
+        temp_path = '{0}.tmp'.format(path)
+        with open(temp_path, 'w') as manifest_fd:
+            json.dump(manifest, manifest_fd, indent=1, sort_keys=True)
+        os.rename(temp_path, path)
+
+    def remove(self, names):
+        '''
+        Description:
+            Removes the manifests for the stages, and the manifest directory
+            once it is empty.
+        '''
+
+        for name in names:
+            path = self.path(name)
+            if os.path.exists(path):
+                os.unlink(path)
+
+        if os.path.isdir(self.directory) and not os.listdir(self.directory):
+            os.rmdir(self.directory)
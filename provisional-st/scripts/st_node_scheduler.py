@@ -0,0 +1,500 @@
+#! /usr/bin/env python
+
+'''
+    File: st_node_scheduler.py
+
+    Purpose: Shares one budget of worker slots between all of the ST jobs
+             running on a node.  The scheduler listens on a Unix socket and
+             leases slots to MODTRAN runs, gdalwarp, and the compiled
+             applications, favoring the jobs closest to completion.
+
+             Jobs find the scheduler through the ST_SCHEDULER_SOCKET
+             environment variable.  Without it, or when the scheduler can
+             not be reached, every lease is granted in full immediately and
+             processing is as before.
+
+    Project: Land Satellites Data Systems Science Research and Development
+             (LSRD) at the USGS EROS
+
+    License: NASA Open Source Agreement 1.3
+'''
+
+import os
+import sys
+import json
+import errno
+import socket
+import logging
+import threading
+import multiprocessing
+from argparse import ArgumentParser
+
+import st_utilities as util
+
+
+# Environment variables through which jobs find the scheduler and identify
+# themselves when requesting a lease
+SOCKET_ENV = 'ST_SCHEDULER_SOCKET'
+JOB_ENV = 'ST_SCHEDULER_JOB'
+
+# Requests
+REGISTER = 'register'
+PROGRESS = 'progress'
+ACQUIRE = 'acquire'
+
+
+def scheduler_socket():
+    """The scheduler socket for this job
+
+    Returns:
+        <str>: The socket path, or None if no scheduler is in use
+    """
+
+    path = os.environ.get(SOCKET_ENV, '')
+    if len(path) == 0:
+        return None
+
+    return path
+
+
+def send_message(connection_fd, message):
+    """Writes one request or reply
+
+    Args:
+        connection_fd <file>: The connection
+        message <dict>: The message
+    """
+
+    connection_fd.write(''.join([json.dumps(message), '\n']))
+    connection_fd.flush()
+
+
+def receive_message(connection_fd):
+    """Reads one request or reply
+
+    Args:
+        connection_fd <file>: The connection
+
+    Returns:
+        <dict>: The message, or None if the connection was closed
+    """
+
+    line = connection_fd.readline()
+    if len(line) == 0:
+        return None
+
+    return json.loads(line)
+
+
+class NodeScheduler(object):
+    '''
+    Description:
+        Tracks the registered jobs and the slots leased to them.
+
+        A waiting lease is granted when it is the highest priority waiter
+        and at least its minimum number of slots is free.  It is given as
+        many of the slots it asked for as are free.  Priority goes to the
+        job with the largest fraction of its stages completed, then to the
+        job which registered first.  Leases from jobs which did not register
+        come last.
+    '''
+
+    def __init__(self, slots):
+        super(NodeScheduler, self).__init__()
+
+        self.slots = max(1, slots)
+        self.free_slots = self.slots
+        self.jobs = dict()
+        self.waiting = list()
+        self.sequence = 0
+        self.condition = threading.Condition()
+
+    def register(self, job):
+        '''
+        Description:
+            Adds a job, which has not completed anything yet.
+        '''
+
+        with self.condition:
+            self.sequence += 1
+            self.jobs[job] = {'order': self.sequence,
+                              'fraction': 0.0}
+            self.condition.notify_all()
+
+    def progress(self, job, completed, total):
+        '''
+        Description:
+            Records the number of stages a job has completed.
+        '''
+
+        with self.condition:
+            if job in self.jobs:
+                self.jobs[job]['fraction'] = (float(completed) /
+                                              max(1, total))
+                self.condition.notify_all()
+
+    def unregister(self, job):
+        '''
+        Description:
+            Removes a job.
+        '''
+
+        with self.condition:
+            self.jobs.pop(job, None)
+            self.condition.notify_all()
+
+    def _priority(self, request):
+        '''
+        Description:
+            Sort key for a waiting lease, lowest first.
+        '''
+
+        job = self.jobs.get(request['job'])
+        if job is None:
+            return (1, 0.0, request['order'])
+
+        return (0, -job['fraction'], job['order'])
+
+    def acquire(self, job, slots, minimum):
+        '''
+        Description:
+            Waits for and leases slots.
+
+        Returns:
+            <int>: The number of slots leased
+        '''
+
+        slots = min(max(1, slots), self.slots)
+        minimum = min(max(1, minimum), slots)
+
+        with self.condition:
+            self.sequence += 1
+            request = {'job': job, 'order': self.sequence}
+            self.waiting.append(request)
+
+            try:
+                while True:
+                    best = min(self.waiting, key=self._priority)
+                    if best is request and self.free_slots >= minimum:
+                        break
+                    self.condition.wait()
+            finally:
+                self.waiting.remove(request)
+                self.condition.notify_all()
+
+            granted = min(slots, self.free_slots)
+            self.free_slots -= granted
+
+        return granted
+
+    def release(self, slots):
+        '''
+        Description:
+            Returns leased slots.
+        '''
+
+        with self.condition:
+            self.free_slots += slots
+            self.condition.notify_all()
+
+    def handle_connection(self, connection):
+        '''
+        Description:
+            Serves one client.  A connection either registers a job, and
+            then reports its progress, or acquires one lease which is held
+            until the connection closes.  Closing the connection, which also
+            happens when the client exits for any reason, unregisters the
+            job or releases the lease.
+        '''
+
+        logger = logging.getLogger(__name__)
+
+        connection_fd = connection.makefile('rw')
+        registered = None
+        leased = 0
+
+        try:
+            while True:
+                message = receive_message(connection_fd)
+                if message is None:
+                    break
+
+                request = message.get('request')
+                if request == REGISTER and registered is None:
+                    registered = message['job']
+                    self.register(registered)
+                    logger.info('Registered job [{0}]'.format(registered))
+                    send_message(connection_fd, {'status': 'ok'})
+
+                elif request == PROGRESS and registered is not None:
+                    self.progress(registered, int(message['completed']),
+                                  int(message['total']))
+
+                elif request == ACQUIRE and not leased:
+                    leased = self.acquire(message.get('job'),
+                                          int(message['slots']),
+                                          int(message.get('minimum', 1)))
+                    logger.debug('Leased {0} slot(s) to job [{1}]'
+                                 .format(leased, message.get('job')))
+                    send_message(connection_fd, {'granted': leased})
+
+                else:
+                    send_message(connection_fd,
+                                 {'error': 'Unexpected request [{0}]'
+                                           .format(request)})
+        except (socket.error, ValueError, KeyError):
+            logger.exception('Dropping connection')
+        finally:
+            if leased:
+                self.release(leased)
+            if registered is not None:
+                self.unregister(registered)
+                logger.info('Unregistered job [{0}]'.format(registered))
+            connection_fd.close()
+            connection.close()
+
+    def serve(self, path):
+        '''
+        Description:
+            Listens on the socket and serves each client on its own thread.
+        '''
+
+        logger = logging.getLogger(__name__)
+
+        try:
+            os.unlink(path)
+        except OSError as ose:
+            if ose.errno != errno.ENOENT:
+                raise
+
+        listener = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)
+        listener.bind(path)
+        listener.listen(128)
+
+        logger.info('Scheduling {0} slot(s) on [{1}]'
+                    .format(self.slots, path))
+
+        try:
+            while True:
+                (connection, dummy) = listener.accept()
+                thread = threading.Thread(target=self.handle_connection,
+                                          args=(connection,))
+                thread.daemon = True
+                thread.start()
+        finally:
+            listener.close()
+            os.unlink(path)
+
+
+def connect(path):
+    """Connects to the scheduler
+
+    Args:
+        path <str>: The scheduler socket
+
+    Returns:
+        <tuple>: The socket and a file for reading and writing it
+    """
+
+    connection = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)
+    connection.connect(path)
+
+    return (connection, connection.makefile('rw'))
+
+
+class SlotLease(object):
+    '''
+    Description:
+        Leases worker slots from the node scheduler for the duration of a
+        with statement, which provides the number of slots granted.
+
+        Between minimum and slots are granted.  Without a scheduler, all of
+        the slots are granted.
+    '''
+
+    def __init__(self, slots, minimum=1):
+        super(SlotLease, self).__init__()
+
+        self.slots = slots
+        self.minimum = minimum
+        self.connection = None
+        self.connection_fd = None
+
+    def __enter__(self):
+        logger = logging.getLogger(__name__)
+
+        path = scheduler_socket()
+        if path is None:
+            return self.slots
+
+        try:
+            (self.connection, self.connection_fd) = connect(path)
+            send_message(self.connection_fd,
+                         {'request': ACQUIRE,
+                          'job': os.environ.get(JOB_ENV),
+                          'slots': self.slots,
+                          'minimum': self.minimum})
+            reply = receive_message(self.connection_fd)
+            if reply is None or 'granted' not in reply:
+                raise socket.error('No lease from [{0}]'.format(path))
+        except socket.error:
+            logger.warning('Node scheduler unavailable, running without a'
+                           ' lease')
+            self.close()
+            return self.slots
+
+        return reply['granted']
+
+    def __exit__(self, exc_type, exc_value, traceback):
+        self.close()
+
+    def close(self):
+        '''
+        Description:
+            Releases the lease.
+        '''
+
+        if self.connection_fd is not None:
+            self.connection_fd.close()
+            self.connection_fd = None
+        if self.connection is not None:
+            self.connection.close()
+            self.connection = None
+
+
+class JobRegistration(object):
+    '''
+    Description:
+        Registers a job with the node scheduler and reports its progress.
+
+        The job identifier is placed in the environment, so the leases of
+        the job's stages and of the applications they start are given the
+        job's priority.
+    '''
+
+    def __init__(self, job):
+        super(JobRegistration, self).__init__()
+
+        self.job = job
+        self.connection = None
+        self.connection_fd = None
+
+        logger = logging.getLogger(__name__)
+
+        path = scheduler_socket()
+        if path is None:
+            return
+
+        try:
+            (self.connection, self.connection_fd) = connect(path)
+            send_message(self.connection_fd, {'request': REGISTER,
+                                              'job': job})
+            if receive_message(self.connection_fd) is None:
+                raise socket.error('No reply from [{0}]'.format(path))
+        except socket.error:
+            logger.warning('Node scheduler unavailable, running without'
+                           ' registering')
+            self.close()
+            return
+
+        os.environ[JOB_ENV] = job
+
+    def progress(self, completed, total):
+        '''
+        Description:
+            Reports the number of stages completed.  Suitable for use as the
+            progress callback of a StageGraph.
+        '''
+
+        if self.connection_fd is None:
+            return
+
+        try:
+            send_message(self.connection_fd, {'request': PROGRESS,
+                                              'completed': completed,
+                                              'total': total})
+        except socket.error:
+            logger = logging.getLogger(__name__)
+            logger.warning('Lost the node scheduler connection')
+            self.close()
+
+    def close(self):
+        '''
+        Description:
+            Unregisters the job.
+        '''
+
+        if self.connection_fd is not None:
+            self.connection_fd.close()
+            self.connection_fd = None
+        if self.connection is not None:
+            self.connection.close()
+            self.connection = None
+
+
+def retrieve_command_line_arguments():
+    """Read arguments from the command line
+
+    Returns:
+        args <arguments>: The arguments read from the command line
+    """
+
+    parser = ArgumentParser(description='Shares worker slots between the ST'
+                                        ' jobs on a node')
+
+    parser.add_argument('--version',
+                        action='version',
+                        version=util.Version.version_text())
+
+    parser.add_argument('--socket',
+                        action='store', dest='socket',
+                        required=False, default=scheduler_socket(),
+                        help='The Unix socket to listen on, defaulting to'
+                             ' ${0}'.format(SOCKET_ENV))
+
+    parser.add_argument('--slots',
+                        action='store', dest='slots', type=int,
+                        required=False,
+                        default=multiprocessing.cpu_count(),
+                        help='The number of worker slots on the node,'
+                             ' defaulting to the number of cores')
+
+    parser.add_argument('--debug',
+                        action='store_true', dest='debug',
+                        required=False, default=False,
+                        help='Output debug messages')
+
+    args = parser.parse_args()
+
+    if args.socket is None:
+        raise Exception('--socket must be specified on the command line')
+
+    return args
+
+
+def main():
+    """Main processing for the node scheduler
+    """
+
+    # Command Line Arguments
+    args = retrieve_command_line_arguments()
+
+    # Check logging level
+    logging_level = logging.INFO
+    if args.debug:
+        logging_level = logging.DEBUG
+
+    # Setup the default logger format and level.  Log to STDOUT.
+    logging.basicConfig(format=('%(asctime)s.%(msecs)03d %(process)d'
+                                ' %(levelname)-8s'
+                                ' %(filename)s:%(lineno)d:'
+                                '%(funcName)s -- %(message)s'),
+                        datefmt='%Y-%m-%d %H:%M:%S',
+                        level=logging_level,
+                        stream=sys.stdout)
+
+    NodeScheduler(slots=args.slots).serve(args.socket)
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,378 @@
+'''
+    File: st_pipeline.py
+
+    Purpose: Runs the ST python processing stages within a single process,
+             sharing the parsed XML metadata between them and optionally
+             handing raster bands from one stage to the next in memory.
+
+    Project: Land Satellites Data Systems Science Research and Development
+             (LSRD) at the USGS EROS
+
+    License: NASA Open Source Agreement 1.3
+'''
+
+import logging
+
+from osgeo import gdal
+
+from espa import Metadata
+
+import st_utilities as util
+import emissivity_utilities as emis_util
+
+from st_grid_points import read_grid_points
+from st_node_scheduler import SlotLease
+from st_run_modtran import LOCAL_EXECUTOR
+
+import st_determine_grid_points
+import st_geometry_cache
+import st_extract_auxiliary_narr_data
+import st_build_modtran_input
+import st_surrogate
+import estimate_landsat_emissivity
+import estimate_landsat_emissivity_stdev
+import build_st_data
+import st_generate_distance_to_cloud
+import st_generate_qa
+import st_convert_bands
+
+
+NO_DATA_VALUE = -9999
+
+
+class PipelineContext(object):
+    '''
+    Description:
+        Holds the state shared between the stages of an in-process run.
+    '''
+
+    def __init__(self, xml_filename, in_memory, debug):
+        super(PipelineContext, self).__init__()
+
+        self.xml_filename = xml_filename
+        self.in_memory = in_memory
+        self.debug = debug
+
+        self.espa_metadata = None
+        self.refresh_metadata()
+
+    def refresh_metadata(self):
+        '''
+        Description:
+            Reparses the XML metadata.  Required after a stage which updates
+            the XML file through something other than the shared object.
+        '''
+
+        self.espa_metadata = Metadata(self.xml_filename)
+        self.espa_metadata.parse()
+
+
+def determine_grid_points(context, data_path, clear_sky=False,
+                          geometry_cache=None):
+    """Determines the grid points to utilize
+
+    Args:
+        context <PipelineContext>: Shared processing state
+        data_path <str>: Directory for ST data files
+        clear_sky <bool>: Only run MODTRAN for points near clear pixels
+        geometry_cache <str>: Directory of the geometry cache, or None
+    """
+
+    logger = logging.getLogger(__name__)
+
+    logger.info('Determining grid points')
+
+    gdal_objs = st_determine_grid_points.initialize_gdal_objects(
+        espa_metadata=context.espa_metadata)
+
+    data_bounds = st_determine_grid_points.determine_adjusted_data_bounds(
+        espa_metadata=context.espa_metadata, gdal_objs=gdal_objs)
+    logger.debug(str(data_bounds))
+
+    qa_filename = None
+    if clear_sky:
+        qa_filename = st_determine_grid_points.find_pixel_qa_filename(
+            context.espa_metadata)
+
+    if geometry_cache is not None:
+        geometry_cache = st_geometry_cache.footprint_directory(
+            geometry_cache, context.espa_metadata)
+
+    st_determine_grid_points.generate_point_grid(
+        debug=context.debug, gdal_objs=gdal_objs, data_bounds=data_bounds,
+        data_path=data_path, qa_filename=qa_filename,
+        geometry_cache=geometry_cache)
+
+
+def extract_auxiliary_narr_data(context, aux_path):
+    """Extracts the NARR parameters required for the scene
+
+    Args:
+        context <PipelineContext>: Shared processing state
+        aux_path <str>: Directory for the auxiliary data files
+    """
+
+    logger = logging.getLogger(__name__)
+
+    logger.info('Extracting ST AUX data')
+    st_extract_auxiliary_narr_data.extract_narr_aux_data(
+        context.espa_metadata, aux_path)
+
+
+def build_modtran_input(context, data_path, cluster_tolerance=None):
+    """Generates the MODTRAN tape5 files for each grid point
+
+    Args:
+        context <PipelineContext>: Shared processing state
+        data_path <str>: Directory for ST data files
+        cluster_tolerance <ProfileTolerance>: Largest profile differences of
+                                              points sharing MODTRAN runs,
+                                              or None to run every point
+    """
+
+    logger = logging.getLogger(__name__)
+
+    logger.info('Generating MODTRAN tape5 files')
+
+    (grid_points, dummy1, dummy2) = read_grid_points()
+
+    std_atmos = [layer for layer in
+                 st_build_modtran_input.load_std_atmosphere(
+                     data_path=data_path)]
+
+    st_build_modtran_input.generate_modtran_tape5_files(
+        espa_metadata=context.espa_metadata,
+        data_path=data_path,
+        std_atmos=std_atmos,
+        grid_points=grid_points,
+        cluster_tolerance=cluster_tolerance)
+
+
+def generate_emissivity_products(context, server_name, server_path):
+    """Generate the required Emissivity products
+
+    Args:
+        context <PipelineContext>: Shared processing state
+        server_name <str>: Name of the ASTER GED server
+        server_path <str>: Path on the ASTER GED server
+    """
+
+    st_data_dir = emis_util.get_env_var('ST_DATA_DIR', None)
+
+    # Both bands are added to the XML with a single write
+    with util.MetadataTransaction(context.espa_metadata):
+        estimate_landsat_emissivity.generate_emissivity_data(
+            xml_filename=context.xml_filename,
+            server_name=server_name,
+            server_path=server_path,
+            st_data_dir=st_data_dir,
+            no_data_value=NO_DATA_VALUE,
+            intermediate=False,
+            espa_metadata=context.espa_metadata)
+
+        estimate_landsat_emissivity_stdev.generate_emissivity_data(
+            xml_filename=context.xml_filename,
+            server_name=server_name,
+            server_path=server_path,
+            st_data_dir=st_data_dir,
+            no_data_value=NO_DATA_VALUE,
+            intermediate=False,
+            espa_metadata=context.espa_metadata)
+
+
+def run_modtran(context, modtran_data_path, process_count,
+                executor=LOCAL_EXECUTOR, queue_directory=None):
+    """Run MODTRAN for the grid points that require it
+
+    MODTRAN changes the working directory for each run, so it is kept in its
+    own process to leave the stages running beside it unaffected.
+
+    Args:
+        context <PipelineContext>: Shared processing state
+        modtran_data_path <str>: Directory for the MODTRAN 'DATA' files
+        process_count <str>: Number of processes to use
+        executor <str>: How the MODTRAN runs are made
+        queue_directory <str>: Work queue directory for the queue executor
+    """
+
+    logger = logging.getLogger(__name__)
+
+    cmd = ['st_run_modtran.py',
+           '--modtran_data_path', modtran_data_path,
+           '--process_count', str(process_count),
+           '--executor', executor]
+    if queue_directory is not None:
+        cmd.extend(['--queue_directory', queue_directory])
+    if context.debug:
+        cmd.append('--debug')
+
+    output = ''
+    try:
+        output = util.System.execute_cmd(' '.join(cmd))
+    finally:
+        if len(output) > 0:
+            logger.info(output)
+
+
+def run_surrogate(context, table_filename):
+    """Predict the MODTRAN point parameters from a surrogate table
+
+    Args:
+        context <PipelineContext>: Shared processing state
+        table_filename <str>: The surrogate table
+    """
+
+    logger = logging.getLogger(__name__)
+
+    logger.info('Predicting MODTRAN point parameters')
+
+    st_surrogate.generate_point_parameters(
+        table_filename=table_filename,
+        satellite=str(
+            context.espa_metadata.xml_object.global_metadata.satellite))
+
+
+def generate_atmospheric_parameters(context, point_parameters=None,
+                                    all_thermal_bands=False,
+                                    geometry_cache=None,
+                                    map_space_cells=False):
+    """Generate the thermal, upwelled, and downwelled radiance bands as well
+       as the atmospheric transmittance band
+
+    Args:
+        context <PipelineContext>: Shared processing state
+        point_parameters <str>: File of the point parameters to use instead
+                                of the MODTRAN results
+        all_thermal_bands <bool>: Also generate the bands of Landsat 8
+                                  band 11
+        geometry_cache <str>: Directory of the geometry cache, or None
+        map_space_cells <bool>: Select the interpolation cells in map
+                                coordinates
+    """
+
+    logger = logging.getLogger(__name__)
+
+    # This is a compiled application, so it still runs as its own process
+    cmd = ['st_atmospheric_parameters', '--xml', context.xml_filename]
+    if point_parameters is not None:
+        cmd.extend(['--point-parameters', point_parameters])
+    if all_thermal_bands:
+        cmd.append('--all-thermal-bands')
+    if geometry_cache is not None:
+        cmd.extend(['--geometry-cache', st_geometry_cache.footprint_directory(
+            geometry_cache, context.espa_metadata)])
+    if map_space_cells:
+        cmd.append('--map-space-cells')
+    if context.debug:
+        cmd.append('--debug')
+
+    cmd = ' '.join(cmd)
+    output = ''
+    try:
+        logger.info('Calling [{0}]'.format(cmd))
+        with SlotLease(slots=1):
+            output = util.System.execute_cmd(cmd)
+    except Exception:
+        logger.error('Failed creating atmospheric parameters and generating '
+                     'intermediate data')
+        raise
+    finally:
+        if len(output) > 0:
+            logger.info(output)
+
+    # The application added its bands to the XML file
+    context.refresh_metadata()
+
+
+def generate_surface_temperature(context):
+    """Generate the Surface Temperature band
+
+    Args:
+        context <PipelineContext>: Shared processing state
+    """
+
+    logger = logging.getLogger(__name__)
+
+    try:
+        current_processor = build_st_data.BuildSTData(
+            xml_filename=context.xml_filename)
+        current_processor.generate_data()
+    except Exception:
+        logger.error('Failed processing Surface Temperature')
+        raise
+
+    # The band was added to the XML file through the metadata_api
+    context.refresh_metadata()
+
+
+def generate_distance_to_cloud(context):
+    """Generate the distance to cloud band
+
+    Args:
+        context <PipelineContext>: Shared processing state
+    """
+
+    st_generate_distance_to_cloud.generate_distance(
+        xml_filename=context.xml_filename,
+        no_data_value=NO_DATA_VALUE,
+        espa_metadata=context.espa_metadata)
+
+
+def generate_qa(context):
+    """Generate the surface temperature quality band
+
+    Args:
+        context <PipelineContext>: Shared processing state
+    """
+
+    st_generate_qa.generate_qa(xml_filename=context.xml_filename,
+                               no_data_value=NO_DATA_VALUE,
+                               espa_metadata=context.espa_metadata)
+
+
+def convert_intermediate_bands(context):
+    """Convert and scale the intermediate bands
+
+    Args:
+        context <PipelineContext>: Shared processing state
+    """
+
+    st_convert_bands.convert_bands(xml_filename=context.xml_filename,
+                                   no_data_value=NO_DATA_VALUE,
+                                   espa_metadata=context.espa_metadata)
+
+
+def initialize(xml_filename, in_memory, debug):
+    """Prepare for running the stages
+
+    Args:
+        xml_filename <str>: XML metadata filename
+        in_memory <bool>: Hand raster bands between stages in memory
+        debug <bool>: Debug logging and processing
+
+    Returns:
+        <PipelineContext>: The shared state to hand to each stage
+    """
+
+    # Register all the gdal drivers
+    gdal.AllRegister()
+
+    if in_memory:
+        util.RasterCache.enable()
+
+    return PipelineContext(xml_filename=xml_filename,
+                           in_memory=in_memory,
+                           debug=debug)
+
+
+def release(context):
+    """Release any memory held on behalf of the stages
+
+    Args:
+        context <PipelineContext>: Shared processing state
+    """
+
+    if context.in_memory:
+        util.RasterCache.disable()
+
+    context.espa_metadata = None
@@ -0,0 +1,568 @@
+#! /usr/bin/env python
+
+'''
+    File: st_point_query.py
+
+    Purpose: Determines surface temperature at a list of sites within a
+             scene, such as buoys and towers used for validation, without
+             processing the whole scene.
+
+             A small window scene is created around each site, and sites
+             near each other share one.  The windows are processed as one
+             batch, so the NARR data is extracted once, the ASTER GED tiles
+             are downloaded once, and MODTRAN is run once for each NARR
+             point shared by the windows.  Only the NARR points surrounding
+             the windows are run.  The products are then read at the site
+             pixels and written to a CSV file.
+
+             The distance to cloud at each site is measured in the scene
+             rather than the window, since clouds outside of a window still
+             affect the uncertainty, which is recalculated at the site with
+             it.  Only the neighbourhood of the site needed to find the
+             nearest cloud is searched.
+
+    Project: Land Satellites Data Systems Science Research and Development
+             (LSRD) at the USGS EROS
+
+    License: NASA Open Source Agreement 1.3
+'''
+
+import os
+import sys
+import csv
+import math
+import logging
+from argparse import ArgumentParser
+
+import numpy as np
+from osgeo import gdal
+
+from espa import Metadata
+
+import st_utilities as util
+import st_window
+import st_determine_grid_points as grid
+import st_generate_qa as qa
+from st_generate_distance_to_cloud import PQA_CLOUD, PQA_SINGLE_BIT
+
+
+NO_DATA_VALUE = -9999
+
+# Window processed around each site, in pixels
+DEFAULT_WINDOW_SIZE = 33
+
+# Largest window shared by sites near each other, in pixels
+MAXIMUM_SHARED_WINDOW = 256
+
+# Pixel size used for cloud distances, as in the distance to cloud band, and
+# the distance beyond which the uncertainty no longer changes
+CLOUD_DISTANCE_PIXEL_SIZE = 0.03
+MAXIMUM_CLOUD_DISTANCE = 200.0
+
+# Pixels around a site first searched for clouds.  The search is doubled
+# until it finds a cloud within it, or reaches the distance beyond which
+# the uncertainty no longer changes.
+FIRST_CLOUD_RADIUS = 64
+MAXIMUM_CLOUD_RADIUS = int(math.ceil(MAXIMUM_CLOUD_DISTANCE /
+                                     CLOUD_DISTANCE_PIXEL_SIZE))
+
+# Band names in the window scenes, and the CSV columns they are written to
+SITE_BANDS = (('st_thermal_radiance', 'thermal_radiance'),
+              ('st_atmospheric_transmittance', 'transmittance'),
+              ('st_upwelled_radiance', 'upwelled_radiance'),
+              ('st_downwelled_radiance', 'downwelled_radiance'),
+              ('emis', 'emissivity'),
+              ('emis_stdev', 'emissivity_stdev'),
+              ('surface_temperature', 'surface_temperature'))
+
+SITE_COLUMNS = (['name', 'latitude', 'longitude', 'line', 'sample'] +
+                [column for (dummy, column) in SITE_BANDS] +
+                ['cloud_distance', 'uncertainty', 'status'])
+
+
+class Site(object):
+    '''
+    Description:
+        A location at which surface temperature is wanted.
+    '''
+
+    def __init__(self, name, latitude, longitude):
+        super(Site, self).__init__()
+
+        self.name = name
+        self.latitude = latitude
+        self.longitude = longitude
+        self.line = None
+        self.sample = None
+        self.window = None
+        self.values = dict()
+        self.status = 'ok'
+
+
+def retrieve_command_line_arguments():
+    """Read arguments from the command line
+
+    Returns:
+        args <arguments>: The arguments read from the command line
+    """
+
+    parser = ArgumentParser(description='Determines surface temperature at'
+                                        ' sites within a scene')
+
+    parser.add_argument('--version',
+                        action='version',
+                        version=util.Version.version_text())
+
+    parser.add_argument('--xml',
+                        action='store', dest='xml_filename',
+                        required=False, default=None,
+                        help='The XML metadata file to use')
+
+    parser.add_argument('--sites',
+                        action='store', dest='sites_filename',
+                        required=False, default=None,
+                        help='CSV file of name,latitude,longitude lines')
+
+    parser.add_argument('--output',
+                        action='store', dest='output_filename',
+                        required=False, default='st_point_query.csv',
+                        help='The CSV file to write')
+
+    parser.add_argument('--window-size',
+                        action='store', dest='window_size', type=int,
+                        required=False, default=DEFAULT_WINDOW_SIZE,
+                        help='Lines and samples processed around each'
+                             ' site, sites near each other sharing a window'
+                             ' of up to {0}'.format(MAXIMUM_SHARED_WINDOW))
+
+    parser.add_argument('--keep-temporary-data',
+                        action='store_true', dest='temporary',
+                        required=False, default=False,
+                        help='Keep the shared NARR and MODTRAN data')
+
+    parser.add_argument('--debug',
+                        action='store_true', dest='debug',
+                        required=False, default=False,
+                        help='Output debug messages and/or keep debug data')
+
+    args = parser.parse_args()
+
+    if args.xml_filename is None:
+        raise Exception('--xml must be specified on the command line')
+
+    if args.sites_filename is None:
+        raise Exception('--sites must be specified on the command line')
+
+    if args.window_size < 1:
+        raise Exception('--window-size must be at least 1')
+
+    return args
+
+
+def read_sites(sites_filename):
+    """Read the sites
+
+    Blank lines, comments starting with '#', and a header line are skipped.
+
+    Args:
+        sites_filename <str>: CSV file of name,latitude,longitude lines
+
+    Returns:
+        [<Site>]: The sites
+    """
+
+    sites = list()
+    with open(sites_filename, 'r') as sites_fd:
+        for row in csv.reader(sites_fd):
+            if len(row) == 0 or row[0].strip().startswith('#'):
+                continue
+
+            try:
+                (latitude, longitude) = (float(row[1]), float(row[2]))
+            except (ValueError, IndexError):
+                if len(sites) == 0:
+                    continue
+                raise Exception('Invalid site [{0}] in [{1}]'
+                                .format(','.join(row), sites_filename))
+
+            sites.append(Site(row[0].strip(), latitude, longitude))
+
+    return sites
+
+
+def locate_sites(espa_metadata, sites, window_size):
+    """Determine the pixel and the window of each site
+
+    Args:
+        espa_metadata <espa.Metadata>: The metadata for the scene
+        sites [<Site>]: The sites
+        window_size <int>: Lines and samples around each site
+    """
+
+    gdal_objs = grid.initialize_gdal_objects(espa_metadata=espa_metadata)
+    transform = gdal_objs.data_transform
+
+    located = list()
+    for site in sites:
+        (map_x, map_y, dummy) = gdal_objs.ll_to_data.TransformPoint(
+            site.longitude, site.latitude)
+
+        line = int(math.floor((map_y - transform[3]) / transform[5]))
+        sample = int(math.floor((map_x - transform[0]) / transform[1]))
+
+        if (line < 0 or line >= gdal_objs.nlines or
+                sample < 0 or sample >= gdal_objs.nsamps):
+            site.status = 'outside scene'
+            continue
+
+        site.line = line
+        site.sample = sample
+        located.append(site)
+
+    for group in group_sites(located, window_size):
+        window = group_window(group, window_size, gdal_objs.nlines,
+                              gdal_objs.nsamps)
+        for site in group:
+            site.window = window
+
+
+def group_sites(sites, window_size):
+    """Group the sites near enough to each other to share a window
+
+    Args:
+        sites [<Site>]: The located sites
+        window_size <int>: Lines and samples around each site
+
+    Returns:
+        [[<Site>]]: The sites of each window
+    """
+
+    def fits(group):
+        lines = [site.line for site in group]
+        samples = [site.sample for site in group]
+        return (max(lines) - min(lines) + window_size <=
+                MAXIMUM_SHARED_WINDOW and
+                max(samples) - min(samples) + window_size <=
+                MAXIMUM_SHARED_WINDOW)
+
+    groups = list()
+    for site in sorted(sites, key=lambda site: (site.line, site.sample)):
+        for group in groups:
+            if fits(group + [site]):
+                group.append(site)
+                break
+        else:
+            groups.append([site])
+
+    return groups
+
+
+def group_window(group, window_size, nlines, nsamps):
+    """The window covering window_size pixels around each site of a group
+
+    Args:
+        group [<Site>]: The sites sharing the window
+        window_size <int>: Lines and samples around each site
+        nlines <int>: Lines in the scene
+        nsamps <int>: Samples in the scene
+
+    Returns:
+        <Window>: The window
+    """
+
+    first_line = min([site.line for site in group])
+    first_sample = min([site.sample for site in group])
+
+    window_lines = min(max([site.line for site in group]) - first_line +
+                       window_size, nlines)
+    window_samples = min(max([site.sample for site in group]) -
+                         first_sample + window_size, nsamps)
+
+    # The window is centered on the sites where the scene allows
+    first_line = min(max(0, first_line - window_size // 2),
+                     nlines - window_lines)
+    first_sample = min(max(0, first_sample - window_size // 2),
+                       nsamps - window_samples)
+
+    return st_window.Window(line=first_line, sample=first_sample,
+                            lines=window_lines, samples=window_samples)
+
+
+def site_cloud_distance(raster, nlines, nsamps, site):
+    """The distance in pixels from a site to the nearest cloud
+
+    Squares around the site are searched, doubling in size until a cloud
+    is found within the square's radius, since any cloud outside of it is
+    further away.
+
+    Args:
+        raster <gdal.Band>: The pixel QA band
+        nlines <int>: Lines in the band
+        nsamps <int>: Samples in the band
+        site <Site>: The site
+
+    Returns:
+        <float>: The distance, or None when there is no cloud within
+                 MAXIMUM_CLOUD_RADIUS
+    """
+
+    distance = None
+    radius = FIRST_CLOUD_RADIUS
+    while True:
+        first_line = max(0, site.line - radius)
+        first_sample = max(0, site.sample - radius)
+        last_line = min(nlines, site.line + radius + 1)
+        last_sample = min(nsamps, site.sample + radius + 1)
+
+        block = raster.ReadAsArray(first_sample, first_line,
+                                   last_sample - first_sample,
+                                   last_line - first_line)
+        cloud = np.bitwise_and(np.right_shift(block, PQA_CLOUD),
+                               PQA_SINGLE_BIT)
+
+        (lines, samples) = np.nonzero(cloud)
+        if lines.size > 0:
+            distance = math.sqrt(float(np.min(
+                (lines + first_line - site.line)**2 +
+                (samples + first_sample - site.sample)**2)))
+            if distance <= radius:
+                return distance
+
+        whole_scene = (first_line == 0 and first_sample == 0 and
+                       last_line == nlines and last_sample == nsamps)
+        if whole_scene or radius >= MAXIMUM_CLOUD_RADIUS:
+            return distance
+
+        radius *= 2
+
+
+def site_cloud_distances(espa_metadata, sites):
+    """Measure the distance from each site to the nearest cloud in the scene
+
+    Args:
+        espa_metadata <espa.Metadata>: The metadata for the scene
+        sites [<Site>]: The sites within the scene
+    """
+
+    qa_filename = None
+    for band in espa_metadata.xml_object.bands.band:
+        if (band.get('product') == 'level2_qa' and
+                band.get('name') == 'pixel_qa'):
+            qa_filename = str(band.file_name)
+
+    if qa_filename is None:
+        raise Exception('Failed to find the PIXEL QA band in the input data')
+
+    dataset = gdal.Open(qa_filename)
+    raster = dataset.GetRasterBand(1)
+
+    for site in sites:
+        distance = site_cloud_distance(raster, dataset.RasterYSize,
+                                       dataset.RasterXSize, site)
+        if distance is None:
+            site.values['cloud_distance'] = MAXIMUM_CLOUD_DISTANCE
+        else:
+            site.values['cloud_distance'] = min(
+                distance * CLOUD_DISTANCE_PIXEL_SIZE, MAXIMUM_CLOUD_DISTANCE)
+
+    del raster
+    del dataset
+
+
+def process_windows(xml_filename, sites, work_directory, temporary, debug):
+    """Create the window scenes and generate their products as a batch
+
+    Args:
+        xml_filename <str>: XML metadata filename of the scene
+        sites [<Site>]: The sites within the scene
+        work_directory <str>: Directory for the shared batch data
+        temporary <bool>: Keep the shared batch data
+        debug <bool>: Debug logging and processing
+
+    Returns:
+        <dict>: The window scene directory of each window
+    """
+
+    logger = logging.getLogger(__name__)
+
+    directories = dict()
+    for site in sites:
+        if site.window not in directories:
+            directories[site.window] = st_window.create_window_scene(
+                xml_filename=xml_filename, window=site.window)
+
+    window_xmls = [os.path.join(directory, os.path.basename(xml_filename))
+                   for directory in sorted(directories.values())]
+
+    cmd = ['st_generate_products_batch.py',
+           '--keep-intermediate-data',
+           '--work-directory', work_directory,
+           '--xml'] + window_xmls
+    if temporary:
+        cmd.append('--keep-temporary-data')
+    if debug:
+        cmd.append('--debug')
+
+    # A window which failed leaves its sites without values, which is
+    # reported for them, rather than failing every site
+    output = ''
+    try:
+        output = util.System.execute_cmd(' '.join(cmd))
+    except Exception:
+        logger.exception('Failed generating the products of some windows')
+    finally:
+        if len(output) > 0:
+            logger.info(output)
+
+    return directories
+
+
+def read_site_values(directory, xml_filename, sites):
+    """Read the products at the site pixels
+
+    Args:
+        directory <str>: The window scene directory
+        xml_filename <str>: Base XML metadata filename
+        sites [<Site>]: The sites within the window
+    """
+
+    espa_metadata = Metadata(os.path.join(directory, xml_filename))
+    espa_metadata.parse()
+
+    bands = dict([(band.get('name'), band)
+                  for band in espa_metadata.xml_object.bands.band])
+
+    for (name, column) in SITE_BANDS:
+        band = bands.get(name)
+        if band is None:
+            for site in sites:
+                site.status = 'missing {0}'.format(name)
+            continue
+
+        scale_factor = float(band.get('scale_factor', 1.0))
+        add_offset = float(band.get('add_offset', 0.0))
+        fill_value = float(band.get('fill_value', NO_DATA_VALUE))
+
+        dataset = gdal.Open(os.path.join(directory, str(band.file_name)))
+        raster = dataset.GetRasterBand(1)
+        for site in sites:
+            value = float(raster.ReadAsArray(site.sample - site.window.sample,
+                                             site.line - site.window.line,
+                                             1, 1)[0][0])
+            if value == fill_value:
+                site.values[column] = None
+                if site.status == 'ok':
+                    site.status = 'fill'
+            else:
+                site.values[column] = value * scale_factor + add_offset
+        del raster
+        del dataset
+
+    satellite = espa_metadata.xml_object.global_metadata.satellite
+    thermal_info = qa.retrieve_thermal_constants(espa_metadata, satellite)
+
+    for site in [site for site in sites if site.status == 'ok']:
+        values = [np.array([site.values[column]], dtype=np.float64)
+                  for column in ('thermal_radiance', 'transmittance',
+                                 'upwelled_radiance', 'downwelled_radiance',
+                                 'emissivity', 'emissivity_stdev',
+                                 'cloud_distance')]
+        uncertainty = qa.calculate_uncertainty(*values,
+                                               satellite=satellite,
+                                               k1=float(thermal_info.k1),
+                                               k2=float(thermal_info.k2))
+        site.values['uncertainty'] = float(uncertainty[0])
+
+
+def write_sites(output_filename, sites):
+    """Write the values at each site
+
+    Args:
+        output_filename <str>: The CSV file to write
+        sites [<Site>]: The sites
+    """
+
+    with open(output_filename, 'wb') as output_fd:
+        writer = csv.writer(output_fd)
+        writer.writerow(SITE_COLUMNS)
+
+        for site in sites:
+            row = [site.name, site.latitude, site.longitude,
+                   site.line, site.sample]
+            for column in SITE_COLUMNS[len(row):-1]:
+                value = site.values.get(column)
+                row.append('' if value is None else '{0:.6f}'.format(value))
+            row.append(site.status)
+
+            writer.writerow(['' if value is None else value
+                             for value in row])
+
+
+def main():
+    """Main processing for determining surface temperature at sites
+    """
+
+    # Command Line Arguments
+    args = retrieve_command_line_arguments()
+
+    # Check logging level
+    logging_level = logging.INFO
+    if args.debug:
+        logging_level = logging.DEBUG
+
+    # Setup the default logger format and level.  Log to STDOUT.
+    logging.basicConfig(format=('%(asctime)s.%(msecs)03d %(process)d'
+                                ' %(levelname)-8s'
+                                ' %(filename)s:%(lineno)d:'
+                                '%(funcName)s -- %(message)s'),
+                        datefmt='%Y-%m-%d %H:%M:%S',
+                        level=logging_level,
+                        stream=sys.stdout)
+    logger = logging.getLogger(__name__)
+
+    logger.info('*** Begin ST Point Query ***')
+
+    # Register all the gdal drivers
+    gdal.AllRegister()
+
+    espa_metadata = Metadata(args.xml_filename)
+    espa_metadata.parse()
+
+    sites = read_sites(args.sites_filename)
+    locate_sites(espa_metadata, sites, args.window_size)
+
+    located = [site for site in sites if site.window is not None]
+    logger.info('{0} of {1} site(s) are within the scene'
+                .format(len(located), len(sites)))
+
+    if located:
+        site_cloud_distances(espa_metadata, located)
+
+        directories = process_windows(
+            xml_filename=args.xml_filename,
+            sites=located,
+            work_directory=os.path.join(
+                os.path.dirname(os.path.realpath(args.xml_filename)),
+                'st_point_query_work'),
+            temporary=args.temporary,
+            debug=args.debug)
+
+        for (window, directory) in directories.items():
+            window_sites = [site for site in located if site.window == window]
+            try:
+                read_site_values(directory,
+                                 os.path.basename(args.xml_filename),
+                                 window_sites)
+            except Exception:
+                logger.exception('Failed reading the products in [{0}]'
+                                 .format(directory))
+                for site in window_sites:
+                    site.status = 'failed'
+
+    write_sites(args.output_filename, sites)
+
+    logger.info('*** ST Point Query - Complete ***')
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,380 @@
+'''
+    File: st_preview.py
+
+    Purpose: Creates a reduced resolution copy of a scene, so that a quick
+             look at the surface temperature can be produced in a fraction
+             of the time of the full resolution scene.
+
+             Each pixel of the preview scene covers a box of pixels of the
+             scene.  Image bands, such as the thermal and the elevation, are
+             averaged over the box, excluding fill.  QA bands hold bit flags
+             which can not be averaged, so the center pixel of the box is
+             used.
+
+             Averaging the elevation narrows its range, so MODTRAN is also
+             run through fewer ground altitudes for the preview.
+
+    Project: Land Satellites Data Systems Science Research and Development
+             (LSRD) at the USGS EROS
+
+    License: NASA Open Source Agreement 1.3
+'''
+
+import os
+import re
+import shutil
+import logging
+
+import numpy as np
+from lxml import objectify
+from osgeo import gdal
+
+from espa import Metadata
+
+from st_manifest import ST_PRODUCTS
+from st_window import update_geographic_bounds
+
+
+# Numpy types for the ESPA data types
+DATA_TYPES = {'INT8': np.int8, 'UINT8': np.uint8,
+              'INT16': np.int16, 'UINT16': np.uint16,
+              'INT32': np.int32, 'UINT32': np.uint32,
+              'FLOAT32': np.float32, 'FLOAT64': np.float64}
+
+# Written in the preview scene directory, from its surface temperature band
+QUICK_LOOK_FILENAME = 'st_quick_look.png'
+
+# Percentiles of the surface temperature stretched over the quick look
+STRETCH_PERCENTILES = (2, 98)
+
+
+def preview_directory(factor):
+    """The directory the preview scene is created in
+
+    Args:
+        factor <int>: Scene pixels averaged along each side of a preview pixel
+
+    Returns:
+        <str>: The directory name
+    """
+
+    return 'st_preview_{0}'.format(factor)
+
+
+def reduced_size(size, factor):
+    """Preview pixels needed to cover the scene pixels
+
+    Args:
+        size <int>: Scene lines or samples
+        factor <int>: Scene pixels averaged along each side of a preview pixel
+
+    Returns:
+        <int>: Preview lines or samples
+    """
+
+    return (size + factor - 1) // factor
+
+
+def reduce_band(source, destination, nlines, nsamps, data_type, fill_value,
+                average, factor):
+    """Write the reduced resolution copy of a raw binary band
+
+    Args:
+        source <str>: The band file to reduce
+        destination <str>: The reduced band file to create
+        nlines <int>: Lines in the band
+        nsamps <int>: Samples in the band
+        data_type <numpy.dtype>: Type of the band data
+        fill_value <float>: Fill value of the band, or None
+        average <bool>: Average the box, instead of using its center
+        factor <int>: Scene pixels averaged along each side of a preview pixel
+    """
+
+    out_samps = reduced_size(nsamps, factor)
+    padded_samps = out_samps * factor
+
+    with open(source, 'rb') as source_fd, \
+            open(destination, 'wb') as destination_fd:
+        # One line of preview pixels is made from each strip of lines
+        for first_line in xrange(0, nlines, factor):
+            strip_lines = min(factor, nlines - first_line)
+            strip = np.fromfile(source_fd, dtype=data_type,
+                                count=strip_lines * nsamps)
+            if strip.size != strip_lines * nsamps:
+                raise Exception('Band [{0}] is shorter than the {1} lines'
+                                ' by {2} samples in the XML'
+                                .format(source, nlines, nsamps))
+            strip = strip.reshape(strip_lines, nsamps)
+
+            if not average:
+                columns = np.minimum(
+                    np.arange(out_samps) * factor + factor // 2, nsamps - 1)
+                destination_fd.write(
+                    strip[strip_lines // 2, columns].astype(data_type)
+                    .tostring())
+                continue
+
+            # The partial box at the end of the strip is padded with excluded
+            # pixels, so every box can be averaged together
+            valid = np.zeros((strip_lines, padded_samps), dtype=np.bool)
+            valid[:, :nsamps] = True
+            if fill_value is not None:
+                valid[:, :nsamps] = strip != fill_value
+
+            values = np.zeros((strip_lines, padded_samps), dtype=np.float64)
+            values[:, :nsamps] = strip
+            values[~valid] = 0
+            del strip
+
+            totals = values.reshape(strip_lines, out_samps, factor) \
+                .sum(axis=2).sum(axis=0)
+            counts = valid.reshape(strip_lines, out_samps, factor) \
+                .sum(axis=2).sum(axis=0)
+            del values
+            del valid
+
+            line = np.zeros(out_samps, dtype=np.float64)
+            covered = counts > 0
+            line[covered] = totals[covered] / counts[covered]
+            if fill_value is not None:
+                line[~covered] = fill_value
+
+            if np.issubdtype(data_type, np.integer):
+                line = np.round(line)
+
+            destination_fd.write(line.astype(data_type).tostring())
+
+
+def reduce_envi_header(source, destination, nlines, nsamps, factor):
+    """Copy an ENVI header, updating it for the preview
+
+    Args:
+        source <str>: The header of the band
+        destination <str>: The header of the reduced band
+        nlines <int>: Lines in the reduced band
+        nsamps <int>: Samples in the reduced band
+        factor <int>: Scene pixels averaged along each side of a preview pixel
+    """
+
+    with open(source, 'r') as source_fd:
+        text = source_fd.read()
+
+    text = re.sub(r'(?m)^samples\s*=.*$',
+                  'samples = {0}'.format(nsamps), text)
+    text = re.sub(r'(?m)^lines\s*=.*$',
+                  'lines = {0}'.format(nlines), text)
+
+    # The reference point stays put, and is a fractional preview pixel
+    # unless it is the upper left corner
+    match = re.search(r'map info\s*=\s*\{([^}]*)\}', text)
+    if match is not None:
+        fields = [field.strip() for field in match.group(1).split(',')]
+        fields[1] = repr((float(fields[1]) - 1.0) / factor + 1.0)
+        fields[2] = repr((float(fields[2]) - 1.0) / factor + 1.0)
+        fields[5] = repr(float(fields[5]) * factor)
+        fields[6] = repr(float(fields[6]) * factor)
+        text = ''.join([text[:match.start(1)], ', '.join(fields),
+                        text[match.end(1):]])
+
+    with open(destination, 'w') as destination_fd:
+        destination_fd.write(text)
+
+
+def update_projection_corners(espa_metadata, nlines, nsamps, pixel_size,
+                              factor):
+    """Move the projection corner points to the preview pixels
+
+    Args:
+        espa_metadata <espa.Metadata>: The preview metadata
+        nlines <int>: Lines in the preview
+        nsamps <int>: Samples in the preview
+        pixel_size <tuple>: Scene pixel size in the x and y directions
+        factor <int>: Scene pixels averaged along each side of a preview pixel
+    """
+
+    projection = espa_metadata.xml_object.global_metadata \
+        .projection_information
+
+    for corner_point in projection.corner_point:
+        if corner_point.get('location') == 'UL':
+            ul_x = float(corner_point.get('x'))
+            ul_y = float(corner_point.get('y'))
+
+    # Corner points at pixel centers move to the center of the first box
+    if projection.get('grid_origin') == 'CENTER':
+        ul_x += (factor - 1) * 0.5 * pixel_size[0]
+        ul_y -= (factor - 1) * 0.5 * pixel_size[1]
+    lr_x = ul_x + (nsamps - 1) * factor * pixel_size[0]
+    lr_y = ul_y - (nlines - 1) * factor * pixel_size[1]
+
+    for corner_point in projection.corner_point:
+        if corner_point.get('location') == 'UL':
+            corner_point.set('x', repr(ul_x))
+            corner_point.set('y', repr(ul_y))
+        elif corner_point.get('location') == 'LR':
+            corner_point.set('x', repr(lr_x))
+            corner_point.set('y', repr(lr_y))
+
+
+def create_preview_scene(xml_filename, factor):
+    """Create the preview scene, unless it already exists
+
+    Args:
+        xml_filename <str>: XML metadata filename of the scene
+        factor <int>: Scene pixels averaged along each side of a preview pixel
+
+    Returns:
+        <str>: The directory holding the preview scene
+    """
+
+    logger = logging.getLogger(__name__)
+
+    directory = os.path.join(os.path.dirname(xml_filename),
+                             preview_directory(factor))
+    preview_xml = os.path.join(directory, os.path.basename(xml_filename))
+
+    if os.path.isfile(preview_xml):
+        logger.info('Using the preview scene in [{0}]'.format(directory))
+        return directory
+
+    logger.info('Creating the preview scene in [{0}]'.format(directory))
+
+    if not os.path.isdir(directory):
+        os.makedirs(directory)
+
+    # The XML is completed under another name, so an interrupted creation
+    # is started over
+    partial_xml = ''.join([preview_xml, '.partial'])
+    shutil.copyfile(xml_filename, partial_xml)
+
+    espa_metadata = Metadata(partial_xml)
+    espa_metadata.parse()
+
+    # Create an element maker
+    maker = objectify.ElementMaker(annotate=False, namespace=None, nsmap=None)
+
+    bands = espa_metadata.xml_object.bands
+    reference_filename = None
+    reference = None
+    for band in list(bands.band):
+        # Products from an earlier ST run of the scene are not inputs
+        if band.get('product') in ST_PRODUCTS:
+            bands.remove(band)
+            continue
+
+        nlines = int(band.get('nlines'))
+        nsamps = int(band.get('nsamps'))
+        out_lines = reduced_size(nlines, factor)
+        out_samps = reduced_size(nsamps, factor)
+
+        fill_value = band.get('fill_value')
+        if fill_value is not None:
+            fill_value = float(fill_value)
+
+        source = os.path.join(os.path.dirname(xml_filename),
+                              str(band.file_name))
+        filename = os.path.basename(source)
+        destination = os.path.join(directory, filename)
+
+        logger.debug('Reducing [{0}]'.format(filename))
+        reduce_band(source=source,
+                    destination=destination,
+                    nlines=nlines,
+                    nsamps=nsamps,
+                    data_type=DATA_TYPES[band.get('data_type')],
+                    fill_value=fill_value,
+                    average=(band.get('category') != 'qa'),
+                    factor=factor)
+
+        header = ''.join([os.path.splitext(source)[0], '.hdr'])
+        if os.path.isfile(header):
+            reduce_envi_header(source=header,
+                               destination=os.path.join(
+                                   directory, os.path.basename(header)),
+                               nlines=out_lines,
+                               nsamps=out_samps,
+                               factor=factor)
+
+        pixel_size = (float(band.pixel_size.get('x')),
+                      float(band.pixel_size.get('y')))
+        band.pixel_size.set('x', repr(pixel_size[0] * factor))
+        band.pixel_size.set('y', repr(pixel_size[1] * factor))
+        band.set('nlines', str(out_lines))
+        band.set('nsamps', str(out_samps))
+        band.file_name = maker.element(filename)
+
+        if (band.get('product') == 'toa_bt' and
+                band.get('category') == 'image' and
+                reference_filename is None):
+            reference_filename = destination
+            reference = (out_lines, out_samps, pixel_size)
+
+    if reference_filename is None:
+        raise Exception('Missing TOA Brightness Temperature Band')
+
+    update_projection_corners(espa_metadata,
+                              nlines=reference[0],
+                              nsamps=reference[1],
+                              pixel_size=reference[2],
+                              factor=factor)
+    update_geographic_bounds(espa_metadata, reference_filename)
+
+    espa_metadata.validate()
+    espa_metadata.write()
+
+    os.rename(partial_xml, preview_xml)
+
+    return directory
+
+
+def write_quick_look(xml_filename, png_filename):
+    """Write a PNG of the surface temperature band
+
+    The temperatures are stretched over the grey levels, with black for
+    fill.
+
+    Args:
+        xml_filename <str>: XML metadata filename of the preview scene
+        png_filename <str>: The PNG file to write
+    """
+
+    logger = logging.getLogger(__name__)
+
+    espa_metadata = Metadata(xml_filename)
+    espa_metadata.parse()
+
+    st_band = None
+    for band in espa_metadata.xml_object.bands.band:
+        if (band.get('product') == 'st' and
+                band.get('name') == 'surface_temperature'):
+            st_band = band
+
+    if st_band is None:
+        raise Exception('Failed to find the Surface Temperature band')
+
+    dataset = gdal.Open(os.path.join(os.path.dirname(xml_filename),
+                                     str(st_band.file_name)))
+    data = dataset.GetRasterBand(1).ReadAsArray(0, 0, dataset.RasterXSize,
+                                                dataset.RasterYSize)
+    del dataset
+
+    valid = data != float(st_band.get('fill_value'))
+    image = np.zeros(data.shape, dtype=np.uint8)
+    if np.any(valid):
+        (low, high) = np.percentile(data[valid], STRETCH_PERCENTILES)
+        scale = 254.0 / max(high - low, 1)
+        image[valid] = (np.clip((data[valid] - low) * scale, 0, 254) +
+                        1).astype(np.uint8)
+    del data
+
+    mem_driver = gdal.GetDriverByName('MEM')
+    mem_ds = mem_driver.Create('', image.shape[1], image.shape[0], 1,
+                               gdal.GDT_Byte)
+    mem_ds.GetRasterBand(1).WriteArray(image)
+
+    png_driver = gdal.GetDriverByName('PNG')
+    png_ds = png_driver.CreateCopy(png_filename, mem_ds)
+    del png_ds
+    del mem_ds
+
+    logger.info('Wrote the quick look [{0}]'.format(png_filename))
@@ -14,14 +14,23 @@
 
 import os
 import sys
+import time
+import errno
+import socket
 import logging
 import glob
+import hashlib
+import shutil
+import threading
 from argparse import ArgumentParser
 from multiprocessing import Pool
+from collections import OrderedDict
 
 import st_utilities as util
+import st_trace
 
-from st_grid_points import read_grid_points
+from st_grid_points import read_grid_points, point_directory
+from st_node_scheduler import SlotLease
 
 
 def retrieve_command_line_arguments():
@@ -48,6 +57,30 @@ def retrieve_command_line_arguments():
                         required=False, default=1,
                         help='Number of processes to utilize')
 
+    parser.add_argument('--executor',
+                        action='store', dest='executor',
+                        required=False, default=LOCAL_EXECUTOR,
+                        choices=[LOCAL_EXECUTOR, QUEUE_EXECUTOR],
+                        help='Run MODTRAN in local processes, or through a'
+                             ' work queue on a shared filesystem')
+
+    parser.add_argument('--queue_directory',
+                        action='store', dest='queue_directory',
+                        required=False, default=None,
+                        help='Work queue directory for the queue executor'
+                             ' and for workers')
+
+    parser.add_argument('--worker',
+                        action='store_true', dest='worker',
+                        required=False, default=False,
+                        help='Run as a worker, making the MODTRAN runs'
+                             ' placed on the work queue')
+
+    parser.add_argument('--drain',
+                        action='store_true', dest='drain',
+                        required=False, default=False,
+                        help='As a worker, exit once the work queue is empty')
+
     parser.add_argument('--debug',
                         action='store_true', dest='debug',
                         required=False, default=False,
@@ -62,6 +95,11 @@ def retrieve_command_line_arguments():
     if args.modtran_data_path == '':
         raise Exception('The MODTRAN data directory provided was empty')
 
+    if ((args.worker or args.executor == QUEUE_EXECUTOR) and
+            args.queue_directory is None):
+        raise Exception('--queue_directory must be specified on the'
+                        ' command line')
+
     return args
 
 
@@ -144,6 +182,95 @@ def create_extracted_output(tsp_value, pltout_results):
                               .format(len(pltout_results)))
 
 
+RESULT_MARKER = 'st_modtran.done'
+
+
+def tape5_digest(directory=os.curdir):
+    """Digest of the MODTRAN input, identifying the run
+
+    Args:
+        directory <str>: The run directory
+
+    Returns:
+        <str>: SHA1 hex digest of the tape5 file
+    """
+
+    with open(os.path.join(directory, TAPE5), 'rb') as tape5_fd:
+        return hashlib.sha1(tape5_fd.read()).hexdigest()
+
+
+def results_are_current(digest, directory=os.curdir):
+    """Determines if the extracted results were produced from the tape5
+
+    Args:
+        digest <str>: Digest of the current tape5 file
+        directory <str>: The run directory
+
+    Returns:
+        <bool>: True if the run does not need to be made again
+    """
+
+    for filename in (RESULT_HDR, RESULT_DATA, RESULT_MARKER):
+        if not os.path.isfile(os.path.join(directory, filename)):
+            return False
+
+    with open(os.path.join(directory, RESULT_MARKER), 'r') as marker_fd:
+        return marker_fd.read().strip() == digest
+
+
+def write_completion_marker(digest):
+    """Marks the extracted results as complete for the tape5
+
+    The results are flushed to disk before the marker is renamed into
+    place, so a marker is never present for incomplete results, even if the
+    node goes down.
+
+    Args:
+        digest <str>: Digest of the tape5 file the results came from
+    """
+
+    for filename in (RESULT_HDR, RESULT_DATA):
+        with open(filename, 'r') as result_fd:
+            os.fsync(result_fd.fileno())
+
+    temp_marker = '{0}.tmp'.format(RESULT_MARKER)
+    with open(temp_marker, 'w') as marker_fd:
+        marker_fd.write('{0}\n'.format(digest))
+        marker_fd.flush()
+        os.fsync(marker_fd.fileno())
+
+    os.rename(temp_marker, RESULT_MARKER)
+
+
+def copy_results(source_directory, directory, digest):
+    """Copies the MODTRAN results for a tape5 into another run directory
+
+    The completion marker is renamed into place last, so the run is only
+    seen as complete once all of the results are present.
+
+    Args:
+        source_directory <str>: The run directory holding the results
+        directory <str>: The run directory to copy to
+        digest <str>: Digest of the tape5 file
+    """
+
+    marker = os.path.join(directory, RESULT_MARKER)
+    if os.path.isfile(marker):
+        with open(marker, 'r') as marker_fd:
+            if marker_fd.read().strip() == digest:
+                return
+        os.unlink(marker)
+
+    for filename in (RESULT_HDR, RESULT_DATA):
+        shutil.copyfile(os.path.join(source_directory, filename),
+                        os.path.join(directory, filename))
+
+    temp_marker = '{0}.tmp'.format(marker)
+    shutil.copyfile(os.path.join(source_directory, RESULT_MARKER),
+                    temp_marker)
+    os.rename(temp_marker, marker)
+
+
 class ModtranProcessingError(Exception):
     """Exception specifically for MODTRAN errors"""
     pass
@@ -152,60 +279,542 @@ class ModtranProcessingError(Exception):
 TAPE5 = 'tape5'
 
 
-def process_point_dir((point_path, modtran_data_path)):
-    """Run MODTRAN for a point and parse/format the results for later use
+def run_modtran_in_directory(tape5_path, modtran_data_path):
+    """Run MODTRAN for one tape5 and parse/format the results for later use
+
+    The working directory is changed to the tape5 directory and is not
+    restored.
 
     Args:
-        path <str>: The path to a directory containing a tape5 file
+        tape5_path <str>: The real path to a directory containing a tape5
+        modtran_data_path <str>: Directory for the MODTRAN 'DATA' files
+
+    Returns:
+        <bool>: True if MODTRAN was run, False if the results were current
     """
 
     logger = logging.getLogger(__name__)
 
+    os.chdir(tape5_path)
+
+    digest = tape5_digest()
+    if results_are_current(digest):
+        logger.debug('Reusing Directory [{}]'.format(tape5_path))
+        return False
+
+    logger.info('Processing Directory [{}]'.format(tape5_path))
+
+    # The previous results, if any, are no longer valid
+    if os.path.exists(RESULT_MARKER):
+        os.unlink(RESULT_MARKER)
+
+    # MODTRAN requires the directory to always be named 'DATA'
+    util.System.create_link(modtran_data_path, 'DATA')
+
+    output = ''
+    try:
+        # Each run is a single threaded process.  The time spent waiting for
+        # the slot is traced apart from the run.
+        wait_time = time.time()
+        with SlotLease(slots=1):
+            st_trace.record('wait', 'modtran', wait_time,
+                            directory=tape5_path)
+            with st_trace.span('run', 'modtran', directory=tape5_path):
+                output = util.System.execute_cmd('modtran')
+
+        if len(output) > 0:
+            if 'STOP Error:' in output:
+                msg = ('Error processing data point [{}]'
+                       .format(tape5_path))
+                raise ModtranProcessingError(msg)
+
+    finally:
+        if len(output) > 0:
+            logger.info(output)
+
+    if not os.path.isfile(TAPE6):
+        raise ModtranProcessingError('Missing MODTRAN output file'
+                                     ' {}'.format(TAPE6))
+
+    if not os.path.isfile(PLTOUT_ASC):
+        raise ModtranProcessingError('Missing MODTRAN output file'
+                                     ' {}'.format(PLTOUT_ASC))
+
+    # Modtran is done with this point
+    # So now we can parse the results and generate a specifically
+    # formatted version to be used later in the processing flow
+    with st_trace.span('parse', 'modtran', directory=tape5_path):
+        tsp_value = extract_target_surface_temp()
+        pltout_results = extract_pltout_results()
+
+        create_extracted_output(tsp_value, pltout_results)
+
+    write_completion_marker(digest)
+
+    # Pool workers exit without running their exit handlers, so the peak
+    # memory of the worker and its MODTRAN runs is recorded after each run
+    st_trace.record_peak_rss()
+
+    return True
+
+
+def process_run_dir((tape5_path, modtran_data_path)):
+    """Run MODTRAN for a single tape5 directory
+
+    Args:
+        tape5_path <str>: The path to a directory containing a tape5 file
+        modtran_data_path <str>: Directory for the MODTRAN 'DATA' files
+
+    Returns:
+        <bool>: True if MODTRAN was run, False if the results were current
+    """
+
     current_directory = os.getcwd()
 
-    # Get the real paths to simplify the logic a bit
-    r_paths = [os.path.realpath(path)
-               for path in glob.glob(os.path.join(point_path, '*', '*', '*'))]
+    try:
+        return run_modtran_in_directory(os.path.realpath(tape5_path),
+                                        modtran_data_path)
+    finally:
+        os.chdir(current_directory)
+
+
+# Executors
+LOCAL_EXECUTOR = 'local'
+QUEUE_EXECUTOR = 'queue'
+
+
+class LocalExecutor(object):
+    '''
+    Description:
+        Makes the MODTRAN runs in a pool of local processes.
+    '''
+
+    def __init__(self, process_count):
+        super(LocalExecutor, self).__init__()
+
+        self.process_count = max(1, process_count)
+
+    def run(self, run_parms):
+        '''
+        Description:
+            Makes the runs, returning for each whether MODTRAN was run.
+        '''
+
+        if self.process_count > 1:
+            pools = Pool(self.process_count)
+            try:
+                return pools.map(process_run_dir, run_parms)
+            finally:
+                pools.close()
+
+        return map(process_run_dir, run_parms)
+
+
+# Work queue files.  The queue directory holds an entry for each run waiting
+# for a worker.  The worker which claims a run holds a lock file in the run
+# directory and counts the attempt there.  A failed attempt leaves the entry
+# to be claimed again, and the failure file is only left once the attempts
+# are used up.
+QUEUE_ENTRY_EXTENSION = '.run'
+RUN_LOCK = 'st_modtran.lock'
+RUN_ATTEMPTS = 'st_modtran.attempts'
+RUN_FAILED = 'st_modtran.failed'
+
+# Attempts made at a run before it is failed, including those of workers
+# which went away while holding its lock
+MAX_RUN_ATTEMPTS = 3
+
+# Seconds between checks of the queue, and between lock refreshes by a
+# worker.  A lock not refreshed within the stale time belongs to a worker
+# which has gone away, and is broken.
+QUEUE_POLL_SECONDS = 5
+LOCK_REFRESH_SECONDS = 30
+LOCK_STALE_SECONDS = 300
+
+
+def queue_entry_name(queue_directory, tape5_path):
+    """The work queue entry for a run directory
+
+    Args:
+        queue_directory <str>: The work queue directory
+        tape5_path <str>: The real path of the run directory
+
+    Returns:
+        <str>: The entry filename
+    """
+
+    name = hashlib.sha1(tape5_path).hexdigest()
+
+    return os.path.join(queue_directory,
+                        ''.join([name, QUEUE_ENTRY_EXTENSION]))
+
+
+def break_stale_lock(lock_path):
+    """Removes a lock whose worker has stopped refreshing it
+
+    The lock is renamed aside first, so only one of several workers finding
+    it stale breaks it.
+
+    Args:
+        lock_path <str>: The lock file
+    """
+
+    logger = logging.getLogger(__name__)
+
+    try:
+        if time.time() - os.stat(lock_path).st_mtime < LOCK_STALE_SECONDS:
+            return
+
+        stale_path = '{0}.{1}.{2}'.format(lock_path, socket.gethostname(),
+                                          os.getpid())
+        os.rename(lock_path, stale_path)
+        os.unlink(stale_path)
+        logger.warning('Broke stale lock [{0}]'.format(lock_path))
+    except OSError as ose:
+        if ose.errno != errno.ENOENT:
+            raise
+
+
+def claim_run(tape5_path):
+    """Claims a run directory for this worker
+
+    Args:
+        tape5_path <str>: The run directory
+
+    Returns:
+        <bool>: True if the run was claimed
+    """
+
+    lock_path = os.path.join(tape5_path, RUN_LOCK)
+
+    break_stale_lock(lock_path)
 
     try:
-        for tape5_path in r_paths:
-            logger.info('Processing Directory [{}]'.format(tape5_path))
-            os.chdir(tape5_path)
-            # MODTRAN requires the directory to always be named 'DATA'
-            util.System.create_link(modtran_data_path, 'DATA')
+        lock_fd = os.open(lock_path, os.O_CREAT | os.O_EXCL | os.O_WRONLY,
+                          0644)
+    except OSError as ose:
+        if ose.errno == errno.EEXIST:
+            return False
+        raise
+
+    os.write(lock_fd, '{0}:{1}\n'.format(socket.gethostname(), os.getpid()))
+    os.close(lock_fd)
+
+    return True
+
 
-            output = ''
+class LockRefresher(object):
+    '''
+    Description:
+        Keeps a claimed run's lock fresh while MODTRAN runs, so other
+        workers do not take it to be stale.
+    '''
+
+    def __init__(self, lock_path):
+        super(LockRefresher, self).__init__()
+
+        self.lock_path = lock_path
+        self.stopped = threading.Event()
+        self.thread = threading.Thread(target=self.refresh)
+        self.thread.daemon = True
+
+    def refresh(self):
+        '''
+        Description:
+            Thread body.
+        '''
+
+        while not self.stopped.wait(LOCK_REFRESH_SECONDS):
             try:
-                output = util.System.execute_cmd('modtran')
+                os.utime(self.lock_path, None)
+            except OSError:
+                pass
 
-                if len(output) > 0:
-                    if 'STOP Error:' in output:
-                        msg = ('Error processing data point [{}]'
-                               .format(point_path))
-                        raise ModtranProcessingError(msg)
+    def __enter__(self):
+        self.thread.start()
+        return self
 
-            finally:
-                if len(output) > 0:
-                    logger.info(output)
+    def __exit__(self, exc_type, exc_value, traceback):
+        self.stopped.set()
+        self.thread.join()
+
+
+def remove_file(filename):
+    """Removes a file which may already be gone
+
+    Args:
+        filename <str>: The file to remove
+    """
+
+    try:
+        os.unlink(filename)
+    except OSError as ose:
+        if ose.errno != errno.ENOENT:
+            raise
+
+
+def record_attempt(tape5_path):
+    """Counts an attempt at a claimed run
+
+    Args:
+        tape5_path <str>: The run directory
+
+    Returns:
+        <int>: The number of attempts, including this one
+    """
+
+    attempts_path = os.path.join(tape5_path, RUN_ATTEMPTS)
 
-            if not os.path.isfile(TAPE6):
-                raise ModtranProcessingError('Missing MODTRAN output file'
-                                             ' {}'.format(TAPE6))
+    attempts = 0
+    try:
+        with open(attempts_path, 'r') as attempts_fd:
+            attempts = int(attempts_fd.read().strip() or 0)
+    except IOError as ioe:
+        if ioe.errno != errno.ENOENT:
+            raise
+
+    attempts += 1
+    with open(attempts_path, 'w') as attempts_fd:
+        attempts_fd.write('{0}\n'.format(attempts))
+
+    return attempts
+
+
+def fail_run(tape5_path, reason):
+    """Leaves the failure file for the run
+
+    Args:
+        tape5_path <str>: The run directory
+        reason <str>: Why the run failed
+    """
 
-            if not os.path.isfile(PLTOUT_ASC):
-                raise ModtranProcessingError('Missing MODTRAN output file'
-                                             ' {}'.format(PLTOUT_ASC))
+    with open(os.path.join(tape5_path, RUN_FAILED), 'w') as fail_fd:
+        fail_fd.write('{0}: {1}\n'.format(socket.gethostname(), reason))
 
-            # Modtran is done with this point
-            # So now we can parse the results and generate a specifically
-            # formatted version to be used later in the processing flow
-            tsp_value = extract_target_surface_temp()
-            pltout_results = extract_pltout_results()
 
-            create_extracted_output(tsp_value, pltout_results)
+def process_queue_entry(entry, modtran_data_path):
+    """Claims and makes the run for a work queue entry
+
+    Args:
+        entry <str>: The queue entry filename
+        modtran_data_path <str>: Directory for the MODTRAN 'DATA' files
+
+    Returns:
+        <bool>: True if this worker claimed the run
+    """
+
+    logger = logging.getLogger(__name__)
 
+    try:
+        with open(entry, 'r') as entry_fd:
+            tape5_path = entry_fd.read().strip()
+    except IOError as ioe:
+        # Another worker completed it
+        if ioe.errno == errno.ENOENT:
+            return False
+        raise
+
+    if not claim_run(tape5_path):
+        return False
+
+    lock_path = os.path.join(tape5_path, RUN_LOCK)
+    try:
+        # An attempt is counted before it is made, so one whose worker
+        # went away is counted too
+        attempts = record_attempt(tape5_path)
+        if attempts > MAX_RUN_ATTEMPTS:
+            logger.error('Failed processing [{0}] {1} times'
+                         .format(tape5_path, MAX_RUN_ATTEMPTS))
+            fail_run(tape5_path, 'Stopped during each of {0} attempts'
+                     .format(MAX_RUN_ATTEMPTS))
+        else:
+            try:
+                with LockRefresher(lock_path):
+                    process_run_dir((tape5_path, modtran_data_path))
+            except Exception as error:
+                if attempts < MAX_RUN_ATTEMPTS:
+                    # The entry is left for this or another worker to retry
+                    logger.warning('Failed processing [{0}] on attempt {1}'
+                                   ' of {2}: {3}'
+                                   .format(tape5_path, attempts,
+                                           MAX_RUN_ATTEMPTS, error))
+                    return True
+
+                logger.exception('Failed processing [{0}]'
+                                 .format(tape5_path))
+                fail_run(tape5_path, error)
+
+        # The entry goes before the lock, so nobody claims the run again
+        remove_file(entry)
     finally:
-        os.chdir(current_directory)
+        remove_file(lock_path)
+
+    return True
+
+
+def run_queue_worker(queue_directory, modtran_data_path, drain):
+    """Makes the runs placed on the work queue
+
+    Args:
+        queue_directory <str>: The work queue directory
+        modtran_data_path <str>: Directory for the MODTRAN 'DATA' files
+        drain <bool>: Exit once the queue is empty
+    """
+
+    logger = logging.getLogger(__name__)
+
+    logger.info('Working on queue [{0}]'.format(queue_directory))
+
+    while True:
+        entries = sorted(glob.glob(os.path.join(
+            queue_directory, ''.join(['*', QUEUE_ENTRY_EXTENSION]))))
+
+        if not entries and drain:
+            break
+
+        claimed = 0
+        for entry in entries:
+            if process_queue_entry(entry, modtran_data_path):
+                claimed += 1
+
+        if not claimed:
+            time.sleep(QUEUE_POLL_SECONDS)
+
+
+class QueueExecutor(object):
+    '''
+    Description:
+        Places the MODTRAN runs on a work queue in a shared filesystem and
+        waits for workers, on this or other nodes, to make them.
+
+        The run directories must be on a filesystem shared with the
+        workers, and the filesystem must provide exclusive file creation.
+    '''
+
+    def __init__(self, queue_directory):
+        super(QueueExecutor, self).__init__()
+
+        self.queue_directory = queue_directory
+
+    def run(self, run_parms):
+        '''
+        Description:
+            Makes the runs, returning for each whether MODTRAN was run.
+        '''
+
+        logger = logging.getLogger(__name__)
+
+        if not os.path.isdir(self.queue_directory):
+            os.makedirs(self.queue_directory)
+
+        executed = list()
+        waiting = dict()
+        queued_time = time.time()
+        for (tape5_path, dummy) in run_parms:
+            tape5_path = os.path.realpath(tape5_path)
+            digest = tape5_digest(tape5_path)
+
+            if results_are_current(digest, tape5_path):
+                executed.append(False)
+                continue
+
+            executed.append(True)
+            waiting[tape5_path] = digest
+            remove_file(os.path.join(tape5_path, RUN_FAILED))
+            remove_file(os.path.join(tape5_path, RUN_ATTEMPTS))
+
+            entry = queue_entry_name(self.queue_directory, tape5_path)
+            with open('{0}.tmp'.format(entry), 'w') as entry_fd:
+                entry_fd.write('{0}\n'.format(tape5_path))
+            os.rename('{0}.tmp'.format(entry), entry)
+
+        logger.info('Queued {0} MODTRAN run(s) on [{1}]'
+                    .format(len(waiting), self.queue_directory))
+
+        while waiting:
+            for (tape5_path, digest) in waiting.items():
+                failed = os.path.join(tape5_path, RUN_FAILED)
+                if os.path.isfile(failed):
+                    with open(failed, 'r') as fail_fd:
+                        raise ModtranProcessingError(
+                            'Error processing [{0}] {1}'
+                            .format(tape5_path, fail_fd.read().strip()))
+
+                if (not os.path.exists(queue_entry_name(self.queue_directory,
+                                                         tape5_path)) and
+                        results_are_current(digest, tape5_path)):
+                    del waiting[tape5_path]
+                    st_trace.record('queue_wait', 'modtran', queued_time,
+                                    directory=tape5_path)
+
+            if waiting:
+                time.sleep(QUEUE_POLL_SECONDS)
+
+        return executed
+
+
+def make_executor(executor, process_count, queue_directory):
+    """Creates the executor for the MODTRAN runs
+
+    Args:
+        executor <str>: LOCAL_EXECUTOR or QUEUE_EXECUTOR
+        process_count <int>: Number of processes for the local executor
+        queue_directory <str>: Work queue directory for the queue executor
+
+    Returns:
+        An object with a run method taking a list of
+        (run directory, MODTRAN data path) and returning a list of <bool>
+    """
+
+    if executor == QUEUE_EXECUTOR:
+        return QueueExecutor(queue_directory)
+
+    return LocalExecutor(process_count)
+
+
+def run_modtran_points(grid_points, modtran_data_path, executor):
+    """Run MODTRAN for each of the grid points flagged for a MODTRAN run
+
+    Args:
+        grid_points [GridPointInfo]: The grid points to process
+        modtran_data_path <str>: Directory for the MODTRAN 'DATA' files
+        executor <object>: Makes the runs
+    """
+
+    logger = logging.getLogger(__name__)
+
+    # Cut down to just the ones we need to run MODTRAN on, and expand those
+    # to each elevation, temperature, and albedo directory
+    run_paths = list()
+    for point in grid_points:
+        if point.run_modtran:
+            run_paths.extend(
+                sorted(glob.glob(os.path.join(point_directory(point),
+                                              '*', '*', '*'))))
+
+    # Directories with the same tape5, such as those of clustered points,
+    # are only run once and the results are copied to the others
+    runs = OrderedDict()
+    for path in run_paths:
+        runs.setdefault(tape5_digest(path), list()).append(path)
+
+    logger.info('MODTRAN runs required [{0}] distinct [{1}]'
+                .format(len(run_paths), len(runs)))
+
+    run_parms = [(paths[0], modtran_data_path) for paths in runs.values()]
+
+    try:
+        executed = executor.run(run_parms)
+    except:
+        logger.exception('Error processing points')
+        raise
+
+    logger.info('MODTRAN runs reused [{0}] executed [{1}]'
+                .format(executed.count(False), executed.count(True)))
+
+    for (digest, paths) in runs.items():
+        for path in paths[1:]:
+            copy_results(paths[0], path, digest)
 
 
 PROC_CFG_FILENAME = 'processing.conf'
@@ -232,30 +841,22 @@ def main():
                         level=logging_level,
                         stream=sys.stdout)
 
-    logger = logging.getLogger(__name__)
+    if args.worker:
+        run_queue_worker(queue_directory=args.queue_directory,
+                         modtran_data_path=args.modtran_data_path,
+                         drain=args.drain)
+        return
 
     # Load the grid information
     (grid_points, dummy1, dummy2) = read_grid_points()
 
-    # Cut down to just the ones we need to run MODTRAN on
-    point_parms = [('{0:03}_{1:03}_{2:03}_{3:03}'.format(point.row,
-                                                         point.col,
-                                                         point.narr_row,
-                                                         point.narr_col),
-                    args.modtran_data_path)
-                   for point in grid_points if point.run_modtran]
-
-    process_count = int(args.process_count)
+    executor = make_executor(executor=args.executor,
+                             process_count=int(args.process_count),
+                             queue_directory=args.queue_directory)
 
-    try:
-        if process_count > 1:
-            pools = Pool(process_count)
-            pools.map(process_point_dir, point_parms)
-        else:
-            map(process_point_dir, point_parms)
-    except:
-        logger.exception('Error processing points')
-        raise
+    run_modtran_points(grid_points=grid_points,
+                       modtran_data_path=args.modtran_data_path,
+                       executor=executor)
 
 
 if __name__ == '__main__':
@@ -0,0 +1,581 @@
+#! /usr/bin/env python
+
+'''
+    File: st_service.py
+
+    Purpose: Serves ST requests from a long running process listening on a
+             Unix socket, so interactive and on-demand requests skip the
+             process startup and the loading of data earlier requests have
+             already loaded.
+
+             The static data files, the NARR extractions of recent
+             acquisition times, and the ASTER GED tiles of recent scenes are
+             kept between requests.  A scene, a window of a scene, or sites
+             within a scene are processed with the same stage functions as
+             st_generate_products.py --in-process, and each reply gives the
+             time taken by the request and by each of its stages.
+
+             Requests and replies are JSON objects, one per line.  Started
+             with --request, this sends one request to a running service and
+             prints the reply, which is also how the service is checked
+             locally, for example with {"request": "status"}.
+
+    Project: Land Satellites Data Systems Science Research and Development
+             (LSRD) at the USGS EROS
+
+    License: NASA Open Source Agreement 1.3
+'''
+
+import os
+import sys
+import json
+import time
+import errno
+import shutil
+import socket
+import logging
+import threading
+from collections import OrderedDict
+from argparse import ArgumentParser
+
+from espa import Metadata
+
+import st_utilities as util
+import emissivity_utilities as emis_util
+import st_window
+import st_point_query as point_query
+import st_generate_products as products
+import st_generate_products_batch as batch
+from st_node_scheduler import send_message, receive_message, connect
+
+
+# Requests
+STATUS = 'status'
+SCENE = 'scene'
+WINDOW = 'window'
+POINT = 'point'
+
+# Directories, within the work directory, of the NARR extractions and the
+# ASTER GED tiles kept between requests
+NARR_DIRECTORY = 'narr'
+ASTER_DIRECTORY = 'aster'
+
+# Entries of the shared data cache and NARR extractions kept by default
+DEFAULT_CACHE_ENTRIES = 256
+DEFAULT_NARR_EXTRACTIONS = 4
+
+# Options a scene or window request may give, with their defaults
+SCENE_OPTIONS = batch.SCENE_OPTIONS
+
+
+def retrieve_command_line_arguments():
+    """Read arguments from the command line
+
+    Returns:
+        args <arguments>: The arguments read from the command line
+    """
+
+    parser = ArgumentParser(description='Serves ST requests on a Unix'
+                                        ' socket, keeping data loaded'
+                                        ' between requests')
+
+    parser.add_argument('--version',
+                        action='version',
+                        version=util.Version.version_text())
+
+    parser.add_argument('--socket',
+                        action='store', dest='socket_path',
+                        required=False, default=None,
+                        help='The Unix socket to listen on')
+
+    parser.add_argument('--request',
+                        action='store', dest='request',
+                        required=False, default=None,
+                        help='Send this JSON request to the service listening'
+                             ' on the socket and print the reply')
+
+    parser.add_argument('--work-directory',
+                        action='store', dest='work_directory',
+                        required=False, default='st_service',
+                        help='Directory for the NARR extractions and ASTER'
+                             ' GED tiles kept between requests')
+
+    parser.add_argument('--cache-entries',
+                        action='store', dest='cache_entries', type=int,
+                        required=False, default=DEFAULT_CACHE_ENTRIES,
+                        help='Loaded data files kept in memory'
+                             ' (default {0})'.format(DEFAULT_CACHE_ENTRIES))
+
+    parser.add_argument('--narr-extractions',
+                        action='store', dest='narr_extractions', type=int,
+                        required=False, default=DEFAULT_NARR_EXTRACTIONS,
+                        help='NARR extractions kept for later requests'
+                             ' (default {0})'
+                             .format(DEFAULT_NARR_EXTRACTIONS))
+
+    parser.add_argument('--geometry-cache',
+                        action='store', dest='geometry_cache',
+                        required=False, default=None,
+                        help='Directory of the geometry kept for each scene'
+                             ' footprint')
+
+    parser.add_argument('--debug',
+                        action='store_true', dest='debug',
+                        required=False, default=False,
+                        help='Output debug messages and/or keep debug data')
+
+    args = parser.parse_args()
+
+    if args.socket_path is None:
+        raise Exception('--socket must be specified on the command line')
+
+    if args.cache_entries < 1:
+        raise Exception('--cache-entries must be at least 1')
+
+    if args.narr_extractions < 1:
+        raise Exception('--narr-extractions must be at least 1')
+
+    return args
+
+
+def stage_timings(graph):
+    """The times of each stage, relative to the start of the graph
+
+    Args:
+        graph <StageGraph>: The stages which were run
+
+    Returns:
+        [<dict>]: The name and times of each stage
+    """
+
+    timings = list()
+    for stage in graph.stages:
+        timing = {'stage': stage.name, 'reused': stage.reused}
+        if stage.start_time is not None and stage.end_time is not None:
+            timing['start'] = stage.start_time - graph.start_time
+            timing['end'] = stage.end_time - graph.start_time
+            timing['elapsed'] = stage.elapsed()
+        timings.append(timing)
+
+    return timings
+
+
+class STService(object):
+    '''
+    Description:
+        Processes the requests, one at a time, since the stages run in the
+        directory of the scene being processed.
+
+        The NARR extractions are kept in the work directory for the most
+        recent acquisition times.  The least recently used extraction, and
+        the pressure layers loaded from it, are released to make room for a
+        new one.
+    '''
+
+    def __init__(self, cfg, work_directory, narr_extractions,
+                 geometry_cache, debug):
+        super(STService, self).__init__()
+
+        self.cfg = cfg
+        self.work_directory = os.path.realpath(work_directory)
+        self.narr_extractions = narr_extractions
+        self.geometry_cache = geometry_cache
+        self.debug = debug
+
+        self.narr_directories = OrderedDict()
+        self.lock = threading.Lock()
+        self.start_time = time.time()
+        self.requests = 0
+
+    def narr_directory(self, scene):
+        '''
+        Description:
+            Extracts the NARR data for the scene, unless a recent request
+            already has.
+
+        Returns:
+            <str>: The directory holding the extraction
+        '''
+
+        logger = logging.getLogger(__name__)
+
+        directory = os.path.join(
+            self.work_directory, NARR_DIRECTORY,
+            batch.NARR_DIRECTORY_TEMPLATE.format(scene.t0_date,
+                                                 scene.t1_date))
+
+        batch.extract_shared_narr_data(scene=scene,
+                                       narr_directory=directory,
+                                       aux_path=self.cfg['aux_path'])
+
+        self.narr_directories.pop(directory, None)
+        self.narr_directories[directory] = True
+
+        while len(self.narr_directories) > self.narr_extractions:
+            (oldest, dummy) = self.narr_directories.popitem(last=False)
+            logger.info('Releasing NARR data [{0}]'.format(oldest))
+            util.SharedDataCache.release(oldest)
+            shutil.rmtree(oldest, ignore_errors=True)
+
+        return directory
+
+    def generate_scene(self, xml_filename, options):
+        '''
+        Description:
+            Generates the products of a scene.
+
+        Returns:
+            [<dict>]: The times of each stage
+        '''
+
+        scene = batch.Scene(xml_filename)
+
+        narr_directory = self.narr_directory(scene)
+
+        graph = batch.run_in_directory(scene.directory,
+                                       batch.run_scene_stages,
+                                       scene=scene,
+                                       narr_directory=narr_directory,
+                                       cfg=self.cfg,
+                                       options=options,
+                                       geometry_cache=self.geometry_cache,
+                                       debug=self.debug)
+
+        return stage_timings(graph)
+
+    def scene_request(self, message):
+        '''
+        Description:
+            Generates the products of the scene in the request.
+        '''
+
+        options = scene_options(message)
+
+        return {'stages': self.generate_scene(
+            xml_filename=os.path.realpath(message['xml']),
+            options=options)}
+
+    def window_request(self, message):
+        '''
+        Description:
+            Generates the products of the window of the scene in the
+            request, as a scene of its own.
+        '''
+
+        options = scene_options(message)
+        xml_filename = os.path.realpath(message['xml'])
+        window = st_window.parse_window(message['window'])
+
+        directory = st_window.create_window_scene(xml_filename=xml_filename,
+                                                  window=window)
+
+        return {'directory': directory,
+                'stages': self.generate_scene(
+                    xml_filename=os.path.join(
+                        directory, os.path.basename(xml_filename)),
+                    options=options)}
+
+    def point_request(self, message):
+        '''
+        Description:
+            Determines the products at the sites of the request, by
+            processing a window around each of them.
+        '''
+
+        logger = logging.getLogger(__name__)
+
+        xml_filename = os.path.realpath(message['xml'])
+        window_size = int(message.get('window_size',
+                                      point_query.DEFAULT_WINDOW_SIZE))
+        if window_size < 1:
+            raise Exception('The window size must be at least 1')
+
+        sites = [point_query.Site(name=str(site['name']),
+                                  latitude=float(site['latitude']),
+                                  longitude=float(site['longitude']))
+                 for site in message['sites']]
+
+        espa_metadata = Metadata(xml_filename)
+        espa_metadata.parse()
+
+        located = list()
+
+        def locate():
+            point_query.locate_sites(espa_metadata, sites, window_size)
+
+            located.extend([site for site in sites
+                            if site.window is not None])
+            if located:
+                point_query.site_cloud_distances(espa_metadata, located)
+
+        batch.run_in_directory(os.path.dirname(xml_filename), locate)
+
+        # The site values are read from the intermediate bands
+        options = dict(SCENE_OPTIONS)
+        options['intermediate'] = True
+
+        windows = list()
+        for window in sorted(set([site.window for site in located])):
+            window_sites = [site for site in located if site.window == window]
+            directory = None
+            try:
+                directory = st_window.create_window_scene(
+                    xml_filename=xml_filename, window=window)
+
+                stages = self.generate_scene(
+                    xml_filename=os.path.join(
+                        directory, os.path.basename(xml_filename)),
+                    options=options)
+                windows.append({'directory': directory, 'stages': stages})
+
+                point_query.read_site_values(directory,
+                                             os.path.basename(xml_filename),
+                                             window_sites)
+            except Exception:
+                logger.exception('Failed processing the window in [{0}]'
+                                 .format(directory))
+                for site in window_sites:
+                    site.status = 'failed'
+
+        replies = list()
+        for site in sites:
+            reply = {'name': site.name,
+                     'latitude': site.latitude,
+                     'longitude': site.longitude,
+                     'line': site.line,
+                     'sample': site.sample,
+                     'status': site.status}
+            reply.update(site.values)
+            replies.append(reply)
+
+        return {'sites': replies, 'windows': windows}
+
+    def status_request(self, message):
+        '''
+        Description:
+            Reports on the service, without touching any data.
+        '''
+
+        return {'version': util.Version.version_number(),
+                'uptime': time.time() - self.start_time,
+                'requests': self.requests,
+                'cache_entries': len(util.SharedDataCache.entries),
+                'narr_extractions': list(self.narr_directories.keys())}
+
+    def process(self, message):
+        '''
+        Description:
+            Processes one request.
+
+        Returns:
+            <dict>: The reply, including the seconds spent waiting for
+                    earlier requests and processing this one
+        '''
+
+        logger = logging.getLogger(__name__)
+
+        handlers = {STATUS: self.status_request,
+                    SCENE: self.scene_request,
+                    WINDOW: self.window_request,
+                    POINT: self.point_request}
+
+        request = message.get('request')
+        handler = handlers.get(request)
+        if handler is None:
+            return {'status': 'error',
+                    'error': 'Unexpected request [{0}]'.format(request)}
+
+        received_time = time.time()
+
+        # Status is answered even while a request is being processed
+        if request == STATUS:
+            reply = handler(message)
+            reply['status'] = 'ok'
+            reply['elapsed'] = time.time() - received_time
+            return reply
+
+        with self.lock:
+            start_time = time.time()
+            self.requests += 1
+
+            logger.info('Processing [{0}] request for [{1}]'
+                        .format(request, message.get('xml')))
+            try:
+                reply = handler(message)
+                reply['status'] = 'ok'
+            except Exception as e:
+                logger.exception('Failed [{0}] request'.format(request))
+                reply = {'status': 'error', 'error': str(e)}
+
+            end_time = time.time()
+
+        reply['queued'] = start_time - received_time
+        reply['elapsed'] = end_time - start_time
+
+        logger.info('Completed [{0}] request in {1:.1f} seconds'
+                    .format(request, reply['elapsed']))
+
+        return reply
+
+    def handle_connection(self, connection):
+        '''
+        Description:
+            Serves one client, which may send any number of requests.
+        '''
+
+        logger = logging.getLogger(__name__)
+
+        connection_fd = connection.makefile('rw')
+
+        try:
+            while True:
+                message = receive_message(connection_fd)
+                if message is None:
+                    break
+
+                send_message(connection_fd, self.process(message))
+        except (socket.error, ValueError):
+            logger.exception('Dropping connection')
+        finally:
+            connection_fd.close()
+            connection.close()
+
+    def serve(self, path):
+        '''
+        Description:
+            Listens on the socket and serves each client on its own thread.
+        '''
+
+        logger = logging.getLogger(__name__)
+
+        try:
+            os.unlink(path)
+        except OSError as ose:
+            if ose.errno != errno.ENOENT:
+                raise
+
+        listener = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)
+        listener.bind(path)
+        listener.listen(16)
+
+        logger.info('Serving ST requests on [{0}]'.format(path))
+
+        try:
+            while True:
+                (connection, dummy) = listener.accept()
+                thread = threading.Thread(target=self.handle_connection,
+                                          args=(connection,))
+                thread.daemon = True
+                thread.start()
+        finally:
+            listener.close()
+            os.unlink(path)
+
+
+def scene_options(message):
+    """The options of a scene or window request
+
+    Args:
+        message <dict>: The request
+
+    Returns:
+        <dict>: Every option, with the defaults for those not given
+    """
+
+    unknown = [name for name in message.get('options', dict())
+               if name not in SCENE_OPTIONS]
+    if unknown:
+        raise Exception('Unexpected options {0}'.format(unknown))
+
+    options = dict(SCENE_OPTIONS)
+    options.update(message.get('options', dict()))
+
+    if options['all_thermal_bands']:
+        products.check_all_thermal_bands()
+
+    return options
+
+
+def send_request(path, request):
+    """Send a request to the service and wait for the reply
+
+    Args:
+        path <str>: The service socket
+        request <dict>: The request
+
+    Returns:
+        <dict>: The reply
+    """
+
+    (connection, connection_fd) = connect(path)
+    try:
+        send_message(connection_fd, request)
+        reply = receive_message(connection_fd)
+    finally:
+        connection_fd.close()
+        connection.close()
+
+    if reply is None:
+        raise Exception('The service closed the connection')
+
+    return reply
+
+
+def main():
+    """Main processing for serving ST requests
+    """
+
+    # Command Line Arguments
+    args = retrieve_command_line_arguments()
+
+    # A client only prints the reply, so it can be read as JSON
+    if args.request is not None:
+        reply = send_request(args.socket_path, json.loads(args.request))
+        print(json.dumps(reply, indent=4, sort_keys=True))
+        if reply.get('status') != 'ok':
+            sys.exit(1)
+        return
+
+    # Check logging level
+    logging_level = logging.INFO
+    if args.debug:
+        logging_level = logging.DEBUG
+
+    # Setup the default logger format and level.  Log to STDOUT.
+    logging.basicConfig(format=('%(asctime)s.%(msecs)03d %(process)d'
+                                ' %(levelname)-8s'
+                                ' %(filename)s:%(lineno)d:'
+                                '%(funcName)s -- %(message)s'),
+                        datefmt='%Y-%m-%d %H:%M:%S',
+                        level=logging_level,
+                        stream=sys.stdout)
+    logger = logging.getLogger(__name__)
+
+    logger.info('*** Begin ST Service ***')
+
+    cfg = batch.processing_cfg()
+
+    # Everything loaded for one request is kept for the following ones
+    util.SharedDataCache.enable(limit=args.cache_entries)
+    emis_util.AsterTileStore.enable(os.path.join(args.work_directory,
+                                                 ASTER_DIRECTORY))
+
+    service = STService(cfg=cfg,
+                        work_directory=args.work_directory,
+                        narr_extractions=args.narr_extractions,
+                        geometry_cache=args.geometry_cache,
+                        debug=args.debug)
+
+    try:
+        service.serve(args.socket_path)
+    except KeyboardInterrupt:
+        pass
+    finally:
+        emis_util.AsterTileStore.disable()
+        util.SharedDataCache.disable()
+
+    logger.info('*** ST Service - Complete ***')
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,352 @@
+'''
+    File: st_stage_graph.py
+
+    Purpose: Runs processing stages as a dependency graph, starting each
+             stage on its own thread as soon as the stages it depends on are
+             complete and enough of the core budget is available.
+
+    Project: Land Satellites Data Systems Science Research and Development
+             (LSRD) at the USGS EROS
+
+    License: NASA Open Source Agreement 1.3
+'''
+
+import sys
+import time
+import logging
+import threading
+import Queue
+
+from st_exceptions import StageGraphError
+from st_manifest import fingerprint_files
+import st_trace
+
+
+# Access to the XML metadata file
+METADATA_READ = 'read'
+METADATA_WRITE = 'write'
+
+
+class Stage(object):
+    '''
+    Description:
+        A unit of processing within the graph.
+    '''
+
+    def __init__(self, name, function, depends_on, cores, metadata_access,
+                 inputs, outputs, settings):
+        super(Stage, self).__init__()
+
+        self.name = name
+        self.function = function
+        self.depends_on = tuple(depends_on)
+        self.cores = cores
+        self.metadata_access = metadata_access
+
+        # Filename patterns and configuration recorded in the manifest
+        self.inputs = list(inputs)
+        self.outputs = list(outputs)
+        self.settings = settings
+
+        self.reused = False
+        self.start_time = None
+        self.end_time = None
+
+    def elapsed(self):
+        '''
+        Description:
+            Returns the seconds the stage ran for.
+        '''
+
+        return self.end_time - self.start_time
+
+
+class StageGraph(object):
+    '''
+    Description:
+        Schedules the stages which have been added so that independent
+        stages run concurrently.
+
+        A stage is started once everything it depends on has completed, the
+        cores it needs fit within what is left of the budget, and its use of
+        the XML metadata does not conflict with a running stage.  Any number
+        of stages may read the metadata together, but a stage which updates
+        it runs alone with respect to the metadata.
+
+        When given a manifest store, a stage is skipped if everything it
+        depends on was skipped and its manifest shows the same settings,
+        inputs, and outputs as are present now.
+
+        When given a progress function, it is called with the number of
+        stages completed and the total number of stages, once reused stages
+        are known and again as each stage completes.
+    '''
+
+    def __init__(self, core_budget, manifests=None, progress=None):
+        super(StageGraph, self).__init__()
+
+        self.core_budget = max(1, core_budget)
+        self.manifests = manifests
+        self.progress = progress
+        self.stages = list()
+        self.planned = None
+        self.start_time = None
+        self.end_time = None
+
+    def add_stage(self, name, function, depends_on=(), cores=1,
+                  metadata_access=None, inputs=(), outputs=(),
+                  settings=None):
+        '''
+        Description:
+            Adds a stage to the graph.  The function is called without
+            arguments.  A stage requiring more cores than the budget is
+            limited to the budget.  The inputs and outputs are filename
+            patterns.
+        '''
+
+        names = [stage.name for stage in self.stages]
+        if name in names:
+            raise StageGraphError('Stage [{0}] already defined'.format(name))
+
+        for dependency in depends_on:
+            if dependency not in names:
+                raise StageGraphError('Stage [{0}] depends on unknown stage'
+                                      ' [{1}]'.format(name, dependency))
+
+        self.stages.append(Stage(name=name,
+                                 function=function,
+                                 depends_on=depends_on,
+                                 cores=min(max(1, cores), self.core_budget),
+                                 metadata_access=metadata_access,
+                                 inputs=inputs,
+                                 outputs=outputs,
+                                 settings=settings or dict()))
+
+    def plan(self):
+        '''
+        Description:
+            Determines which stages can reuse the results of a previous run.
+
+        Returns:
+            [<Stage>]: The stages which need to run
+        '''
+
+        reused = set()
+        for stage in self.stages:
+            stage.reused = False
+
+            if self.manifests is None:
+                continue
+
+            for dependency in stage.depends_on:
+                if dependency not in reused:
+                    break
+            else:
+                if self.manifests.is_current(stage):
+                    stage.reused = True
+                    reused.add(stage.name)
+
+        self.planned = [stage for stage in self.stages if not stage.reused]
+
+        return self.planned
+
+    def beside_cores(self, name):
+        '''
+        Description:
+            Determines the most cores needed by any one planned stage which
+            may run at the same time as the named stage, being those which
+            neither depend on it nor are depended on by it.
+
+        Returns:
+            <int>: The cores, or 0 when no planned stage may run beside it
+        '''
+
+        if self.planned is None:
+            self.plan()
+
+        stages = dict([(stage.name, stage) for stage in self.stages])
+
+        def dependencies(stage_name):
+            found = set()
+            pending = list(stages[stage_name].depends_on)
+            while pending:
+                dependency = pending.pop()
+                if dependency not in found:
+                    found.add(dependency)
+                    pending.extend(stages[dependency].depends_on)
+            return found
+
+        before = dependencies(name)
+        cores = 0
+        for stage in self.planned:
+            if (stage.name == name or stage.name in before or
+                    name in dependencies(stage.name)):
+                continue
+            cores = max(cores, stage.cores)
+
+        return cores
+
+    def _can_start(self, stage, completed, running):
+        '''
+        Description:
+            Determines if the stage can start with the current state.
+        '''
+
+        for dependency in stage.depends_on:
+            if dependency not in completed:
+                return False
+
+        cores_in_use = sum([current.cores for current in running.values()])
+        if cores_in_use + stage.cores > self.core_budget:
+            return False
+
+        if stage.metadata_access is not None:
+            for current in running.values():
+                if current.metadata_access is None:
+                    continue
+                if (stage.metadata_access == METADATA_WRITE or
+                        current.metadata_access == METADATA_WRITE):
+                    return False
+
+        return True
+
+    @staticmethod
+    def _execute(stage, manifests, done_queue):
+        '''
+        Description:
+            Thread body which runs a stage and reports the outcome.
+        '''
+
+        exc_info = None
+        try:
+            inputs = None
+            if manifests is not None:
+                # Until it completes, the stage has no valid results
+                manifests.remove([stage.name])
+                inputs = fingerprint_files(stage.inputs)
+
+            with st_trace.span(stage.name, 'stage', cores=stage.cores):
+                stage.function()
+
+            if manifests is not None:
+                manifests.save(stage, inputs)
+        except Exception:
+            exc_info = sys.exc_info()
+
+        stage.end_time = time.time()
+        done_queue.put((stage.name, exc_info))
+
+    def run(self):
+        '''
+        Description:
+            Runs all of the stages.  After a failure no further stages are
+            started, the running stages are allowed to finish, and then the
+            first failure is raised.
+        '''
+
+        logger = logging.getLogger(__name__)
+
+        stages = dict([(stage.name, stage) for stage in self.stages])
+        if self.planned is None:
+            self.plan()
+
+        pending = [stage.name for stage in self.planned]
+        running = dict()
+        completed = set()
+        failure = None
+
+        for stage in self.stages:
+            if stage.reused:
+                logger.info('Reusing the results of stage [{0}]'
+                            .format(stage.name))
+                completed.add(stage.name)
+
+        if self.progress is not None:
+            self.progress(len(completed), len(self.stages))
+
+        done_queue = Queue.Queue()
+
+        self.start_time = time.time()
+
+        while pending or running:
+            if failure is None:
+                for name in list(pending):
+                    stage = stages[name]
+                    if not self._can_start(stage, completed, running):
+                        continue
+
+                    pending.remove(name)
+                    running[name] = stage
+
+                    logger.info('Starting stage [{0}] using {1} core(s)'
+                                .format(name, stage.cores))
+
+                    stage.start_time = time.time()
+                    thread = threading.Thread(target=StageGraph._execute,
+                                              name=name,
+                                              args=(stage, self.manifests,
+                                                    done_queue))
+                    thread.daemon = True
+                    thread.start()
+
+            if not running:
+                if failure is not None:
+                    break
+                raise StageGraphError('Unable to start stages {0}'
+                                      .format(pending))
+
+            # A timeout keeps the wait interruptible
+            try:
+                (name, exc_info) = done_queue.get(True, 1.0)
+            except Queue.Empty:
+                continue
+
+            stage = running.pop(name)
+
+            if exc_info is None:
+                completed.add(name)
+                logger.info('Completed stage [{0}] in {1:.1f} seconds'
+                            .format(name, stage.elapsed()))
+                if self.progress is not None:
+                    self.progress(len(completed), len(self.stages))
+            else:
+                logger.error('Failed stage [{0}] after {1:.1f} seconds'
+                             .format(name, stage.elapsed()))
+                if failure is None:
+                    failure = exc_info
+
+        self.end_time = time.time()
+
+        self.log_timings()
+
+        if failure is not None:
+            raise failure[0], failure[1], failure[2]
+
+    def log_timings(self):
+        '''
+        Description:
+            Logs the start and end of each stage relative to the start of the
+            graph.
+        '''
+
+        logger = logging.getLogger(__name__)
+
+        logger.info('Stage timings (seconds from start):')
+        for stage in self.stages:
+            if stage.reused:
+                logger.info('  {0:<32} reused'.format(stage.name))
+                continue
+
+            if stage.start_time is None or stage.end_time is None:
+                logger.info('  {0:<32} not run'.format(stage.name))
+                continue
+
+            logger.info('  {0:<32} start {1:9.1f}  end {2:9.1f}'
+                        '  elapsed {3:9.1f}'
+                        .format(stage.name,
+                                stage.start_time - self.start_time,
+                                stage.end_time - self.start_time,
+                                stage.elapsed()))
+
+        logger.info('  {0:<32} {1:9.1f}'
+                    .format('total', self.end_time - self.start_time))
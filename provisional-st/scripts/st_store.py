@@ -0,0 +1,257 @@
+'''
+    File: st_store.py
+
+    Purpose: Reads and writes the binary stores the processing stages hand
+             the grid points, their elevations, and the atmospheric
+             parameters to each other in.  The layout is shared with
+             st_store.h and st_store.c, and the two must be kept in step.
+
+             A store is a header, a table of sections, and the values of
+             each section.  Everything is little-endian:
+
+             header (32 bytes)
+                 magic          8 bytes, STORE_MAGIC
+                 version        uint32, STORE_VERSION
+                 byte order     uint32, BYTE_ORDER_MARK
+                 section count  uint32
+                 table crc      uint32, CRC-32 of the section table
+                 file size      uint64
+
+             section (48 bytes each)
+                 name           24 bytes, NUL padded
+                 type           uint32, one of STORE_TYPES
+                 crc            uint32, CRC-32 of the values
+                 offset         uint64, from the start of the file
+                 count          uint64, number of values
+
+             The values of each section start on an 8 byte boundary, so a
+             store can be mapped and its sections used in place.
+
+    Project: Land Satellites Data Systems Science Research and Development
+             (LSRD) at the USGS EROS
+
+    License: NASA Open Source Agreement 1.3
+'''
+
+import os
+import zlib
+import mmap
+import struct
+from collections import OrderedDict
+
+import numpy as np
+
+
+STORE_MAGIC = 'ST_STORE'
+STORE_VERSION = 1
+BYTE_ORDER_MARK = 0x01020304
+STORE_ALIGNMENT = 8
+# Section names are terminated within the name field
+STORE_NAME_SIZE = 24
+
+STORE_HEADER = struct.Struct('<8sIIIIQ')
+STORE_SECTION = struct.Struct('<{0}sIIQQ'.format(STORE_NAME_SIZE))
+
+# Section type codes and the values they hold
+STORE_INT32 = 1
+STORE_FLOAT32 = 2
+STORE_FLOAT64 = 3
+STORE_TYPES = {STORE_INT32: np.dtype('<i4'),
+               STORE_FLOAT32: np.dtype('<f4'),
+               STORE_FLOAT64: np.dtype('<f8')}
+
+# Written by st_determine_grid_points.py
+GRID_POINT_STORE_NAME = 'grid_points.store'
+# Written by st_build_modtran_input.py
+ELEVATION_STORE_NAME = 'elevations.store'
+# Written by st_atmospheric_parameters
+SCENE_ATMOSPHERE_STORE_NAME = 'scene_atmosphere.store'
+
+# The grid, as the point count, rows, and columns
+SECTION_GRID = 'grid'
+# Values of each grid point
+SECTION_INDEX = 'index'
+SECTION_RUN_MODTRAN = 'run_modtran'
+SECTION_ROW = 'row'
+SECTION_COL = 'col'
+SECTION_NARR_ROW = 'narr_row'
+SECTION_NARR_COL = 'narr_col'
+SECTION_LON = 'lon'
+SECTION_LAT = 'lat'
+SECTION_MAP_X = 'map_x'
+SECTION_MAP_Y = 'map_y'
+# The standard elevations MODTRAN is run at, the first replaced by the
+# ground elevation of each point
+SECTION_ALTITUDES = 'altitudes'
+SECTION_GROUND_ELEVATION = 'ground_elevation'
+SECTION_GROUND_DIRECTORY = 'ground_directory'
+# The atmosphere, as the point count, elevations, and thermal bands
+SECTION_ATMOSPHERE = 'atmosphere'
+# Values of each elevation of each point, all of a point together
+SECTION_ELEVATION = 'elevation'
+SECTION_ELEVATION_DIRECTORY = 'elevation_directory'
+# Completed with the thermal band number
+SECTION_TRANSMISSION = 'transmission_{0}'
+SECTION_UPWELLED_RADIANCE = 'upwelled_radiance_{0}'
+SECTION_DOWNWELLED_RADIANCE = 'downwelled_radiance_{0}'
+
+
+def crc32(data):
+    """The unsigned CRC-32 of some bytes"""
+
+    return zlib.crc32(data) & 0xffffffff
+
+
+def aligned(offset):
+    """The offset rounded up to the alignment of the section values"""
+
+    return ((offset + STORE_ALIGNMENT - 1) //
+            STORE_ALIGNMENT * STORE_ALIGNMENT)
+
+
+def store_type(values):
+    """The section type the values are stored as
+
+    Args:
+        values <numpy.ndarray>: The section values
+
+    Returns:
+        <int>: The type code
+    """
+
+    if values.dtype.kind in 'iub':
+        return STORE_INT32
+    elif values.dtype.kind == 'f' and values.dtype.itemsize == 4:
+        return STORE_FLOAT32
+    elif values.dtype.kind == 'f':
+        return STORE_FLOAT64
+
+    raise Exception('No store type for values of [{0}]'
+                    .format(values.dtype))
+
+
+def write_store(filename, sections):
+    """Write a store, under a name of its own and then renamed into place,
+       so a reader never sees part of one
+
+    Args:
+        filename <str>: The store
+        sections [(<str>, <numpy.ndarray>)]: Name and values of each section
+    """
+
+    offset = aligned(STORE_HEADER.size + STORE_SECTION.size * len(sections))
+
+    table = list()
+    blocks = list()
+    for (name, values) in sections:
+        if len(name) >= STORE_NAME_SIZE:
+            raise Exception('Store section name [{0}] is too long'
+                            .format(name))
+
+        type_code = store_type(values)
+        data = np.ascontiguousarray(values,
+                                    dtype=STORE_TYPES[type_code]).tobytes()
+
+        table.append(STORE_SECTION.pack(name, type_code, crc32(data),
+                                        offset, values.size))
+        blocks.append((offset, data))
+        offset = aligned(offset + len(data))
+
+    table = ''.join(table)
+    header = STORE_HEADER.pack(STORE_MAGIC, STORE_VERSION, BYTE_ORDER_MARK,
+                               len(sections), crc32(table), offset)
+
+    temporary_filename = '{0}.{1}'.format(filename, os.getpid())
+    with open(temporary_filename, 'wb') as store_fd:
+        store_fd.write(header)
+        store_fd.write(table)
+        for (block_offset, data) in blocks:
+            store_fd.write('\0' * (block_offset - store_fd.tell()))
+            store_fd.write(data)
+        store_fd.write('\0' * (offset - store_fd.tell()))
+
+    os.rename(temporary_filename, filename)
+
+
+def read_store(filename):
+    """Map a store and check it
+
+    Args:
+        filename <str>: The store
+
+    Returns:
+        <OrderedDict>: Section name to its values, which are read only views
+                       of the mapped store
+    """
+
+    with open(filename, 'rb') as store_fd:
+        mapped = mmap.mmap(store_fd.fileno(), 0, access=mmap.ACCESS_READ)
+
+    def invalid(reason):
+        return Exception('Store [{0}] {1}'.format(filename, reason))
+
+    if len(mapped) < STORE_HEADER.size:
+        raise invalid('is too short for a store')
+
+    (magic, version, byte_order, section_count, table_crc,
+     file_size) = STORE_HEADER.unpack_from(mapped, 0)
+
+    if magic != STORE_MAGIC:
+        raise invalid('is not a store')
+    if version != STORE_VERSION:
+        raise invalid('is version {0}, not {1}'
+                      .format(version, STORE_VERSION))
+    if byte_order != BYTE_ORDER_MARK:
+        raise invalid('has an unknown byte order')
+    if file_size != len(mapped):
+        raise invalid('is {0} bytes, not {1}'.format(len(mapped), file_size))
+
+    table_end = STORE_HEADER.size + STORE_SECTION.size * section_count
+    if table_end > len(mapped):
+        raise invalid('is too short for its section table')
+    if crc32(mapped[STORE_HEADER.size:table_end]) != table_crc:
+        raise invalid('has a corrupt section table')
+
+    sections = OrderedDict()
+    for position in xrange(section_count):
+        (name, type_code, crc, offset, count) = STORE_SECTION.unpack_from(
+            mapped, STORE_HEADER.size + STORE_SECTION.size * position)
+        name = name.rstrip('\0')
+
+        if type_code not in STORE_TYPES:
+            raise invalid('section [{0}] has unknown type {1}'
+                          .format(name, type_code))
+
+        dtype = STORE_TYPES[type_code]
+        end = offset + count * dtype.itemsize
+        if offset % STORE_ALIGNMENT != 0 or end > len(mapped):
+            raise invalid('section [{0}] is outside the store'.format(name))
+        if crc32(mapped[offset:end]) != crc:
+            raise invalid('section [{0}] is corrupt'.format(name))
+
+        sections[name] = np.frombuffer(mapped, dtype=dtype, count=count,
+                                       offset=offset)
+
+    return sections
+
+
+def store_section(sections, name, count=None):
+    """The values of a section of a store
+
+    Args:
+        sections <OrderedDict>: The store, from read_store
+        name <str>: The section
+        count <int>: The number of values expected, or None for any
+
+    Returns:
+        <numpy.ndarray>: The values
+    """
+
+    if name not in sections:
+        raise Exception('The store has no [{0}] section'.format(name))
+
+    if count is not None and sections[name].size != count:
+        raise Exception('The store [{0}] section has {1} values, not {2}'
+                        .format(name, sections[name].size, count))
+
+    return sections[name]
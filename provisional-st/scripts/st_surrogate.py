@@ -0,0 +1,458 @@
+#! /usr/bin/env python
+
+'''
+    File: st_surrogate.py
+
+    Purpose: Provides the atmospheric parameters at the MODTRAN points
+             without running MODTRAN, by predicting them from a table fitted
+             to the results of previous runs (see st_build_surrogate.py).
+
+             Each point and elevation is described by the total column
+             water, near-surface temperature, and elevation of the profile
+             in its tape5 file.  The transmission, upwelled radiance, and
+             downwelled radiance are quadratic in those descriptors, and the
+             residuals of the fit are reported as the expected error of the
+             predictions.
+
+    Project: Land Satellites Data Systems Science Research and Development
+             (LSRD) at the USGS EROS
+
+    License: NASA Open Source Agreement 1.3
+'''
+
+import os
+import sys
+import math
+import json
+import logging
+from argparse import ArgumentParser
+from collections import namedtuple
+
+import numpy as np
+
+from espa import Metadata
+
+import st_utilities as util
+
+from st_grid_points import read_grid_points, point_directory
+from st_build_modtran_input import TAPE5
+from st_store import (ELEVATION_STORE_NAME, SCENE_ATMOSPHERE_STORE_NAME,
+                      SECTION_ALTITUDES, SECTION_GROUND_ELEVATION,
+                      SECTION_GROUND_DIRECTORY, SECTION_ATMOSPHERE,
+                      SECTION_ELEVATION, SECTION_TRANSMISSION,
+                      SECTION_UPWELLED_RADIANCE, SECTION_DOWNWELLED_RADIANCE,
+                      read_store, store_section)
+
+
+# Point parameters written for st_atmospheric_parameters --point-parameters
+SURROGATE_PARAMETERS_NAME = 'surrogate_parameters.txt'
+
+# Written in the scene directory with the expected error of the predictions
+SURROGATE_REPORT_NAME = 'st_surrogate_report.json'
+
+# The view geometry is not a descriptor, since every tape5 file is nadir
+DESCRIPTORS = ('column_water', 'surface_temperature', 'elevation')
+
+PARAMETER_NAMES = ('transmission', 'upwelled_radiance', 'downwelled_radiance')
+
+# The tape5 head holds four cards, the last giving the number of layers
+TAPE5_HEAD_LINES = 4
+
+# A fit needs several times as many samples as it has terms
+MINIMUM_SAMPLES = 50
+
+ProfileLayer = namedtuple('ProfileLayer', ('hgt', 'pressure', 'temp', 'rh'))
+
+# One elevation of a point MODTRAN is run for
+ElevationRun = namedtuple('ElevationRun', ('point', 'elevation', 'tape5'))
+
+
+def retrieve_command_line_arguments():
+    """Read arguments from the command line
+
+    Returns:
+        args <arguments>: The arguments read from the command line
+    """
+
+    parser = ArgumentParser(description='Predicts the atmospheric parameters'
+                                        ' at the MODTRAN points from a'
+                                        ' surrogate table')
+
+    parser.add_argument('--version',
+                        action='version',
+                        version=util.Version.version_text())
+
+    parser.add_argument('--xml',
+                        action='store', dest='xml_filename',
+                        required=False, default=None,
+                        help='The XML metadata file to use')
+
+    parser.add_argument('--table',
+                        action='store', dest='table_filename',
+                        required=False, default=None,
+                        help='The surrogate table to use')
+
+    parser.add_argument('--debug',
+                        action='store_true', dest='debug',
+                        required=False, default=False,
+                        help='Output debug messages and/or keep debug data')
+
+    args = parser.parse_args()
+
+    if args.xml_filename is None:
+        raise Exception('--xml must be specified on the command line')
+
+    if args.table_filename is None:
+        raise Exception('--table must be specified on the command line')
+
+    return args
+
+
+def read_tape5_profile(filename):
+    """Read the profile layers from a tape5 file
+
+    Args:
+        filename <str>: The tape5 file
+
+    Returns:
+        [<ProfileLayer>]: The layers, lowest first
+    """
+
+    with open(filename, 'r') as tape5_fd:
+        lines = tape5_fd.readlines()
+
+    count = int(lines[TAPE5_HEAD_LINES - 1].split()[0])
+
+    return [ProfileLayer(hgt=float(line[0:10]),
+                         pressure=float(line[10:20]),
+                         temp=float(line[20:30]),
+                         rh=float(line[30:40]))
+            for line in lines[TAPE5_HEAD_LINES:TAPE5_HEAD_LINES + count]]
+
+
+def profile_descriptors(layers):
+    """The descriptors of a profile
+
+    Args:
+        layers [<ProfileLayer>]: The layers, lowest first
+
+    Returns:
+        <tuple>: Total column water (cm), near-surface temperature (K), and
+                 elevation (km)
+    """
+
+    # Water vapour density (kg m^-3) at each layer, from the saturation
+    # vapour pressure (hPa) over water and the relative humidity
+    densities = list()
+    for layer in layers:
+        saturation = 6.112 * math.exp(17.67 * (layer.temp - 273.15) /
+                                      (layer.temp - 29.65))
+        vapour = layer.rh / 100.0 * saturation
+        densities.append(vapour * 100.0 / (461.5 * layer.temp))
+
+    # Integrated over height in m this is kg m^-2, or mm of water
+    column_water = 0.0
+    for index in range(1, len(layers)):
+        column_water += (0.5 * (densities[index] + densities[index - 1]) *
+                         (layers[index].hgt - layers[index - 1].hgt) * 1000.0)
+
+    return (column_water / 10.0, layers[0].temp, layers[0].hgt)
+
+
+def scene_elevation_runs():
+    """The elevations of each point MODTRAN is run for, in the order
+       st_atmospheric_parameters uses them
+
+    Returns:
+        [<ElevationRun>]: The elevation runs
+    """
+
+    (grid_points, dummy1, dummy2) = read_grid_points()
+
+    store = read_store(ELEVATION_STORE_NAME)
+    altitudes = [float(value)
+                 for value in store_section(store, SECTION_ALTITUDES)]
+    ground_elevations = store_section(store, SECTION_GROUND_ELEVATION,
+                                      len(grid_points))
+    ground_directories = store_section(store, SECTION_GROUND_DIRECTORY,
+                                       len(grid_points))
+
+    runs = list()
+    for (position, point) in enumerate(grid_points):
+        if not point.run_modtran:
+            continue
+
+        # The first elevation is the point's own ground height
+        elevations = [(float(ground_elevations[position]),
+                       '{0:05.3f}'.format(ground_directories[position]))]
+        elevations.extend([(altitude, '{0:05.3f}'.format(altitude))
+                           for altitude in altitudes[1:]])
+
+        for (elevation, directory) in elevations:
+            runs.append(ElevationRun(
+                point=point,
+                elevation=elevation,
+                tape5=os.path.join(point_directory(point), directory,
+                                   '000', '0.1', TAPE5)))
+
+    return runs
+
+
+def read_point_parameters(filename):
+    """Read the point parameters st_atmospheric_parameters made from the
+       MODTRAN results, for the reference thermal band
+
+    Args:
+        filename <str>: The scene atmosphere store
+
+    Returns:
+        [<tuple>]: The elevation followed by the parameters, for each
+                   elevation of each point MODTRAN was run for, in the order
+                   of scene_elevation_runs
+    """
+
+    (grid_points, dummy1, dummy2) = read_grid_points()
+
+    store = read_store(filename)
+    (count, num_elevations, dummy) = [
+        int(value) for value in store_section(store, SECTION_ATMOSPHERE, 3)]
+    if count != len(grid_points):
+        raise Exception('[{0}] holds {1} points, not {2}'
+                        .format(filename, count, len(grid_points)))
+
+    values = count * num_elevations
+    columns = [store_section(store, name, values)
+               for name in (SECTION_ELEVATION,
+                            SECTION_TRANSMISSION.format(0),
+                            SECTION_UPWELLED_RADIANCE.format(0),
+                            SECTION_DOWNWELLED_RADIANCE.format(0))]
+
+    parameters = list()
+    for (position, point) in enumerate(grid_points):
+        if not point.run_modtran:
+            continue
+
+        for location in xrange(position * num_elevations,
+                               (position + 1) * num_elevations):
+            parameters.append(tuple(float(column[location])
+                                    for column in columns))
+
+    return parameters
+
+
+def features(table, descriptors):
+    """The terms of the quadratic model for some descriptors
+
+    Args:
+        table <dict>: The surrogate table
+        descriptors <tuple>: The descriptors
+
+    Returns:
+        [<float>]: The terms
+    """
+
+    scaled = [(value - centre) / scale
+              for (value, centre, scale)
+              in zip(descriptors, table['centre'], table['scale'])]
+
+    terms = [1.0]
+    terms.extend(scaled)
+    for first in range(len(scaled)):
+        for second in range(first, len(scaled)):
+            terms.append(scaled[first] * scaled[second])
+
+    return terms
+
+
+def fit_table(samples, satellite):
+    """Fit the surrogate table to samples of previous MODTRAN runs
+
+    Args:
+        samples [(<tuple>, <tuple>)]: The descriptors and parameters of each
+                                      elevation run
+        satellite <str>: Name of satellite the parameters are for
+
+    Returns:
+        <dict>: The surrogate table
+    """
+
+    if len(samples) < MINIMUM_SAMPLES:
+        raise Exception('At least {0} samples are needed to fit the'
+                        ' surrogate table, only {1} were found'
+                        .format(MINIMUM_SAMPLES, len(samples)))
+
+    descriptors = np.array([sample[0] for sample in samples])
+    parameters = np.array([sample[1] for sample in samples])
+
+    # The descriptors are scaled so the terms are comparable in size
+    table = {'satellite': satellite,
+             'descriptors': list(DESCRIPTORS),
+             'parameters': list(PARAMETER_NAMES),
+             'centre': [float(value) for value in descriptors.mean(axis=0)],
+             'scale': [float(value) if value > 0.0 else 1.0
+                       for value in descriptors.std(axis=0)],
+             'minimum': [float(value) for value in descriptors.min(axis=0)],
+             'maximum': [float(value) for value in descriptors.max(axis=0)],
+             'samples': len(samples)}
+
+    design = np.array([features(table, sample[0]) for sample in samples])
+
+    table['coefficients'] = dict()
+    table['rmse'] = dict()
+    for (index, name) in enumerate(PARAMETER_NAMES):
+        (coefficients, dummy, rank, dummy) = np.linalg.lstsq(
+            design, parameters[:, index])
+
+        # Runs which all look alike do not determine every coefficient
+        if rank < design.shape[1]:
+            raise Exception('The samples do not determine the {0} model'
+                            .format(name))
+
+        residuals = parameters[:, index] - np.dot(design, coefficients)
+
+        table['coefficients'][name] = [float(value)
+                                       for value in coefficients]
+        table['rmse'][name] = float(np.sqrt(
+            np.sum(residuals ** 2) / (len(samples) - design.shape[1])))
+
+    return table
+
+
+def predict(table, descriptors):
+    """Predict the atmospheric parameters for some descriptors
+
+    Args:
+        table <dict>: The surrogate table
+        descriptors <tuple>: The descriptors
+
+    Returns:
+        <tuple>: (transmission, upwelled radiance, downwelled radiance)
+    """
+
+    terms = features(table, descriptors)
+
+    (transmission,
+     upwelled_radiance,
+     downwelled_radiance) = [sum([coefficient * term
+                                  for (coefficient, term)
+                                  in zip(table['coefficients'][name], terms)])
+                             for name in PARAMETER_NAMES]
+
+    return (min(max(transmission, 0.0), 1.0),
+            max(upwelled_radiance, 0.0),
+            max(downwelled_radiance, 0.0))
+
+
+def extrapolated(table, descriptors):
+    """Whether descriptors are outside those the table was fitted to
+
+    Args:
+        table <dict>: The surrogate table
+        descriptors <tuple>: The descriptors
+
+    Returns:
+        <bool>: True if the prediction is an extrapolation
+    """
+
+    return any([value < minimum or value > maximum
+                for (value, minimum, maximum)
+                in zip(descriptors, table['minimum'], table['maximum'])])
+
+
+def generate_point_parameters(table_filename, satellite):
+    """Predict the parameters at each MODTRAN point and elevation, and write
+       them for st_atmospheric_parameters
+
+    Args:
+        table_filename <str>: The surrogate table
+        satellite <str>: Name of satellite (e.g.: "LANDSAT_8")
+
+    Returns:
+        <dict>: The expected error of the predictions
+    """
+
+    logger = logging.getLogger(__name__)
+
+    with open(table_filename, 'r') as table_fd:
+        table = json.load(table_fd)
+
+    if table['satellite'] != satellite:
+        raise Exception('Surrogate table [{0}] is for {1}, not {2}'
+                        .format(table_filename, table['satellite'],
+                                satellite))
+
+    runs = scene_elevation_runs()
+
+    extrapolated_runs = 0
+    with open(SURROGATE_PARAMETERS_NAME, 'w') as parameters_fd:
+        for run in runs:
+            descriptors = profile_descriptors(read_tape5_profile(run.tape5))
+            if extrapolated(table, descriptors):
+                extrapolated_runs += 1
+
+            parameters_fd.write('{0:f},{1:f},{2:12.9f},{3:12.9f},{4:12.9f},'
+                                '{5:12.9f}\n'
+                                .format(run.point.lat, run.point.lon,
+                                        run.elevation,
+                                        *predict(table, descriptors)))
+
+    report = {'table': os.path.abspath(table_filename),
+              'training_samples': table['samples'],
+              'elevation_runs': len(runs),
+              'extrapolated_runs': extrapolated_runs,
+              'expected_error': table['rmse']}
+
+    with open(SURROGATE_REPORT_NAME, 'w') as report_fd:
+        json.dump(report, report_fd, indent=4, sort_keys=True)
+        report_fd.write('\n')
+
+    logger.info('Predicted [{0}] elevation runs from [{1}] training samples'
+                .format(len(runs), table['samples']))
+    for name in PARAMETER_NAMES:
+        logger.info('Expected {0} error [{1:.9f}]'
+                    .format(name, table['rmse'][name]))
+    if extrapolated_runs > 0:
+        logger.warning('[{0}] elevation runs are outside the profiles the'
+                       ' table was fitted to, and may be less accurate'
+                       .format(extrapolated_runs))
+
+    return report
+
+
+def main():
+    """Main processing for predicting the MODTRAN point parameters
+    """
+
+    # Command Line Arguments
+    args = retrieve_command_line_arguments()
+
+    # Check logging level
+    logging_level = logging.INFO
+    if args.debug:
+        logging_level = logging.DEBUG
+
+    # Setup the default logger format and level.  Log to STDOUT.
+    logging.basicConfig(format=('%(asctime)s.%(msecs)03d %(process)d'
+                                ' %(levelname)-8s'
+                                ' %(filename)s:%(lineno)d:'
+                                '%(funcName)s -- %(message)s'),
+                        datefmt='%Y-%m-%d %H:%M:%S',
+                        level=logging_level,
+                        stream=sys.stdout)
+    logger = logging.getLogger(__name__)
+
+    logger.info('*** Begin ST Surrogate ***')
+
+    # XML Metadata
+    espa_metadata = Metadata()
+    espa_metadata.parse(xml_filename=args.xml_filename)
+
+    generate_point_parameters(
+        table_filename=args.table_filename,
+        satellite=str(espa_metadata.xml_object.global_metadata.satellite))
+
+    logger.info('*** ST Surrogate - Complete ***')
+
+
+if __name__ == '__main__':
+    main()
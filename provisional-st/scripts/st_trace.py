@@ -0,0 +1,299 @@
+'''
+    File: st_trace.py
+
+    Purpose: Records spans of the processing, and the peak memory of each
+             process, as Chrome trace events, which chrome://tracing and
+             Perfetto display as a timeline.
+
+             Tracing is on when the ST_TRACE_DIR environment variable names a
+             directory, which the processes started by a traced run inherit.
+             Each process appends its events to its own file there, one JSON
+             event per line, and the files are merged into one trace when
+             the run completes.
+
+    Project: Land Satellites Data Systems Science Research and Development
+             (LSRD) at the USGS EROS
+
+    License: NASA Open Source Agreement 1.3
+'''
+
+import os
+import sys
+import glob
+import json
+import time
+import atexit
+import shutil
+import logging
+import resource
+import threading
+from collections import defaultdict
+from contextlib import contextmanager
+from functools import wraps
+
+
+# Environment variable naming the directory the events are written to
+TRACE_ENV = 'ST_TRACE_DIR'
+
+# Written in the scene directory by a traced run
+TRACE_DIRECTORY = 'st_trace'
+TRACE_FILENAME = 'st_trace.json'
+
+# Event file of each process within the trace directory
+EVENT_FILE_TEMPLATE = 'trace.{0}.jsonl'
+
+# Counter event holding the peak resident set size of a process
+PEAK_RSS = 'peak_rss'
+
+_lock = threading.Lock()
+_named_processes = set()
+
+
+def trace_directory():
+    """The directory the events are written to
+
+    Returns:
+        <str>: The directory, or None if tracing is off
+    """
+
+    directory = os.environ.get(TRACE_ENV, '')
+    if len(directory) == 0:
+        return None
+
+    return directory
+
+
+def enabled():
+    """Is tracing on
+
+    Returns:
+        <bool>: True if events are being recorded
+    """
+
+    return trace_directory() is not None
+
+
+def _timestamp(seconds):
+    """Trace timestamps are microseconds
+    """
+
+    return int(round(seconds * 1000000.0))
+
+
+def write_event(event):
+    """Append an event to the file of this process
+
+    The first event of a process is preceded by its name.  Tracing never
+    fails the processing, so a failed write is only logged.
+
+    Args:
+        event <dict>: The trace event, without the process and thread
+    """
+
+    directory = trace_directory()
+    if directory is None:
+        return
+
+    pid = os.getpid()
+    event['pid'] = pid
+    event.setdefault('tid', threading.current_thread().ident)
+
+    lines = list()
+    with _lock:
+        if pid not in _named_processes:
+            _named_processes.add(pid)
+            lines.append(json.dumps(
+                {'name': 'process_name', 'ph': 'M', 'pid': pid,
+                 'tid': event['tid'],
+                 'args': {'name': os.path.basename(sys.argv[0])}}))
+        lines.append(json.dumps(event))
+
+        try:
+            with open(os.path.join(directory,
+                                   EVENT_FILE_TEMPLATE.format(pid)),
+                      'a') as event_fd:
+                event_fd.write(''.join([line + '\n' for line in lines]))
+        except IOError:
+            logger = logging.getLogger(__name__)
+            logger.warning('Unable to write trace events to [{0}]'
+                           .format(directory))
+
+
+def record(name, category, start_time, end_time=None, **args):
+    """Record a span which has already completed
+
+    Args:
+        name <str>: The span
+        category <str>: What the span is part of
+        start_time <float>: Start of the span, from time.time()
+        end_time <float>: End of the span, or None for now
+        args: Details shown with the span
+    """
+
+    if not enabled():
+        return
+
+    if end_time is None:
+        end_time = time.time()
+
+    write_event({'name': name, 'cat': category, 'ph': 'X',
+                 'ts': _timestamp(start_time),
+                 'dur': _timestamp(end_time - start_time),
+                 'args': args})
+
+
+@contextmanager
+def span(name, category, **args):
+    """Record the span of a with statement, including one which fails
+
+    Args:
+        name <str>: The span
+        category <str>: What the span is part of
+        args: Details shown with the span
+    """
+
+    start_time = time.time()
+    try:
+        yield
+    finally:
+        record(name, category, start_time, **args)
+
+
+def traced(name, category, **args):
+    """Decorator recording a span for each call of the function
+
+    Args:
+        name <str>: The span
+        category <str>: What the span is part of
+        args: Details shown with the span
+    """
+
+    def decorator(function):
+        @wraps(function)
+        def traced_function(*function_args, **function_kwargs):
+            with span(name, category, **args):
+                return function(*function_args, **function_kwargs)
+
+        return traced_function
+
+    return decorator
+
+
+def record_peak_rss():
+    """Record the peak resident set size of this process, and of the
+       processes it has waited for, in kilobytes
+    """
+
+    if not enabled():
+        return
+
+    write_event({'name': PEAK_RSS, 'ph': 'C',
+                 'ts': _timestamp(time.time()),
+                 'args': {'self_kb': resource.getrusage(
+                              resource.RUSAGE_SELF).ru_maxrss,
+                          'children_kb': resource.getrusage(
+                              resource.RUSAGE_CHILDREN).ru_maxrss}})
+
+
+def start(directory=TRACE_DIRECTORY):
+    """Turn on tracing for this process and the processes it starts
+
+    Args:
+        directory <str>: The directory to write the events to
+    """
+
+    if os.path.isdir(directory):
+        shutil.rmtree(directory)
+    os.makedirs(directory)
+
+    os.environ[TRACE_ENV] = os.path.realpath(directory)
+
+
+def stop():
+    """Turn off tracing and collect the events written by every process
+
+    Returns:
+        [<dict>]: The events, in time order
+    """
+
+    record_peak_rss()
+
+    directory = trace_directory()
+    del os.environ[TRACE_ENV]
+
+    events = list()
+    for filename in sorted(glob.glob(os.path.join(
+            directory, EVENT_FILE_TEMPLATE.format('*')))):
+        with open(filename, 'r') as event_fd:
+            for line in event_fd:
+                # A process killed while writing leaves a partial line
+                try:
+                    events.append(json.loads(line))
+                except ValueError:
+                    pass
+
+    shutil.rmtree(directory, ignore_errors=True)
+
+    return sorted(events, key=lambda event: event.get('ts', 0))
+
+
+def write_trace(events, filename=TRACE_FILENAME):
+    """Write the events as a Chrome trace
+
+    Args:
+        events [<dict>]: The events
+        filename <str>: The trace file
+    """
+
+    with open(filename, 'w') as trace_fd:
+        json.dump({'traceEvents': events, 'displayTimeUnit': 'ms'},
+                  trace_fd)
+        trace_fd.write('\n')
+
+
+def log_summary(events):
+    """Log the total time of each kind of span and the peak memory of each
+       process
+
+    Args:
+        events [<dict>]: The events
+    """
+
+    logger = logging.getLogger(__name__)
+
+    durations = defaultdict(list)
+    names = dict()
+    peaks = dict()
+    for event in events:
+        if event['ph'] == 'X':
+            durations[(event['cat'], event['name'])].append(
+                event['dur'] / 1000000.0)
+        elif event['ph'] == 'M':
+            names[event['pid']] = event['args']['name']
+        elif event['ph'] == 'C' and event['name'] == PEAK_RSS:
+            (self_kb, children_kb) = peaks.get(event['pid'], (0, 0))
+            peaks[event['pid']] = (max(self_kb, event['args']['self_kb']),
+                                   max(children_kb,
+                                       event['args']['children_kb']))
+
+    logger.info('Trace summary (seconds):')
+    logger.info('  {0:<24} {1:<32} {2:>6} {3:>10} {4:>9} {5:>9}'
+                .format('category', 'span', 'count', 'total', 'mean',
+                        'max'))
+    for ((category, name), seconds) in sorted(durations.items()):
+        logger.info('  {0:<24} {1:<32} {2:6d} {3:10.2f} {4:9.3f} {5:9.3f}'
+                    .format(category, name, len(seconds), sum(seconds),
+                            sum(seconds) / len(seconds), max(seconds)))
+
+    logger.info('Peak resident set size (MB):')
+    logger.info('  {0:<8} {1:<40} {2:>9} {3:>9}'
+                .format('pid', 'process', 'self', 'children'))
+    for (pid, (self_kb, children_kb)) in sorted(peaks.items()):
+        logger.info('  {0:<8} {1:<40} {2:9.1f} {3:9.1f}'
+                    .format(pid, names.get(pid, ''), self_kb / 1024.0,
+                            children_kb / 1024.0))
+
+
+# Processes started by a traced run report their peak memory as they exit
+if enabled():
+    atexit.register(record_peak_rss)
@@ -15,10 +15,12 @@ import logging
 import errno
 import commands
 import datetime
+import threading
 from time import sleep
+from collections import OrderedDict
 from cStringIO import StringIO
 import requests
-from osgeo import gdal, osr
+from osgeo import gdal, osr, gdal_array
 
 
 class Version(object):
@@ -416,18 +418,22 @@ class Geo(object):
             raise
 
     @staticmethod
-    def mosaic_tiles_into_one_raster(src_names, dest_name, no_data_value):
+    def mosaic_tiles_into_one_raster(src_names, dest_name, no_data_value,
+                                     multi=True):
         '''
         Description:
             Executes gdalwarp on the supplied source names to generate a
-            mosaic'ed destination named file.
+            mosaic'ed destination named file.  The multi option has gdalwarp
+            use a second thread.
         '''
 
         logger = logging.getLogger(__name__)
 
-        cmd = ['gdalwarp', '-wm', '2048', '-multi',
-               '-srcnodata', str(no_data_value),
-               '-dstnodata', str(no_data_value)]
+        cmd = ['gdalwarp', '-wm', '2048']
+        if multi:
+            cmd.append('-multi')
+        cmd.extend(['-srcnodata', str(no_data_value),
+                    '-dstnodata', str(no_data_value)])
         cmd.extend(src_names)
         cmd.append(dest_name)
 
@@ -442,3 +448,311 @@ class Geo(object):
         finally:
             if len(output) > 0:
                 logger.info(output)
+
+
+class RasterCache(object):
+    '''
+    Description:
+        Provides an in-memory store of raster band data, so that processing
+        stages running within the same process can hand bands to each other
+        without writing and re-reading them through GDAL.  It is disabled by
+        default, in which case nothing is stored and all reads go to disk.
+    '''
+
+    enabled = False
+    rasters = dict()
+
+    @staticmethod
+    def enable():
+        '''
+        Description:
+            Turns on storing of raster band data.
+        '''
+
+        RasterCache.enabled = True
+
+    @staticmethod
+    def disable():
+        '''
+        Description:
+            Turns off storing of raster band data and releases all of it.
+        '''
+
+        RasterCache.enabled = False
+        RasterCache.rasters.clear()
+
+    @staticmethod
+    def put(name, band_number, data, data_type):
+        '''
+        Description:
+            Stores the band data as it was written to disk with the
+            specified GDAL data type.  The data is only copied when it is
+            held as another type, so the caller must not modify it after.
+        '''
+
+        if not RasterCache.enabled:
+            return
+
+        numeric_type = gdal_array.GDALTypeCodeToNumericTypeCode(data_type)
+        RasterCache.store(name, band_number,
+                          data.astype(numeric_type, copy=False))
+
+    @staticmethod
+    def get(name, band_number):
+        '''
+        Description:
+            Returns the stored band data as a read only view, or None if
+            the band has not been stored.  Callers which modify the data
+            must copy it first.
+        '''
+
+        return RasterCache.rasters.get((os.path.realpath(name), band_number))
+
+    @staticmethod
+    def store(name, band_number, data):
+        '''
+        Description:
+            Stores a read only view of the band data.
+        '''
+
+        view = data.view()
+        view.flags.writeable = False
+        RasterCache.rasters[(os.path.realpath(name), band_number)] = view
+
+        return view
+
+    @staticmethod
+    def read(name, band_number):
+        '''
+        Description:
+            Returns the band data, from the store if present otherwise from
+            disk.  Band data read from disk is stored for later readers, and
+            is then returned as a read only view, the same as stored data.
+        '''
+
+        data = RasterCache.get(name, band_number)
+        if data is not None:
+            return data
+
+        dataset = gdal.Open(name)
+        if dataset is None:
+            raise RuntimeError('GDAL failed to open {0}'.format(name))
+
+        data = (dataset.GetRasterBand(band_number)
+                .ReadAsArray(0, 0, dataset.RasterXSize, dataset.RasterYSize))
+        del dataset
+
+        if RasterCache.enabled:
+            return RasterCache.store(name, band_number, data)
+
+        return data
+
+    @staticmethod
+    def release(name):
+        '''
+        Description:
+            Releases all of the stored band data for the specified raster.
+        '''
+
+        real_name = os.path.realpath(name)
+        for key in [key for key in RasterCache.rasters
+                    if key[0] == real_name]:
+            del RasterCache.rasters[key]
+
+
+class SharedDataCache(object):
+    '''
+    Description:
+        Provides an in-memory store of data loaded from the static and
+        auxiliary files, so that scenes processed within the same process
+        parse each file only once.  Entries are keyed on the real path, size,
+        and modification time of the files they were loaded from, so a file
+        which changes is loaded again.  It is disabled by default, in which
+        case the loader is always called and nothing is stored.
+
+        When enabled with a limit, only that many entries are kept and the
+        least recently used entry is released to make room for a new one.
+
+        Callers must not modify the data they are given.  Stages running on
+        threads of their own may share it, so the entries are only used
+        with the lock held, while the loader is called without it.
+    '''
+
+    lock = threading.Lock()
+    enabled = False
+    limit = None
+    entries = OrderedDict()
+
+    @staticmethod
+    def enable(limit=None):
+        '''
+        Description:
+            Turns on storing of loaded data, keeping at most limit entries
+            when a limit is given.
+        '''
+
+        with SharedDataCache.lock:
+            SharedDataCache.enabled = True
+            SharedDataCache.limit = limit
+
+    @staticmethod
+    def disable():
+        '''
+        Description:
+            Turns off storing of loaded data and releases all of it.
+        '''
+
+        with SharedDataCache.lock:
+            SharedDataCache.enabled = False
+            SharedDataCache.limit = None
+            SharedDataCache.entries.clear()
+
+    @staticmethod
+    def load(filenames, loader, name=None):
+        '''
+        Description:
+            Returns the data loaded from the files, calling the loader only
+            if the data has not already been stored.  The name tells apart
+            different data loaded from the same files.  When two callers
+            load the same data at once, both call the loader and the data
+            stored first is returned to each.
+        '''
+
+        if not SharedDataCache.enabled:
+            return loader()
+
+        files = list()
+        for filename in filenames:
+            status = os.stat(filename)
+            files.append((os.path.realpath(filename),
+                          status.st_size, status.st_mtime))
+        key = (name, tuple(files))
+
+        entries = SharedDataCache.entries
+        with SharedDataCache.lock:
+            if key in entries:
+                # Move the entry to the most recently used end
+                data = entries.pop(key)
+                entries[key] = data
+                return data
+
+        data = loader()
+
+        with SharedDataCache.lock:
+            if not SharedDataCache.enabled:
+                return data
+
+            if key in entries:
+                # Stored by another caller while this one was loading
+                data = entries.pop(key)
+            elif SharedDataCache.limit is not None:
+                while len(entries) >= max(1, SharedDataCache.limit):
+                    entries.popitem(last=False)
+
+            entries[key] = data
+
+        return data
+
+    @staticmethod
+    def release(directory):
+        '''
+        Description:
+            Releases all of the stored data loaded from files within the
+            directory.
+        '''
+
+        prefix = os.path.join(os.path.realpath(directory), '')
+        with SharedDataCache.lock:
+            for key in [key for key in SharedDataCache.entries
+                        if [item for item in key[1]
+                            if item[0].startswith(prefix)]]:
+                del SharedDataCache.entries[key]
+
+
+class MetadataTransaction(object):
+    '''
+    Description:
+        Collects the band additions and updates made to parsed XML metadata,
+        so that the XML file is validated and written once when the
+        transaction commits, instead of once for each band.
+
+        As a with statement, the transaction commits when the block is
+        left.  This happens even when the block fails, since the band files
+        changed before the failure must still match the XML file.  A
+        transaction begun on metadata which already has one open becomes
+        part of the open one.
+    '''
+
+    lock = threading.Lock()
+    open_transactions = dict()
+
+    def __init__(self, espa_metadata):
+        super(MetadataTransaction, self).__init__()
+
+        self.espa_metadata = espa_metadata
+        self.pending = False
+        self.nested = False
+
+    def __enter__(self):
+        with MetadataTransaction.lock:
+            key = id(self.espa_metadata)
+            if key in MetadataTransaction.open_transactions:
+                self.nested = True
+            else:
+                MetadataTransaction.open_transactions[key] = self
+
+        return self
+
+    def __exit__(self, exc_type, exc_value, traceback):
+        if self.nested:
+            return False
+
+        with MetadataTransaction.lock:
+            del MetadataTransaction.open_transactions[id(self.espa_metadata)]
+
+        if exc_type is None:
+            self.commit()
+        else:
+            # Keep the original failure rather than one from the commit
+            try:
+                self.commit()
+            except Exception:
+                logger = logging.getLogger(__name__)
+                logger.exception('Failed writing the XML metadata')
+
+        return False
+
+    def commit(self):
+        '''
+        Description:
+            Validates and writes the XML metadata, if it has been changed.
+        '''
+
+        if not self.pending:
+            return
+
+        logger = logging.getLogger(__name__)
+        logger.info('Writing the XML metadata')
+
+        self.espa_metadata.validate()
+        self.espa_metadata.write()
+        self.pending = False
+
+    @staticmethod
+    def save(espa_metadata):
+        '''
+        Description:
+            Validates and writes changed XML metadata, or leaves it to the
+            transaction open on the metadata.
+        '''
+
+        with MetadataTransaction.lock:
+            transaction = MetadataTransaction.open_transactions.get(
+                id(espa_metadata))
+
+        if transaction is not None:
+            transaction.pending = True
+            return
+
+        espa_metadata.validate()
+        espa_metadata.write()
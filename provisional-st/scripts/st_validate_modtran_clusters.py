@@ -0,0 +1,303 @@
+#! /usr/bin/env python
+
+'''
+    File: st_validate_modtran_clusters.py
+
+    Purpose: Measures the error introduced by clustering MODTRAN points.
+
+             Clustered points use the MODTRAN runs of their cluster's
+             representative.  For a scene processed with clustering, and
+             with its temporary data kept, this runs MODTRAN for each
+             clustered point with its own profile and reports the largest
+             difference in the atmospheric parameters from those it was
+             given.
+
+    Project: Land Satellites Data Systems Science Research and Development
+             (LSRD) at the USGS EROS
+
+    License: NASA Open Source Agreement 1.3
+'''
+
+import os
+import sys
+import glob
+import json
+import logging
+from argparse import ArgumentParser
+
+import numpy as np
+
+from espa import Metadata
+
+import st_utilities as util
+import libst
+import st_build_modtran_input as modtran_input
+from st_grid_points import read_grid_points, point_directory
+from st_run_modtran import (LOCAL_EXECUTOR, RESULT_HDR, RESULT_DATA,
+                            make_executor)
+
+
+# Directory the clustered points are run again in, with their own profiles
+VALIDATION_DIRECTORY = 'modtran_cluster_validation'
+
+# Written in the scene directory with the largest differences found
+VALIDATION_NAME = 'modtran_cluster_validation.json'
+
+# Spectral response files in the ST data directory for each satellite
+SPECTRAL_RESPONSE_FILES = {'LANDSAT_4': 'L4_Spectral_Response.txt',
+                           'LANDSAT_5': 'L5_Spectral_Response.txt',
+                           'LANDSAT_7': 'L7_Spectral_Response.txt',
+                           'LANDSAT_8': 'L8_Spectral_Response.txt'}
+
+# The MODTRAN runs of each elevation in MODTRAN table column order
+TABLE_RUNS = (('273', '0.0'), ('310', '0.0'), ('000', '0.1'))
+
+PARAMETER_NAMES = ('transmission', 'upwelled_radiance', 'downwelled_radiance')
+
+
+def retrieve_command_line_arguments():
+    """Read arguments from the command line
+
+    Returns:
+        args <arguments>: The arguments read from the command line
+    """
+
+    parser = ArgumentParser(description='Measures the atmospheric parameter'
+                                        ' error of clustered MODTRAN points')
+
+    parser.add_argument('--version',
+                        action='version',
+                        version=util.Version.version_text())
+
+    parser.add_argument('--xml',
+                        action='store', dest='xml_filename',
+                        required=False, default=None,
+                        help='The XML metadata file to use')
+
+    parser.add_argument('--data_path',
+                        action='store', dest='data_path',
+                        required=False, default=None,
+                        help='Specify the ST Data directory')
+
+    parser.add_argument('--modtran_data_path',
+                        action='store', dest='modtran_data_path',
+                        required=False, default=None,
+                        help='Specify the MODTRAN data directory')
+
+    parser.add_argument('--process_count',
+                        action='store', dest='process_count', type=int,
+                        required=False, default=1,
+                        help='Number of processes to use')
+
+    parser.add_argument('--debug',
+                        action='store_true', dest='debug',
+                        required=False, default=False,
+                        help='Output debug messages and/or keep debug data')
+
+    args = parser.parse_args()
+
+    if args.xml_filename is None:
+        raise Exception('--xml must be specified on the command line')
+
+    if args.data_path is None:
+        raise Exception('--data_path must be specified on the command line')
+
+    if args.modtran_data_path is None:
+        raise Exception('--modtran_data_path must be specified on the'
+                        ' command line')
+
+    return args
+
+
+def load_spectral_response(satellite):
+    """Load the thermal band spectral response used by the pixel stage
+
+    Args:
+        satellite <str>: Name of satellite (e.g.: "LANDSAT_8")
+
+    Returns:
+        <numpy.ndarray>: float64 wavelengths then responses, shape
+                         (2, num_srs)
+    """
+
+    if satellite not in SPECTRAL_RESPONSE_FILES:
+        raise Exception('Unsupported satellite sensor')
+
+    st_data_dir = os.environ.get('ST_DATA_DIR')
+    if st_data_dir is None:
+        raise Exception('ST_DATA_DIR environment variable is not set')
+
+    srs = np.loadtxt(os.path.join(st_data_dir,
+                                  SPECTRAL_RESPONSE_FILES[satellite]),
+                     dtype=np.float64)
+
+    return np.ascontiguousarray(srs[:, :2].T)
+
+
+def elevation_parameters(srs, elevation_path):
+    """Atmospheric parameters from the MODTRAN runs of one elevation
+
+    Args:
+        srs <numpy.ndarray>: The spectral response
+        elevation_path <str>: Directory holding the runs of the elevation
+
+    Returns:
+        <tuple>: (transmission, upwelled radiance, downwelled radiance)
+    """
+
+    with open(os.path.join(elevation_path, '000', '0.1', RESULT_HDR),
+              'r') as hdr_fd:
+        zero_temp = float(hdr_fd.readline().split()[1])
+
+    columns = list()
+    for (temperature, albedo) in TABLE_RUNS:
+        data = np.loadtxt(os.path.join(elevation_path, temperature, albedo,
+                                       RESULT_DATA),
+                          dtype=np.float64, ndmin=2)
+        if not columns:
+            columns.append(data[:, 0])
+        columns.append(data[:, 1])
+
+    modtran = np.ascontiguousarray(np.column_stack(columns))
+
+    return libst.point_parameters(srs, modtran, zero_temp)
+
+
+def point_parameters(srs, point_path):
+    """Atmospheric parameters of a point at each of its elevations
+
+    Args:
+        srs <numpy.ndarray>: The spectral response
+        point_path <str>: Directory holding the runs of the point
+
+    Returns:
+        [<tuple>]: The parameters of each elevation, lowest first
+    """
+
+    elevation_paths = sorted(glob.glob(os.path.join(point_path, '*')),
+                             key=lambda path: float(os.path.basename(path)))
+
+    return [elevation_parameters(srs, path) for path in elevation_paths]
+
+
+def validate_clusters(espa_metadata, data_path, modtran_data_path,
+                      process_count):
+    """Run the clustered points with their own profiles and compare
+
+    Args:
+        espa_metadata <espa.Metadata>: The metadata for the scene
+        data_path <str>: Directory for ST data files
+        modtran_data_path <str>: Directory for the MODTRAN 'DATA' files
+        process_count <int>: Number of processes to use
+
+    Returns:
+        <dict>: The largest difference of each parameter, and the point
+                it was found at
+    """
+
+    logger = logging.getLogger(__name__)
+
+    clusters = modtran_input.read_clusters()
+    if not clusters:
+        raise Exception('The MODTRAN points were not clustered')
+
+    (grid_points, dummy1, dummy2) = read_grid_points()
+    members = [point for point in grid_points
+               if point.run_modtran and
+               clusters.get(point_directory(point),
+                            point_directory(point)) !=
+               point_directory(point)]
+
+    logger.info('Validating [{0}] clustered points'.format(len(members)))
+
+    std_atmos = [layer for layer in
+                 modtran_input.load_std_atmosphere(data_path=data_path)]
+
+    # The clustered points are generated and run as if they were not
+    modtran_input.generate_modtran_tape5_files(
+        espa_metadata=espa_metadata,
+        data_path=data_path,
+        std_atmos=std_atmos,
+        grid_points=members,
+        output_directory=VALIDATION_DIRECTORY)
+
+    run_parms = list()
+    for point in members:
+        run_parms.extend([
+            (path, modtran_data_path)
+            for path in sorted(glob.glob(os.path.join(
+                VALIDATION_DIRECTORY, point_directory(point),
+                '*', '*', '*')))])
+
+    executor = make_executor(executor=LOCAL_EXECUTOR,
+                             process_count=process_count,
+                             queue_directory=None)
+    executor.run(run_parms)
+
+    srs = load_spectral_response(
+        str(espa_metadata.xml_object.global_metadata.satellite))
+
+    worst = dict([(name, {'difference': 0.0, 'point': None})
+                  for name in PARAMETER_NAMES])
+    for point in members:
+        shared = point_parameters(srs, point_directory(point))
+        own = point_parameters(srs, os.path.join(VALIDATION_DIRECTORY,
+                                                 point_directory(point)))
+
+        for (shared_values, own_values) in zip(shared, own):
+            for (name, given, actual) in zip(PARAMETER_NAMES, shared_values,
+                                             own_values):
+                if abs(given - actual) > worst[name]['difference']:
+                    worst[name] = {'difference': abs(given - actual),
+                                   'point': point_directory(point)}
+
+    for name in PARAMETER_NAMES:
+        logger.info('Largest {0} difference [{1:.9f}] at [{2}]'
+                    .format(name, worst[name]['difference'],
+                            worst[name]['point']))
+
+    return worst
+
+
+def main():
+    """Main processing for validating clustered MODTRAN points
+    """
+
+    # Command Line Arguments
+    args = retrieve_command_line_arguments()
+
+    # Check logging level
+    logging_level = logging.INFO
+    if args.debug:
+        logging_level = logging.DEBUG
+
+    # Setup the default logger format and level.  Log to STDOUT.
+    logging.basicConfig(format=('%(asctime)s.%(msecs)03d %(process)d'
+                                ' %(levelname)-8s'
+                                ' %(filename)s:%(lineno)d:'
+                                '%(funcName)s -- %(message)s'),
+                        datefmt='%Y-%m-%d %H:%M:%S',
+                        level=logging_level,
+                        stream=sys.stdout)
+    logger = logging.getLogger(__name__)
+
+    logger.info('*** Begin Validate MODTRAN Clusters ***')
+
+    # XML Metadata
+    espa_metadata = Metadata()
+    espa_metadata.parse(xml_filename=args.xml_filename)
+
+    worst = validate_clusters(espa_metadata=espa_metadata,
+                              data_path=args.data_path,
+                              modtran_data_path=args.modtran_data_path,
+                              process_count=args.process_count)
+
+    with open(VALIDATION_NAME, 'w') as validation_fd:
+        json.dump(worst, validation_fd, indent=4, sort_keys=True)
+        validation_fd.write('\n')
+
+    logger.info('*** Validate MODTRAN Clusters - Complete ***')
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,432 @@
+'''
+    File: st_window.py
+
+    Purpose: Creates a copy of a scene restricted to a window of lines and
+             samples, so that a region of interest can be processed without
+             processing the whole scene.
+
+             The window scene is placed in its own directory, with the input
+             bands cropped to the window and the XML metadata describing the
+             window, including its projection corners and geographic bounds.
+             Every stage, and so the grid points, the MODTRAN runs, and the
+             ASTER GED tiles, then only covers the window.
+
+             The window is given in the pixels of the thermal band.  A band
+             of another pixel size is cropped to the same area, in its own
+             pixels, and is left out when the window does not fall on whole
+             pixels of it.
+
+    Project: Land Satellites Data Systems Science Research and Development
+             (LSRD) at the USGS EROS
+
+    License: NASA Open Source Agreement 1.3
+'''
+
+import os
+import re
+import shutil
+import logging
+from collections import namedtuple
+
+from lxml import objectify
+from osgeo import gdal, osr
+
+from espa import Metadata
+
+from st_manifest import ST_PRODUCTS
+
+
+Window = namedtuple('Window', ('line', 'sample', 'lines', 'samples'))
+
+# Bytes in each pixel for the ESPA data types
+DATA_TYPE_SIZES = {'INT8': 1, 'UINT8': 1,
+                   'INT16': 2, 'UINT16': 2,
+                   'INT32': 4, 'UINT32': 4,
+                   'FLOAT32': 4, 'FLOAT64': 8}
+
+# Points along each edge of the window used for its geographic bounds
+EDGE_POINTS = 16
+
+# Records the scene and window the window scene was created from
+WINDOW_SOURCE_NAME = 'st_window_source.txt'
+
+# Difference from a whole pixel still taken as one
+PIXEL_TOLERANCE = 1e-6
+
+
+def parse_window(text):
+    """Parse a window specification
+
+    Args:
+        text <str>: 'line0,sample0,lines,samples'
+
+    Returns:
+        <Window>: The window
+    """
+
+    try:
+        window = Window(*[int(value) for value in text.split(',')])
+    except (ValueError, TypeError):
+        raise Exception('The window must be given as'
+                        ' line0,sample0,lines,samples')
+
+    if window.line < 0 or window.sample < 0:
+        raise Exception('The window must start within the scene')
+
+    if window.lines <= 0 or window.samples <= 0:
+        raise Exception('The window must contain at least one pixel')
+
+    return window
+
+
+def window_directory(window):
+    """The directory the window scene is created in
+
+    Args:
+        window <Window>: The window
+
+    Returns:
+        <str>: The directory name
+    """
+
+    return 'st_window_{0}_{1}_{2}_{3}'.format(window.line, window.sample,
+                                              window.lines, window.samples)
+
+
+def band_window(window, pixel_size, band_pixel_size):
+    """The window in the pixels of a band
+
+    Args:
+        window <Window>: The window, in pixels of pixel_size
+        pixel_size <tuple>: Pixel size the window is given in
+        band_pixel_size <tuple>: Pixel size of the band
+
+    Returns:
+        <Window>: The window in the pixels of the band, or None when it does
+                  not fall on whole pixels of the band
+    """
+
+    x_scale = pixel_size[0] / band_pixel_size[0]
+    y_scale = pixel_size[1] / band_pixel_size[1]
+
+    scaled = (window.line * y_scale, window.sample * x_scale,
+              window.lines * y_scale, window.samples * x_scale)
+    pixels = [int(round(value)) for value in scaled]
+
+    if any([abs(value - pixel) > PIXEL_TOLERANCE
+            for (value, pixel) in zip(scaled, pixels)]):
+        return None
+
+    return Window(*pixels)
+
+
+def window_source(xml_filename, window):
+    """Describe what a window scene is created from
+
+    The input bands are described by their size and modification time, so
+    a scene which is replaced is noticed, while the ST products added to
+    its XML are not.
+
+    Args:
+        xml_filename <str>: XML metadata filename of the scene
+        window <Window>: The window
+
+    Returns:
+        <str>: The description
+    """
+
+    espa_metadata = Metadata(xml_filename)
+    espa_metadata.parse()
+
+    lines = [os.path.realpath(xml_filename),
+             '{0},{1},{2},{3}'.format(*window)]
+
+    for band in espa_metadata.xml_object.bands.band:
+        if band.get('product') in ST_PRODUCTS:
+            continue
+
+        filename = os.path.join(os.path.dirname(xml_filename),
+                                str(band.file_name))
+        status = os.stat(filename)
+        lines.append('{0} {1} {2!r}'.format(os.path.basename(filename),
+                                            status.st_size,
+                                            status.st_mtime))
+
+    return ''.join(['{0}\n'.format(line) for line in lines])
+
+
+def crop_band(source, destination, nlines, nsamps, data_size, window):
+    """Copy the window of a raw binary band
+
+    Args:
+        source <str>: The band file to crop
+        destination <str>: The cropped band file to create
+        nlines <int>: Lines in the band
+        nsamps <int>: Samples in the band
+        data_size <int>: Bytes in each pixel
+        window <Window>: The window
+    """
+
+    line_size = nsamps * data_size
+    window_size = window.samples * data_size
+
+    with open(source, 'rb') as source_fd, \
+            open(destination, 'wb') as destination_fd:
+        for line in xrange(window.line, window.line + window.lines):
+            source_fd.seek(line * line_size + window.sample * data_size)
+            data = source_fd.read(window_size)
+            if len(data) != window_size:
+                raise Exception('Band [{0}] is shorter than the {1} lines'
+                                ' by {2} samples in the XML'
+                                .format(source, nlines, nsamps))
+            destination_fd.write(data)
+
+
+def crop_envi_header(source, destination, window):
+    """Copy an ENVI header, updating it for the window
+
+    Args:
+        source <str>: The header of the band
+        destination <str>: The header of the cropped band
+        window <Window>: The window
+    """
+
+    with open(source, 'r') as source_fd:
+        text = source_fd.read()
+
+    text = re.sub(r'(?m)^samples\s*=.*$',
+                  'samples = {0}'.format(window.samples), text)
+    text = re.sub(r'(?m)^lines\s*=.*$',
+                  'lines = {0}'.format(window.lines), text)
+
+    # The reference pixel moves to the same pixel of the window
+    match = re.search(r'map info\s*=\s*\{([^}]*)\}', text)
+    if match is not None:
+        fields = [field.strip() for field in match.group(1).split(',')]
+        easting = float(fields[3]) + window.sample * float(fields[5])
+        northing = float(fields[4]) - window.line * float(fields[6])
+        fields[3] = repr(easting)
+        fields[4] = repr(northing)
+        text = ''.join([text[:match.start(1)], ', '.join(fields),
+                        text[match.end(1):]])
+
+    with open(destination, 'w') as destination_fd:
+        destination_fd.write(text)
+
+
+def update_projection_corners(espa_metadata, window, pixel_size):
+    """Move the projection corner points to the window
+
+    Args:
+        espa_metadata <espa.Metadata>: The window metadata
+        window <Window>: The window
+        pixel_size <tuple>: Pixel size in the x and y directions
+    """
+
+    projection = espa_metadata.xml_object.global_metadata \
+        .projection_information
+
+    for corner_point in projection.corner_point:
+        if corner_point.get('location') == 'UL':
+            ul_x = float(corner_point.get('x'))
+            ul_y = float(corner_point.get('y'))
+
+    # The corners keep the grid origin of the scene's corners
+    ul_x += window.sample * pixel_size[0]
+    ul_y -= window.line * pixel_size[1]
+    lr_x = ul_x + (window.samples - 1) * pixel_size[0]
+    lr_y = ul_y - (window.lines - 1) * pixel_size[1]
+
+    for corner_point in projection.corner_point:
+        if corner_point.get('location') == 'UL':
+            corner_point.set('x', repr(ul_x))
+            corner_point.set('y', repr(ul_y))
+        elif corner_point.get('location') == 'LR':
+            corner_point.set('x', repr(lr_x))
+            corner_point.set('y', repr(lr_y))
+
+
+def update_geographic_bounds(espa_metadata, band_filename):
+    """Set the geographic corners and bounding coordinates to the window
+
+    Args:
+        espa_metadata <espa.Metadata>: The window metadata
+        band_filename <str>: A cropped band, for its georeferencing
+    """
+
+    dataset = gdal.Open(band_filename)
+    transform = dataset.GetGeoTransform()
+    samps = dataset.RasterXSize
+    lines = dataset.RasterYSize
+    data_srs = osr.SpatialReference()
+    data_srs.ImportFromWkt(dataset.GetProjection())
+    del dataset
+
+    data_to_ll = osr.CoordinateTransformation(data_srs,
+                                              data_srs.CloneGeogCS())
+
+    def to_ll(sample, line):
+        (lon, lat, dummy) = data_to_ll.TransformPoint(
+            transform[0] + sample * transform[1] + line * transform[2],
+            transform[3] + sample * transform[4] + line * transform[5])
+        return (lon, lat)
+
+    # The edges are followed, since they curve in geographic coordinates
+    edge = [float(index) / EDGE_POINTS for index in range(EDGE_POINTS + 1)]
+    points = ([to_ll(fraction * samps, 0) for fraction in edge] +
+              [to_ll(fraction * samps, lines) for fraction in edge] +
+              [to_ll(0, fraction * lines) for fraction in edge] +
+              [to_ll(samps, fraction * lines) for fraction in edge])
+
+    global_metadata = espa_metadata.xml_object.global_metadata
+
+    # Create an element maker
+    maker = objectify.ElementMaker(annotate=False, namespace=None, nsmap=None)
+
+    bounds = global_metadata.bounding_coordinates
+    bounds.west = maker.element(repr(min([lon for (lon, lat) in points])))
+    bounds.east = maker.element(repr(max([lon for (lon, lat) in points])))
+    bounds.north = maker.element(repr(max([lat for (lon, lat) in points])))
+    bounds.south = maker.element(repr(min([lat for (lon, lat) in points])))
+
+    # The corners are the centers of the corner pixels
+    corners = {'UL': to_ll(0.5, 0.5),
+               'LR': to_ll(samps - 0.5, lines - 0.5)}
+    for corner in global_metadata.corner:
+        location = corner.get('location')
+        if location in corners:
+            corner.set('longitude', repr(corners[location][0]))
+            corner.set('latitude', repr(corners[location][1]))
+
+
+def create_window_scene(xml_filename, window):
+    """Create the window scene, unless it already exists for the same scene
+       and window
+
+    Args:
+        xml_filename <str>: XML metadata filename of the scene
+        window <Window>: The window
+
+    Returns:
+        <str>: The directory holding the window scene
+    """
+
+    logger = logging.getLogger(__name__)
+
+    directory = os.path.join(os.path.dirname(xml_filename),
+                             window_directory(window))
+    window_xml = os.path.join(directory, os.path.basename(xml_filename))
+
+    source = window_source(xml_filename, window)
+    source_filename = os.path.join(directory, WINDOW_SOURCE_NAME)
+
+    # A window scene which was created before holds the products of any
+    # earlier run for the window, which later runs can reuse
+    if os.path.isfile(window_xml):
+        recorded = None
+        if os.path.isfile(source_filename):
+            with open(source_filename, 'r') as source_fd:
+                recorded = source_fd.read()
+
+        if recorded == source:
+            logger.info('Using the window scene in [{0}]'.format(directory))
+            return directory
+
+        logger.info('The window scene in [{0}] is of another scene or'
+                    ' window'.format(directory))
+        shutil.rmtree(directory)
+
+    logger.info('Creating the window scene in [{0}]'.format(directory))
+
+    if not os.path.isdir(directory):
+        os.makedirs(directory)
+
+    # The XML is completed under another name, so an interrupted creation
+    # is started over
+    partial_xml = ''.join([window_xml, '.partial'])
+    shutil.copyfile(xml_filename, partial_xml)
+
+    espa_metadata = Metadata(partial_xml)
+    espa_metadata.parse()
+
+    # Create an element maker
+    maker = objectify.ElementMaker(annotate=False, namespace=None, nsmap=None)
+
+    bands = espa_metadata.xml_object.bands
+
+    def is_reference(band):
+        return (band.get('product') == 'toa_bt' and
+                band.get('category') == 'image')
+
+    def band_pixel_size(band):
+        return (float(band.pixel_size.get('x')),
+                float(band.pixel_size.get('y')))
+
+    # The window is in the pixels of the thermal band
+    references = [band for band in bands.band if is_reference(band)]
+    if not references:
+        raise Exception('Missing TOA Brightness Temperature Band')
+    pixel_size = band_pixel_size(references[0])
+
+    reference_filename = None
+    for band in list(bands.band):
+        # Products from an earlier ST run of the scene are not inputs
+        if band.get('product') in ST_PRODUCTS:
+            bands.remove(band)
+            continue
+
+        cropped = band_window(window, pixel_size, band_pixel_size(band))
+        if cropped is None:
+            logger.warning('Leaving out band [{0}], the window does not'
+                           ' fall on whole pixels of it'
+                           .format(band.get('name')))
+            bands.remove(band)
+            continue
+
+        nlines = int(band.get('nlines'))
+        nsamps = int(band.get('nsamps'))
+        if (cropped.line + cropped.lines > nlines or
+                cropped.sample + cropped.samples > nsamps):
+            raise Exception('The window does not fit within band [{0}] of'
+                            ' {1} lines by {2} samples'
+                            .format(band.get('name'), nlines, nsamps))
+
+        source = os.path.join(os.path.dirname(xml_filename),
+                              str(band.file_name))
+        filename = os.path.basename(source)
+        destination = os.path.join(directory, filename)
+
+        logger.debug('Cropping [{0}]'.format(filename))
+        crop_band(source=source,
+                  destination=destination,
+                  nlines=nlines,
+                  nsamps=nsamps,
+                  data_size=DATA_TYPE_SIZES[band.get('data_type')],
+                  window=cropped)
+
+        header = ''.join([os.path.splitext(source)[0], '.hdr'])
+        if os.path.isfile(header):
+            crop_envi_header(source=header,
+                             destination=os.path.join(
+                                 directory, os.path.basename(header)),
+                             window=cropped)
+
+        band.set('nlines', str(cropped.lines))
+        band.set('nsamps', str(cropped.samples))
+        band.file_name = maker.element(filename)
+
+        if band is references[0]:
+            reference_filename = destination
+
+    update_projection_corners(espa_metadata, window, pixel_size)
+    update_geographic_bounds(espa_metadata, reference_filename)
+
+    espa_metadata.validate()
+    espa_metadata.write()
+
+    with open(source_filename, 'w') as source_fd:
+        source_fd.write(source)
+
+    os.rename(partial_xml, window_xml)
+
+    return directory
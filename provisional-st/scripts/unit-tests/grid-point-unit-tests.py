@@ -0,0 +1,168 @@
+'''
+    FILE: grid-point-unit-tests.py
+
+    PURPOSE: Provides unit testing of the clear sky selection of the grid
+             points MODTRAN is run for.  It does not need the validation
+             data.
+
+    PROJECT: Land Satellites Data Systems Science Research and Development
+             (LSRD) at the USGS EROS
+
+    LICENSE: NASA Open Source Agreement 1.3
+'''
+
+
+import sys
+import unittest
+from collections import namedtuple
+
+import numpy as np
+
+# Add the parent directory where the modules to test are located
+sys.path.insert(0, '..')
+import st_utilities as util
+import st_determine_grid_points as grid
+from st_grid_points import PointInfo
+from st_generate_distance_to_cloud import PQA_CLOUD
+
+
+# The scene is 128 by 128 pixels of 0.0025 degrees, with the upper left
+# corner at (0, 0.32), and the grid points are 0.1 degrees apart around it
+SCENE_PIXELS = 128
+PIXEL_SIZE = 0.0025
+GRID_SIZE = 7
+GRID_SPACING = 0.1
+GRID_ORIGIN = -0.15
+FILL_VALUE = -9999
+QA_FILENAME = 'pixel_qa.img'
+
+FakeGdalInfo = namedtuple('FakeGdalInfo',
+                          ('data_ds', 'data_to_ll', 'data_transform',
+                           'nsamps', 'nlines', 'fill_value'))
+
+
+class FakeBand(object):
+    '''Stands in for a GDAL raster band.'''
+
+    def __init__(self, data):
+        self.data = data
+
+    def ReadAsArray(self, x_offset, y_offset, x_size, y_size):
+        return self.data[y_offset:y_offset + y_size,
+                         x_offset:x_offset + x_size].copy()
+
+
+class FakeDataset(object):
+    '''Stands in for a GDAL dataset of one band.'''
+
+    def __init__(self, data):
+        self.band = FakeBand(data)
+
+    def GetRasterBand(self, band_number):
+        return self.band
+
+
+class FakeTransformation(object):
+    '''Stands in for a transformation to longitude and latitude, with the
+       scene mapped in degrees.'''
+
+    def TransformPoint(self, map_x, map_y):
+        return (map_x, map_y, 0.0)
+
+
+class ClearSky_TestCase(unittest.TestCase):
+    '''Tests for selecting the grid points of the clear pixels.'''
+
+    def setUp(self):
+        data = np.ones((SCENE_PIXELS, SCENE_PIXELS), dtype=np.int16)
+        self.gdal_objs = FakeGdalInfo(
+            data_ds=FakeDataset(data),
+            data_to_ll=FakeTransformation(),
+            data_transform=(0.0, PIXEL_SIZE, 0.0,
+                            SCENE_PIXELS * PIXEL_SIZE, 0.0, -PIXEL_SIZE),
+            nsamps=SCENE_PIXELS,
+            nlines=SCENE_PIXELS,
+            fill_value=FILL_VALUE)
+
+        self.qa_data = np.zeros((SCENE_PIXELS, SCENE_PIXELS),
+                                dtype=np.uint16)
+
+        self.original_points = grid.determine_gridded_narr_points
+        grid.determine_gridded_narr_points = self.determine_points
+
+        util.RasterCache.enable()
+
+    def tearDown(self):
+        util.RasterCache.disable()
+
+        grid.determine_gridded_narr_points = self.original_points
+
+    def determine_points(self, debug, gdal_objs, data_bounds, data_path,
+                         geometry):
+        '''Stands in for reading the NARR grid, with rows going north.'''
+
+        grid_points = list()
+        for row in xrange(GRID_SIZE):
+            for col in xrange(GRID_SIZE):
+                map_x = GRID_ORIGIN + col * GRID_SPACING
+                map_y = GRID_ORIGIN + row * GRID_SPACING
+                point = PointInfo(col=col, row=row, lat=map_y, lon=map_x,
+                                  map_y=map_y, map_x=map_x)
+                grid_points.append({'index': len(grid_points),
+                                    'row': row,
+                                    'col': col,
+                                    'narr_row': row,
+                                    'narr_col': col,
+                                    'run_modtran': grid.is_in_data(
+                                        gdal_objs=gdal_objs, point=point),
+                                    'point': point})
+
+        return (grid_points, GRID_SIZE, GRID_SIZE)
+
+    def run_points(self, qa_filename=QA_FILENAME):
+        '''The indexes of the points selected for MODTRAN.'''
+
+        util.RasterCache.store(QA_FILENAME, 1, self.qa_data)
+
+        (grid_points, grid_rows, grid_cols, valid_pixels) = (
+            grid.select_modtran_points(debug=False,
+                                       gdal_objs=self.gdal_objs,
+                                       data_bounds=None,
+                                       data_path=None,
+                                       qa_filename=qa_filename))
+
+        self.assertEqual(valid_pixels, SCENE_PIXELS * SCENE_PIXELS)
+
+        return [point['index'] for point in grid_points
+                if point['run_modtran']]
+
+    def test_clear(self):
+        '''A clear scene runs the same points as without the QA band.'''
+
+        clear_points = self.run_points()
+
+        self.assertNotEqual(clear_points, [])
+        self.assertEqual(clear_points, self.run_points(qa_filename=None))
+
+    def test_partly_clouded(self):
+        '''Points far from the clear pixels are not run.'''
+
+        all_points = self.run_points()
+
+        # Only the southern edge of the scene is clear
+        self.qa_data[:SCENE_PIXELS - 2, :] = 1 << PQA_CLOUD
+        clear_points = self.run_points()
+
+        self.assertNotEqual(clear_points, [])
+        self.assertTrue(set(clear_points) < set(all_points))
+
+    def test_fully_clouded(self):
+        '''A fully clouded scene runs no points, rather than failing.'''
+
+        self.qa_data[:, :] = 1 << PQA_CLOUD
+
+        self.assertEqual(self.run_points(), [])
+
+
+if __name__ == '__main__':
+    unittest.main()
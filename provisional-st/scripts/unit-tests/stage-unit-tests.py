@@ -0,0 +1,587 @@
+'''
+    FILE: stage-unit-tests.py
+
+    PURPOSE: Provides unit testing of the stage manifests, the stage graph
+             planning, the node scheduler leases, and the MODTRAN work
+             queue.  None of them need the validation data.
+
+    PROJECT: Land Satellites Data Systems Science Research and Development
+             (LSRD) at the USGS EROS
+
+    LICENSE: NASA Open Source Agreement 1.3
+'''
+
+
+import os
+import sys
+import time
+import shutil
+import tempfile
+import threading
+import unittest
+
+# Add the parent directory where the modules to test are located
+sys.path.insert(0, '..')
+from st_manifest import ManifestStore, fingerprint_files
+from st_stage_graph import StageGraph
+from st_node_scheduler import NodeScheduler, SlotLease, SOCKET_ENV
+import st_run_modtran
+
+
+def write_file(filename, contents):
+    '''Write a small file.'''
+
+    with open(filename, 'w') as output_fd:
+        output_fd.write(contents)
+
+
+class DirectoryTestCase(unittest.TestCase):
+    '''Runs each test in a directory of its own.'''
+
+    def setUp(self):
+        self.original_directory = os.getcwd()
+        self.directory = tempfile.mkdtemp()
+        os.chdir(self.directory)
+
+    def tearDown(self):
+        os.chdir(self.original_directory)
+        shutil.rmtree(self.directory)
+
+
+class ManifestStore_TestCase(DirectoryTestCase):
+    '''Tests for recording and checking stage manifests.'''
+
+    def setUp(self):
+        super(ManifestStore_TestCase, self).setUp()
+
+        write_file('input.txt', 'input')
+        write_file('output.txt', 'output')
+
+        self.manifests = ManifestStore()
+        self.graph = StageGraph(core_budget=1)
+        self.graph.add_stage('stage', None, inputs=['input.txt'],
+                             outputs=['output.txt'],
+                             settings={'setting': 1})
+        self.stage = self.graph.stages[0]
+
+        self.manifests.save(self.stage, fingerprint_files(['input.txt']))
+
+    def test_fingerprint_files(self):
+        '''Files are fingerprinted by size and modification time.'''
+
+        fingerprints = fingerprint_files(['*.txt', 'missing.txt'])
+        self.assertEqual(sorted(fingerprints), ['input.txt', 'output.txt'])
+
+        write_file('input.txt', 'changed input')
+        self.assertNotEqual(fingerprints['input.txt'],
+                            fingerprint_files(['input.txt'])['input.txt'])
+
+    def test_current(self):
+        '''An unchanged stage is current.'''
+
+        self.assertTrue(self.manifests.is_current(self.stage))
+
+    def test_no_manifest(self):
+        '''A stage without a manifest is not current.'''
+
+        self.manifests.remove(['stage'])
+        self.assertFalse(self.manifests.is_current(self.stage))
+
+    def test_unreadable_manifest(self):
+        '''A stage with an unreadable manifest is not current.'''
+
+        write_file(self.manifests.path('stage'), '{')
+        self.assertFalse(self.manifests.is_current(self.stage))
+
+    def test_changed_input(self):
+        '''A stage whose input changed is not current.'''
+
+        write_file('input.txt', 'changed input')
+        self.assertFalse(self.manifests.is_current(self.stage))
+
+    def test_touched_input(self):
+        '''A stage whose input was rewritten unchanged is not current.'''
+
+        status = os.stat('input.txt')
+        os.utime('input.txt', (status.st_atime, status.st_mtime + 10))
+        self.assertFalse(self.manifests.is_current(self.stage))
+
+    def test_new_input(self):
+        '''A stage with another file matching its inputs is not current.'''
+
+        self.stage.inputs = ['input*.txt']
+        self.manifests.save(self.stage, fingerprint_files(self.stage.inputs))
+
+        write_file('input2.txt', 'input')
+        self.assertFalse(self.manifests.is_current(self.stage))
+
+    def test_changed_setting(self):
+        '''A stage whose settings changed is not current.'''
+
+        self.stage.settings = {'setting': 2}
+        self.assertFalse(self.manifests.is_current(self.stage))
+
+    def test_missing_output(self):
+        '''A stage whose output is missing is not current.'''
+
+        os.unlink('output.txt')
+        self.assertFalse(self.manifests.is_current(self.stage))
+
+    def test_changed_output(self):
+        '''A stage whose output changed is not current.'''
+
+        write_file('output.txt', 'changed output')
+        self.assertFalse(self.manifests.is_current(self.stage))
+
+
+class StageGraphPlan_TestCase(DirectoryTestCase):
+    '''Tests for reusing the results of previous runs.
+
+    The stages are
+
+        first -> second -> third
+        beside
+
+    where each of first, second, and third reads what the one before it
+    wrote, and beside reads the same input as first but is otherwise
+    independent of them.
+    '''
+
+    def setUp(self):
+        super(StageGraphPlan_TestCase, self).setUp()
+
+        write_file('input.txt', 'input')
+
+        self.settings = dict([(name, {'setting': 1})
+                              for name in ['first', 'second', 'third',
+                                           'beside']])
+        self.run_graph()
+
+    def copy_function(self, source, destination):
+        '''A stage function which copies one file to another.'''
+
+        def copy():
+            shutil.copyfile(source, destination)
+            self.ran.append(destination)
+
+        return copy
+
+    def build_graph(self):
+        '''The stage graph, with the current settings.'''
+
+        graph = StageGraph(core_budget=2, manifests=ManifestStore())
+
+        graph.add_stage('first',
+                        self.copy_function('input.txt', 'first.txt'),
+                        inputs=['input.txt'], outputs=['first.txt'],
+                        settings=self.settings['first'])
+        graph.add_stage('second',
+                        self.copy_function('first.txt', 'second.txt'),
+                        depends_on=('first',),
+                        inputs=['first.txt'], outputs=['second.txt'],
+                        settings=self.settings['second'])
+        graph.add_stage('third',
+                        self.copy_function('second.txt', 'third.txt'),
+                        depends_on=('second',),
+                        inputs=['second.txt'], outputs=['third.txt'],
+                        settings=self.settings['third'])
+        graph.add_stage('beside',
+                        self.copy_function('input.txt', 'beside.txt'),
+                        inputs=['input.txt'], outputs=['beside.txt'],
+                        settings=self.settings['beside'])
+
+        return graph
+
+    def planned(self):
+        '''Names of the stages planned to run.'''
+
+        return sorted([stage.name for stage in self.build_graph().plan()])
+
+    def run_graph(self):
+        '''Runs the stages which are planned.'''
+
+        self.ran = list()
+        self.build_graph().run()
+
+    def test_unchanged(self):
+        '''Nothing is run again when nothing changed.'''
+
+        self.assertEqual(self.planned(), [])
+
+        self.run_graph()
+        self.assertEqual(self.ran, [])
+
+    def test_changed_input(self):
+        '''A changed input runs the stage and all downstream of it.'''
+
+        write_file('input.txt', 'changed input')
+        self.assertEqual(self.planned(), ['beside', 'first', 'second',
+                                          'third'])
+
+    def test_changed_setting(self):
+        '''A changed setting runs the stage and all downstream of it.'''
+
+        self.settings['second'] = {'setting': 2}
+        self.assertEqual(self.planned(), ['second', 'third'])
+
+    def test_missing_output(self):
+        '''A missing output runs the stage and all downstream of it.'''
+
+        os.unlink('second.txt')
+        self.assertEqual(self.planned(), ['second', 'third'])
+
+    def test_missing_manifest(self):
+        '''A missing manifest runs the stage and all downstream of it.'''
+
+        ManifestStore().remove(['first'])
+        self.assertEqual(self.planned(), ['first', 'second', 'third'])
+
+    def test_downstream_unchanged_results(self):
+        '''A stage run again runs those downstream of it, even when it
+           writes the same results.'''
+
+        self.settings['first'] = {'setting': 2}
+        self.run_graph()
+
+        self.assertEqual(sorted(self.ran),
+                         ['first.txt', 'second.txt', 'third.txt'])
+        self.assertEqual(self.planned(), [])
+
+    def test_failed_stage(self):
+        '''A stage which failed is run again, along with those downstream
+           of it.'''
+
+        self.settings['second'] = {'setting': 2}
+        graph = self.build_graph()
+
+        def fail():
+            raise Exception('Stage failed')
+        graph.stages[1].function = fail
+
+        self.assertRaises(Exception, graph.run)
+        self.assertFalse(os.path.exists(ManifestStore().path('second')))
+        self.assertEqual(self.planned(), ['second', 'third'])
+
+    def test_beside_cores(self):
+        '''Only stages planned to run and not dependent either way run
+           beside a stage.'''
+
+        graph = self.build_graph()
+        graph.plan()
+        self.assertEqual(graph.beside_cores('second'), 0)
+
+        os.unlink('beside.txt')
+        graph.plan()
+        self.assertEqual(graph.beside_cores('second'), 1)
+        self.assertEqual(graph.beside_cores('beside'), 0)
+
+
+class NodeScheduler_TestCase(unittest.TestCase):
+    '''Tests for the node scheduler priorities and leases.'''
+
+    def setUp(self):
+        self.scheduler = NodeScheduler(slots=4)
+        self.granted = list()
+
+    def wait_for_waiters(self, count):
+        '''Waits until the number of leases are waiting.'''
+
+        for dummy in xrange(500):
+            with self.scheduler.condition:
+                if len(self.scheduler.waiting) == count:
+                    return
+            time.sleep(0.01)
+
+        self.fail('Expected {0} waiting leases'.format(count))
+
+    def start_acquire(self, job, slots, minimum):
+        '''Acquires a lease on a thread of its own.'''
+
+        def acquire():
+            granted = self.scheduler.acquire(job, slots, minimum)
+            with self.scheduler.condition:
+                self.granted.append((job, granted))
+
+        thread = threading.Thread(target=acquire)
+        thread.daemon = True
+        thread.start()
+
+        return thread
+
+    def test_lease_limits(self):
+        '''A lease is limited to the slots free, and then to the minimum.'''
+
+        self.assertEqual(self.scheduler.acquire('job', 10, 1), 4)
+        self.scheduler.release(4)
+
+        self.assertEqual(self.scheduler.acquire('job', 3, 1), 3)
+        self.assertEqual(self.scheduler.acquire('job', 3, 1), 1)
+        self.assertEqual(self.scheduler.free_slots, 0)
+
+        self.scheduler.release(4)
+        self.assertEqual(self.scheduler.free_slots, 4)
+
+    def test_waits_for_minimum(self):
+        '''A lease waits until its minimum is free.'''
+
+        self.scheduler.acquire('job', 3, 3)
+
+        thread = self.start_acquire('job', 2, 2)
+        self.wait_for_waiters(1)
+        self.assertEqual(self.granted, [])
+
+        self.scheduler.release(1)
+        thread.join(5)
+        self.assertEqual(self.granted, [('job', 2)])
+
+    def test_priority_to_progress(self):
+        '''Leases go first to the job with the most stages completed.'''
+
+        self.scheduler.register('early')
+        self.scheduler.register('late')
+        self.scheduler.progress('late', 3, 4)
+        self.scheduler.progress('early', 1, 4)
+
+        self.scheduler.acquire('holder', 4, 4)
+
+        threads = [self.start_acquire('early', 4, 4)]
+        self.wait_for_waiters(1)
+        threads.append(self.start_acquire('late', 4, 4))
+        self.wait_for_waiters(2)
+
+        self.scheduler.release(4)
+        self.wait_for_waiters(1)
+        self.scheduler.release(4)
+        for thread in threads:
+            thread.join(5)
+
+        self.assertEqual(self.granted, [('late', 4), ('early', 4)])
+
+    def test_priority_to_registration(self):
+        '''Among jobs equally complete, the first registered leads, and
+           jobs which did not register come last.'''
+
+        self.scheduler.register('first')
+        self.scheduler.register('second')
+
+        self.scheduler.acquire('holder', 4, 4)
+
+        threads = list()
+        for job in ['unknown', 'second', 'first']:
+            threads.append(self.start_acquire(job, 4, 4))
+            self.wait_for_waiters(len(threads))
+
+        # Each lease is released as soon as it is granted
+        for count in [2, 1, 0]:
+            self.scheduler.release(4)
+            self.wait_for_waiters(count)
+        for thread in threads:
+            thread.join(5)
+
+        self.assertEqual(self.granted, [('first', 4), ('second', 4),
+                                        ('unknown', 4)])
+
+    def test_unregister(self):
+        '''An unregistered job loses its priority.'''
+
+        self.scheduler.register('job')
+        self.scheduler.progress('job', 1, 1)
+        self.scheduler.unregister('job')
+
+        self.assertEqual(self.scheduler.jobs, dict())
+
+    def test_lease_released_on_close(self):
+        '''A lease through the socket is released when it closes.'''
+
+        directory = tempfile.mkdtemp()
+        path = os.path.join(directory, 'scheduler.socket')
+        original_socket = os.environ.get(SOCKET_ENV)
+
+        thread = threading.Thread(target=self.scheduler.serve, args=(path,))
+        thread.daemon = True
+        thread.start()
+
+        try:
+            for dummy in xrange(500):
+                if os.path.exists(path):
+                    break
+                time.sleep(0.01)
+
+            os.environ[SOCKET_ENV] = path
+            with SlotLease(3) as granted:
+                self.assertEqual(granted, 3)
+                self.assertEqual(self.scheduler.free_slots, 1)
+
+            for dummy in xrange(500):
+                if self.scheduler.free_slots == 4:
+                    break
+                time.sleep(0.01)
+            self.assertEqual(self.scheduler.free_slots, 4)
+        finally:
+            if original_socket is None:
+                del os.environ[SOCKET_ENV]
+            else:
+                os.environ[SOCKET_ENV] = original_socket
+            shutil.rmtree(directory)
+
+    def test_no_scheduler(self):
+        '''Without a scheduler a lease is granted in full.'''
+
+        original_socket = os.environ.pop(SOCKET_ENV, None)
+        try:
+            with SlotLease(7, minimum=2) as granted:
+                self.assertEqual(granted, 7)
+        finally:
+            if original_socket is not None:
+                os.environ[SOCKET_ENV] = original_socket
+
+
+class WorkQueue_TestCase(DirectoryTestCase):
+    '''Tests for claiming and retrying MODTRAN work queue runs.'''
+
+    def setUp(self):
+        super(WorkQueue_TestCase, self).setUp()
+
+        self.queue_directory = os.path.join(self.directory, 'queue')
+        self.run_directory = os.path.join(self.directory, 'run')
+        os.mkdir(self.queue_directory)
+        os.mkdir(self.run_directory)
+
+        self.entry = st_run_modtran.queue_entry_name(self.queue_directory,
+                                                     self.run_directory)
+        write_file(self.entry, '{0}\n'.format(self.run_directory))
+
+        self.lock = os.path.join(self.run_directory, st_run_modtran.RUN_LOCK)
+        self.failed = os.path.join(self.run_directory,
+                                   st_run_modtran.RUN_FAILED)
+
+        self.runs = list()
+        self.failures = 0
+        self.original_process_run_dir = st_run_modtran.process_run_dir
+        st_run_modtran.process_run_dir = self.process_run_dir
+
+    def tearDown(self):
+        st_run_modtran.process_run_dir = self.original_process_run_dir
+
+        super(WorkQueue_TestCase, self).tearDown()
+
+    def process_run_dir(self, run_parms):
+        '''Stands in for MODTRAN, failing as many times as asked.'''
+
+        self.runs.append(run_parms[0])
+        # The run holds the lock while it is made
+        self.assertTrue(os.path.exists(self.lock))
+
+        if len(self.runs) <= self.failures:
+            raise Exception('MODTRAN failed')
+
+        return True
+
+    def make_stale(self):
+        '''Leaves a lock from a worker which went away.'''
+
+        write_file(self.lock, 'elsewhere:1\n')
+        stale_time = time.time() - st_run_modtran.LOCK_STALE_SECONDS - 60
+        os.utime(self.lock, (stale_time, stale_time))
+
+    def test_claim(self):
+        '''A run is claimed by one worker at a time.'''
+
+        self.assertTrue(st_run_modtran.claim_run(self.run_directory))
+        self.assertFalse(st_run_modtran.claim_run(self.run_directory))
+
+    def test_fresh_lock(self):
+        '''A lock which is being refreshed is kept.'''
+
+        write_file(self.lock, 'elsewhere:1\n')
+        st_run_modtran.break_stale_lock(self.lock)
+
+        self.assertTrue(os.path.exists(self.lock))
+        self.assertFalse(st_run_modtran.process_queue_entry(self.entry,
+                                                            'data'))
+        self.assertEqual(self.runs, [])
+
+    def test_stale_lock(self):
+        '''A lock which is no longer refreshed is broken.'''
+
+        self.make_stale()
+        st_run_modtran.break_stale_lock(self.lock)
+
+        self.assertFalse(os.path.exists(self.lock))
+        self.assertTrue(st_run_modtran.claim_run(self.run_directory))
+
+    def test_completed_entry(self):
+        '''An entry completed by another worker is passed over.'''
+
+        os.unlink(self.entry)
+        self.assertFalse(st_run_modtran.process_queue_entry(self.entry,
+                                                            'data'))
+
+    def test_run(self):
+        '''A successful run removes the entry and the lock.'''
+
+        self.assertTrue(st_run_modtran.process_queue_entry(self.entry,
+                                                           'data'))
+
+        self.assertEqual(self.runs, [self.run_directory])
+        self.assertFalse(os.path.exists(self.entry))
+        self.assertFalse(os.path.exists(self.lock))
+        self.assertFalse(os.path.exists(self.failed))
+
+    def test_retry(self):
+        '''A failed run is left on the queue and made again.'''
+
+        self.failures = st_run_modtran.MAX_RUN_ATTEMPTS - 1
+
+        for attempt in xrange(st_run_modtran.MAX_RUN_ATTEMPTS):
+            self.assertTrue(os.path.exists(self.entry))
+            self.assertTrue(st_run_modtran.process_queue_entry(self.entry,
+                                                               'data'))
+            self.assertFalse(os.path.exists(self.lock))
+            self.assertFalse(os.path.exists(self.failed))
+
+        self.assertEqual(len(self.runs), st_run_modtran.MAX_RUN_ATTEMPTS)
+        self.assertFalse(os.path.exists(self.entry))
+
+    def test_failed(self):
+        '''A run is only failed once its attempts are used up.'''
+
+        self.failures = st_run_modtran.MAX_RUN_ATTEMPTS
+
+        for attempt in xrange(st_run_modtran.MAX_RUN_ATTEMPTS):
+            self.assertFalse(os.path.exists(self.failed))
+            st_run_modtran.process_queue_entry(self.entry, 'data')
+
+        self.assertTrue(os.path.exists(self.failed))
+        self.assertFalse(os.path.exists(self.entry))
+        self.assertFalse(os.path.exists(self.lock))
+
+    def test_killed_worker(self):
+        '''A run whose worker went away holding its lock is made again.'''
+
+        st_run_modtran.record_attempt(self.run_directory)
+        self.make_stale()
+
+        self.assertTrue(st_run_modtran.process_queue_entry(self.entry,
+                                                           'data'))
+        self.assertEqual(self.runs, [self.run_directory])
+        self.assertFalse(os.path.exists(self.failed))
+        self.assertFalse(os.path.exists(self.entry))
+
+    def test_killed_workers(self):
+        '''A run whose workers all went away holding its lock is failed.'''
+
+        for attempt in xrange(st_run_modtran.MAX_RUN_ATTEMPTS):
+            st_run_modtran.record_attempt(self.run_directory)
+        self.make_stale()
+
+        self.assertTrue(st_run_modtran.process_queue_entry(self.entry,
+                                                           'data'))
+        self.assertEqual(self.runs, [])
+        self.assertTrue(os.path.exists(self.failed))
+        self.assertFalse(os.path.exists(self.entry))
+        self.assertFalse(os.path.exists(self.lock))
+
+
+if __name__ == '__main__':
+    unittest.main()
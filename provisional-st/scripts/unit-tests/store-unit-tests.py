@@ -0,0 +1,250 @@
+'''
+    FILE: store-unit-tests.py
+
+    PURPOSE: Provides unit testing of the binary stores the processing
+             stages hand their results to each other in.  The stores are
+             written and read with st_store.py, and with st_store.c through
+             st_store_copy, which is built from the C sources when a
+             compiler is found.  It does not need the validation data.
+
+    PROJECT: Land Satellites Data Systems Science Research and Development
+             (LSRD) at the USGS EROS
+
+    LICENSE: NASA Open Source Agreement 1.3
+'''
+
+
+import os
+import sys
+import shutil
+import tempfile
+import unittest
+import subprocess
+
+import numpy as np
+
+# Add the parent directory where the modules to test are located
+sys.path.insert(0, '..')
+import st_store as store
+
+
+SOURCE_DIRECTORY = os.path.join('..', '..', 'src')
+STORE_COPY_SOURCES = ('st_store_copy.c', 'st_store.c', 'utilities.c')
+
+# The name of the store, and of its copy
+STORE_NAME = 'test.store'
+COPY_NAME = 'copy.store'
+
+
+def build_store_copy(directory):
+    '''Build st_store_copy in the directory, returning where it is, or None
+       when it can not be built'''
+
+    executable = os.path.join(directory, 'st_store_copy')
+    command = (['gcc', '-Wall', '-I', SOURCE_DIRECTORY, '-o', executable] +
+               [os.path.join(SOURCE_DIRECTORY, source)
+                for source in STORE_COPY_SOURCES] +
+               ['-lm'])
+
+    try:
+        with open(os.devnull, 'w') as devnull:
+            status = subprocess.call(command, stdout=devnull,
+                                     stderr=devnull)
+    except OSError:
+        return None
+
+    if status != 0:
+        return None
+
+    return executable
+
+
+class StoreTestCase(unittest.TestCase):
+    '''Writes the stores of the tests in a directory of their own.'''
+
+    @classmethod
+    def setUpClass(cls):
+        cls.build_directory = tempfile.mkdtemp()
+        cls.store_copy = build_store_copy(cls.build_directory)
+
+    @classmethod
+    def tearDownClass(cls):
+        shutil.rmtree(cls.build_directory)
+
+    def setUp(self):
+        self.directory = tempfile.mkdtemp()
+        self.filename = os.path.join(self.directory, STORE_NAME)
+        self.copy_filename = os.path.join(self.directory, COPY_NAME)
+
+        # A section of each type, one empty, and one which is not a
+        # multiple of the alignment
+        self.sections = [
+            (store.SECTION_GRID, np.array([6, 2, 3], dtype=np.int32)),
+            (store.SECTION_RUN_MODTRAN,
+             np.array([1, 0, 1, 1, 0, 1], dtype=np.int32)),
+            (store.SECTION_LON,
+             np.linspace(-98.5, -97.25, 6).astype(np.float32)),
+            (store.SECTION_LAT, np.linspace(41.0, 42.5, 6)),
+            (store.SECTION_GROUND_DIRECTORY, np.array([], dtype=np.int32))]
+
+    def tearDown(self):
+        shutil.rmtree(self.directory)
+
+    def assertSections(self, sections):
+        '''The sections read are those written, in order.'''
+
+        self.assertEqual(list(sections.keys()),
+                         [name for (name, values) in self.sections])
+
+        for (name, values) in self.sections:
+            self.assertEqual(sections[name].dtype,
+                             store.STORE_TYPES[store.store_type(values)])
+            self.assertTrue(np.array_equal(sections[name], values))
+
+    def copy_store(self, filename):
+        '''Copy a store with st_store_copy, returning its exit status.'''
+
+        if self.store_copy is None:
+            self.skipTest('st_store_copy could not be built')
+
+        with open(os.devnull, 'w') as devnull:
+            return subprocess.call([self.store_copy, filename,
+                                    self.copy_filename],
+                                   stdout=devnull, stderr=devnull)
+
+    def corrupt(self, offset, data=None):
+        '''Overwrite a byte of the store, flipping it by default.'''
+
+        with open(self.filename, 'r+b') as store_fd:
+            store_fd.seek(offset)
+            if data is None:
+                data = chr(ord(store_fd.read(1)) ^ 0xff)
+                store_fd.seek(offset)
+            store_fd.write(data)
+
+    def assertRejected(self, reason):
+        '''Both readers reject the store.'''
+
+        with self.assertRaises(Exception) as context:
+            store.read_store(self.filename)
+        self.assertIn(reason, str(context.exception))
+
+        self.assertNotEqual(self.copy_store(self.filename), 0)
+        self.assertFalse(os.path.exists(self.copy_filename))
+
+
+class RoundTrip_TestCase(StoreTestCase):
+    '''Tests for reading the stores written.'''
+
+    def test_python(self):
+        '''A store written by Python reads back the same.'''
+
+        store.write_store(self.filename, self.sections)
+
+        self.assertSections(store.read_store(self.filename))
+
+    def test_read_only(self):
+        '''The sections read are not writeable.'''
+
+        store.write_store(self.filename, self.sections)
+        sections = store.read_store(self.filename)
+
+        with self.assertRaises(ValueError):
+            sections[store.SECTION_LAT][0] = 0.0
+
+    def test_python_to_c(self):
+        '''C reads a store written by Python, and writes the same bytes.'''
+
+        store.write_store(self.filename, self.sections)
+
+        self.assertEqual(self.copy_store(self.filename), 0)
+
+        with open(self.filename, 'rb') as store_fd:
+            written = store_fd.read()
+        with open(self.copy_filename, 'rb') as store_fd:
+            self.assertEqual(store_fd.read(), written)
+
+    def test_c_to_python(self):
+        '''Python reads a store written by C.'''
+
+        store.write_store(self.filename, self.sections)
+
+        self.assertEqual(self.copy_store(self.filename), 0)
+
+        self.assertSections(store.read_store(self.copy_filename))
+
+    def test_store_section(self):
+        '''Sections are checked for their count.'''
+
+        store.write_store(self.filename, self.sections)
+        sections = store.read_store(self.filename)
+
+        self.assertEqual(
+            list(store.store_section(sections, store.SECTION_GRID, 3)),
+            [6, 2, 3])
+
+        with self.assertRaises(Exception):
+            store.store_section(sections, store.SECTION_GRID, 2)
+        with self.assertRaises(Exception):
+            store.store_section(sections, store.SECTION_ELEVATION)
+
+
+class Corruption_TestCase(StoreTestCase):
+    '''Tests for rejecting the stores which are not as written.'''
+
+    def setUp(self):
+        super(Corruption_TestCase, self).setUp()
+
+        store.write_store(self.filename, self.sections)
+
+    def section_offset(self, name):
+        '''Where the values of a section start.'''
+
+        for (position, (section_name, values)) in enumerate(self.sections):
+            if section_name == name:
+                entry = (store.STORE_HEADER.size +
+                         store.STORE_SECTION.size * position)
+                with open(self.filename, 'rb') as store_fd:
+                    store_fd.seek(entry)
+                    return store.STORE_SECTION.unpack(
+                        store_fd.read(store.STORE_SECTION.size))[3]
+
+    def test_section(self):
+        '''A changed value is rejected.'''
+
+        self.corrupt(self.section_offset(store.SECTION_LAT) + 3)
+
+        self.assertRejected('is corrupt')
+
+    def test_section_table(self):
+        '''A changed section table is rejected.'''
+
+        self.corrupt(store.STORE_HEADER.size + store.STORE_SECTION.size + 1)
+
+        self.assertRejected('corrupt section table')
+
+    def test_truncated(self):
+        '''A store cut short is rejected.'''
+
+        with open(self.filename, 'r+b') as store_fd:
+            store_fd.truncate(os.path.getsize(self.filename) - 8)
+
+        self.assertRejected('bytes, not')
+
+    def test_magic(self):
+        '''A file which is not a store is rejected.'''
+
+        self.corrupt(0, 'X')
+
+        self.assertRejected('is not a store')
+
+    def test_version(self):
+        '''A store of another version is rejected.'''
+
+        self.corrupt(8, chr(store.STORE_VERSION + 1))
+
+        self.assertRejected('is version')
+
+
+if __name__ == '__main__':
+    unittest.main()
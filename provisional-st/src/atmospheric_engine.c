@@ -0,0 +1,1948 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <math.h>
+
+
+/* Matches the definition from the GCTP library, which is not used here */
+#ifndef PI
+#define PI (3.141592653589793238)
+#endif
+
+#include "const.h"
+#include "utilities.h"
+#include "atmospheric_engine.h"
+
+/*****************************************************************************
+DESCRIPTION: The computational routines used to produce atmospheric
+transmission, upwelled radiance, and downwelled radiance from MODTRAN runs at
+grid points, along with the public libst interface to them.
+*****************************************************************************/
+
+
+/* This emissivity/albedo is for water */
+#define WATER_ALBEDO (0.1)
+#define WATER_EMISSIVITY (1.0 - WATER_ALBEDO)
+#define INV_WATER_ALBEDO (1.0 / WATER_ALBEDO)
+
+
+/* Defines the distance to the current pixel, along with the index of the
+   point So that we can find the index of the closest point to start 
+   determining the correct cell to use */
+typedef struct
+{
+    int index;
+    double distance;
+} GRID_ITEM;
+
+
+/* Defines index locations in the vertices array for the current cell to be
+   used for interpolation of the pixel */
+typedef enum
+{
+    LL_POINT,
+    UL_POINT,
+    UR_POINT,
+    LR_POINT,
+    NUM_CELL_POINTS
+} CELL_POINTS;
+
+
+/* Defines index locations for the parameters in the at_height array */
+typedef enum
+{
+    AHP_TRANSMISSION,
+    AHP_UPWELLED_RADIANCE,
+    AHP_DOWNWELLED_RADIANCE,
+    AHP_NUM_PARAMETERS
+} AT_HEIGHT_PARAMETERS;
+
+
+/*****************************************************************************
+METHOD:  planck_eq
+
+PURPOSE: Using Planck's equation to calculate radiance at each wavelength for
+         current temperature.
+
+HISTORY:
+Date        Programmer       Reason
+--------    ---------------  -------------------------------------
+9/30/2014   Song Guo         Original Development
+*****************************************************************************/
+static void planck_eq
+(
+    const double *wavelength, /* I: Each wavelength */
+    int num_elements,   /* I: Number of wavelengths to calculate */
+    double temperature, /* I: The temperature to calculate for */
+    double *bb_radiance /* O: the blackbody results for each wavelength */
+)
+{
+    int i;
+    double lambda;
+
+    /* Planck Const hecht pg, 585 ## units: Js */
+    double PLANCK_CONST = (6.6260755 * pow (10, -34));
+
+    /* Boltzmann Gas Const halliday et 2001 -- units: J/K */
+    double BOLTZMANN_GAS_CONST = (1.3806503 * pow (10, -23));
+
+    /* Speed of Light -- units: m/s */
+    double SPEED_OF_LIGHT = (299792458.0);
+    double SPEED_OF_LIGHT_SQRD = (SPEED_OF_LIGHT * SPEED_OF_LIGHT);
+
+    for (i = 0; i < num_elements; i++)
+    {
+        /* Lambda intervals of spectral response locations microns units: m */
+        lambda = wavelength[i] * pow (10, -6);
+
+        /* Compute the Planck Blackbody Eq [W/m^2 sr um] */
+        bb_radiance[i] = 2.0 * PLANCK_CONST * SPEED_OF_LIGHT_SQRD
+                         * (pow (10, -6) * pow (lambda, -5.0))
+                         * (1.0 / (exp ((PLANCK_CONST * SPEED_OF_LIGHT)
+                                         / (lambda
+                                            * BOLTZMANN_GAS_CONST
+                                            * temperature))
+                                   - 1.0));
+
+        /* Convert to W/cm^2 sr micron to match modtran units */
+        /* br / (100 * 100) == br * 10e-5 */
+        bb_radiance[i] *= 10e-5;
+    }
+}
+
+
+/*****************************************************************************
+MODULE:  spline
+
+PURPOSE: spline constructs a cubic spline given a set of x and y values,
+         through these values.
+
+RETURN: SUCCESS
+        FAILURE
+
+HISTORY:
+Date        Programmer       Reason
+--------    ---------------  -------------------------------------
+9/29/2014   Song Guo         Modified from Numerical Recipes in C
+                             (ISBN 0-521-43108-5)
+*****************************************************************************/
+static int spline
+(
+    const double *x,
+    const double *y,
+    int n,
+    double yp1,
+    double ypn,
+    double *y2
+)
+{
+    char FUNC_NAME[] = "spline";
+    int i;
+    double p;
+    double qn;
+    double sig;
+    double un;
+    double *u = NULL;
+
+    u = malloc ((unsigned) (n - 1) * sizeof (double));
+    if (u == NULL)
+    {
+        RETURN_ERROR ("Can't allocate memory", FUNC_NAME, FAILURE);
+    }
+
+    /* Set the lower boundary */
+    if (yp1 > 0.99e30)
+    {
+        /* To be "natural" */
+        y2[0] = 0.0;
+        u[0] = 0.0;
+    }
+    else
+    {
+        /* To have a specified first derivative */
+        y2[0] = -0.5;
+        u[0] = (3.0 / (x[1] - x[0]))
+               * ((y[1] - y[0]) / (x[1] - x[0]) - yp1);
+    }
+
+    /* Set the upper boundary */
+    if (ypn > 0.99e30)
+    {
+        /* To be "natural" */
+        qn = 0.0;
+        un = 0.0;
+    }
+    else
+    {
+        /* To have a specified first derivative */
+        qn = 0.5;
+        un = (3.0 / (x[n - 1] - x[n - 2]))
+             * (ypn - (y[n - 1] - y[n - 2]) / (x[n - 1] - x[n - 2]));
+    }
+
+    /* Perform decomposition of the tridiagonal algorithm */
+    for (i = 1; i <= n - 2; i++)
+    {
+        sig = (x[i] - x[i - 1]) / (x[i + 1] - x[i - 1]);
+
+        p = sig * y2[i - 1] + 2.0;
+
+        y2[i] = (sig - 1.0) / p;
+
+        u[i] = (y[i + 1] - y[i]) / (x[i + 1] - x[i])
+               - (y[i] - y[i - 1]) / (x[i] - x[i - 1]);
+
+        u[i] = (6.0 * u[i] / (x[i + 1] - x[i - 1]) - sig * u[i - 1]) / p;
+    }
+    y2[n - 1] = (un - qn * u[n - 2]) / (qn * y2[n - 2] + 1.0);
+
+    /* Perform the backsubstitution of the tridiagonal algorithm */
+    for (i = n - 2; i >= 0; i--)
+    {
+        y2[i] = y2[i] * y2[i + 1] + u[i];
+    }
+
+    free (u);
+
+    return SUCCESS;
+}
+
+
+/*****************************************************************************
+MODULE:  splint
+
+PURPOSE: splint uses the cubic spline generated with spline to interpolate
+         values in the XY table
+
+HISTORY:
+Date        Programmer       Reason
+--------    ---------------  -------------------------------------
+9/29/2014   Song Guo         Modified from online code
+
+NOTE: The search bracket is kept by the caller in klo and khi, both set to
+      -1 before the first call for a table, so that consecutive calls with
+      increasing x do not have to search the whole table.
+*****************************************************************************/
+static const double one_sixth = (1.0 / 6.0); /* To remove a division */
+static void splint
+(
+    const double *xa,
+    const double *ya,
+    const double *y2a,
+    int n,
+    double x,
+    int *klo,      /* I/O: Lower index of the search bracket */
+    int *khi,      /* I/O: Upper index of the search bracket */
+    double *y
+)
+{
+    int k;
+    double h;
+    double b;
+    double a;
+
+    if ((*klo) < 0)
+    {
+        (*klo) = 0;
+        (*khi) = n - 1;
+    }
+    else
+    {
+        if (x < xa[(*klo)])
+            (*klo) = 0;
+        if (x > xa[(*khi)])
+            (*khi) = n - 1;
+    }
+
+    while ((*khi) - (*klo) > 1)
+    {
+        k = ((*khi) + (*klo)) >> 1;
+
+        if (xa[k] > x)
+            (*khi) = k;
+        else
+            (*klo) = k;
+    }
+
+    h = xa[(*khi)] - xa[(*klo)];
+
+    if (h == 0.0)
+    {
+        *y = 0.0;
+    }
+    else
+    {
+        a = (xa[(*khi)] - x) / h;
+
+        b = (x - xa[(*klo)]) / h;
+
+        *y = a * ya[(*klo)]
+             + b * ya[(*khi)]
+             + ((a * a * a - a) * y2a[(*klo)]
+                + (b * b * b - b) * y2a[(*khi)]) * (h * h) * one_sixth;
+    }
+}
+
+
+/*****************************************************************************
+MODULE:  int_tabulated
+
+PURPOSE: This function integrates a tabulated set of data { x(i) , f(i) },
+         on the closed interval [min(X) , max(X)].
+
+RETURN: SUCCESS
+        FAILURE
+
+HISTORY:
+Date        Programmer       Reason
+--------    ---------------  -------------------------------------
+9/29/2014   Song Guo         Original Development
+
+NOTE: x and f are assumed to be in sorted order (min(x) -> max(x))
+*****************************************************************************/
+static int int_tabulated
+(
+    const double *x,   /*I: Tabulated X-value data */
+    const double *f,   /*I: Tabulated F-value data */
+    int nums,          /*I: Number of points */
+    double *result_out /*O: Integrated result */
+)
+{
+    char FUNC_NAME[] = "int_tabulated";
+    double *temp = NULL;
+    double *z = NULL;
+    double xmin;
+    double xmax;
+    int i;
+    int *ii = NULL;
+    int ii_count;
+    int klo = -1;      /* Search bracket for splint */
+    int khi = -1;
+    double h;
+    double result;
+    int segments;
+
+    /* Figure out the number of segments needed */
+    segments = nums - 1;
+    while (segments % 4 != 0)
+        segments++;
+
+    /* Determine how many iterations are needed  */
+    ii_count = (int) ((segments) / 4);
+
+    /* Determine the min and max */
+    xmin = x[0];
+    xmax = x[nums - 1];
+
+    /* Determine the step size */
+    h = (xmax - xmin) / segments;
+
+    /* Allocate memory */
+    temp = malloc (nums * sizeof (double));
+    if (temp == NULL)
+    {
+        RETURN_ERROR ("Allocating temp memory", FUNC_NAME, FAILURE);
+    }
+
+    z = malloc ((segments+1) * sizeof (double));
+    if (z == NULL)
+    {
+        RETURN_ERROR ("Allocating z memory", FUNC_NAME, FAILURE);
+    }
+
+    ii = malloc (ii_count * sizeof (int));
+    if (ii == NULL)
+    {
+        RETURN_ERROR ("Allocating ii memory", FUNC_NAME, FAILURE);
+    }
+
+    /* Interpolate spectral response over wavelength */
+    /* Using 1e30 forces generation of a natural spline and produces nearly
+       the same results as IDL */
+    if (spline (x, f, nums, 1e30, 1e30, temp) != SUCCESS)
+    {
+        RETURN_ERROR ("Failed during spline", FUNC_NAME, FAILURE);
+    }
+
+    /* Call splint for interpolations. one-based arrays are considered */
+    for (i = 0; i < segments+1; i++)
+    {
+        splint (x, f, temp, nums, h*i+xmin, &klo, &khi, &z[i]);
+    }
+
+    /* Get the 5-points needed for Newton-Cotes formula */
+    for (i = 0; i < ii_count; i++)
+    {
+        ii[i] = (i + 1) * 4;
+    }
+
+    /* Compute the integral using the 5-point Newton-Cotes formula */
+    result = 0.0;
+    for (i = 0; i < ii_count; i++)
+    {
+        result += (h * (14.0 * (z[ii[i] - 4] + z[ii[i]]) +
+                        64.0 * (z[ii[i] - 3] + z[ii[i] - 1]) +
+                        24.0 * z[ii[i] - 2]) / 45.0);
+    }
+
+    /* Assign the results to the output */
+    *result_out = result;
+
+    free (temp);
+    free (z);
+    free (ii);
+
+    return SUCCESS;
+}
+
+
+/*****************************************************************************
+MODULE:  calculate_lt
+
+PURPOSE: Calculate blackbody radiance from temperature using spectral response
+         function.
+
+RETURN: SUCCESS
+        FAILURE
+
+HISTORY:
+Date        Programmer       Reason
+--------    ---------------  -------------------------------------
+9/29/2014   Song Guo         Original Development
+*****************************************************************************/
+static int calculate_lt
+(
+    double temperature,         /*I: temperature */
+    const double *srs_wavelength, /*I: spectral response wavelengths */
+    const double *srs_response, /*I: spectral response function */
+    int num_srs,                /*I: number of spectral response points */
+    double *radiance            /*O: blackbody radiance */
+)
+{
+    char FUNC_NAME[] = "calculate_lt";
+    int i;
+    double rs_integral;
+    double temp_integral;
+    double *product;
+    double *blackbody_radiance;
+
+    /* Allocate memory */
+    blackbody_radiance = malloc (num_srs * sizeof (double));
+    if (blackbody_radiance == NULL)
+    {
+        RETURN_ERROR ("Allocating blackbody_radiance memory", FUNC_NAME,
+                      FAILURE);
+    }
+
+    product = malloc (num_srs * sizeof (double));
+    if (product == NULL)
+    {
+        RETURN_ERROR ("Allocating product memory", FUNC_NAME, FAILURE);
+    }
+
+    /* integrate spectral response over wavelength */
+    if (int_tabulated (srs_wavelength, srs_response, num_srs,
+                       &rs_integral) != SUCCESS)
+    {
+        RETURN_ERROR ("Calling int_tabulated\n", FUNC_NAME, FAILURE);
+    }
+
+    /* Use planck's blackbody radiance equation to calculate radiance at each
+       wavelength for the current temperature */
+    planck_eq (srs_wavelength, num_srs, temperature, blackbody_radiance);
+
+    /* Multiply the calculated planck radiance by the spectral response and
+       integrate over wavelength to get one number for current temp */
+    for (i = 0; i < num_srs; i++)
+    {
+        product[i] = blackbody_radiance[i] * srs_response[i];
+    }
+
+    if (int_tabulated (srs_wavelength, product, num_srs,
+                       &temp_integral) != SUCCESS)
+    {
+        RETURN_ERROR ("Calling int_tabulated\n", FUNC_NAME, FAILURE);
+    }
+
+    /* Divide above result by integral of spectral response function */
+    *radiance = temp_integral / rs_integral;
+
+    /* Free allocated memory */
+    free (blackbody_radiance);
+    free (product);
+
+    return SUCCESS;
+}
+
+
+/*****************************************************************************
+MODULE:  linear_interpolate_over_modtran
+
+PURPOSE: Simulate IDL (interpol) function for ST.
+*****************************************************************************/
+static void linear_interpolate_over_modtran
+(
+    const double *modtran, /* I: The MODTRAN data - provides both the a and
+                                 b, MODTRAN_NUM_COLUMNS values per row */
+    int index,        /* I: The MODTRAN temperatur to use for a */
+    const double *c,  /* I: The Landsat wavelength grid points */
+    int num_in,       /* I: Number of input data and grid points*/
+    int num_out,      /* I: Number of output grid points */
+    double *x         /* O: Interpolated output results */
+)
+{
+    int i;
+    int o;
+
+    double d1 = 0.0;
+    double d2 = 0.0;
+    double g;
+    double g1 = 0.0;
+    double g2 = 0.0;
+
+    int a = index; /* MODTRAN radiance for specififc temp */
+    int b = MODTRAN_WAVELENGTH; /* MODTRAN wavelength */
+
+#define MODTRAN_VALUE(row, column) \
+            modtran[(row) * MODTRAN_NUM_COLUMNS + (column)]
+
+    for (o = 0; o < num_out; o++)
+    {
+        g = c[o];
+
+        /* Initialize to the first two */
+        d1 = MODTRAN_VALUE(0, a);
+        d2 = MODTRAN_VALUE(1, a);
+        g1 = MODTRAN_VALUE(0, b);
+        g2 = MODTRAN_VALUE(1, b);
+
+        for (i = 0; i < num_in-1; i++)
+        {
+            if (g <= MODTRAN_VALUE(i, b) && g > MODTRAN_VALUE(i+1, b))
+            {
+                /* Found it in the middle of the data */
+                d1 = MODTRAN_VALUE(i, a);
+                d2 = MODTRAN_VALUE(i+1, a);
+                g1 = MODTRAN_VALUE(i, b);
+                g2 = MODTRAN_VALUE(i+1, b);
+                break;
+            }
+        }
+
+        if (i == num_in-1)
+        {
+            /* Less than the last so use the last two */
+            d1 = MODTRAN_VALUE(i-1, a);
+            d2 = MODTRAN_VALUE(i, a);
+            g1 = MODTRAN_VALUE(i-1, b);
+            g2 = MODTRAN_VALUE(i, b);
+        }
+
+        /* Apply the formula for linear interpolation */
+        x[o] = d1 + ((g - g1) / (g2 - g1)) * (d2 - d1);
+    }
+
+#undef MODTRAN_VALUE
+}
+
+
+/*****************************************************************************
+MODULE:  calculate_lobs
+
+PURPOSE: Calculate observed radiance from MODTRAN results and the spectral
+         response function.
+
+RETURN: SUCCESS
+        FAILURE
+
+HISTORY:
+Date        Programmer       Reason
+--------    ---------------  -------------------------------------
+9/29/2014   Song Guo         Original Development
+*****************************************************************************/
+static int calculate_lobs
+(
+    const double *modtran,      /*I: MODTRAN results with wavelengths */
+    const double *srs_wavelength, /*I: spectral response wavelengths */
+    const double *srs_response, /*I: spectral response function */
+    int num_entries,            /*I: number of MODTRAN points */
+    int num_srs,                /*I: number of spectral response points */
+    int index,                  /*I: column index for data be used */
+    double *radiance            /*O: LOB outputs */
+)
+{
+    char FUNC_NAME[] = "calculate_lobs";
+    int i;
+    double *temp_rad;
+    double rs_integral;
+    double temp_integral;
+    double *product;
+
+    /* Allocate memory */
+    temp_rad = malloc (num_srs * sizeof (double));
+    if (temp_rad == NULL)
+    {
+        RETURN_ERROR ("Allocating temp_rad memory", FUNC_NAME, FAILURE);
+    }
+
+    product = malloc (num_srs * sizeof (double));
+    if (product == NULL)
+    {
+        RETURN_ERROR ("Allocating product memory", FUNC_NAME, FAILURE);
+    }
+
+    /* Integrate spectral response over wavelength */
+    if (int_tabulated (srs_wavelength, srs_response, num_srs,
+                       &rs_integral) != SUCCESS)
+    {
+        RETURN_ERROR ("Calling int_tabulated\n", FUNC_NAME, FAILURE);
+    }
+
+    /* Interpolate MODTRAN radiance to Landsat wavelengths */
+    linear_interpolate_over_modtran (modtran, index, srs_wavelength,
+                                     num_entries, num_srs, temp_rad);
+
+    /* Multiply the calculated radiance by the spectral response and integrate
+       over wavelength to get one number for current temperature */
+    for (i = 0; i < num_srs; i++)
+    {
+        product[i] = temp_rad[i] * srs_response[i];
+    }
+
+    if (int_tabulated (srs_wavelength, product, num_srs,
+                       &temp_integral) != SUCCESS)
+    {
+        RETURN_ERROR ("Calling int_tabulated\n", FUNC_NAME, FAILURE);
+    }
+
+    /* Divide above result by integral of spectral response function */
+    *radiance = temp_integral / rs_integral;
+
+    /* Free allocated memory */
+    free (temp_rad);
+    free (product);
+
+    return SUCCESS;
+}
+
+
+/*****************************************************************************
+METHOD:  matrix_transpose_2x2
+
+PURPOSE: Transposes a 2x2 matrix, producing a 2x2 result.
+*****************************************************************************/
+static void matrix_transpose_2x2(double *A, double *out)
+{
+    /*
+        Formula is:
+
+            out[0] = a
+            out[1] = c
+            out[2] = b
+            out[3] = d
+
+        Where:
+
+            a = A[0]
+            b = A[1]
+            c = A[2]
+            d = A[3]
+    */
+
+    out[0] = A[0];
+    out[1] = A[2];
+    out[2] = A[1];
+    out[3] = A[3];
+}
+
+
+/*****************************************************************************
+METHOD:  matrix_inverse_2x2
+
+PURPOSE: Inverts a 2x2 matrix, producing a 2x2 result.
+*****************************************************************************/
+static void matrix_inverse_2x2(double *A, double *out)
+{
+    /*
+        Formula is:
+
+            out[0] = d * determinant;
+            out[1] = (-b) * determinant;
+            out[2] = (-c) * determinant;
+            out[3] = a * determinant;
+
+        Where:
+
+            a = A[0]
+            b = A[1]
+            c = A[2]
+            d = A[3]
+
+            determinant = 1.0 / (a * d - b * c)
+    */
+
+    double determinant = (1.0 / (A[0] * A[3] - A[1] * A[2]));
+
+    out[0] = A[3] * determinant;
+    out[1] = (-A[1]) * determinant;
+    out[2] = (-A[2]) * determinant;
+    out[3] = A[0] * determinant;
+}
+
+
+/*****************************************************************************
+METHOD:  matrix_multiply_2x2_2x2
+
+PURPOSE: Multiply a 2x2 matrix with a 2x2 matrix, producing a 2x2 result.
+*****************************************************************************/
+static void matrix_multiply_2x2_2x2(double *A, double *B, double *out)
+{
+    /*
+        Formula is:
+
+            out[0] = a * e + b * g
+            out[1] = a * f + b * h
+            out[2] = c * e + d * g
+            out[3] = c * f + d * h
+
+        Where:
+
+            a = A[0]
+            b = A[1]
+            c = A[2]
+            d = A[3]
+
+            e = B[0]
+            f = B[1]
+            g = B[2]
+            h = B[3]
+    */
+
+    out[0] = A[0] * B[0] + A[1] * B[2];
+    out[1] = A[0] * B[1] + A[1] * B[3];
+    out[2] = A[2] * B[0] + A[3] * B[2];
+    out[3] = A[2] * B[1] + A[3] * B[3];
+}
+
+
+/*****************************************************************************
+METHOD:  matrix_multiply_2x2_2x1
+
+PURPOSE: Multiply a 2x2 matrix with a 2x1 matrix, producing a 2x1 result.
+*****************************************************************************/
+static void matrix_multiply_2x2_2x1(double *A, double *B, double *out)
+{
+    /*
+        Formula is:
+
+            out[0] = a * e + b * f
+            out[1] = c * e + d * f
+
+        Where:
+
+            a = A[0]
+            b = A[1]
+            c = A[2]
+            d = A[3]
+
+            e = B[0]
+            f = B[1]
+    */
+
+    out[0] = A[0] * B[0] + A[1] * B[1];
+    out[1] = A[2] * B[0] + A[3] * B[1];
+}
+
+
+
+/* Pixel parameter routines */
+
+/*****************************************************************************
+METHOD:  qsort_grid_compare_function
+
+PURPOSE: A qsort routine that can be used with the GRID_ITEM items to sort by
+         distance
+
+RETURN: int: -1 (a<b), 1 (b<a), 0 (a==b) 
+*****************************************************************************/
+static int qsort_grid_compare_function
+(
+    const void *grid_item_a,
+    const void *grid_item_b
+)
+{
+    double a = (*(GRID_ITEM*)grid_item_a).distance;
+    double b = (*(GRID_ITEM*)grid_item_b).distance;
+
+    if (a < b)
+        return -1;
+    else if (b < a)
+        return 1;
+
+    return 0;
+}
+
+
+/*****************************************************************************
+METHOD:  haversine_distance
+
+PURPOSE: Calculates the great-circle distance between 2 points in meters.
+         The points are given in decimal degrees.  The Haversine formula
+         is used. 
+
+RETURN: double - The great-circle distance in meters between the points.
+
+NOTE: This is based on the haversine_distance function in the ST Python
+      scripts.
+*****************************************************************************/
+static double haversine_distance
+(
+    double lon_1,  /* I: the longitude for the first point */
+    double lat_1,  /* I: the latitude for the first point */
+    double lon_2,  /* I: the longitude for the second point */
+    double lat_2   /* I: the latitude for the second point */
+)
+{
+
+    double lon_1_radians; /* Longitude for first point in radians */
+    double lat_1_radians; /* Latitude for first point in radians */
+    double lon_2_radians; /* Longitude for second point in radians */
+    double lat_2_radians; /* Latitude for second point in radians */
+    double sin_lon;       /* Intermediate value */
+    double sin_lat;       /* Intermediate value */
+    double sin_lon_sqrd;  /* Intermediate value */
+    double sin_lat_sqrd;  /* Intermediate value */
+
+    /* Convert to radians */
+    lon_1_radians = lon_1 * RADIANS_PER_DEGREE;
+    lat_1_radians = lat_1 * RADIANS_PER_DEGREE;
+    lon_2_radians = lon_2 * RADIANS_PER_DEGREE;
+    lat_2_radians = lat_2 * RADIANS_PER_DEGREE;
+
+    /* Figure out some sines */
+    sin_lon = sin((lon_2_radians - lon_1_radians) / 2.0);
+    sin_lat = sin((lat_2_radians - lat_1_radians) / 2.0);
+    sin_lon_sqrd = sin_lon * sin_lon;
+    sin_lat_sqrd = sin_lat * sin_lat;
+
+    /* Compute and return the distance */
+    return EQUATORIAL_RADIUS * 2 + asin(sqrt(sin_lat_sqrd 
+        + cos(lat_1_radians) * cos(lat_2_radians) * sin_lon_sqrd));
+}
+
+
+/*****************************************************************************
+METHOD:  determine_height_bracket
+
+PURPOSE: Determine the elevations of a point to interpolate between for the
+         height of the current pixel.  The elevations are the same for every
+         band, so the bracket is shared by them.
+*****************************************************************************/
+static void determine_height_bracket
+(
+    const ST_ATMOS_GRID *grid, /* I: results from MODTRAN runs */
+    int point,                /* I: the grid point to interpolate */
+    double interpolate_to,    /* I: current landsat pixel height */
+    int *below,               /* O: elevation below the height */
+    int *above                /* O: elevation equal to or above the height */
+)
+{
+    int elevation;
+    int count = grid->num_elevations;
+
+    /* Offset the array to the elevations for the point */
+    const double *elevations = grid->elevation + point * count;
+
+    /* Find the height to use that is below the interpolate_to height */
+    *below = 0;
+    for (elevation = 0; elevation < count; elevation++)
+    {
+        if (elevations[elevation] < interpolate_to)
+        {
+            *below = elevation; /* Last match will always be the one we want */
+        }
+    }
+
+    /* Find the height to use that is equal to or above the interpolate_to
+       height.  It will always be the same or the next height */ 
+    *above = *below; /* Start with the same */
+    if (*above != (count - 1))
+    {
+        /* Not the last height */
+
+        /* Check to make sure that we are not less that the below height,
+           indicating that our interpolate_to height is below the first
+           height */
+        if (! (interpolate_to < elevations[*above]))
+        {
+            /* Use the next height, since it will be equal to or above our
+               interpolate_to height */
+            (*above)++;
+        }
+        /* Else - We are at the first height, so use that for both above and
+                  below */
+    }
+    /* Else - We are at the last height, so use that for both above and
+              below */
+}
+
+
+/*****************************************************************************
+METHOD:  interpolate_to_height
+
+PURPOSE: Interpolate to height of current pixel
+*****************************************************************************/
+static void interpolate_to_height
+(
+    const ST_ATMOS_GRID *grid, /* I: results from MODTRAN runs */
+    int point,                /* I: the grid point to interpolate */
+    int below,                /* I: elevation below the height */
+    int above,                /* I: elevation equal to or above the height */
+    double interpolate_to,    /* I: current landsat pixel height */
+    double *at_height         /* O: interpolated height for point */
+)
+{
+    int parameter;
+    int count = grid->num_elevations;
+
+    double below_parameters[AHP_NUM_PARAMETERS];
+    double above_parameters[AHP_NUM_PARAMETERS];
+
+    double slope;
+    double intercept;
+
+    double above_height;
+    double inv_height_diff; /* To remove the multiple divisions */
+
+    /* Offset the arrays to the elevations for the point */
+    const double *elevations = grid->elevation + point * count;
+    const double *transmission = grid->transmission + point * count;
+    const double *upwelled = grid->upwelled_radiance + point * count;
+    const double *downwelled = grid->downwelled_radiance + point * count;
+
+    below_parameters[AHP_TRANSMISSION] = transmission[below];
+    below_parameters[AHP_UPWELLED_RADIANCE] = upwelled[below];
+    below_parameters[AHP_DOWNWELLED_RADIANCE] = downwelled[below];
+
+    if (above == below)
+    {
+        /* Use the below parameters since the same */
+        at_height[AHP_TRANSMISSION] =
+            below_parameters[AHP_TRANSMISSION];
+        at_height[AHP_UPWELLED_RADIANCE] =
+            below_parameters[AHP_UPWELLED_RADIANCE];
+        at_height[AHP_DOWNWELLED_RADIANCE] =
+            below_parameters[AHP_DOWNWELLED_RADIANCE];
+    }
+    else
+    {
+        /* Interpolate between the heights for each parameter */
+        above_height = elevations[above];
+        inv_height_diff = 1.0 / (above_height - elevations[below]);
+
+        above_parameters[AHP_TRANSMISSION] = transmission[above];
+        above_parameters[AHP_UPWELLED_RADIANCE] = upwelled[above];
+        above_parameters[AHP_DOWNWELLED_RADIANCE] = downwelled[above];
+
+        for (parameter = 0; parameter < AHP_NUM_PARAMETERS; parameter++)
+        {
+            slope = (above_parameters[parameter] - below_parameters[parameter])
+                    * inv_height_diff;
+
+            intercept = above_parameters[parameter] - slope * above_height;
+
+            at_height[parameter] = slope * interpolate_to + intercept;
+        }
+    }
+}
+
+
+/*****************************************************************************
+METHOD:  determine_location_weights
+
+PURPOSE: Determine the Shepard's method weight of each cell vertex for the
+         location of the current pixel
+*****************************************************************************/
+static void determine_location_weights
+(
+    const ST_ATMOS_GRID *grid,   /* I: The coordinate points */
+    const int *vertices,         /* I: The vertices for the points to use */
+    double interpolate_easting,  /* I: interpolate to easting */
+    double interpolate_northing, /* I: interpolate to northing */
+    double *w                    /* O: weight of each vertex */
+)
+{
+    int point;
+
+    double inv_h[NUM_CELL_POINTS];
+    double total = 0.0;
+
+    /* Shepard's method */
+    for (point = 0; point < NUM_CELL_POINTS; point++)
+    {
+        inv_h[point] = 1.0 / sqrt (((grid->map_x[vertices[point]]
+                                     - interpolate_easting)
+                                    * (grid->map_x[vertices[point]]
+                                       - interpolate_easting))
+                                   +
+                                   ((grid->map_y[vertices[point]]
+                                     - interpolate_northing)
+                                    * (grid->map_y[vertices[point]]
+                                       - interpolate_northing)));
+
+        total += inv_h[point];
+    }
+
+    /* Determine the weights for each vertex */
+    for (point = 0; point < NUM_CELL_POINTS; point++)
+    {
+        w[point] = inv_h[point] / total;
+    }
+}
+
+
+/*****************************************************************************
+METHOD:  interpolate_to_location
+
+PURPOSE: Interpolate to location of current pixel
+*****************************************************************************/
+static void interpolate_to_location
+(
+    const double *w,             /* I: weight of each vertex */
+    double at_height[][AHP_NUM_PARAMETERS], /* I: current height atmospheric
+                                                  results */
+    double *parameters           /* O: interpolated pixel atmospheric 
+                                       parameters */
+)
+{
+    int point;
+    int parameter;
+
+    /* For each parameter apply each vertex's weighted value */
+    for (parameter = 0; parameter < AHP_NUM_PARAMETERS; parameter++)
+    {
+        parameters[parameter] = 0.0;
+        for (point = 0; point < NUM_CELL_POINTS; point++)
+        {
+            parameters[parameter] += (w[point] * at_height[point][parameter]);
+        }
+    }
+}
+
+
+/*****************************************************************************
+METHOD:  determine_grid_point_distances
+
+PURPOSE: Determines the distances for the current set of grid points.  The
+         location is longitude and latitude, or with map_space the map x and
+         y, which are compared to the map coordinates of the points.
+
+NOTE: The indexes of the grid points are assumed to be populated.
+*****************************************************************************/
+static void determine_grid_point_distances
+(
+    const ST_ATMOS_GRID *grid, /* I: All the available points */
+    bool map_space,            /* I: The location is in map coordinates */
+    double x,                  /* I: Longitude or map x of the current
+                                     line/sample */
+    double y,                  /* I: Latitude or map y of the current
+                                     line/sample */
+    int num_grid_points,       /* I: The number of grid points to operate on */
+    GRID_ITEM *grid_points     /* I/O: Sorted to determine the center grid
+                                       point */
+)
+{
+    int point;
+    int index;
+
+    /* Populate the distances to the grid points */
+    for (point = 0; point < num_grid_points; point++)
+    {
+        index = grid_points[point].index;
+
+        if (map_space)
+        {
+            grid_points[point].distance = hypot (grid->map_x[index] - x,
+                                                 grid->map_y[index] - y);
+        }
+        else
+        {
+            grid_points[point].distance = haversine_distance (
+                grid->lon[index], grid->lat[index], x, y);
+        }
+    }
+}
+
+
+/*****************************************************************************
+METHOD:  determine_center_grid_point
+
+PURPOSE: Determines the index of the center point from the current set of grid
+         points.
+
+NOTE: The indexes of the grid points are assumed to be populated.
+
+RETURN: type = int
+    Value  Description
+    -----  -------------------------------------------------------------------
+    index  The index of the center point
+*****************************************************************************/
+static int determine_center_grid_point
+(
+    const ST_ATMOS_GRID *grid, /* I: All the available points */
+    bool map_space,            /* I: The location is in map coordinates */
+    double x,                  /* I: Longitude or map x of the current
+                                     line/sample */
+    double y,                  /* I: Latitude or map y of the current
+                                     line/sample */
+    int num_grid_points,       /* I: The number of grid points to operate on */
+    GRID_ITEM *grid_points     /* I/O: Sorted to determine the center grid
+                                       point */
+)
+{
+    determine_grid_point_distances (grid, map_space, x, y, num_grid_points,
+                                    grid_points);
+
+    /* Sort them to find the closest one */
+    qsort (grid_points, num_grid_points, sizeof (GRID_ITEM),
+           qsort_grid_compare_function);
+
+    return grid_points[0].index;
+}
+
+
+/*****************************************************************************
+METHOD:  determine_first_center_grid_point
+
+PURPOSE: Determines the index of the first center point to use for the current
+         line.  Only called when the fist valid point for a line is
+         encountered.  The point is determined from all of the available
+         points.
+
+RETURN: type = int
+    Value  Description
+    -----  -------------------------------------------------------------------
+    index  The index of the center point
+*****************************************************************************/
+static int determine_first_center_grid_point
+(
+    const ST_ATMOS_GRID *grid, /* I: All the available points */
+    bool map_space,            /* I: The location is in map coordinates */
+    double x,                  /* I: Longitude or map x of the current
+                                     line/sample */
+    double y,                  /* I: Latitude or map y of the current
+                                     line/sample */
+    GRID_ITEM *grid_points     /* I/O: Memory passed in, populated and
+                                       sorted to determine the center grid
+                                       point */
+)
+{
+    int point;
+
+    /* Assign the point indexes for all grid points */
+    for (point = 0; point < grid->count; point++)
+    {
+        grid_points[point].index = point;
+    }
+
+    return determine_center_grid_point (grid, map_space, x, y, grid->count,
+                                        grid_points);
+}
+
+
+/*****************************************************************************
+METHOD:  determine_pixel_cells
+
+PURPOSE: Determine the interpolation cell of each pixel of a block of whole
+         scene lines, from the grid point distances to either the pixel
+         longitude and latitude, or the pixel map coordinates.
+
+RETURN: SUCCESS
+        FAILURE
+*****************************************************************************/
+static int determine_pixel_cells
+(
+    const ST_ATMOS_GRID *grid, /* I: grid point locations */
+    bool map_space,            /* I: select in map coordinates, instead of
+                                     from longitude and latitude */
+    int lines,                 /* I: number of lines in the buffers */
+    int samples,               /* I: number of samples in each line */
+    int first_line,            /* I: scene line of the first buffer line */
+    double ul_map_x,           /* I: map x of the scene upper left pixel */
+    double ul_map_y,           /* I: map y of the scene upper left pixel */
+    float x_pixel_size,        /* I: pixel size in map x */
+    float y_pixel_size,        /* I: pixel size in map y */
+    const float *longitude,    /* I: pixel longitude in degrees, not used
+                                     with map_space */
+    const float *latitude,     /* I: pixel latitude in degrees, not used
+                                     with map_space */
+    const float *thermal,      /* I: thermal radiance, for the fill */
+    int16_t *cells             /* I/O: lower left point of the interpolation
+                                       cell of each pixel */
+)
+{
+    char FUNC_NAME[] = "determine_pixel_cells";
+
+    int line;
+    int sample;
+
+    bool first_sample;
+
+    double x;                  /* Longitude or map x of the pixel */
+    double y;                  /* Latitude or map y of the pixel */
+
+    GRID_ITEM *grid_points = NULL;
+
+    int center_point = 0;
+    double avg_distance_ll;
+    double avg_distance_ul;
+    double avg_distance_ur;
+    double avg_distance_lr;
+
+    /* Use local variables for cleaner code */
+    int num_cols = grid->cols;
+    long pixel_line_loc;
+    long pixel_loc;
+
+    /* Allocate memory to hold the grid_points to the first sample of data for
+       the current line */
+    grid_points = malloc (grid->count * sizeof (GRID_ITEM));
+    if (grid_points == NULL)
+    {
+        RETURN_ERROR ("Allocating grid_points memory", FUNC_NAME, FAILURE);
+    }
+
+    for (line = 0; line < lines; line++)
+    {
+        pixel_line_loc = (long) line * samples;
+
+        /* Set first_sample to be true */
+        first_sample = true;
+        for (sample = 0; sample < samples; sample++)
+        {
+            pixel_loc = pixel_line_loc + sample;
+
+            if (thermal[pixel_loc] == ST_NO_DATA_VALUE)
+                continue;
+
+            /* The search around the previous center point is only valid for
+               the pixel beside it, so a known cell restarts the search */
+            if (cells[pixel_loc] != ST_CELL_UNKNOWN)
+            {
+                first_sample = true;
+                continue;
+            }
+
+            if (map_space)
+            {
+                x = ul_map_x + (sample * x_pixel_size);
+                y = ul_map_y - ((first_line + line) * y_pixel_size);
+            }
+            else
+            {
+                x = longitude[pixel_loc];
+                y = latitude[pixel_loc];
+            }
+
+            if (first_sample)
+            {
+                /* Determine the first center point from all of the
+                   available points */
+                center_point = determine_first_center_grid_point(
+                                   grid, map_space, x, y, grid_points);
+
+                /* Set first_sample to be false */
+                first_sample = false;
+            }
+            else
+            {
+                /* Determine the center point from the current 9 grid
+                   points for the current line/sample */
+                center_point = determine_center_grid_point(
+                                   grid, map_space, x, y, NUM_GRID_POINTS,
+                                   grid_points);
+            }
+
+            /* Fix the index values, since the points are from a new line
+               or were messed up during determining the center point */
+            grid_points[CC_GRID_POINT].index = center_point;
+            grid_points[LL_GRID_POINT].index = center_point - 1 - num_cols;
+            grid_points[LC_GRID_POINT].index = center_point - 1;
+            grid_points[UL_GRID_POINT].index = center_point - 1 + num_cols;
+            grid_points[UC_GRID_POINT].index = center_point + num_cols;
+            grid_points[UR_GRID_POINT].index = center_point + 1 + num_cols;
+            grid_points[RC_GRID_POINT].index = center_point + 1;
+            grid_points[LR_GRID_POINT].index = center_point + 1 - num_cols;
+            grid_points[DC_GRID_POINT].index = center_point - num_cols;
+
+            /* Fix the distances, since the points are from a new line or
+               were messed up during determining the center point */
+            determine_grid_point_distances (grid, map_space, x, y,
+                                            NUM_GRID_POINTS, grid_points);
+
+            /* Determine the average distances for each quadrant around
+               the center point. We only need to use the three outer grid 
+               points */
+            avg_distance_ll = (grid_points[DC_GRID_POINT].distance
+                               + grid_points[LL_GRID_POINT].distance
+                               + grid_points[LC_GRID_POINT].distance)
+                              / 3.0;
+
+            avg_distance_ul = (grid_points[LC_GRID_POINT].distance
+                               + grid_points[UL_GRID_POINT].distance
+                               + grid_points[UC_GRID_POINT].distance)
+                              / 3.0;
+
+            avg_distance_ur = (grid_points[UC_GRID_POINT].distance
+                               + grid_points[UR_GRID_POINT].distance
+                               + grid_points[RC_GRID_POINT].distance)
+                              / 3.0;
+
+            avg_distance_lr = (grid_points[RC_GRID_POINT].distance
+                               + grid_points[LR_GRID_POINT].distance
+                               + grid_points[DC_GRID_POINT].distance)
+                              / 3.0;
+
+            /* Determine which quadrant is closer, the cell is identified by
+               its lower left vertex */
+            if (avg_distance_ll < avg_distance_ul
+                && avg_distance_ll < avg_distance_ur
+                && avg_distance_ll < avg_distance_lr)
+            { /* LL Cell */
+                cells[pixel_loc] = center_point - 1 - num_cols;
+            }
+            else if (avg_distance_ul < avg_distance_ur
+                && avg_distance_ul < avg_distance_lr)
+            { /* UL Cell */
+                cells[pixel_loc] = center_point - 1;
+            }
+            else if (avg_distance_ur < avg_distance_lr)
+            { /* UR Cell */
+                cells[pixel_loc] = center_point;
+            }
+            else
+            { /* LR Cell */
+                cells[pixel_loc] = center_point - num_cols;
+            }
+        } /* END - for sample */
+    } /* END - for line */
+
+    free (grid_points);
+
+    return SUCCESS;
+}
+
+
+/* Public interface */
+
+/*****************************************************************************
+METHOD:  st_calculate_lt
+
+PURPOSE: Calculate the band blackbody radiance for a temperature using the
+         spectral response function.
+
+RETURN: SUCCESS
+        FAILURE
+*****************************************************************************/
+int st_calculate_lt
+(
+    double temperature,        /* I: temperature in Kelvin */
+    const double *srs,         /* I: spectral response, num_srs wavelengths
+                                     followed by num_srs responses */
+    int num_srs,               /* I: number of spectral response points */
+    double *radiance           /* O: band blackbody radiance */
+)
+{
+    char FUNC_NAME[] = "st_calculate_lt";
+
+    if (calculate_lt (temperature, srs, srs + num_srs, num_srs, radiance)
+        != SUCCESS)
+    {
+        RETURN_ERROR ("Calling calculate_lt", FUNC_NAME, FAILURE);
+    }
+
+    return SUCCESS;
+}
+
+
+/*****************************************************************************
+METHOD:  st_point_parameters
+
+PURPOSE: Generate transmission, upwelled radiance, and downwelled radiance for
+         one elevation of a grid point from the three MODTRAN runs made there.
+
+RETURN: SUCCESS
+        FAILURE
+
+NOTE: The MODTRAN runs are at 273K and 310K with 0.0 albedo, and at 0K with
+      0.1 albedo.
+*****************************************************************************/
+int st_point_parameters
+(
+    const double *srs,         /* I: spectral response, num_srs wavelengths
+                                     followed by num_srs responses */
+    int num_srs,               /* I: number of spectral response points */
+    const double *modtran,     /* I: MODTRAN radiance table, num_entries rows
+                                     of MODTRAN_NUM_COLUMNS */
+    int num_entries,           /* I: number of MODTRAN table rows */
+    double zero_temp,          /* I: target surface temperature of the 0K
+                                     MODTRAN run */
+    double *transmission,      /* O: atmospheric transmission */
+    double *upwelled_radiance, /* O: upwelled radiance */
+    double *downwelled_radiance /* O: downwelled radiance */
+)
+{
+    char FUNC_NAME[] = "st_point_parameters";
+
+    const double *srs_wavelength = srs;
+    const double *srs_response = srs + num_srs;
+
+    double temp_radiance_0;
+    double obs_radiance_0;
+    double temp_radiance_273;
+    double temp_radiance_310;
+    double y_0;
+    double y_1;
+    double tau; /* Transmission */
+    double lu;  /* Upwelled Radiance */
+
+    /* Variables to hold matrices and the results for the operations perfomed
+       on them */
+    double X_2x2[4];
+    double Xt_2x2[4];
+    double Xt_X_2x2[4];
+    double Inv_Xt_X_2x2[4];
+    double Y_2x1[2];
+    double Xt_Y_2x1[4];
+    double A_2x1[2];
+
+    /* Calculate Lt for each specific temperature */
+    if (calculate_lt (273, srs_wavelength, srs_response, num_srs,
+                      &temp_radiance_273) != SUCCESS)
+    {
+        RETURN_ERROR ("Calling calculate_lt for 273K", FUNC_NAME, FAILURE);
+    }
+    if (calculate_lt (310, srs_wavelength, srs_response, num_srs,
+                      &temp_radiance_310) != SUCCESS)
+    {
+        RETURN_ERROR ("Calling calculate_lt for 310K", FUNC_NAME, FAILURE);
+    }
+
+    /* Implement a = INVERT(TRANSPOSE(x)##x)##TRANSPOSE(x)##y
+       from the IDL code base. */
+    X_2x2[0] = 1;
+    X_2x2[1] = temp_radiance_273;
+    X_2x2[2] = 1;
+    X_2x2[3] = temp_radiance_310;
+
+    matrix_transpose_2x2(X_2x2, Xt_2x2);
+    matrix_multiply_2x2_2x2(Xt_2x2, X_2x2, Xt_X_2x2);
+    matrix_inverse_2x2(Xt_X_2x2, Inv_Xt_X_2x2);
+
+    /* Parameters from 3 MODTRAN runs
+       Lobs = Lt*tau + Lu; m = tau; b = Lu; */
+    if (calculate_lobs (modtran, srs_wavelength, srs_response,
+                        num_entries, num_srs, MODTRAN_RADIANCE_273, &y_0)
+        != SUCCESS)
+    {
+        RETURN_ERROR ("Calling calculate_lobs for height y_0",
+                      FUNC_NAME, FAILURE);
+    }
+
+    if (calculate_lobs (modtran, srs_wavelength, srs_response,
+                        num_entries, num_srs, MODTRAN_RADIANCE_310, &y_1)
+        != SUCCESS)
+    {
+        RETURN_ERROR ("Calling calculate_lobs for height y_1",
+                      FUNC_NAME, FAILURE);
+    }
+
+    Y_2x1[0] = y_0;
+    Y_2x1[1] = y_1;
+
+    matrix_multiply_2x2_2x1(Xt_2x2, Y_2x1, Xt_Y_2x1);
+    matrix_multiply_2x2_2x1(Inv_Xt_X_2x2, Xt_Y_2x1, A_2x1);
+
+    tau = A_2x1[1]; /* Transmittance */
+    lu = A_2x1[0];  /* Upwelled Radiance */
+
+    /* Determine Lobs and Lt when MODTRAN was run at 0K - calculate 
+       downwelled */
+    if (calculate_lt (zero_temp, srs_wavelength, srs_response, num_srs,
+                      &temp_radiance_0) != SUCCESS)
+    {
+        RETURN_ERROR ("Calling calculate_lt for zero temp (0Kelvin)",
+                      FUNC_NAME, FAILURE);
+    }
+
+    if (calculate_lobs (modtran, srs_wavelength, srs_response,
+                        num_entries, num_srs, MODTRAN_RADIANCE_000,
+                        &obs_radiance_0) != SUCCESS)
+    {
+        RETURN_ERROR ("Calling calculate_lobs for (0Kelvin)",
+                      FUNC_NAME, FAILURE);
+    }
+
+    /* Calculate the downwelled radiance. These are all equivalent:
+       Ld = (((Lobs - Lu) / tau)
+             - (Lt * WATER_EMISSIVITY)) / (1.0 - WATER_EMISSIVITY)
+       Ld = (((Lobs - Lu) / tau)
+             - (Lt * WATER_EMISSIVITY)) / WATER_ALBEDO
+       Ld = (((Lobs - Lu) / tau)
+             - (Lt * WATER_EMISSIVITY)) * INV_WATER_ALBEDO */
+    *downwelled_radiance = (((obs_radiance_0 - lu) / tau)
+                            - (temp_radiance_0 * WATER_EMISSIVITY))
+                           * INV_WATER_ALBEDO;
+    *transmission = tau;
+    *upwelled_radiance = lu;
+
+    return SUCCESS;
+}
+
+
+/*****************************************************************************
+METHOD:  st_pixel_cells
+
+PURPOSE: Determine the interpolation cell of each pixel of a block of whole
+         scene lines, identified by the grid point at its lower left.  Only
+         pixels which are not fill and whose cell is ST_CELL_UNKNOWN are
+         determined, so cells kept from an earlier scene with the same
+         footprint are reused.
+
+RETURN: SUCCESS
+        FAILURE
+*****************************************************************************/
+int st_pixel_cells
+(
+    const ST_ATMOS_GRID *grid, /* I: grid point locations */
+    int lines,                 /* I: number of lines in the buffers */
+    int samples,               /* I: number of samples in each line */
+    const float *longitude,    /* I: pixel longitude in degrees */
+    const float *latitude,     /* I: pixel latitude in degrees */
+    const float *thermal,      /* I: thermal radiance, for the fill */
+    int16_t *cells             /* I/O: lower left point of the interpolation
+                                       cell of each pixel */
+)
+{
+    return determine_pixel_cells (grid, false, lines, samples, 0, 0.0, 0.0,
+                                  0.0, 0.0, longitude, latitude, thermal,
+                                  cells);
+}
+
+
+/*****************************************************************************
+METHOD:  st_pixel_cells_map
+
+PURPOSE: Determine the interpolation cell of each pixel as st_pixel_cells
+         does, but from the map coordinates of the pixels and the grid
+         points.  The pixel longitude and latitude are not needed, so the
+         caller does not have to convert every pixel to geodetic
+         coordinates.  The selection is not the same as the geodetic one
+         for pixels about as close to two grid points, which
+         st_compare_cell_selection.py reports for a scene.
+
+RETURN: SUCCESS
+        FAILURE
+*****************************************************************************/
+int st_pixel_cells_map
+(
+    const ST_ATMOS_GRID *grid, /* I: grid point locations */
+    int lines,                 /* I: number of lines in the buffers */
+    int samples,               /* I: number of samples in each line */
+    int first_line,            /* I: scene line of the first buffer line */
+    double ul_map_x,           /* I: map x of the scene upper left pixel */
+    double ul_map_y,           /* I: map y of the scene upper left pixel */
+    float x_pixel_size,        /* I: pixel size in map x */
+    float y_pixel_size,        /* I: pixel size in map y */
+    const float *thermal,      /* I: thermal radiance, for the fill */
+    int16_t *cells             /* I/O: lower left point of the interpolation
+                                       cell of each pixel */
+)
+{
+    return determine_pixel_cells (grid, true, lines, samples, first_line,
+                                  ul_map_x, ul_map_y, x_pixel_size,
+                                  y_pixel_size, NULL, NULL, thermal, cells);
+}
+
+
+/*****************************************************************************
+METHOD:  st_pixel_parameters_cells
+
+PURPOSE: Generate transmission, upwelled radiance, and downwelled radiance for
+         several thermal bands at each pixel of a block of whole scene lines,
+         from the interpolation cells determined by st_pixel_cells.  The
+         height bracket and location weights of a pixel are found once and
+         applied to the parameters of every band.
+
+RETURN: SUCCESS
+        FAILURE
+*****************************************************************************/
+int st_pixel_parameters_cells
+(
+    const ST_ATMOS_GRID *grids, /* I: atmospheric parameters at grid points
+                                      for each band, the point locations and
+                                      elevations of the first are used */
+    int num_bands,             /* I: number of bands */
+    int lines,                 /* I: number of lines in the buffers */
+    int samples,               /* I: number of samples in each line */
+    int first_line,            /* I: scene line of the first buffer line */
+    double ul_map_x,           /* I: map x of the scene upper left pixel */
+    double ul_map_y,           /* I: map y of the scene upper left pixel */
+    float x_pixel_size,        /* I: pixel size in map x */
+    float y_pixel_size,        /* I: pixel size in map y */
+    const float *thermal,      /* I: thermal radiance of the first band,
+                                     fill for every band */
+    const int16_t *elevation,  /* I: pixel elevation in meters */
+    const int16_t *cells,      /* I: lower left point of the interpolation
+                                     cell of each pixel */
+    float **transmission,      /* O: atmospheric transmission of each band */
+    float **upwelled_radiance, /* O: upwelled radiance W m^-2 sr^-1 um^-1 of
+                                     each band */
+    float **downwelled_radiance /* O: downwelled radiance W m^-2 sr^-1
+                                      um^-1 of each band */
+)
+{
+    char FUNC_NAME[] = "st_pixel_parameters_cells";
+
+    int line;
+    int sample;
+    int band;
+
+    const ST_ATMOS_GRID *grid = &grids[0];
+
+    double easting;
+    double northing;
+
+    int vertex;
+    int cell_vertices[NUM_CELL_POINTS];
+    int below[NUM_CELL_POINTS];
+    int above[NUM_CELL_POINTS];
+
+    double weights[NUM_CELL_POINTS];
+    double at_height[NUM_CELL_POINTS][AHP_NUM_PARAMETERS];
+    double parameters[AHP_NUM_PARAMETERS];
+
+    double current_height;
+
+    /* Use local variables for cleaner code */
+    int num_cols = grid->cols;
+    long pixel_line_loc;
+    long pixel_loc;
+
+    for (line = 0; line < lines; line++)
+    {
+        pixel_line_loc = (long) line * samples;
+
+        for (sample = 0; sample < samples; sample++)
+        {
+            pixel_loc = pixel_line_loc + sample;
+
+            if (thermal[pixel_loc] == ST_NO_DATA_VALUE)
+            {
+                for (band = 0; band < num_bands; band++)
+                {
+                    transmission[band][pixel_loc] = ST_NO_DATA_VALUE;
+                    upwelled_radiance[band][pixel_loc] = ST_NO_DATA_VALUE;
+                    downwelled_radiance[band][pixel_loc] = ST_NO_DATA_VALUE;
+                }
+
+                continue;
+            }
+
+            /* A cell outside the grid can only come from cells which were
+               not determined for this grid */
+            if (cells[pixel_loc] < 0
+                || cells[pixel_loc] + 1 + num_cols >= grid->count)
+            {
+                RETURN_ERROR ("Pixel cell is not within the grid points",
+                              FUNC_NAME, FAILURE);
+            }
+
+            easting = ul_map_x + (sample * x_pixel_size);
+            northing = ul_map_y - ((first_line + line) * y_pixel_size);
+
+            /* LL Point */
+            cell_vertices[LL_POINT] = cells[pixel_loc];
+            /* UL Point */
+            cell_vertices[UL_POINT] = cell_vertices[LL_POINT] + num_cols;
+            /* UR Point */
+            cell_vertices[UR_POINT] = cell_vertices[UL_POINT] + 1;
+            /* LR Point */
+            cell_vertices[LR_POINT] = cell_vertices[LL_POINT] + 1;
+
+            /* Pixels interpolated from a point MODTRAN was not run for are
+               fill, as when clear sky selection skipped the points around
+               cloud */
+            for (vertex = 0; vertex < NUM_CELL_POINTS; vertex++)
+            {
+                if (grid->transmission[(long) cell_vertices[vertex]
+                                       * grid->num_elevations]
+                    == ST_NO_DATA_VALUE)
+                {
+                    break;
+                }
+            }
+            if (vertex < NUM_CELL_POINTS)
+            {
+                for (band = 0; band < num_bands; band++)
+                {
+                    transmission[band][pixel_loc] = ST_NO_DATA_VALUE;
+                    upwelled_radiance[band][pixel_loc] = ST_NO_DATA_VALUE;
+                    downwelled_radiance[band][pixel_loc] = ST_NO_DATA_VALUE;
+                }
+                continue;
+            }
+
+            /* Convert height from m to km -- Same as 1.0 / 1000.0 */
+            current_height = (double) elevation[pixel_loc] * 0.001;
+
+            /* Find the elevations to interpolate between at each of the
+               four closest points, and the weight of each point */
+            for (vertex = 0; vertex < NUM_CELL_POINTS; vertex++)
+            {
+                determine_height_bracket (grid, cell_vertices[vertex],
+                                          current_height, &below[vertex],
+                                          &above[vertex]);
+            }
+
+            determine_location_weights (grid, cell_vertices, easting,
+                                        northing, weights);
+
+            for (band = 0; band < num_bands; band++)
+            {
+                /* Interpolate three parameters to that height at each of
+                   the four closest points */
+                for (vertex = 0; vertex < NUM_CELL_POINTS; vertex++)
+                {
+                    interpolate_to_height (&grids[band],
+                                           cell_vertices[vertex],
+                                           below[vertex], above[vertex],
+                                           current_height,
+                                           at_height[vertex]);
+                }
+
+                /* Interpolate parameters at appropriate height to location
+                   of current pixel */
+                interpolate_to_location (weights, at_height, &parameters[0]);
+
+                /* Convert radiances to W*m^(-2)*sr(-1) */
+                upwelled_radiance[band][pixel_loc] =
+                    parameters[AHP_UPWELLED_RADIANCE] * 10000.0;
+                downwelled_radiance[band][pixel_loc] =
+                    parameters[AHP_DOWNWELLED_RADIANCE] * 10000.0;
+                transmission[band][pixel_loc] =
+                    parameters[AHP_TRANSMISSION];
+            }
+        } /* END - for sample */
+    } /* END - for line */
+
+    return SUCCESS;
+}
+
+
+/*****************************************************************************
+METHOD:  st_pixel_parameters_bands
+
+PURPOSE: Generate transmission, upwelled radiance, and downwelled radiance for
+         several thermal bands at each pixel of a block of whole scene lines.
+         The cell, height bracket, and location weights of a pixel are found
+         once and applied to the parameters of every band.
+
+RETURN: SUCCESS
+        FAILURE
+*****************************************************************************/
+int st_pixel_parameters_bands
+(
+    const ST_ATMOS_GRID *grids, /* I: atmospheric parameters at grid points
+                                      for each band, the point locations and
+                                      elevations of the first are used */
+    int num_bands,             /* I: number of bands */
+    int lines,                 /* I: number of lines in the buffers */
+    int samples,               /* I: number of samples in each line */
+    int first_line,            /* I: scene line of the first buffer line */
+    double ul_map_x,           /* I: map x of the scene upper left pixel */
+    double ul_map_y,           /* I: map y of the scene upper left pixel */
+    float x_pixel_size,        /* I: pixel size in map x */
+    float y_pixel_size,        /* I: pixel size in map y */
+    const float *longitude,    /* I: pixel longitude in degrees */
+    const float *latitude,     /* I: pixel latitude in degrees */
+    const float *thermal,      /* I: thermal radiance of the first band,
+                                     fill for every band */
+    const int16_t *elevation,  /* I: pixel elevation in meters */
+    float **transmission,      /* O: atmospheric transmission of each band */
+    float **upwelled_radiance, /* O: upwelled radiance W m^-2 sr^-1 um^-1 of
+                                     each band */
+    float **downwelled_radiance, /* O: downwelled radiance W m^-2 sr^-1
+                                       um^-1 of each band */
+    int32_t *cell              /* O: lower left point of the interpolation
+                                     cell, ST_CELL_UNKNOWN where none is
+                                     found, may be NULL */
+)
+{
+    char FUNC_NAME[] = "st_pixel_parameters_bands";
+
+    int line;
+    int sample;
+    int band;
+
+    int16_t *cells = NULL;     /* Cell of each sample of a line */
+
+    float *line_transmission[MAX_THERMAL_BANDS];
+    float *line_upwelled[MAX_THERMAL_BANDS];
+    float *line_downwelled[MAX_THERMAL_BANDS];
+
+    long pixel_line_loc;
+
+    if (num_bands > MAX_THERMAL_BANDS)
+    {
+        RETURN_ERROR ("Too many thermal bands", FUNC_NAME, FAILURE);
+    }
+
+    cells = malloc (samples * sizeof (int16_t));
+    if (cells == NULL)
+    {
+        RETURN_ERROR ("Allocating cells memory", FUNC_NAME, FAILURE);
+    }
+
+    /* The cells are found a line at a time to keep the memory small */
+    for (line = 0; line < lines; line++)
+    {
+        pixel_line_loc = (long) line * samples;
+
+        for (sample = 0; sample < samples; sample++)
+        {
+            cells[sample] = ST_CELL_UNKNOWN;
+        }
+
+        if (st_pixel_cells (grids, 1, samples, &longitude[pixel_line_loc],
+                            &latitude[pixel_line_loc],
+                            &thermal[pixel_line_loc], cells) != SUCCESS)
+        {
+            free (cells);
+            RETURN_ERROR ("Calling st_pixel_cells", FUNC_NAME, FAILURE);
+        }
+
+        if (cell != NULL)
+        {
+            for (sample = 0; sample < samples; sample++)
+                cell[pixel_line_loc + sample] = cells[sample];
+        }
+
+        for (band = 0; band < num_bands; band++)
+        {
+            line_transmission[band] = &transmission[band][pixel_line_loc];
+            line_upwelled[band] = &upwelled_radiance[band][pixel_line_loc];
+            line_downwelled[band] =
+                &downwelled_radiance[band][pixel_line_loc];
+        }
+
+        if (st_pixel_parameters_cells (grids, num_bands, 1, samples,
+                first_line + line, ul_map_x, ul_map_y, x_pixel_size,
+                y_pixel_size, &thermal[pixel_line_loc],
+                &elevation[pixel_line_loc], cells, line_transmission,
+                line_upwelled, line_downwelled) != SUCCESS)
+        {
+            free (cells);
+            RETURN_ERROR ("Calling st_pixel_parameters_cells", FUNC_NAME,
+                          FAILURE);
+        }
+    }
+
+    free (cells);
+
+    return SUCCESS;
+}
+
+
+/*****************************************************************************
+METHOD:  st_pixel_parameters
+
+PURPOSE: Generate transmission, upwelled radiance, and downwelled radiance at
+         each pixel of a block of whole scene lines.
+
+RETURN: SUCCESS
+        FAILURE
+*****************************************************************************/
+int st_pixel_parameters
+(
+    const ST_ATMOS_GRID *grid, /* I: atmospheric parameters at grid points */
+    int lines,                 /* I: number of lines in the buffers */
+    int samples,               /* I: number of samples in each line */
+    int first_line,            /* I: scene line of the first buffer line */
+    double ul_map_x,           /* I: map x of the scene upper left pixel */
+    double ul_map_y,           /* I: map y of the scene upper left pixel */
+    float x_pixel_size,        /* I: pixel size in map x */
+    float y_pixel_size,        /* I: pixel size in map y */
+    const float *longitude,    /* I: pixel longitude in degrees */
+    const float *latitude,     /* I: pixel latitude in degrees */
+    const float *thermal,      /* I: thermal radiance */
+    const int16_t *elevation,  /* I: pixel elevation in meters */
+    float *transmission,       /* O: atmospheric transmission */
+    float *upwelled_radiance,  /* O: upwelled radiance W m^-2 sr^-1 um^-1 */
+    float *downwelled_radiance, /* O: downwelled radiance W m^-2 sr^-1 um^-1 */
+    int32_t *cell              /* O: lower left point of the interpolation
+                                     cell, ST_CELL_UNKNOWN where none is
+                                     found, may be NULL */
+)
+{
+    return st_pixel_parameters_bands (grid, 1, lines, samples, first_line,
+                                      ul_map_x, ul_map_y, x_pixel_size,
+                                      y_pixel_size, longitude, latitude,
+                                      thermal, elevation, &transmission,
+                                      &upwelled_radiance,
+                                      &downwelled_radiance, cell);
+}
+
+
+/*****************************************************************************
+METHOD:  st_radiance_to_temperature
+
+PURPOSE: Convert thermal radiance to brightness temperature using the inverse
+         Planck function with the K1 and K2 constants for the instrument.
+*****************************************************************************/
+void st_radiance_to_temperature
+(
+    const float *radiance,     /* I: thermal radiance */
+    long count,                /* I: number of values */
+    double k1,                 /* I: K1 thermal conversion constant */
+    double k2,                 /* I: K2 thermal conversion constant */
+    float *temperature         /* O: brightness temperature in Kelvin */
+)
+{
+    long index;
+
+    for (index = 0; index < count; index++)
+    {
+        if (radiance[index] == ST_NO_DATA_VALUE)
+            temperature[index] = ST_NO_DATA_VALUE;
+        else
+            temperature[index] = k2 / log (k1 / radiance[index] + 1.0);
+    }
+}
+
+
+/*****************************************************************************
+METHOD:  st_temperature_to_radiance
+
+PURPOSE: Convert brightness temperature to thermal radiance using the Planck
+         function with the K1 and K2 constants for the instrument.
+*****************************************************************************/
+void st_temperature_to_radiance
+(
+    const float *temperature,  /* I: brightness temperature in Kelvin */
+    long count,                /* I: number of values */
+    double k1,                 /* I: K1 thermal conversion constant */
+    double k2,                 /* I: K2 thermal conversion constant */
+    float *radiance            /* O: thermal radiance */
+)
+{
+    long index;
+
+    for (index = 0; index < count; index++)
+    {
+        if (temperature[index] == ST_NO_DATA_VALUE)
+            radiance[index] = ST_NO_DATA_VALUE;
+        else
+            radiance[index] = k1 / (exp (k2 / temperature[index]) - 1.0);
+    }
+}
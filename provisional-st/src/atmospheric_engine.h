@@ -0,0 +1,203 @@
+#ifndef ATMOSPHERIC_ENGINE_H
+#define ATMOSPHERIC_ENGINE_H
+
+
+#include <stdint.h>
+
+
+/*****************************************************************************
+DESCRIPTION: The atmospheric parameter engine.  These routines hold the
+computational parts of st_atmospheric_parameters and are also built into
+libst.so for use from other applications.
+
+All routines are reentrant.  They operate only on the buffers provided by the
+caller, they do not read or write any files, and they hold no state between
+calls.  Pixel fill is ST_NO_DATA_VALUE (-9999.0) for both input and output.
+*****************************************************************************/
+
+
+/* Columns of a MODTRAN radiance table row:
+   wavelength | 273K,0.0 albedo | 310K,0.0 albedo | 000K,0.1 albedo */
+typedef enum
+{
+    MODTRAN_WAVELENGTH,
+    MODTRAN_RADIANCE_273,
+    MODTRAN_RADIANCE_310,
+    MODTRAN_RADIANCE_000,
+    MODTRAN_NUM_COLUMNS
+} MODTRAN_TABLE_COLUMNS;
+
+
+/* Atmospheric parameters at each elevation of each grid point.  The grid
+   point arrays hold count values.  The elevation arrays hold
+   count * num_elevations values, all of the elevations of a point together
+   and in ascending order.  The parameters of a point MODTRAN was not run
+   for are ST_NO_DATA_VALUE. */
+typedef struct
+{
+    int count;                   /* Number of grid points */
+    int rows;                    /* Number of grid point rows */
+    int cols;                    /* Number of grid point columns */
+    int num_elevations;          /* Number of elevations for each point */
+    const double *lon;           /* Point longitude in degrees */
+    const double *lat;           /* Point latitude in degrees */
+    const double *map_x;         /* Point map projection x */
+    const double *map_y;         /* Point map projection y */
+    const double *elevation;     /* Elevation in km */
+    const double *transmission;  /* Atmospheric transmission */
+    const double *upwelled_radiance;   /* Upwelled radiance */
+    const double *downwelled_radiance; /* Downwelled radiance */
+} ST_ATMOS_GRID;
+
+
+int st_calculate_lt
+(
+    double temperature,        /* I: temperature in Kelvin */
+    const double *srs,         /* I: spectral response, num_srs wavelengths
+                                     followed by num_srs responses */
+    int num_srs,               /* I: number of spectral response points */
+    double *radiance           /* O: band blackbody radiance */
+);
+
+int st_point_parameters
+(
+    const double *srs,         /* I: spectral response, num_srs wavelengths
+                                     followed by num_srs responses */
+    int num_srs,               /* I: number of spectral response points */
+    const double *modtran,     /* I: MODTRAN radiance table, num_entries rows
+                                     of MODTRAN_NUM_COLUMNS */
+    int num_entries,           /* I: number of MODTRAN table rows */
+    double zero_temp,          /* I: target surface temperature of the 0K
+                                     MODTRAN run */
+    double *transmission,      /* O: atmospheric transmission */
+    double *upwelled_radiance, /* O: upwelled radiance */
+    double *downwelled_radiance /* O: downwelled radiance */
+);
+
+/* Cell of a pixel which has not been determined */
+#define ST_CELL_UNKNOWN (-1)
+
+int st_pixel_cells
+(
+    const ST_ATMOS_GRID *grid, /* I: grid point locations */
+    int lines,                 /* I: number of lines in the buffers */
+    int samples,               /* I: number of samples in each line */
+    const float *longitude,    /* I: pixel longitude in degrees */
+    const float *latitude,     /* I: pixel latitude in degrees */
+    const float *thermal,      /* I: thermal radiance, for the fill */
+    int16_t *cells             /* I/O: lower left point of the interpolation
+                                       cell of each pixel, only the
+                                       ST_CELL_UNKNOWN cells are determined */
+);
+
+int st_pixel_cells_map
+(
+    const ST_ATMOS_GRID *grid, /* I: grid point locations */
+    int lines,                 /* I: number of lines in the buffers */
+    int samples,               /* I: number of samples in each line */
+    int first_line,            /* I: scene line of the first buffer line */
+    double ul_map_x,           /* I: map x of the scene upper left pixel */
+    double ul_map_y,           /* I: map y of the scene upper left pixel */
+    float x_pixel_size,        /* I: pixel size in map x */
+    float y_pixel_size,        /* I: pixel size in map y */
+    const float *thermal,      /* I: thermal radiance, for the fill */
+    int16_t *cells             /* I/O: lower left point of the interpolation
+                                       cell of each pixel, only the
+                                       ST_CELL_UNKNOWN cells are determined */
+);
+
+int st_pixel_parameters_cells
+(
+    const ST_ATMOS_GRID *grids, /* I: atmospheric parameters at grid points
+                                      for each band, the point locations and
+                                      elevations of the first are used */
+    int num_bands,             /* I: number of bands */
+    int lines,                 /* I: number of lines in the buffers */
+    int samples,               /* I: number of samples in each line */
+    int first_line,            /* I: scene line of the first buffer line */
+    double ul_map_x,           /* I: map x of the scene upper left pixel */
+    double ul_map_y,           /* I: map y of the scene upper left pixel */
+    float x_pixel_size,        /* I: pixel size in map x */
+    float y_pixel_size,        /* I: pixel size in map y */
+    const float *thermal,      /* I: thermal radiance of the first band,
+                                     fill for every band */
+    const int16_t *elevation,  /* I: pixel elevation in meters */
+    const int16_t *cells,      /* I: lower left point of the interpolation
+                                     cell of each pixel */
+    float **transmission,      /* O: atmospheric transmission of each band */
+    float **upwelled_radiance, /* O: upwelled radiance W m^-2 sr^-1 um^-1 of
+                                     each band */
+    float **downwelled_radiance /* O: downwelled radiance W m^-2 sr^-1
+                                      um^-1 of each band */
+);
+
+int st_pixel_parameters
+(
+    const ST_ATMOS_GRID *grid, /* I: atmospheric parameters at grid points */
+    int lines,                 /* I: number of lines in the buffers */
+    int samples,               /* I: number of samples in each line */
+    int first_line,            /* I: scene line of the first buffer line */
+    double ul_map_x,           /* I: map x of the scene upper left pixel */
+    double ul_map_y,           /* I: map y of the scene upper left pixel */
+    float x_pixel_size,        /* I: pixel size in map x */
+    float y_pixel_size,        /* I: pixel size in map y */
+    const float *longitude,    /* I: pixel longitude in degrees */
+    const float *latitude,     /* I: pixel latitude in degrees */
+    const float *thermal,      /* I: thermal radiance */
+    const int16_t *elevation,  /* I: pixel elevation in meters */
+    float *transmission,       /* O: atmospheric transmission */
+    float *upwelled_radiance,  /* O: upwelled radiance W m^-2 sr^-1 um^-1 */
+    float *downwelled_radiance, /* O: downwelled radiance W m^-2 sr^-1 um^-1 */
+    int32_t *cell              /* O: lower left point of the interpolation
+                                     cell, ST_CELL_UNKNOWN where none is
+                                     found, may be NULL */
+);
+
+int st_pixel_parameters_bands
+(
+    const ST_ATMOS_GRID *grids, /* I: atmospheric parameters at grid points
+                                      for each band, the point locations and
+                                      elevations of the first are used */
+    int num_bands,             /* I: number of bands */
+    int lines,                 /* I: number of lines in the buffers */
+    int samples,               /* I: number of samples in each line */
+    int first_line,            /* I: scene line of the first buffer line */
+    double ul_map_x,           /* I: map x of the scene upper left pixel */
+    double ul_map_y,           /* I: map y of the scene upper left pixel */
+    float x_pixel_size,        /* I: pixel size in map x */
+    float y_pixel_size,        /* I: pixel size in map y */
+    const float *longitude,    /* I: pixel longitude in degrees */
+    const float *latitude,     /* I: pixel latitude in degrees */
+    const float *thermal,      /* I: thermal radiance of the first band,
+                                     fill for every band */
+    const int16_t *elevation,  /* I: pixel elevation in meters */
+    float **transmission,      /* O: atmospheric transmission of each band */
+    float **upwelled_radiance, /* O: upwelled radiance W m^-2 sr^-1 um^-1 of
+                                     each band */
+    float **downwelled_radiance, /* O: downwelled radiance W m^-2 sr^-1
+                                       um^-1 of each band */
+    int32_t *cell              /* O: lower left point of the interpolation
+                                     cell, ST_CELL_UNKNOWN where none is
+                                     found, may be NULL */
+);
+
+void st_radiance_to_temperature
+(
+    const float *radiance,     /* I: thermal radiance */
+    long count,                /* I: number of values */
+    double k1,                 /* I: K1 thermal conversion constant */
+    double k2,                 /* I: K2 thermal conversion constant */
+    float *temperature         /* O: brightness temperature in Kelvin */
+);
+
+void st_temperature_to_radiance
+(
+    const float *temperature,  /* I: brightness temperature in Kelvin */
+    long count,                /* I: number of values */
+    double k1,                 /* I: K1 thermal conversion constant */
+    double k2,                 /* I: K2 thermal conversion constant */
+    float *radiance            /* O: thermal radiance */
+);
+
+
+#endif /* ATMOSPHERIC_ENGINE_H */
@@ -9,12 +9,15 @@
 
 
 #include "const.h"
-#include "2d_array.h"
 #include "utilities.h"
 #include "input.h"
 #include "st_types.h"
 #include "output.h"
 #include "intermediate_data.h"
+#include "atmospheric_engine.h"
+#include "geometry_cache.h"
+#include "trace.h"
+#include "st_store.h"
 #include "calculate_atmospheric_parameters.h"
 
 /*****************************************************************************
@@ -27,687 +30,309 @@ radiance band is also created based on a Landsat thermal band and parameters.
 /* calculate_point_atmospheric_parameters functions */
 
 /*****************************************************************************
-METHOD:  planck_eq
+METHOD:  write_point_atmospheric_parameters
 
-PURPOSE: Using Planck's equation to calculate radiance at each wavelength for
-         current temperature.
-
-HISTORY:
-Date        Programmer       Reason
---------    ---------------  -------------------------------------
-9/30/2014   Song Guo         Original Development
-*****************************************************************************/
-void planck_eq
-(
-    double *wavelength, /* I: Each wavelength */
-    int num_elements,   /* I: Number of wavelengths to calculate */
-    double temperature, /* I: The temperature to calculate for */
-    double *bb_radiance /* O: the blackbody results for each wavelength */
-)
-{
-    int i;
-    double lambda;
-
-    /* Planck Const hecht pg, 585 ## units: Js */
-    double PLANCK_CONST = (6.6260755 * pow (10, -34));
-
-    /* Boltzmann Gas Const halliday et 2001 -- units: J/K */
-    double BOLTZMANN_GAS_CONST = (1.3806503 * pow (10, -23));
-
-    /* Speed of Light -- units: m/s */
-    double SPEED_OF_LIGHT = (299792458.0);
-    double SPEED_OF_LIGHT_SQRD = (SPEED_OF_LIGHT * SPEED_OF_LIGHT);
-
-    for (i = 0; i < num_elements; i++)
-    {
-        /* Lambda intervals of spectral response locations microns units: m */
-        lambda = wavelength[i] * pow (10, -6);
-
-        /* Compute the Planck Blackbody Eq [W/m^2 sr um] */
-        bb_radiance[i] = 2.0 * PLANCK_CONST * SPEED_OF_LIGHT_SQRD
-                         * (pow (10, -6) * pow (lambda, -5.0))
-                         * (1.0 / (exp ((PLANCK_CONST * SPEED_OF_LIGHT)
-                                         / (lambda
-                                            * BOLTZMANN_GAS_CONST
-                                            * temperature))
-                                   - 1.0));
-
-        /* Convert to W/cm^2 sr micron to match modtran units */
-        /* br / (100 * 100) == br * 10e-5 */
-        bb_radiance[i] *= 10e-5;
-    }
-}
-
-
-/*****************************************************************************
-MODULE:  spline
-
-PURPOSE: spline constructs a cubic spline given a set of x and y values,
-         through these values.
+PURPOSE: Write transmission, upwelled radiance, and downwelled radiance at
+         each height for each NARR point that is used to
+         atmospheric_parameters.txt.
 
 RETURN: SUCCESS
         FAILURE
-
-HISTORY:
-Date        Programmer       Reason
---------    ---------------  -------------------------------------
-9/29/2014   Song Guo         Modified from Numerical Recipes in C
-                             (ISBN 0-521-43108-5)
 *****************************************************************************/
-int spline
+int write_point_atmospheric_parameters
 (
-    double *x,
-    double *y,
-    int n,
-    double yp1,
-    double ypn,
-    double *y2
+    GRID_POINTS *grid_points,  /* I: The coordinate points */
+    ATMOS_TABLE *atmos_table   /* I: Atmospheric parameters for the points */
 )
 {
-    char FUNC_NAME[] = "spline";
-    int i;
-    double p;
-    double qn;
-    double sig;
-    double un;
-    double *u = NULL;
+    char FUNC_NAME[] = "write_point_atmospheric_parameters";
 
-    u = malloc ((unsigned) (n - 1) * sizeof (double));
-    if (u == NULL)
-    {
-        RETURN_ERROR ("Can't allocate memory", FUNC_NAME, FAILURE);
-    }
+    FILE *fd;
 
-    /* Set the lower boundary */
-    if (yp1 > 0.99e30)
-    {
-        /* To be "natural" */
-        y2[0] = 0.0;
-        u[0] = 0.0;
-    }
-    else
-    {
-        /* To have a specified first derivative */
-        y2[0] = -0.5;
-        u[0] = (3.0 / (x[1] - x[0]))
-               * ((y[1] - y[0]) / (x[1] - x[0]) - yp1);
-    }
+    int i;
+    int j;
+    long location;
 
-    /* Set the upper boundary */
-    if (ypn > 0.99e30)
-    {
-        /* To be "natural" */
-        qn = 0.0;
-        un = 0.0;
-    }
-    else
+    char current_file[PATH_MAX];
+    char msg[PATH_MAX];
+
+    snprintf (current_file, sizeof (current_file),
+              "atmospheric_parameters.txt");
+    snprintf (msg, sizeof (msg),
+              "Creating Atmospheric Parameters File = [%s]\n", current_file);
+    LOG_MESSAGE (msg, FUNC_NAME);
+    fd = fopen (current_file, "w");
+    if (fd == NULL)
     {
-        /* To have a specified first derivative */
-        qn = 0.5;
-        un = (3.0 / (x[n - 1] - x[n - 2]))
-             * (ypn - (y[n - 1] - y[n - 2]) / (x[n - 1] - x[n - 2]));
+        RETURN_ERROR ("Can't open atmospheric_parameters.txt file",
+                      FUNC_NAME, FAILURE);
     }
-
-    /* Perform decomposition of the tridiagonal algorithm */
-    for (i = 1; i <= n - 2; i++)
+    for (i = 0; i < grid_points->count; i++)
     {
-        sig = (x[i] - x[i - 1]) / (x[i + 1] - x[i - 1]);
-
-        p = sig * y2[i - 1] + 2.0;
-
-        y2[i] = (sig - 1.0) / p;
-
-        u[i] = (y[i + 1] - y[i]) / (x[i + 1] - x[i])
-               - (y[i] - y[i - 1]) / (x[i] - x[i - 1]);
+        /* Only write parameters for grid points where MODTRAN was run */
+        if (!atmos_table->ran_modtran[i])
+        {
+            continue;
+        }
 
-        u[i] = (6.0 * u[i] / (x[i + 1] - x[i - 1]) - sig * u[i - 1]) / p;
-    }
-    y2[n - 1] = (un - qn * u[n - 2]) / (qn * y2[n - 2] + 1.0);
+        for (j = 0; j < atmos_table->num_elevations; j++)
+        {
+            location = (long) i * atmos_table->num_elevations + j;
 
-    /* Perform the backsubstitution of the tridiagonal algorithm */
-    for (i = n - 2; i >= 0; i--)
-    {
-        y2[i] = y2[i] * y2[i + 1] + u[i];
+            fprintf (fd, "%f,%f,%12.9f,%12.9f,%12.9f,%12.9f\n",
+                 atmos_table->lat[i],
+                 atmos_table->lon[i],
+                 atmos_table->elevation[location],
+                 atmos_table->transmission[0][location],
+                 atmos_table->upwelled_radiance[0][location],
+                 atmos_table->downwelled_radiance[0][location]);
+        }
     }
-
-    free (u);
+    fclose (fd);
 
     return SUCCESS;
 }
 
 
 /*****************************************************************************
-MODULE:  splint
+METHOD:  write_used_points
 
-PURPOSE: splint uses the cubic spline generated with spline to interpolate
-         values in the XY table
+PURPOSE: Write the index and map coordinates of each NARR point that is used
+         to used_points.txt, primarily useful for plotting them against the
+         scene.
 
-HISTORY:
-Date        Programmer       Reason
---------    ---------------  -------------------------------------
-9/29/2014   Song Guo         Modified from online code
+RETURN: SUCCESS
+        FAILURE
 *****************************************************************************/
-static int splint_klo = -1;
-static int splint_khi = -1;
-static double one_sixth = (1.0 / 6.0); /* To remove a division */
-void splint
+int write_used_points
 (
-    double *xa,
-    double *ya,
-    double *y2a,
-    int n,
-    double x,
-    double *y
+    GRID_POINTS *grid_points,  /* I: The coordinate points */
+    ATMOS_TABLE *atmos_table   /* I: Atmospheric parameters for the points */
 )
 {
-    int k;
-    double h;
-    double b;
-    double a;
+    char FUNC_NAME[] = "write_used_points";
 
-    if (splint_klo < 0)
-    {
-        splint_klo = 0;
-        splint_khi = n - 1;
-    }
-    else
-    {
-        if (x < xa[splint_klo])
-            splint_klo = 0;
-        if (x > xa[splint_khi])
-            splint_khi = n - 1;
-    }
-
-    while (splint_khi - splint_klo > 1)
-    {
-        k = (splint_khi + splint_klo) >> 1;
-
-        if (xa[k] > x)
-            splint_khi = k;
-        else
-            splint_klo = k;
-    }
+    FILE *fd;
 
-    h = xa[splint_khi] - xa[splint_klo];
+    int i;
 
-    if (h == 0.0)
+    fd = fopen ("used_points.txt", "w");
+    if (fd == NULL)
     {
-        *y = 0.0;
+        RETURN_ERROR ("Can't open used_points.txt file",
+                      FUNC_NAME, FAILURE);
     }
-    else
+    for (i = 0; i < grid_points->count; i++)
     {
-        a = (xa[splint_khi] - x) / h;
-
-        b = (x - xa[splint_klo]) / h;
+        if (!atmos_table->ran_modtran[i])
+        {
+            continue;
+        }
 
-        *y = a * ya[splint_klo]
-             + b * ya[splint_khi]
-             + ((a * a * a - a) * y2a[splint_klo]
-                + (b * b * b - b) * y2a[splint_khi]) * (h * h) * one_sixth;
+        fprintf (fd, "\"%d\"|\"%f\"|\"%f\"\n",
+                 i, grid_points->points[i].map_x,
+                 grid_points->points[i].map_y);
     }
+    fclose (fd);
+
+    return SUCCESS;
 }
 
 
 /*****************************************************************************
-MODULE:  int_tabulated
+METHOD:  write_scene_atmosphere
 
-PURPOSE: This function integrates a tabulated set of data { x(i) , f(i) },
-         on the closed interval [min(X) , max(X)].
+PURPOSE: Write the grid points and the atmospheric parameters at each height
+         of each of them, for every thermal band, to the scene atmosphere
+         store.
 
 RETURN: SUCCESS
         FAILURE
-
-HISTORY:
-Date        Programmer       Reason
---------    ---------------  -------------------------------------
-9/29/2014   Song Guo         Original Development
-
-NOTE: x and f are assumed to be in sorted order (min(x) -> max(x))
 *****************************************************************************/
-int int_tabulated
+int write_scene_atmosphere
 (
-    double *x,         /*I: Tabulated X-value data */
-    double *f,         /*I: Tabulated F-value data */
-    int nums,          /*I: Number of points */
-    double *result_out /*O: Integrated result */
+    GRID_POINTS *grid_points,  /* I: The coordinate points */
+    ATMOS_TABLE *atmos_table   /* I: Atmospheric parameters for the points */
 )
 {
-    char FUNC_NAME[] = "int_tabulated";
-    double *temp = NULL;
-    double *z = NULL;
-    double xmin;
-    double xmax;
+    char FUNC_NAME[] = "write_scene_atmosphere";
+
+    STORE_SECTION sections[NUM_SCENE_ATMOSPHERE_SECTIONS];
+    char name[STORE_NAME_SIZE];
+    int32_t grid[3];
+    int32_t atmosphere[3];
+    int32_t *integers;         /* The integer values of the points */
+    float *coordinates;        /* The coordinates of the points */
+    GRID_POINT *point;
+
+    int count = grid_points->count;
+    int section;
+    int band;
     int i;
-    int *ii = NULL;
-    int ii_count;
-    double h;
-    double result;
-    int segments;
-
-    /* Figure out the number of segments needed */
-    segments = nums - 1;
-    while (segments % 4 != 0)
-        segments++;
-
-    /* Determine how many iterations are needed  */
-    ii_count = (int) ((segments) / 4);
-
-    /* Determine the min and max */
-    xmin = x[0];
-    xmax = x[nums - 1];
-
-    /* Determine the step size */
-    h = (xmax - xmin) / segments;
-
-    /* Allocate memory */
-    temp = malloc (nums * sizeof (double));
-    if (temp == NULL)
-    {
-        RETURN_ERROR ("Allocating temp memory", FUNC_NAME, FAILURE);
-    }
-
-    z = malloc ((segments+1) * sizeof (double));
-    if (z == NULL)
-    {
-        RETURN_ERROR ("Allocating z memory", FUNC_NAME, FAILURE);
-    }
-
-    ii = malloc (ii_count * sizeof (int));
-    if (ii == NULL)
-    {
-        RETURN_ERROR ("Allocating ii memory", FUNC_NAME, FAILURE);
-    }
+    long values = (long) count * atmos_table->num_elevations;
 
-    /* Interpolate spectral response over wavelength */
-    /* Using 1e30 forces generation of a natural spline and produces nearly
-       the same results as IDL */
-    if (spline (x, f, nums, 1e30, 1e30, temp) != SUCCESS)
+    integers = malloc(6 * (long) count * sizeof(int32_t));
+    coordinates = malloc(4 * (long) count * sizeof(float));
+    if (integers == NULL || coordinates == NULL)
     {
-        RETURN_ERROR ("Failed during spline", FUNC_NAME, FAILURE);
-    }
-
-    /* Call splint for interpolations. one-based arrays are considered */
-    for (i = 0; i < segments+1; i++)
-    {
-        splint (x, f, temp, nums, h*i+xmin, &z[i]);
-    }
-
-    /* Get the 5-points needed for Newton-Cotes formula */
-    for (i = 0; i < ii_count; i++)
-    {
-        ii[i] = (i + 1) * 4;
+        free(integers);
+        free(coordinates);
+        RETURN_ERROR("Failed allocating memory for the scene atmosphere",
+                     FUNC_NAME, FAILURE);
     }
 
-    /* Compute the integral using the 5-point Newton-Cotes formula */
-    result = 0.0;
-    for (i = 0; i < ii_count; i++)
+    for (i = 0; i < count; i++)
+    {
+        point = &grid_points->points[i];
+
+        integers[i] = point->index;
+        integers[count + i] = point->run_modtran;
+        integers[2 * count + i] = point->row;
+        integers[3 * count + i] = point->col;
+        integers[4 * count + i] = point->narr_row;
+        integers[5 * count + i] = point->narr_col;
+        coordinates[i] = point->lon;
+        coordinates[count + i] = point->lat;
+        coordinates[2 * count + i] = point->map_x;
+        coordinates[3 * count + i] = point->map_y;
+    }
+
+    grid[0] = count;
+    grid[1] = grid_points->rows;
+    grid[2] = grid_points->cols;
+    atmosphere[0] = count;
+    atmosphere[1] = atmos_table->num_elevations;
+    atmosphere[2] = atmos_table->num_bands;
+
+    section = 0;
+    set_store_section(&sections[section++], SECTION_GRID, STORE_INT32, 3,
+                      grid);
+    set_store_section(&sections[section++], SECTION_INDEX, STORE_INT32,
+                      count, integers);
+    set_store_section(&sections[section++], SECTION_RUN_MODTRAN,
+                      STORE_INT32, count, &integers[count]);
+    set_store_section(&sections[section++], SECTION_ROW, STORE_INT32,
+                      count, &integers[2 * count]);
+    set_store_section(&sections[section++], SECTION_COL, STORE_INT32,
+                      count, &integers[3 * count]);
+    set_store_section(&sections[section++], SECTION_NARR_ROW, STORE_INT32,
+                      count, &integers[4 * count]);
+    set_store_section(&sections[section++], SECTION_NARR_COL, STORE_INT32,
+                      count, &integers[5 * count]);
+    set_store_section(&sections[section++], SECTION_LON, STORE_FLOAT32,
+                      count, coordinates);
+    set_store_section(&sections[section++], SECTION_LAT, STORE_FLOAT32,
+                      count, &coordinates[count]);
+    set_store_section(&sections[section++], SECTION_MAP_X, STORE_FLOAT32,
+                      count, &coordinates[2 * count]);
+    set_store_section(&sections[section++], SECTION_MAP_Y, STORE_FLOAT32,
+                      count, &coordinates[3 * count]);
+    set_store_section(&sections[section++], SECTION_ATMOSPHERE, STORE_INT32,
+                      3, atmosphere);
+    set_store_section(&sections[section++], SECTION_ELEVATION,
+                      STORE_FLOAT64, values, atmos_table->elevation);
+    set_store_section(&sections[section++], SECTION_ELEVATION_DIRECTORY,
+                      STORE_FLOAT64, values,
+                      atmos_table->elevation_directory);
+
+    for (band = 0; band < atmos_table->num_bands; band++)
+    {
+        snprintf(name, sizeof(name), SECTION_TRANSMISSION, band);
+        set_store_section(&sections[section++], name, STORE_FLOAT64, values,
+                          atmos_table->transmission[band]);
+        snprintf(name, sizeof(name), SECTION_UPWELLED_RADIANCE, band);
+        set_store_section(&sections[section++], name, STORE_FLOAT64, values,
+                          atmos_table->upwelled_radiance[band]);
+        snprintf(name, sizeof(name), SECTION_DOWNWELLED_RADIANCE, band);
+        set_store_section(&sections[section++], name, STORE_FLOAT64, values,
+                          atmos_table->downwelled_radiance[band]);
+    }
+
+    if (write_store(SCENE_ATMOSPHERE_STORE_NAME, sections, section)
+        != SUCCESS)
     {
-        result += (h * (14.0 * (z[ii[i] - 4] + z[ii[i]]) +
-                        64.0 * (z[ii[i] - 3] + z[ii[i] - 1]) +
-                        24.0 * z[ii[i] - 2]) / 45.0);
+        free(integers);
+        free(coordinates);
+        RETURN_ERROR("Failed writing the scene atmosphere store", FUNC_NAME,
+                     FAILURE);
     }
 
-    /* Assign the results to the output */
-    *result_out = result;
-
-    free (temp);
-    free (z);
-    free (ii);
+    free(integers);
+    free(coordinates);
 
     return SUCCESS;
 }
 
 
 /*****************************************************************************
-MODULE:  calculate_lt
+METHOD:  read_spectral_response
 
-PURPOSE: Calculate blackbody radiance from temperature using spectral response
-         function.
+PURPOSE: Read a spectral response file into the wavelengths followed by the
+         responses.  When the expected count is zero, every line of the file
+         up to MAX_SRS_COUNT is used.
 
 RETURN: SUCCESS
         FAILURE
-
-HISTORY:
-Date        Programmer       Reason
---------    ---------------  -------------------------------------
-9/29/2014   Song Guo         Original Development
 *****************************************************************************/
-int calculate_lt
+static int read_spectral_response
 (
-    double temperature,         /*I: temperature */
-    double **spectral_response, /*I: spectral response function */
-    int num_srs,                /*I: number of spectral response points */
-    double *radiance            /*O: blackbody radiance */
+    char *srs_file_path,       /* I: The spectral response file */
+    int expected_count,        /* I: Values the file must hold, or zero */
+    double *spectral_response, /* O: Wavelengths followed by responses */
+    int *num_srs               /* O: Number of spectral response values */
 )
 {
-    char FUNC_NAME[] = "calculate_lt";
-    int i;
-    double rs_integral;
-    double temp_integral;
-    double *product;
-    double *blackbody_radiance;
-
-    /* Allocate memory */
-    blackbody_radiance = malloc (num_srs * sizeof (double));
-    if (blackbody_radiance == NULL)
-    {
-        RETURN_ERROR ("Allocating blackbody_radiance memory", FUNC_NAME,
-                      FAILURE);
-    }
-
-    product = malloc (num_srs * sizeof (double));
-    if (product == NULL)
-    {
-        RETURN_ERROR ("Allocating product memory", FUNC_NAME, FAILURE);
-    }
-
-    /* integrate spectral response over wavelength */
-    if (int_tabulated (spectral_response[0], spectral_response[1], num_srs,
-                       &rs_integral) != SUCCESS)
-    {
-        RETURN_ERROR ("Calling int_tabulated\n", FUNC_NAME, FAILURE);
-    }
+    char FUNC_NAME[] = "read_spectral_response";
 
-    /* Use planck's blackbody radiance equation to calculate radiance at each
-       wavelength for the current temperature */
-    planck_eq (spectral_response[0], num_srs, temperature, blackbody_radiance);
-
-    /* Multiply the calculated planck radiance by the spectral response and
-       integrate over wavelength to get one number for current temp */
-    for (i = 0; i < num_srs; i++)
-    {
-        product[i] = blackbody_radiance[i] * spectral_response[1][i];
-    }
-
-    if (int_tabulated (spectral_response[0], product, num_srs,
-                       &temp_integral) != SUCCESS)
-    {
-        RETURN_ERROR ("Calling int_tabulated\n", FUNC_NAME, FAILURE);
-    }
-
-    /* Divide above result by integral of spectral response function */
-    *radiance = temp_integral / rs_integral;
-
-    /* Free allocated memory */
-    free (blackbody_radiance);
-    free (product);
-
-    return SUCCESS;
-}
-
-
-/*****************************************************************************
-MODULE:  linear_interpolate_over_modtran
+    FILE *fd;
 
-PURPOSE: Simulate IDL (interpol) function for ST.
-*****************************************************************************/
-void linear_interpolate_over_modtran
-(
-    double **modtran, /* I: The MODTRAN data - provides both the a and b */
-    int index,        /* I: The MODTRAN temperatur to use for a */
-    double *c,        /* I: The Landsat wavelength grid points */
-    int num_in,       /* I: Number of input data and grid points*/
-    int num_out,      /* I: Number of output grid points */
-    double *x         /* O: Interpolated output results */
-)
-{
     int i;
-    int o;
+    int count;
 
-    double d1 = 0.0;
-    double d2 = 0.0;
-    double g;
-    double g1 = 0.0;
-    double g2 = 0.0;
+    double wavelength[MAX_SRS_COUNT];
+    double response[MAX_SRS_COUNT];
 
-    int a = index; /* MODTRAN radiance for specififc temp */
-    int b = 0;     /* MODTRAN wavelength */
+    char msg[PATH_MAX];
 
-    for (o = 0; o < num_out; o++)
+    snprintf (msg, sizeof (msg),
+              "Reading Spectral Response File [%s]", srs_file_path);
+    LOG_MESSAGE (msg, FUNC_NAME);
+    fd = fopen (srs_file_path, "r");
+    if (fd == NULL)
     {
-        g = c[o];
-
-        /* Initialize to the first two */
-        d1 = modtran[0][a];
-        d2 = modtran[1][a];
-        g1 = modtran[0][b];
-        g2 = modtran[1][b];
-
-        for (i = 0; i < num_in-1; i++)
-        {
-            if (g <= modtran[i][b] && g > modtran[i+1][b])
-            {
-                /* Found it in the middle of the data */
-                d1 = modtran[i][a];
-                d2 = modtran[i+1][a];
-                g1 = modtran[i][b];
-                g2 = modtran[i+1][b];
-                break;
-            }
-        }
-
-        if (i == num_in-1)
-        {
-            /* Less than the last so use the last two */
-            d1 = modtran[i-1][a];
-            d2 = modtran[i][a];
-            g1 = modtran[i-1][b];
-            g2 = modtran[i][b];
-        }
-
-        /* Apply the formula for linear interpolation */
-        x[o] = d1 + ((g - g1) / (g2 - g1)) * (d2 - d1);
+        RETURN_ERROR ("Can't open Spectral Response file", FUNC_NAME, FAILURE);
     }
-}
 
-
-/*****************************************************************************
-MODULE:  calculate_lobs
-
-PURPOSE: Calculate observed radiance from MODTRAN results and the spectral
-         response function.
-
-RETURN: SUCCESS
-        FAILURE
-
-HISTORY:
-Date        Programmer       Reason
---------    ---------------  -------------------------------------
-9/29/2014   Song Guo         Original Development
-*****************************************************************************/
-int calculate_lobs
-(
-    double **modtran,           /*I: MODTRAN results with wavelengths */
-    double **spectral_response, /*I: spectral response function */
-    int num_entries,            /*I: number of MODTRAN points */
-    int num_srs,                /*I: number of spectral response points */
-    int index,                  /*I: column index for data be used */
-    double *radiance            /*O: LOB outputs */
-)
-{
-    char FUNC_NAME[] = "calculate_lobs";
-    int i;
-    double *temp_rad;
-    double rs_integral;
-    double temp_integral;
-    double *product;
-
-    /* Allocate memory */
-    temp_rad = malloc (num_srs * sizeof (double));
-    if (temp_rad == NULL)
+    count = 0;
+    while (count < MAX_SRS_COUNT
+           && fscanf (fd, "%lf %lf%*c", &wavelength[count],
+                      &response[count]) == 2)
     {
-        RETURN_ERROR ("Allocating temp_rad memory", FUNC_NAME, FAILURE);
+        count++;
     }
+    fclose (fd);
 
-    product = malloc (num_srs * sizeof (double));
-    if (product == NULL)
+    if ((expected_count > 0 && count < expected_count) || count < 2)
     {
-        RETURN_ERROR ("Allocating product memory", FUNC_NAME, FAILURE);
+        RETURN_ERROR ("Failed reading spectral response file",
+                      FUNC_NAME, FAILURE);
     }
-
-    /* Integrate spectral response over wavelength */
-    if (int_tabulated (spectral_response[0], spectral_response[1], num_srs,
-                       &rs_integral) != SUCCESS)
+    if (expected_count > 0)
     {
-        RETURN_ERROR ("Calling int_tabulated\n", FUNC_NAME, FAILURE);
+        count = expected_count;
     }
 
-    /* Interpolate MODTRAN radiance to Landsat wavelengths */
-    linear_interpolate_over_modtran (modtran, index, spectral_response[0],
-                                     num_entries, num_srs, temp_rad);
-
-    /* Multiply the calculated radiance by the spectral response and integrate
-       over wavelength to get one number for current temperature */
-    for (i = 0; i < num_srs; i++)
+    for (i = 0; i < count; i++)
     {
-        product[i] = temp_rad[i] * spectral_response[1][i];
+        spectral_response[i] = wavelength[i];
+        spectral_response[count + i] = response[i];
     }
-
-    if (int_tabulated (spectral_response[0], product, num_srs,
-                       &temp_integral) != SUCCESS)
-    {
-        RETURN_ERROR ("Calling int_tabulated\n", FUNC_NAME, FAILURE);
-    }
-
-    /* Divide above result by integral of spectral response function */
-    *radiance = temp_integral / rs_integral;
-
-    /* Free allocated memory */
-    free (temp_rad);
-    free (product);
+    *num_srs = count;
 
     return SUCCESS;
 }
 
 
-/*****************************************************************************
-METHOD:  matrix_transpose_2x2
-
-PURPOSE: Transposes a 2x2 matrix, producing a 2x2 result.
-*****************************************************************************/
-void matrix_transpose_2x2(double *A, double *out)
-{
-    /*
-        Formula is:
-
-            out[0] = a
-            out[1] = c
-            out[2] = b
-            out[3] = d
-
-        Where:
-
-            a = A[0]
-            b = A[1]
-            c = A[2]
-            d = A[3]
-    */
-
-    out[0] = A[0];
-    out[1] = A[2];
-    out[2] = A[1];
-    out[3] = A[3];
-}
-
-
-/*****************************************************************************
-METHOD:  matrix_inverse_2x2
-
-PURPOSE: Inverts a 2x2 matrix, producing a 2x2 result.
-*****************************************************************************/
-void matrix_inverse_2x2(double *A, double *out)
-{
-    /*
-        Formula is:
-
-            out[0] = d * determinant;
-            out[1] = (-b) * determinant;
-            out[2] = (-c) * determinant;
-            out[3] = a * determinant;
-
-        Where:
-
-            a = A[0]
-            b = A[1]
-            c = A[2]
-            d = A[3]
-
-            determinant = 1.0 / (a * d - b * c)
-    */
-
-    double determinant = (1.0 / (A[0] * A[3] - A[1] * A[2]));
-
-    out[0] = A[3] * determinant;
-    out[1] = (-A[1]) * determinant;
-    out[2] = (-A[2]) * determinant;
-    out[3] = A[0] * determinant;
-}
-
-
-/*****************************************************************************
-METHOD:  matrix_multiply_2x2_2x2
-
-PURPOSE: Multiply a 2x2 matrix with a 2x2 matrix, producing a 2x2 result.
-*****************************************************************************/
-void matrix_multiply_2x2_2x2(double *A, double *B, double *out)
-{
-    /*
-        Formula is:
-
-            out[0] = a * e + b * g
-            out[1] = a * f + b * h
-            out[2] = c * e + d * g
-            out[3] = c * f + d * h
-
-        Where:
-
-            a = A[0]
-            b = A[1]
-            c = A[2]
-            d = A[3]
-
-            e = B[0]
-            f = B[1]
-            g = B[2]
-            h = B[3]
-    */
-
-    out[0] = A[0] * B[0] + A[1] * B[2];
-    out[1] = A[0] * B[1] + A[1] * B[3];
-    out[2] = A[2] * B[0] + A[3] * B[2];
-    out[3] = A[2] * B[1] + A[3] * B[3];
-}
-
-
-/*****************************************************************************
-METHOD:  matrix_multiply_2x2_2x1
-
-PURPOSE: Multiply a 2x2 matrix with a 2x1 matrix, producing a 2x1 result.
-*****************************************************************************/
-void matrix_multiply_2x2_2x1(double *A, double *B, double *out)
-{
-    /*
-        Formula is:
-
-            out[0] = a * e + b * f
-            out[1] = c * e + d * f
-
-        Where:
-
-            a = A[0]
-            b = A[1]
-            c = A[2]
-            d = A[3]
-
-            e = B[0]
-            f = B[1]
-    */
-
-    out[0] = A[0] * B[0] + A[1] * B[1];
-    out[1] = A[2] * B[0] + A[3] * B[1];
-}
-
-
 /*****************************************************************************
 METHOD:  calculate_point_atmospheric_parameters
 
@@ -726,54 +351,39 @@ int calculate_point_atmospheric_parameters
 (
     Input_Data_t *input,       /* I: Input structure */
     GRID_POINTS *grid_points,  /* I: The coordinate points */
-    MODTRAN_POINTS *modtran_results /* I/O: Atmospheric parameters from 
-                                   MODTRAN */
+    ATMOS_TABLE *atmos_table   /* I/O: Atmospheric parameters from MODTRAN */
 )
 {
     char FUNC_NAME[] = "calculate_point_atmospheric_parameters";
 
     FILE *fd;
-    FILE *used_points_fd;
 
     int i;
     int j;
     int entry;
+    int band;
+    long location;
 
-    double **spectral_response = NULL;
-    double temp_radiance_0;
-    double obs_radiance_0;
-    double temp_radiance_273;
-    double temp_radiance_310;
+    double spectral_response[MAX_THERMAL_BANDS][2 * MAX_SRS_COUNT];
+                       /* Wavelengths followed by responses for each
+                          thermal band */
     int counter;
     int index;
     int num_entries;   /* Number of MODTRAN output results to read and use */
-    int num_srs;       /* Number of spectral response values available */
+    int num_srs[MAX_THERMAL_BANDS]; /* Number of spectral response values
+                                       available */
+    int srs_count;     /* Number of values the reference band SRS has */
 
     char *st_data_dir = NULL;
-    char current_file[PATH_MAX]; /* Used for MODTRAN info (input), MODTRAN data
-                          (input), and atmospheric parameters (output) files */
+    char current_file[PATH_MAX]; /* Used for MODTRAN info (input) and MODTRAN
+                                    data (input) files */
     char srs_file_path[PATH_MAX];
     char msg[PATH_MAX];
 
     double modtran_wavelength;
     double modtran_radiance;
     double zero_temp;
-    double **current_data;
-    double y_0;
-    double y_1;
-    double tau; /* Transmission */
-    double lu;  /* Upwelled Radiance */
-    double ld;  /* Downwelled Radiance */
-
-    /* Variables to hold matrices and the results for the operations perfomed
-       on them */
-    double X_2x2[4];
-    double Xt_2x2[4];
-    double Xt_X_2x2[4];
-    double Inv_Xt_X_2x2[4];
-    double Y_2x1[2];
-    double Xt_Y_2x1[4];
-    double A_2x1[2];
+    double *current_data;
 
     /* Temperature and albedo */
     int temperature[3] = { 273, 310, 000 };
@@ -787,20 +397,11 @@ int calculate_point_atmospheric_parameters
                       FUNC_NAME, FAILURE);
     }
 
-    /* Allocate memory for maximum spectral response count */
-    spectral_response =
-        (double **) allocate_2d_array (2, MAX_SRS_COUNT, sizeof (double));
-    if (spectral_response == NULL)
-    {
-        RETURN_ERROR ("Allocating spectral_response memory",
-                      FUNC_NAME, FAILURE);
-    }
-
     /* Determine the spectral response file to read */
     if (input->meta.instrument == INST_TM
         && input->meta.satellite == SAT_LANDSAT_4)
     {
-        num_srs = L4_TM_SRS_COUNT;
+        srs_count = L4_TM_SRS_COUNT;
 
         snprintf (srs_file_path, sizeof (srs_file_path),
                   "%s/%s", st_data_dir, "L4_Spectral_Response.txt");
@@ -808,7 +409,7 @@ int calculate_point_atmospheric_parameters
     else if (input->meta.instrument == INST_TM
         && input->meta.satellite == SAT_LANDSAT_5)
     {
-        num_srs = L5_TM_SRS_COUNT;
+        srs_count = L5_TM_SRS_COUNT;
 
         snprintf (srs_file_path, sizeof (srs_file_path),
                   "%s/%s", st_data_dir, "L5_Spectral_Response.txt");
@@ -816,7 +417,7 @@ int calculate_point_atmospheric_parameters
     else if (input->meta.instrument == INST_ETM
              && input->meta.satellite == SAT_LANDSAT_7)
     {
-        num_srs = L7_TM_SRS_COUNT;
+        srs_count = L7_TM_SRS_COUNT;
 
         snprintf (srs_file_path, sizeof (srs_file_path),
                   "%s/%s", st_data_dir, "L7_Spectral_Response.txt");
@@ -824,7 +425,7 @@ int calculate_point_atmospheric_parameters
     else if (input->meta.instrument == INST_OLI_TIRS
              && input->meta.satellite == SAT_LANDSAT_8)
     {
-        num_srs = L8_OLITIRS_SRS_COUNT;
+        srs_count = L8_OLITIRS_SRS_COUNT;
 
         snprintf (srs_file_path, sizeof (srs_file_path),
                   "%s/%s", st_data_dir, "L8_Spectral_Response.txt");
@@ -835,75 +436,44 @@ int calculate_point_atmospheric_parameters
     }
 
     /* Read the selected spectral response file */
-    snprintf (msg, sizeof (msg),
-              "Reading Spectral Response File [%s]", srs_file_path);
-    LOG_MESSAGE (msg, FUNC_NAME);
-    fd = fopen (srs_file_path, "r");
-    if (fd == NULL)
+    if (read_spectral_response (srs_file_path, srs_count,
+                                spectral_response[0], &num_srs[0])
+        != SUCCESS)
     {
-        RETURN_ERROR ("Can't open Spectral Response file", FUNC_NAME, FAILURE);
+        RETURN_ERROR ("Reading the thermal band spectral response",
+                      FUNC_NAME, FAILURE);
     }
 
-    for (i = 0; i < num_srs; i++)
+    /* Landsat 8 band 11 integrates the same MODTRAN spectra with its own
+       response */
+    for (band = 1; band < input->num_thermal_bands; band++)
     {
-        if (fscanf (fd, "%lf %lf%*c", &spectral_response[0][i],
-                    &spectral_response[1][i]) == EOF)
+        snprintf (srs_file_path, sizeof (srs_file_path),
+                  "%s/%s", st_data_dir, "L8_B11_Spectral_Response.txt");
+
+        if (read_spectral_response (srs_file_path, 0,
+                                    spectral_response[band], &num_srs[band])
+            != SUCCESS)
         {
-            RETURN_ERROR ("Failed reading spectral response file",
+            RETURN_ERROR ("Reading the thermal band spectral response",
                           FUNC_NAME, FAILURE);
         }
     }
-    fclose (fd);
-
-    /* Calculate Lt for each specific temperature */
-    if (calculate_lt (273, spectral_response, num_srs, &temp_radiance_273)
-        != SUCCESS)
-    {
-        RETURN_ERROR ("Calling calculate_lt for 273K", FUNC_NAME, FAILURE);
-    }
-    if (calculate_lt (310, spectral_response, num_srs, &temp_radiance_310)
-        != SUCCESS)
-    {
-        RETURN_ERROR ("Calling calculate_lt for 310K", FUNC_NAME, FAILURE);
-    }
-
-    /* Implement a = INVERT(TRANSPOSE(x)##x)##TRANSPOSE(x)##y
-       from the IDL code base.
-       Partially implemented here, the variable part is implemented in the
-       looping code. */
-    X_2x2[0] = 1;
-    X_2x2[1] = temp_radiance_273;
-    X_2x2[2] = 1;
-    X_2x2[3] = temp_radiance_310;
-
-    matrix_transpose_2x2(X_2x2, Xt_2x2);
-    matrix_multiply_2x2_2x2(Xt_2x2, X_2x2, Xt_X_2x2);
-    matrix_inverse_2x2(Xt_X_2x2, Inv_Xt_X_2x2);
-
-    /* Output information about the used points, primarily useful for
-       plotting them against the scene */
-    used_points_fd = fopen ("used_points.txt", "w");
-    if (used_points_fd == NULL)
-    {
-        RETURN_ERROR ("Can't open used_points.txt file",
-                      FUNC_NAME, FAILURE);
-    }
 
     /* Iterate through all grid points and heights */
     counter = 0;
     for (i = 0; i < grid_points->count; i++)
     {
         /* Don't process the points that didn't have a MODTRAN run. */
-        if (!modtran_results->points[i].ran_modtran)
+        if (!atmos_table->ran_modtran[i])
         {
             continue;
         }
 
-        fprintf (used_points_fd, "\"%d\"|\"%f\"|\"%f\"\n",
-                 i, grid_points->points[i].map_x, grid_points->points[i].map_y);
-
-        for (j = 0; j < modtran_results->points[i].count; j++)
+        for (j = 0; j < atmos_table->num_elevations; j++)
         {
+            location = (long) i * atmos_table->num_elevations + j;
+
             /* Read the st_modtran.info file for the 000 execution
                (when MODTRAN is run at 0K)
                We read the zero_temp from this file, and also the record count
@@ -913,7 +483,7 @@ int calculate_point_atmospheric_parameters
                 grid_points->points[i].row, grid_points->points[i].col,
                 grid_points->points[i].narr_row,
                 grid_points->points[i].narr_col,
-                modtran_results->points[i].elevations[j].elevation_directory);
+                atmos_table->elevation_directory[location]);
 
             fd = fopen (current_file, "r");
             if (fd == NULL)
@@ -940,10 +510,10 @@ int calculate_point_atmospheric_parameters
             fclose (fd);
 
             /* For each height, read in radiance information for three
-               MODTRAN runs.  Columns of array are organized as follows:
+               MODTRAN runs.  Columns of the table are organized as follows:
                wavelength | 273,0.0 | 310,0.0 | 000,0.1 */
-            current_data =
-                (double **)allocate_2d_array(num_entries, 4, sizeof(double));
+            current_data = malloc (num_entries * MODTRAN_NUM_COLUMNS
+                                   * sizeof (double));
             if (current_data == NULL)
             {
                 RETURN_ERROR ("Allocating current_data memory",
@@ -951,7 +521,8 @@ int calculate_point_atmospheric_parameters
             }
 
             /* Iterate through the three pairs of parameters */
-            for (index = 1; index < 4; index++)
+            for (index = MODTRAN_RADIANCE_273; index < MODTRAN_NUM_COLUMNS;
+                 index++)
             {
                 /* Define MODTRAN data file */
                 snprintf(current_file, sizeof(current_file), 
@@ -959,8 +530,7 @@ int calculate_point_atmospheric_parameters
                     grid_points->points[i].row, grid_points->points[i].col,
                     grid_points->points[i].narr_row,
                     grid_points->points[i].narr_col,
-                    modtran_results->points[i]
-                        .elevations[j].elevation_directory,
+                    atmos_table->elevation_directory[location],
                     temperature[index - 1],
                     albedo[index - 1]);
 
@@ -982,13 +552,16 @@ int calculate_point_atmospheric_parameters
 
                     /* If we are on the first file set the wavelength value
                        for the data array */
-                    if (index == 1)
+                    if (index == MODTRAN_RADIANCE_273)
                     {
-                        current_data[entry][0] = modtran_wavelength;
+                        current_data[entry * MODTRAN_NUM_COLUMNS
+                                     + MODTRAN_WAVELENGTH] =
+                            modtran_wavelength;
                     }
                     /* Place radiance into data array for current point at
                        current height */
-                    current_data[entry][index] = modtran_radiance;
+                    current_data[entry * MODTRAN_NUM_COLUMNS + index] =
+                        modtran_radiance;
 
                 }
                 fclose (fd);
@@ -996,453 +569,146 @@ int calculate_point_atmospheric_parameters
                 counter++;
             }
 
-            /* Parameters from 3 MODTRAN runs
-               Lobs = Lt*tau + Lu; m = tau; b = Lu; */
-            if (calculate_lobs (current_data, spectral_response,
-                                num_entries, num_srs, 1, &y_0)
-                != SUCCESS)
-            {
-                RETURN_ERROR ("Calling calculate_lobs for height y_0",
-                              FUNC_NAME, FAILURE);
-            }
-
-            if (calculate_lobs (current_data, spectral_response,
-                                num_entries, num_srs, 2, &y_1)
-                != SUCCESS)
-            {
-                RETURN_ERROR ("Calling calculate_lobs for height y_1",
-                              FUNC_NAME, FAILURE);
-            }
-
-            /* Implement a = INVERT(TRANSPOSE(x)##x)##TRANSPOSE(x)##y  from
-               the IDL code base.  Partially implemented above and used here. */
-               
-            Y_2x1[0] = y_0;
-            Y_2x1[1] = y_1;
-
-            matrix_multiply_2x2_2x1(Xt_2x2, Y_2x1, Xt_Y_2x1);
-            matrix_multiply_2x2_2x1(Inv_Xt_X_2x2, Xt_Y_2x1, A_2x1);
-
-            tau = A_2x1[1]; /* Transmittance */
-            lu = A_2x1[0];  /* Upwelled Radiance */
-
-            /* Determine Lobs and Lt when MODTRAN was run at 0K - calculate 
-               downwelled */
-            if (calculate_lt (zero_temp, spectral_response, num_srs,
-                              &temp_radiance_0) != SUCCESS)
-            {
-                RETURN_ERROR ("Calling calculate_lt for zero temp (0Kelvin)",
-                              FUNC_NAME, FAILURE);
-            }
-
-            if (calculate_lobs (current_data, spectral_response,
-                                num_entries, num_srs, 3, &obs_radiance_0)
-                != SUCCESS)
+            /* Place results into MODTRAN results array */
+            for (band = 0; band < input->num_thermal_bands; band++)
             {
-                RETURN_ERROR ("Calling calculate_lobs for (0Kelvin)",
-                              FUNC_NAME, FAILURE);
+                if (st_point_parameters (spectral_response[band],
+                        num_srs[band], current_data, num_entries, zero_temp,
+                        &atmos_table->transmission[band][location],
+                        &atmos_table->upwelled_radiance[band][location],
+                        &atmos_table->downwelled_radiance[band][location])
+                    != SUCCESS)
+                {
+                    RETURN_ERROR ("Calling st_point_parameters",
+                                  FUNC_NAME, FAILURE);
+                }
             }
 
-            /* Calculate the downwelled radiance. These are all equivalent:
-               Ld = (((Lobs - Lu) / tau)
-                     - (Lt * WATER_EMISSIVITY)) / (1.0 - WATER_EMISSIVITY)
-               Ld = (((Lobs - Lu) / tau)
-                     - (Lt * WATER_EMISSIVITY)) / WATER_ALBEDO
-               Ld = (((Lobs - Lu) / tau)
-                     - (Lt * WATER_EMISSIVITY)) * INV_WATER_ALBEDO */
-            ld = (((obs_radiance_0 - lu) / tau)
-                  - (temp_radiance_0 * WATER_EMISSIVITY)) * INV_WATER_ALBEDO;
-
-            /* Place results into MODTRAN results array */
-            modtran_results->points[i].elevations[j].transmission = tau;
-            modtran_results->points[i].elevations[j].upwelled_radiance = lu;
-            modtran_results->points[i].elevations[j].downwelled_radiance = ld;
-
             /* Free the allocated memory in the loop */
-            if (free_2d_array ((void **) current_data) != SUCCESS)
-            {
-                RETURN_ERROR ("Freeing memory: current_data\n",
-                              FUNC_NAME, FAILURE);
-            }
+            free (current_data);
             current_data = NULL;
-        } /* END - modtran_results->points[i].count loop */
+        } /* END - atmos_table->num_elevations loop */
     } /* END - count loop */
-    fclose (used_points_fd);
-
-    /* Free allocated memory */
-    if (free_2d_array ((void **) spectral_response) != SUCCESS)
-    {
-        RETURN_ERROR ("Freeing memory: spectral_response\n", FUNC_NAME,
-                      FAILURE);
-    }
-    spectral_response = NULL;
-
-    /* Write atmospheric transmission, upwelled radiance, and downwelled 
-       radiance for each elevation for each point to a file */
-    snprintf (current_file, sizeof (current_file),
-              "atmospheric_parameters.txt");
-    snprintf (msg, sizeof (msg),
-              "Creating Atmospheric Parameters File = [%s]\n", current_file);
-    LOG_MESSAGE (msg, FUNC_NAME);
-    fd = fopen (current_file, "w");
-    if (fd == NULL)
-    {
-        RETURN_ERROR ("Can't open atmospheric_parameters.txt file",
-                      FUNC_NAME, FAILURE);
-    }
-    for (i = 0; i < grid_points->count; i++)
-    {
-        /* Only write parameters for grid points where MODTRAN was run */
-        if (!modtran_results->points[i].ran_modtran)
-        {
-            continue;
-        }
-
-        for (j = 0; j < modtran_results->points[i].count; j++)
-        {
-            fprintf (fd, "%f,%f,%12.9f,%12.9f,%12.9f,%12.9f\n",
-                 modtran_results->points[i].lat,
-                 modtran_results->points[i].lon,
-                 modtran_results->points[i].elevations[j].elevation,
-                 modtran_results->points[i].elevations[j].transmission,
-                 modtran_results->points[i].elevations[j].upwelled_radiance,
-                 modtran_results->points[i].elevations[j].downwelled_radiance);
-        }
-    }
-    fclose (fd);
 
     return SUCCESS;
 }
 
 
-/******************************************************************************
-METHOD:  qsort_grid_compare_function
-
-PURPOSE: A qsort routine that can be used with the GRID_ITEM items to sort by
-         distance
-
-RETURN: int: -1 (a<b), 1 (b<a), 0 (a==b) 
-******************************************************************************/
-int qsort_grid_compare_function
-(
-    const void *grid_item_a,
-    const void *grid_item_b
-)
-{
-    double a = (*(GRID_ITEM*)grid_item_a).distance;
-    double b = (*(GRID_ITEM*)grid_item_b).distance;
-
-    if (a < b)
-        return -1;
-    else if (b < a)
-        return 1;
-
-    return 0;
-}
-
-
-/******************************************************************************
-METHOD:  haversine_distance
-
-PURPOSE: Calculates the great-circle distance between 2 points in meters.
-         The points are given in decimal degrees.  The Haversine formula
-         is used. 
-
-RETURN: double - The great-circle distance in meters between the points.
-
-NOTE: This is based on the haversine_distance function in the ST Python
-      scripts.
-******************************************************************************/
-double haversine_distance
-(
-    double lon_1,  /* I: the longitude for the first point */
-    double lat_1,  /* I: the latitude for the first point */
-    double lon_2,  /* I: the longitude for the second point */
-    double lat_2   /* I: the latitude for the second point */
-)
-{
-
-    double lon_1_radians; /* Longitude for first point in radians */
-    double lat_1_radians; /* Latitude for first point in radians */
-    double lon_2_radians; /* Longitude for second point in radians */
-    double lat_2_radians; /* Latitude for second point in radians */
-    double sin_lon;       /* Intermediate value */
-    double sin_lat;       /* Intermediate value */
-    double sin_lon_sqrd;  /* Intermediate value */
-    double sin_lat_sqrd;  /* Intermediate value */
-
-    /* Convert to radians */
-    lon_1_radians = lon_1 * RADIANS_PER_DEGREE;
-    lat_1_radians = lat_1 * RADIANS_PER_DEGREE;
-    lon_2_radians = lon_2 * RADIANS_PER_DEGREE;
-    lat_2_radians = lat_2 * RADIANS_PER_DEGREE;
-
-    /* Figure out some sines */
-    sin_lon = sin((lon_2_radians - lon_1_radians) / 2.0);
-    sin_lat = sin((lat_2_radians - lat_1_radians) / 2.0);
-    sin_lon_sqrd = sin_lon * sin_lon;
-    sin_lat_sqrd = sin_lat * sin_lat;
-
-    /* Compute and return the distance */
-    return EQUATORIAL_RADIUS * 2 + asin(sqrt(sin_lat_sqrd 
-        + cos(lat_1_radians) * cos(lat_2_radians) * sin_lon_sqrd));
-}
-
-/******************************************************************************
-METHOD:  interpolate_to_height
-
-PURPOSE: Interpolate to height of current pixel
-******************************************************************************/
-void interpolate_to_height
-(
-    MODTRAN_POINT modtran_point, /* I: results from MODTRAN runs for a point */
-    double interpolate_to,    /* I: current landsat pixel height */
-    double *at_height         /* O: interpolated height for point */
-)
-{
-    int parameter;
-    int elevation;
-    int below = 0;
-    int above = 0;
-
-    double below_parameters[AHP_NUM_PARAMETERS];
-    double above_parameters[AHP_NUM_PARAMETERS];
-
-    double slope;
-    double intercept;
-
-    double above_height;
-    double inv_height_diff; /* To remove the multiple divisions */
-
-    /* Find the height to use that is below the interpolate_to height */
-    for (elevation = 0; elevation < modtran_point.count; elevation++)
-    {
-        if (modtran_point.elevations[elevation].elevation < interpolate_to)
-        {
-            below = elevation; /* Last match will always be the one we want */
-        }
-    }
-
-    /* Find the height to use that is equal to or above the interpolate_to
-       height.  It will always be the same or the next height */ 
-    above = below; /* Start with the same */
-    if (above != (modtran_point.count - 1))
-    {
-        /* Not the last height */
-
-        /* Check to make sure that we are not less that the below height,
-           indicating that our interpolate_to height is below the first
-           height */
-        if (! (interpolate_to < modtran_point.elevations[above].elevation))
-        {
-            /* Use the next height, since it will be equal to or above our
-               interpolate_to height */
-            above++;
-        }
-        /* Else - We are at the first height, so use that for both above and
-                  below */
-    }
-    /* Else - We are at the last height, so use that for both above and
-              below */
-
-    below_parameters[AHP_TRANSMISSION] =
-        modtran_point.elevations[below].transmission;
-    below_parameters[AHP_UPWELLED_RADIANCE] =
-        modtran_point.elevations[below].upwelled_radiance;
-    below_parameters[AHP_DOWNWELLED_RADIANCE] =
-        modtran_point.elevations[below].downwelled_radiance;
-
-    if (above == below)
-    {
-        /* Use the below parameters since the same */
-        at_height[AHP_TRANSMISSION] =
-            below_parameters[AHP_TRANSMISSION];
-        at_height[AHP_UPWELLED_RADIANCE] =
-            below_parameters[AHP_UPWELLED_RADIANCE];
-        at_height[AHP_DOWNWELLED_RADIANCE] =
-            below_parameters[AHP_DOWNWELLED_RADIANCE];
-    }
-    else
-    {
-        /* Interpolate between the heights for each parameter */
-        above_height = modtran_point.elevations[above].elevation;
-        inv_height_diff = 1.0 / (above_height
-                                 - modtran_point.elevations[below].elevation);
-
-        above_parameters[AHP_TRANSMISSION] =
-            modtran_point.elevations[above].transmission;
-        above_parameters[AHP_UPWELLED_RADIANCE] =
-            modtran_point.elevations[above].upwelled_radiance;
-        above_parameters[AHP_DOWNWELLED_RADIANCE] =
-            modtran_point.elevations[above].downwelled_radiance;
-
-        for (parameter = 0; parameter < AHP_NUM_PARAMETERS; parameter++)
-        {
-            slope = (above_parameters[parameter] - below_parameters[parameter])
-                    * inv_height_diff;
-
-            intercept = above_parameters[parameter] - slope * above_height;
-
-            at_height[parameter] = slope * interpolate_to + intercept;
-        }
-    }
-}
-
-
-/******************************************************************************
-METHOD:  interpolate_to_location
-
-PURPOSE: Interpolate to location of current pixel
-******************************************************************************/
-void interpolate_to_location
-(
-    GRID_POINTS *points,         /* I: The coordinate points */
-    int *vertices,               /* I: The vertices for the points to use */
-    double **at_height,          /* I: current height atmospheric results */
-    double interpolate_easting,  /* I: interpolate to easting */
-    double interpolate_northing, /* I: interpolate to northing */
-    double *parameters           /* O: interpolated pixel atmospheric 
-                                       parameters */
-)
-{
-    int point;
-    int parameter;
-
-    double inv_h[NUM_CELL_POINTS];
-    double w[NUM_CELL_POINTS];
-    double total = 0.0;
-
-    /* Shepard's method */
-    for (point = 0; point < NUM_CELL_POINTS; point++)
-    {
-        inv_h[point] = 1.0 / sqrt (((points->points[vertices[point]].map_x
-                                     - interpolate_easting)
-                                    * (points->points[vertices[point]].map_x
-                                       - interpolate_easting))
-                                   +
-                                   ((points->points[vertices[point]].map_y
-                                     - interpolate_northing)
-                                    * (points->points[vertices[point]].map_y
-                                       - interpolate_northing)));
-
-        total += inv_h[point];
-    }
-
-    /* Determine the weights for each vertex */
-    for (point = 0; point < NUM_CELL_POINTS; point++)
-    {
-        w[point] = inv_h[point] / total;
-    }
-
-    /* For each parameter apply each vertex's weighted value */
-    for (parameter = 0; parameter < AHP_NUM_PARAMETERS; parameter++)
-    {
-        parameters[parameter] = 0.0;
-        for (point = 0; point < NUM_CELL_POINTS; point++)
-        {
-            parameters[parameter] += (w[point] * at_height[point][parameter]);
-        }
-    }
-}
-
-
 /*****************************************************************************
-METHOD:  determine_grid_point_distances
+METHOD:  load_point_atmospheric_parameters
 
-PURPOSE: Determines the distances for the current set of grid points.
+PURPOSE: Read transmission, upwelled radiance, and downwelled radiance at
+         each height for each NARR point that is used, from a file made
+         without running MODTRAN (e.g. by st_surrogate.py).  The file has
+         the layout of atmospheric_parameters.txt, and its lines must be in
+         the same point and height order.
 
-NOTE: The indexes of the grid points are assumed to be populated.
+RETURN: SUCCESS
+        FAILURE
 *****************************************************************************/
-void determine_grid_point_distances
+int load_point_atmospheric_parameters
 (
-    GRID_POINTS *points,       /* I: All the available points */
-    double longitude,          /* I: Longitude of the current line/sample */
-    double latitude,           /* I: Latitude of the current line/sample */
-    int num_grid_points,       /* I: The number of grid points to operate on */
-    GRID_ITEM *grid_points     /* I/O: Sorted to determine the center grid
-                                       point */
+    char *parameters_filename, /* I: File holding the point parameters */
+    GRID_POINTS *grid_points,  /* I: The coordinate points */
+    ATMOS_TABLE *atmos_table   /* I/O: Atmospheric parameters for the
+                                     points */
 )
 {
-    int point;
+    char FUNC_NAME[] = "load_point_atmospheric_parameters";
+
+    FILE *fd;
+
+    int i;
+    int j;
+    long location;
 
-    /* Populate the distances to the grid points */
-    for (point = 0; point < num_grid_points; point++)
-    {
-        grid_points[point].distance = haversine_distance (
-            points->points[grid_points[point].index].lon,
-            points->points[grid_points[point].index].lat,
-            longitude, latitude);
-    }
-}
+    double lat;
+    double lon;
+    double elevation;
 
+    char msg[PATH_MAX];
 
-/*****************************************************************************
-METHOD:  determine_center_grid_point
+    snprintf (msg, sizeof (msg),
+              "Reading Point Atmospheric Parameters File [%s]",
+              parameters_filename);
+    LOG_MESSAGE (msg, FUNC_NAME);
+    fd = fopen (parameters_filename, "r");
+    if (fd == NULL)
+    {
+        RETURN_ERROR ("Can't open point atmospheric parameters file",
+                      FUNC_NAME, FAILURE);
+    }
 
-PURPOSE: Determines the index of the center point from the current set of grid
-         points.
+    for (i = 0; i < grid_points->count; i++)
+    {
+        if (!atmos_table->ran_modtran[i])
+        {
+            continue;
+        }
 
-NOTE: The indexes of the grid points are assumed to be populated.
+        for (j = 0; j < atmos_table->num_elevations; j++)
+        {
+            location = (long) i * atmos_table->num_elevations + j;
 
-RETURN: type = int
-    Value  Description
-    -----  -------------------------------------------------------------------
-    index  The index of the center point
-*****************************************************************************/
-int determine_center_grid_point
-(
-    GRID_POINTS *points,       /* I: All the available points */
-    double longitude,          /* I: Longitude of the current line/sample */
-    double latitude,           /* I: Latitude of the current line/sample */
-    int num_grid_points,       /* I: The number of grid points to operate on */
-    GRID_ITEM *grid_points     /* I/O: Sorted to determine the center grid
-                                       point */
-)
-{
-    determine_grid_point_distances (points, longitude, latitude,
-                                    num_grid_points, grid_points);
+            if (fscanf (fd, "%lf,%lf,%lf,%lf,%lf,%lf%*c", &lat, &lon,
+                    &elevation,
+                    &atmos_table->transmission[0][location],
+                    &atmos_table->upwelled_radiance[0][location],
+                    &atmos_table->downwelled_radiance[0][location]) != 6)
+            {
+                RETURN_ERROR ("Failed reading point atmospheric parameters",
+                              FUNC_NAME, FAILURE);
+            }
 
-    /* Sort them to find the closest one */
-    qsort (grid_points, num_grid_points, sizeof (GRID_ITEM),
-           qsort_grid_compare_function);
+            /* A file written for other points or heights would silently
+               place its parameters in the wrong cells */
+            if (fabs (lat - atmos_table->lat[i]) > 0.00001
+                || fabs (lon - atmos_table->lon[i]) > 0.00001
+                || fabs (elevation - atmos_table->elevation[location])
+                   > 0.00001)
+            {
+                snprintf (msg, sizeof (msg),
+                          "Point atmospheric parameters for point %d height"
+                          " %d do not match the grid points", i, j);
+                RETURN_ERROR (msg, FUNC_NAME, FAILURE);
+            }
+        }
+    }
+    fclose (fd);
 
-    return grid_points[0].index;
+    return SUCCESS;
 }
 
 
-/*****************************************************************************
-METHOD:  determine_first_center_grid_point
+/* calculate_pixel_atmospheric_parameters functions */
 
-PURPOSE: Determines the index of the first center point to use for the current
-         line.  Only called when the fist valid point for a line is
-         encountered.  The point is determined from all of the available
-         points.
+/*****************************************************************************
+METHOD:  atmos_table_grid
 
-RETURN: type = int
-    Value  Description
-    -----  -------------------------------------------------------------------
-    index  The index of the center point
+PURPOSE: Point the atmospheric engine's view of the grid at the locations
+         and the parameters of one thermal band in the table.  Nothing is
+         copied, the table already has the layout of the engine.
 *****************************************************************************/
-int determine_first_center_grid_point
+static void atmos_table_grid
 (
-    GRID_POINTS *points,       /* I: All the available points */
-    double longitude,          /* I: Longitude of the current line/sample */
-    double latitude,           /* I: Latitude of the current line/sample */
-    GRID_ITEM *grid_points     /* I/O: Memory passed in, populated and
-                                       sorted to determine the center grid
-                                       point */
+    GRID_POINTS *points,       /* I: The coordinate points */
+    ATMOS_TABLE *atmos_table,  /* I: results from MODTRAN runs */
+    int band,                  /* I: thermal band of the parameters */
+    ST_ATMOS_GRID *grid        /* O: engine view of the grid */
 )
 {
-    int point;
-
-    /* Assign the point indexes for all grid points */
-    for (point = 0; point < points->count; point++)
-    {
-        grid_points[point].index = point;
-    }
-
-    return determine_center_grid_point (points, longitude, latitude,
-                                        points->count, grid_points);
+    grid->count = atmos_table->count;
+    grid->rows = points->rows;
+    grid->cols = points->cols;
+    grid->num_elevations = atmos_table->num_elevations;
+    grid->lon = atmos_table->lon;
+    grid->lat = atmos_table->lat;
+    grid->map_x = atmos_table->map_x;
+    grid->map_y = atmos_table->map_y;
+    grid->elevation = atmos_table->elevation;
+    grid->transmission = atmos_table->transmission[band];
+    grid->upwelled_radiance = atmos_table->upwelled_radiance[band];
+    grid->downwelled_radiance = atmos_table->downwelled_radiance[band];
 }
 
 
@@ -1450,7 +716,15 @@ int determine_first_center_grid_point
 METHOD:  calculate_pixel_atmospheric_parameters
 
 PURPOSE: Generate transmission, upwelled radiance, and downwelled radiance at
-         each Landsat pixel
+         each Landsat pixel for each thermal band
+
+         With a geometry cache, the interpolation cells of the pixels an
+         earlier scene of the footprint had are read from it, and only the
+         pixels it did not have are located.
+
+         The cells are selected from the pixel longitude and latitude, or
+         with map_space_cells from the pixel map coordinates, which leaves
+         the geodetic conversion of every pixel out.
 
 RETURN: SUCCESS
         FAILURE
@@ -1461,66 +735,70 @@ int calculate_pixel_atmospheric_parameters
     GRID_POINTS *points,       /* I: The coordinate points */
     char *xml_filename,        /* I: XML filename */
     Espa_internal_meta_t xml_metadata, /* I: XML metadata */
-    MODTRAN_POINTS *modtran_results /* I: results from MODTRAN runs */
+    ATMOS_TABLE *atmos_table,  /* I: results from MODTRAN runs */
+    char *geometry_cache,      /* I: footprint directory of the geometry
+                                     cache, empty when not used */
+    bool map_space_cells       /* I: select the cells in map coordinates */
 )
 {
     char FUNC_NAME[] = "calculate_pixel_atmospheric_parameters";
 
     int line;
     int sample;
-    int status;
-
-    bool first_sample;
-
-    double easting;
-    double northing;
+    int band;
+    int num_bands = input->num_thermal_bands;
+    bool use_cache = (strlen(geometry_cache) > 0);
+    long new_cells = 0;        /* Cells which were not in the cache */
 
     Geoloc_t *space = NULL;    /* Geolocation information */
     Space_def_t space_def;     /* Space definition (projection values) */
     Img_coord_float_t img;     /* Floating point image coordinates */
     Geo_coord_t geo;           /* Geodetic coordinates */
-    float longitude;           /* Longitude */
-    float latitude;            /* Latitude */
+    float *longitude = NULL;   /* Longitude for each sample of a line */
+    float *latitude = NULL;    /* Latitude for each sample of a line */
+    int16_t *cells = NULL;     /* Cell of each pixel with the cache, or of
+                                  each sample of a line without it */
+    int16_t *line_cells = NULL;
 
-    GRID_ITEM *grid_points = NULL;
+    ST_ATMOS_GRID grid[MAX_THERMAL_BANDS]; /* Engine view of the grid points
+                                              for each thermal band */
 
-    int vertex;
-    int current_index;
-    int center_point;
-    int cell_vertices[NUM_CELL_POINTS];
+    Intermediate_Data_t inter[MAX_THERMAL_BANDS];
+    St_metadata_transaction_t transaction; /* intermediate band additions */
 
-    double **at_height = NULL;
-    double parameters[AHP_NUM_PARAMETERS];
-    double avg_distance_ll;
-    double avg_distance_ul;
-    double avg_distance_ur;
-    double avg_distance_lr;
-
-    Intermediate_Data_t inter;
+    /* Band pointers handed to the reading and the engine */
+    float *band_thermal[MAX_THERMAL_BANDS];
+    float *line_transmittance[MAX_THERMAL_BANDS];
+    float *line_upwelled[MAX_THERMAL_BANDS];
+    float *line_downwelled[MAX_THERMAL_BANDS];
 
     int16_t *elevation_data = NULL; /* input elevation data in meters */
 
-    double current_height;
+    char band_name[MAX_STR_LEN];
     char msg[MAX_STR_LEN];
 
     /* Use local variables for cleaner code */
-    int num_cols = points->cols;
-    int num_points = points->count;
     int pixel_count = input->lines * input->samples;
     int pixel_line_loc;
     int pixel_loc;
 
-    /* Open the intermedate data files */
-    if (open_intermediate(input, &inter) != SUCCESS)
+    for (band = 0; band < num_bands; band++)
     {
-        RETURN_ERROR("Opening intermediate data files", FUNC_NAME, FAILURE);
-    }
+        /* Open the intermedate data files */
+        if (open_intermediate(input, band, &inter[band]) != SUCCESS)
+        {
+            RETURN_ERROR("Opening intermediate data files", FUNC_NAME,
+                         FAILURE);
+        }
 
-    /* Allocate memory for the intermedate data */
-    if (allocate_intermediate(&inter, pixel_count) != SUCCESS)
-    {
-        RETURN_ERROR("Allocating memory for intermediate data",
-                     FUNC_NAME, FAILURE);
+        /* Allocate memory for the intermedate data */
+        if (allocate_intermediate(&inter[band], pixel_count) != SUCCESS)
+        {
+            RETURN_ERROR("Allocating memory for intermediate data",
+                         FUNC_NAME, FAILURE);
+        }
+
+        band_thermal[band] = inter[band].band_thermal;
     }
 
     /* Allocate memory for elevation */
@@ -1530,25 +808,55 @@ int calculate_pixel_atmospheric_parameters
         RETURN_ERROR("Allocating elevation_data memory", FUNC_NAME, FAILURE);
     }
 
-    /* Allocate memory for at_height */
-    at_height = (double **) allocate_2d_array (NUM_CELL_POINTS,
-                                               AHP_NUM_PARAMETERS,
-                                               sizeof (double));
-    if (at_height == NULL)
+    /* Allocate memory for the geographic coordinates of a line */
+    if (!map_space_cells)
+    {
+        longitude = malloc(input->samples * sizeof(float));
+        latitude = malloc(input->samples * sizeof(float));
+        if (longitude == NULL || latitude == NULL)
+        {
+            RETURN_ERROR("Allocating longitude/latitude memory", FUNC_NAME,
+                         FAILURE);
+        }
+    }
+
+    /* The cell indexes are kept in 16 bits */
+    if (points->count > INT16_MAX)
+    {
+        RETURN_ERROR("Too many grid points", FUNC_NAME, FAILURE);
+    }
+
+    if (use_cache)
+    {
+        cells = malloc((long) pixel_count * sizeof(int16_t));
+        if (cells == NULL)
+        {
+            RETURN_ERROR("Allocating cells memory", FUNC_NAME, FAILURE);
+        }
+
+        if (read_geometry_cache(geometry_cache, map_space_cells, input,
+                                points, cells) != SUCCESS)
+        {
+            RETURN_ERROR("Reading the geometry cache", FUNC_NAME, FAILURE);
+        }
+    }
+    else
     {
-        RETURN_ERROR ("Allocating at_height memory", FUNC_NAME, FAILURE);
+        cells = malloc(input->samples * sizeof(int16_t));
+        if (cells == NULL)
+        {
+            RETURN_ERROR("Allocating cells memory", FUNC_NAME, FAILURE);
+        }
     }
 
-    /* Allocate memory to hold the grid_points to the first sample of data for
-       the current line */
-    grid_points = malloc (num_points * sizeof (GRID_ITEM));
-    if (grid_points == NULL)
+    /* The point results for the atmospheric engine */
+    for (band = 0; band < num_bands; band++)
     {
-        RETURN_ERROR ("Allocating grid_points memory", FUNC_NAME, FAILURE);
+        atmos_table_grid(points, atmos_table, band, &grid[band]);
     }
 
     /* Read thermal and elevation data into memory */
-    if (read_input(input, inter.band_thermal, elevation_data, pixel_count)
+    if (read_input(input, band_thermal, elevation_data, pixel_count)
         != SUCCESS)
     {
         RETURN_ERROR ("Reading thermal and elevation bands", FUNC_NAME,
@@ -1556,15 +864,19 @@ int calculate_pixel_atmospheric_parameters
     }
 
     /* Get geolocation space definition */
-    if (!get_geoloc_info(&xml_metadata, &space_def))
-    {
-        RETURN_ERROR ("Getting space metadata from XML file", FUNC_NAME,
-                     FAILURE);
-    }
-    space = setup_mapping(&space_def);
-    if (space == NULL)
+    if (!map_space_cells)
     {
-        RETURN_ERROR ("Setting up geolocation mapping", FUNC_NAME, FAILURE);
+        if (!get_geoloc_info(&xml_metadata, &space_def))
+        {
+            RETURN_ERROR ("Getting space metadata from XML file", FUNC_NAME,
+                         FAILURE);
+        }
+        space = setup_mapping(&space_def);
+        if (space == NULL)
+        {
+            RETURN_ERROR ("Setting up geolocation mapping", FUNC_NAME,
+                          FAILURE);
+        }
     }
 
     /* Show some status messages */
@@ -1587,15 +899,34 @@ int calculate_pixel_atmospheric_parameters
 
         pixel_line_loc = line * input->samples;
 
-        /* Set first_sample to be true */
-        first_sample = true;
+        if (use_cache)
+        {
+            line_cells = &cells[pixel_line_loc];
+        }
+        else
+        {
+            line_cells = cells;
+            for (sample = 0; sample < input->samples; sample++)
+            {
+                line_cells[sample] = ST_CELL_UNKNOWN;
+            }
+        }
+
+        /* Determine latitude and longitude for each non-fill sample without
+           a cell, the reference thermal band decides the fill for all of
+           the bands */
         for (sample = 0; sample < input->samples; sample++)
         {
             pixel_loc = pixel_line_loc + sample;
 
-            if (inter.band_thermal[pixel_loc] != ST_NO_DATA_VALUE)
+            if (inter[0].band_thermal[pixel_loc] != ST_NO_DATA_VALUE
+                && line_cells[sample] == ST_CELL_UNKNOWN)
             {
-                /* Determine latitude and longitude for current line/sample */
+                new_cells++;
+
+                if (map_space_cells)
+                    continue;
+
                 img.l = line;
                 img.s = sample;
                 img.is_fill = false;
@@ -1604,293 +935,207 @@ int calculate_pixel_atmospheric_parameters
                     RETURN_ERROR ("Mapping from line/sample to longitude/"
                         "latitude", FUNC_NAME, FAILURE);
                 }
-                longitude = geo.lon * DEGREES_PER_RADIAN;
-                latitude = geo.lat * DEGREES_PER_RADIAN;
-
-                easting = input->meta.ul_map_corner.x
-                    + (sample * input->x_pixel_size);
-                northing = input->meta.ul_map_corner.y
-                    - (line * input->y_pixel_size);
-
-                if (first_sample)
-                {
-                    /* Determine the first center point from all of the
-                       available points */
-                    center_point = determine_first_center_grid_point(
-                                       points, longitude, latitude,
-                                       grid_points);
-
-                    /* Set first_sample to be false */
-                    first_sample = false;
-                }
-                else
-                {
-                    /* Determine the center point from the current 9 grid
-                       points for the current line/sample */
-                    center_point = determine_center_grid_point(
-                                       points, longitude, latitude,
-                                       NUM_GRID_POINTS, grid_points);
-                }
-
-                /* Fix the index values, since the points are from a new line
-                   or were messed up during determining the center point */
-                grid_points[CC_GRID_POINT].index = center_point;
-                grid_points[LL_GRID_POINT].index = center_point - 1 - num_cols;
-                grid_points[LC_GRID_POINT].index = center_point - 1;
-                grid_points[UL_GRID_POINT].index = center_point - 1 + num_cols;
-                grid_points[UC_GRID_POINT].index = center_point + num_cols;
-                grid_points[UR_GRID_POINT].index = center_point + 1 + num_cols;
-                grid_points[RC_GRID_POINT].index = center_point + 1;
-                grid_points[LR_GRID_POINT].index = center_point + 1 - num_cols;
-                grid_points[DC_GRID_POINT].index = center_point - num_cols;
-
-                /* Fix the distances, since the points are from a new line or
-                   were messed up during determining the center point */
-                determine_grid_point_distances (points, longitude, latitude,
-                                                NUM_GRID_POINTS, grid_points);
-
-                /* Determine the average distances for each quadrant around
-                   the center point. We only need to use the three outer grid 
-                   points */
-                avg_distance_ll = (grid_points[DC_GRID_POINT].distance
-                                   + grid_points[LL_GRID_POINT].distance
-                                   + grid_points[LC_GRID_POINT].distance)
-                                  / 3.0;
-
-                avg_distance_ul = (grid_points[LC_GRID_POINT].distance
-                                   + grid_points[UL_GRID_POINT].distance
-                                   + grid_points[UC_GRID_POINT].distance)
-                                  / 3.0;
-
-                avg_distance_ur = (grid_points[UC_GRID_POINT].distance
-                                   + grid_points[UR_GRID_POINT].distance
-                                   + grid_points[RC_GRID_POINT].distance)
-                                  / 3.0;
-
-                avg_distance_lr = (grid_points[RC_GRID_POINT].distance
-                                   + grid_points[LR_GRID_POINT].distance
-                                   + grid_points[DC_GRID_POINT].distance)
-                                  / 3.0;
-
-                /* Determine which quadrant is closer and setup the cell
-                   vertices to interpolate over based on that */
-                if (avg_distance_ll < avg_distance_ul
-                    && avg_distance_ll < avg_distance_ur
-                    && avg_distance_ll < avg_distance_lr)
-                { /* LL Cell */
-                    cell_vertices[LL_POINT] = center_point - 1 - num_cols;
-                }
-                else if (avg_distance_ul < avg_distance_ur
-                    && avg_distance_ul < avg_distance_lr)
-                { /* UL Cell */
-                    cell_vertices[LL_POINT] = center_point - 1;
-                }
-                else if (avg_distance_ur < avg_distance_lr)
-                { /* UR Cell */
-                    cell_vertices[LL_POINT] = center_point;
-                }
-                else
-                { /* LR Cell */
-                    cell_vertices[LL_POINT] = center_point - num_cols;
-                }
-
-                /* UL Point */
-                cell_vertices[UL_POINT] = cell_vertices[LL_POINT] + num_cols;
-                /* UR Point */
-                cell_vertices[UR_POINT] = cell_vertices[UL_POINT] + 1;
-                /* LR Point */
-                cell_vertices[LR_POINT] = cell_vertices[LL_POINT] + 1;
-
-#if OUTPUT_CELL_DESIGNATION_BAND
-                inter.band_cell[pixel_loc] = cell_vertices[LL_POINT];
-#endif
-
-                /* Convert height from m to km -- Same as 1.0 / 1000.0 */
-                current_height = (double) elevation_data[pixel_loc] * 0.001;
-
-                /* Interpolate three parameters to that height at each of the
-                   four closest points */
-                for (vertex = 0; vertex < NUM_CELL_POINTS; vertex++)
-                {
-                    current_index = cell_vertices[vertex];
-
-                    /* Interpolate three atmospheric parameters to current
-                       height */
-                    interpolate_to_height(
-                        modtran_results->points[current_index],
-                        current_height, at_height[vertex]);
-                }
+                longitude[sample] = geo.lon * DEGREES_PER_RADIAN;
+                latitude[sample] = geo.lat * DEGREES_PER_RADIAN;
+            }
+        }
 
-                /* Interpolate parameters at appropriate height to location of
-                   current pixel */
-                interpolate_to_location(points, cell_vertices, at_height,
-                                        easting, northing, &parameters[0]);
-
-                /* Convert radiances to W*m^(-2)*sr(-1) */
-                inter.band_upwelled[pixel_loc] =
-                    parameters[AHP_UPWELLED_RADIANCE] * 10000.0;
-                inter.band_downwelled[pixel_loc] =
-                    parameters[AHP_DOWNWELLED_RADIANCE] * 10000.0;
-                inter.band_transmittance[pixel_loc] =
-                    parameters[AHP_TRANSMISSION];
-            } /* END - if not FILL */
-            else
+        if (map_space_cells)
+        {
+            if (st_pixel_cells_map(&grid[0], 1, input->samples, line,
+                                   input->meta.ul_map_corner.x,
+                                   input->meta.ul_map_corner.y,
+                                   input->x_pixel_size, input->y_pixel_size,
+                                   &inter[0].band_thermal[pixel_line_loc],
+                                   line_cells) != SUCCESS)
             {
-                inter.band_upwelled[pixel_loc] = ST_NO_DATA_VALUE;
-                inter.band_downwelled[pixel_loc] = ST_NO_DATA_VALUE;
-                inter.band_transmittance[pixel_loc] = ST_NO_DATA_VALUE;
+                RETURN_ERROR ("Calling st_pixel_cells_map", FUNC_NAME,
+                              FAILURE);
+            }
+        }
+        else if (st_pixel_cells(&grid[0], 1, input->samples, longitude,
+                                latitude,
+                                &inter[0].band_thermal[pixel_line_loc],
+                                line_cells) != SUCCESS)
+        {
+            RETURN_ERROR ("Calling st_pixel_cells", FUNC_NAME, FAILURE);
+        }
 
 #if OUTPUT_CELL_DESIGNATION_BAND
-                inter.band_cell[pixel_loc] = 0;
+        for (sample = 0; sample < input->samples; sample++)
+        {
+            if (line_cells[sample] == ST_CELL_UNKNOWN)
+                inter[0].band_cell[pixel_line_loc + sample] = 0;
+            else
+                inter[0].band_cell[pixel_line_loc + sample] =
+                    line_cells[sample];
+        }
 #endif
-            }
-        } /* END - for sample */
 
+        for (band = 0; band < num_bands; band++)
+        {
+            line_transmittance[band] =
+                &inter[band].band_transmittance[pixel_line_loc];
+            line_upwelled[band] = &inter[band].band_upwelled[pixel_line_loc];
+            line_downwelled[band] =
+                &inter[band].band_downwelled[pixel_line_loc];
+        }
+
+        /* Interpolate the point results to each pixel of the line, sharing
+           the pixel geometry between the thermal bands */
+        if (st_pixel_parameters_cells(grid, num_bands, 1, input->samples,
+                line, input->meta.ul_map_corner.x,
+                input->meta.ul_map_corner.y,
+                input->x_pixel_size, input->y_pixel_size,
+                &inter[0].band_thermal[pixel_line_loc],
+                &elevation_data[pixel_line_loc], line_cells,
+                line_transmittance, line_upwelled, line_downwelled)
+            != SUCCESS)
+        {
+            RETURN_ERROR ("Calling st_pixel_parameters_cells", FUNC_NAME,
+                          FAILURE);
+        }
     } /* END - for line */
 
-    /* Write out the temporary intermediate output files */
-    if (write_intermediate(&inter, pixel_count) != SUCCESS)
+    if (use_cache)
     {
-        sprintf (msg, "Writing to intermediate data files");
-        RETURN_ERROR(msg, FUNC_NAME, FAILURE);
-    }
-
-    /* Free allocated memory */
-    free(grid_points);
-    free(elevation_data);
+        snprintf(msg, sizeof(msg), "Located %ld pixels not in the geometry"
+                 " cache", new_cells);
+        LOG_MESSAGE(msg, FUNC_NAME);
 
-    status = free_2d_array((void **)at_height);
-    if (status != SUCCESS)
-    {
-        ERROR_MESSAGE("Freeing memory: at_height\n", FUNC_NAME);
+        /* Keep the cells for the next scene of the footprint, which the
+           cells of this scene are added to */
+        if (new_cells > 0
+            && write_geometry_cache(geometry_cache, map_space_cells, input,
+                                    points, cells) != SUCCESS)
+        {
+            RETURN_ERROR("Writing the geometry cache", FUNC_NAME, FAILURE);
+        }
     }
+    free(cells);
 
-    free_intermediate(&inter);
-
-    /* Close the intermediate binary files */
-    if (close_intermediate(&inter) != SUCCESS)
+    for (band = 0; band < num_bands; band++)
     {
-        sprintf (msg, "Closing file intermediate data files");
-        RETURN_ERROR(msg, FUNC_NAME, FAILURE);
-    }
+        /* Write out the temporary intermediate output files */
+        if (write_intermediate(&inter[band], pixel_count) != SUCCESS)
+        {
+            sprintf (msg, "Writing to intermediate data files");
+            RETURN_ERROR(msg, FUNC_NAME, FAILURE);
+        }
 
-    /* Add the ST intermediate bands to the metadata file */
-    if (add_st_band_product(xml_filename,
-                             input->reference_band_name,
-                             inter.thermal_filename,
-                             ST_THERMAL_RADIANCE_PRODUCT_NAME,
-                             ST_THERMAL_RADIANCE_BAND_NAME,
-                             ST_THERMAL_RADIANCE_SHORT_NAME,
-                             ST_THERMAL_RADIANCE_LONG_NAME,
-                             ST_RADIANCE_UNITS,
-                             0.0, 0.0) != SUCCESS)
-    {
-        ERROR_MESSAGE ("Failed adding ST thermal radiance band product", 
-            FUNC_NAME);
-    }
+        free_intermediate(&inter[band]);
 
-    if (add_st_band_product(xml_filename,
-                             input->reference_band_name,
-                             inter.transmittance_filename,
-                             ST_ATMOS_TRANS_PRODUCT_NAME,
-                             ST_ATMOS_TRANS_BAND_NAME,
-                             ST_ATMOS_TRANS_SHORT_NAME,
-                             ST_ATMOS_TRANS_LONG_NAME,
-                             ST_RADIANCE_UNITS,
-                             0.0, 0.0) != SUCCESS)
-    {
-        ERROR_MESSAGE ("Failed adding ST atmospheric transmission band "
-            "product", FUNC_NAME);
+        /* Close the intermediate binary files */
+        if (close_intermediate(&inter[band]) != SUCCESS)
+        {
+            sprintf (msg, "Closing file intermediate data files");
+            RETURN_ERROR(msg, FUNC_NAME, FAILURE);
+        }
     }
 
-    if (add_st_band_product(xml_filename,
-                             input->reference_band_name,
-                             inter.upwelled_filename,
-                             ST_UPWELLED_RADIANCE_PRODUCT_NAME,
-                             ST_UPWELLED_RADIANCE_BAND_NAME,
-                             ST_UPWELLED_RADIANCE_SHORT_NAME,
-                             ST_UPWELLED_RADIANCE_LONG_NAME,
-                             ST_RADIANCE_UNITS,
-                             0.0, 0.0) != SUCCESS)
-    {
-        ERROR_MESSAGE ("Failed adding ST upwelled radiance band product", 
-            FUNC_NAME);
-    }
+    /* Free allocated memory */
+    free(longitude);
+    free(latitude);
+    free(elevation_data);
 
-    if (add_st_band_product(xml_filename,
-                             input->reference_band_name,
-                             inter.downwelled_filename,
-                             ST_DOWNWELLED_RADIANCE_PRODUCT_NAME,
-                             ST_DOWNWELLED_RADIANCE_BAND_NAME,
-                             ST_DOWNWELLED_RADIANCE_SHORT_NAME,
-                             ST_DOWNWELLED_RADIANCE_LONG_NAME,
-                             ST_RADIANCE_UNITS,
-                             0.0, 0.0) != SUCCESS)
-    {
-        ERROR_MESSAGE ("Failed adding ST downwelled radiance band product", 
+    /* Add the ST intermediate bands to the metadata file, which is updated
+       once for all of them */
+    if (begin_st_metadata_transaction(&transaction, xml_filename,
+                                      input->reference_band_name,
+                                      ST_INTERMEDIATE_BAND_COUNT * num_bands)
+        != SUCCESS)
+    {
+        ERROR_MESSAGE ("Failed reading the metadata for the ST band products",
             FUNC_NAME);
     }
+    else
+    {
+        for (band = 0; band < num_bands; band++)
+        {
+            snprintf(band_name, sizeof(band_name), "%s%s",
+                     ST_THERMAL_RADIANCE_BAND_NAME, inter[band].band_suffix);
+            if (add_st_band_to_transaction(&transaction,
+                                           inter[band].thermal_filename,
+                                           ST_THERMAL_RADIANCE_PRODUCT_NAME,
+                                           band_name,
+                                           ST_THERMAL_RADIANCE_SHORT_NAME,
+                                           ST_THERMAL_RADIANCE_LONG_NAME,
+                                           ST_RADIANCE_UNITS,
+                                           0.0, 0.0) != SUCCESS)
+            {
+                ERROR_MESSAGE ("Failed adding ST thermal radiance band"
+                    " product", FUNC_NAME);
+            }
 
-    return SUCCESS;
-}
-
-/* Setup and cleanup functions */
-
-/*****************************************************************************
-Method:  load_grid_points_hdr
-
-Description:  Loads the grid points header information.
+            snprintf(band_name, sizeof(band_name), "%s%s",
+                     ST_ATMOS_TRANS_BAND_NAME, inter[band].band_suffix);
+            if (add_st_band_to_transaction(&transaction,
+                                           inter[band].transmittance_filename,
+                                           ST_ATMOS_TRANS_PRODUCT_NAME,
+                                           band_name,
+                                           ST_ATMOS_TRANS_SHORT_NAME,
+                                           ST_ATMOS_TRANS_LONG_NAME,
+                                           ST_RADIANCE_UNITS,
+                                           0.0, 0.0) != SUCCESS)
+            {
+                ERROR_MESSAGE ("Failed adding ST atmospheric transmission"
+                    " band product", FUNC_NAME);
+            }
 
-Notes:
-    1. The grid point header file must be present in the current working 
-       directory.
+            snprintf(band_name, sizeof(band_name), "%s%s",
+                     ST_UPWELLED_RADIANCE_BAND_NAME, inter[band].band_suffix);
+            if (add_st_band_to_transaction(&transaction,
+                                           inter[band].upwelled_filename,
+                                           ST_UPWELLED_RADIANCE_PRODUCT_NAME,
+                                           band_name,
+                                           ST_UPWELLED_RADIANCE_SHORT_NAME,
+                                           ST_UPWELLED_RADIANCE_LONG_NAME,
+                                           ST_RADIANCE_UNITS,
+                                           0.0, 0.0) != SUCCESS)
+            {
+                ERROR_MESSAGE ("Failed adding ST upwelled radiance band"
+                    " product", FUNC_NAME);
+            }
 
-RETURN: SUCCESS
-        FAILURE
-*****************************************************************************/
-int load_grid_points_hdr
-(
-    GRID_POINTS *grid_points
-)
-{
-    char FUNC_NAME[] = "load_grid_points_hdr";
-    FILE *grid_fd = NULL;
-    int status;
-    char header_filename[] = "grid_points.hdr";
-    char errmsg[PATH_MAX];
-
-    /* Open the grid header file. */
-    grid_fd = fopen(header_filename, "r");
-    if (grid_fd == NULL)
-    {
-        snprintf(errmsg, sizeof(errmsg), "Failed opening %s", header_filename);
-        RETURN_ERROR(errmsg, FUNC_NAME, FAILURE);
-    }
+            snprintf(band_name, sizeof(band_name), "%s%s",
+                     ST_DOWNWELLED_RADIANCE_BAND_NAME,
+                     inter[band].band_suffix);
+            if (add_st_band_to_transaction(&transaction,
+                                           inter[band].downwelled_filename,
+                                           ST_DOWNWELLED_RADIANCE_PRODUCT_NAME,
+                                           band_name,
+                                           ST_DOWNWELLED_RADIANCE_SHORT_NAME,
+                                           ST_DOWNWELLED_RADIANCE_LONG_NAME,
+                                           ST_RADIANCE_UNITS,
+                                           0.0, 0.0) != SUCCESS)
+            {
+                ERROR_MESSAGE ("Failed adding ST downwelled radiance band"
+                    " product", FUNC_NAME);
+            }
+        }
 
-    /* Read the grid header file. */
-    errno = 0;
-    status = fscanf(grid_fd, "%d\n%d\n%d", &grid_points->count,
-                    &grid_points->rows, &grid_points->cols);
-    if (status != 3 || errno != 0)
-    {
-        fclose(grid_fd);
-        snprintf(errmsg, sizeof(errmsg), "Failed reading %s", header_filename);
-        RETURN_ERROR(errmsg, FUNC_NAME, FAILURE);
+        if (commit_st_metadata_transaction(&transaction) != SUCCESS)
+        {
+            ERROR_MESSAGE ("Failed adding the ST band products to the "
+                "metadata", FUNC_NAME);
+        }
     }
 
-    fclose(grid_fd);
+    free_st_metadata_transaction(&transaction);
 
     return SUCCESS;
 }
 
+/* Setup and cleanup functions */
 
 /*****************************************************************************
 Method:  load_grid_points
 
-Description:  Loads the grid points into a data structure.
+Description:  Loads the grid points from the grid point store into a data
+              structure.
 
 Notes:
-    1. The grid point files must be present in the current working directory.
+    1. The grid point store must be present in the current working directory.
 
 RETURN: SUCCESS
         FAILURE
@@ -1902,48 +1147,86 @@ int load_grid_points
 {
     char FUNC_NAME[] = "load_grid_points";
 
-    FILE *grid_fd = NULL;
+    STORE store;
 
-    int status;
+    const int32_t *grid;
+    const int32_t *index;
+    const int32_t *run_modtran;
+    const int32_t *row;
+    const int32_t *col;
+    const int32_t *narr_row;
+    const int32_t *narr_col;
+    const float *lon;
+    const float *lat;
+    const float *map_x;
+    const float *map_y;
 
-    char binary_filename[] = "grid_points.bin";
-    char errmsg[PATH_MAX];
+    int point;
 
     /* Initialize the points */
     grid_points->points = NULL;
 
-    if (load_grid_points_hdr(grid_points) != SUCCESS)
+    if (open_store(GRID_POINT_STORE_NAME, &store) != SUCCESS)
+    {
+        RETURN_ERROR("Failed opening the grid point store", FUNC_NAME,
+                     FAILURE);
+    }
+
+    grid = store_section(&store, SECTION_GRID, STORE_INT32, 3);
+    if (grid == NULL)
     {
+        close_store(&store);
         RETURN_ERROR("Failed loading grid point header information",
                      FUNC_NAME, FAILURE);
     }
 
+    grid_points->count = grid[0];
+    grid_points->rows = grid[1];
+    grid_points->cols = grid[2];
+
+    index = store_section(&store, SECTION_INDEX, STORE_INT32, grid[0]);
+    run_modtran = store_section(&store, SECTION_RUN_MODTRAN, STORE_INT32,
+                                grid[0]);
+    row = store_section(&store, SECTION_ROW, STORE_INT32, grid[0]);
+    col = store_section(&store, SECTION_COL, STORE_INT32, grid[0]);
+    narr_row = store_section(&store, SECTION_NARR_ROW, STORE_INT32, grid[0]);
+    narr_col = store_section(&store, SECTION_NARR_COL, STORE_INT32, grid[0]);
+    lon = store_section(&store, SECTION_LON, STORE_FLOAT32, grid[0]);
+    lat = store_section(&store, SECTION_LAT, STORE_FLOAT32, grid[0]);
+    map_x = store_section(&store, SECTION_MAP_X, STORE_FLOAT32, grid[0]);
+    map_y = store_section(&store, SECTION_MAP_Y, STORE_FLOAT32, grid[0]);
+    if (index == NULL || run_modtran == NULL || row == NULL || col == NULL
+        || narr_row == NULL || narr_col == NULL || lon == NULL
+        || lat == NULL || map_x == NULL || map_y == NULL)
+    {
+        close_store(&store);
+        RETURN_ERROR("Failed reading the grid point store", FUNC_NAME,
+                     FAILURE);
+    }
+
     grid_points->points = malloc(grid_points->count * sizeof(GRID_POINT));
     if (grid_points->points == NULL)
     {
+        close_store(&store);
         RETURN_ERROR("Failed allocating memory for grid points",
                      FUNC_NAME, FAILURE);
     }
 
-    /* Open the grid point file */
-    grid_fd = fopen(binary_filename, "rb");
-    if (grid_fd == NULL)
-    {
-        snprintf(errmsg, sizeof(errmsg), "Failed opening %s", binary_filename);
-        RETURN_ERROR(errmsg, FUNC_NAME, FAILURE);
-    }
-
-    /* Read the grid points */
-    status = fread(grid_points->points, sizeof(GRID_POINT),
-                   grid_points->count, grid_fd);
-    if (status != grid_points->count || errno != 0)
+    for (point = 0; point < grid_points->count; point++)
     {
-        fclose(grid_fd);
-        snprintf(errmsg, sizeof(errmsg), "Failed reading %s", binary_filename);
-        RETURN_ERROR(errmsg, FUNC_NAME, FAILURE);
+        grid_points->points[point].index = index[point];
+        grid_points->points[point].run_modtran = run_modtran[point];
+        grid_points->points[point].row = row[point];
+        grid_points->points[point].col = col[point];
+        grid_points->points[point].narr_row = narr_row[point];
+        grid_points->points[point].narr_col = narr_col[point];
+        grid_points->points[point].lon = lon[point];
+        grid_points->points[point].lat = lat[point];
+        grid_points->points[point].map_x = map_x[point];
+        grid_points->points[point].map_y = map_y[point];
     }
 
-    fclose(grid_fd);
+    close_store(&store);
 
     return SUCCESS;
 }
@@ -1952,59 +1235,53 @@ int load_grid_points
 /*****************************************************************************
 Method:  load_elevations
 
-Description:  Loads the grid elevations into a data structure.
+Description:  Loads the ground elevations of the points into a data
+              structure.
 
 Notes:
-    1. The grid elevation file must be present in the current working directory.
-    2. The grid elevation entries should be in sync with the grid file.
+    1. The elevation store should be for the points of the grid point store.
 
 RETURN: SUCCESS
         FAILURE
 *****************************************************************************/
 int load_elevations
 (
-    MODTRAN_POINTS *modtran_points
+    STORE *elevation_store,    /* I: The elevation store */
+    ATMOS_TABLE *atmos_table   /* I/O: The table to load the elevations in */
 )
 {
     char FUNC_NAME[] = "load_elevations";
 
-    FILE *elevation_fd = NULL;
-
-    int status;
-    int index;   /* Index into point structure */
-
-    char elevation_filename[] = "grid_elevations.txt";
-    char errmsg[PATH_MAX];
+    const double *ground_elevation;
+    const double *ground_directory;
 
-    snprintf(errmsg, sizeof(errmsg), "Failed reading %s", elevation_filename);
+    int index;     /* Index into point structure */
+    long location; /* Location of the first elevation of the point */
 
-    elevation_fd = fopen(elevation_filename, "r");
-    if (elevation_fd == NULL)
+    ground_elevation = store_section(elevation_store,
+        SECTION_GROUND_ELEVATION, STORE_FLOAT64, atmos_table->count);
+    ground_directory = store_section(elevation_store,
+        SECTION_GROUND_DIRECTORY, STORE_FLOAT64, atmos_table->count);
+    if (ground_elevation == NULL || ground_directory == NULL)
     {
-        RETURN_ERROR(errmsg, FUNC_NAME, FAILURE);
+        RETURN_ERROR("Failed reading the ground elevations", FUNC_NAME,
+                     FAILURE);
     }
 
-    /* Read the elevations into the 0 elevation positions in the MODTRAN 
-       point structure.  The file and structure should have the same order. */
-    index = 0;
-    for (index = 0; index < modtran_points->count; index++)
+    /* Place the elevations in the 0 elevation positions of the points
+       MODTRAN was run for */
+    for (index = 0; index < atmos_table->count; index++)
     {
-        /* Keep looking for a modtran point that was actually run. */
-        if (modtran_points->points[index].ran_modtran == 0)
+        if (atmos_table->ran_modtran[index] == 0)
         {
-            continue; 
+            continue;
         }
 
-        status = fscanf(elevation_fd, "%lf %lf\n", 
-            &(modtran_points->points[index].elevations[0].elevation),
-            &(modtran_points->points[index].elevations[0].elevation_directory));
-        if (status <= 0)
-        {
-            RETURN_ERROR(errmsg, FUNC_NAME, FAILURE);
-        }
-    }
+        location = (long) index * atmos_table->num_elevations;
 
-    fclose(elevation_fd);
+        atmos_table->elevation[location] = ground_elevation[index];
+        atmos_table->elevation_directory[location] = ground_directory[index];
+    }
 
     return SUCCESS;
 }
@@ -2025,136 +1302,160 @@ void free_grid_points
 }
 
 /*****************************************************************************
-Method:  free_modtran_points
+Method:  free_atmos_table
 
-Description:  Free allocated memory for the MODTRAN points.
+Description:  Free allocated memory for the atmospheric table.
 *****************************************************************************/
-void free_modtran_points
+void free_atmos_table
 (
-    MODTRAN_POINTS *modtran_points
+    ATMOS_TABLE *atmos_table
 )
 {
-    int index;     /* Index into MODTRAN points structure */
-
-    for (index = 0; index < modtran_points->count; index++)
-    {
-        free(modtran_points->points[index].elevations);
-        modtran_points->points[index].elevations = NULL;
-    }
-
-    free(modtran_points->points);
-    modtran_points->points = NULL;
+    free(atmos_table->arena);
+    atmos_table->arena = NULL;
 }
 
 
 /*****************************************************************************
-Method:  initialize_modtran_points
+Method:  initialize_atmos_table
 
 Description:  Allocate the memory need to hold the MODTRAN results and
-              initialize known values.
+              initialize known values.  Every array of the table is carved
+              from a single arena.
 
 RETURN: SUCCESS
         FAILURE
 *****************************************************************************/
-int initialize_modtran_points
+int initialize_atmos_table
 (
-    GRID_POINTS *grid_points,      /* I: The coordinate points */
-    MODTRAN_POINTS *modtran_points /* O: Memory Allocated */
+    GRID_POINTS *grid_points,  /* I: The coordinate points */
+    int num_bands,             /* I: Number of thermal bands */
+    ATMOS_TABLE *atmos_table   /* O: Memory Allocated */
 )
 {
-    char FUNC_NAME[] = "initialize_modtran_points";
+    char FUNC_NAME[] = "initialize_atmos_table";
 
-    double gndalt[MAX_NUM_ELEVATIONS];
+    STORE elevation_store;         /* Elevations MODTRAN was run at */
+    const double *gndalt;          /* The standard elevations */
 
     int index;
+    int band;
+    int count = grid_points->count;
     int num_elevations;            /* Number of elevations actually used */
     int elevation_index;           /* Index into elevations */
-    int status;                    /* Function return status */
-
-    FILE *modtran_elevation_fd = NULL;
-
-    char modtran_elevation_filename[] = "modtran_elevations.txt";
-    char errmsg[PATH_MAX];
-
-    snprintf(errmsg, sizeof(errmsg), "Failed reading %s", 
-        modtran_elevation_filename);
-
-    modtran_elevation_fd = fopen(modtran_elevation_filename, "r");
-    if (modtran_elevation_fd == NULL)
-    {
-        RETURN_ERROR(errmsg, FUNC_NAME, FAILURE);
-    }
+    long values;                   /* Values in each elevation array */
+    long location;
+    double *next;                  /* Next unused part of the arena */
 
-    status = fscanf(modtran_elevation_fd, "%d\n", &num_elevations);
-    if (status <= 0)
+    if (open_store(ELEVATION_STORE_NAME, &elevation_store) != SUCCESS)
     {
-        RETURN_ERROR(errmsg, FUNC_NAME, FAILURE);
+        RETURN_ERROR("Failed opening the elevation store", FUNC_NAME,
+                     FAILURE);
     }
 
-    /* Read the elevations into the gndalt structure. */ 
-    index = 0;
-    for (index = 0; index < num_elevations; index++)
+    num_elevations = store_section_count(&elevation_store,
+                                         SECTION_ALTITUDES);
+    gndalt = store_section(&elevation_store, SECTION_ALTITUDES,
+                           STORE_FLOAT64, num_elevations);
+    if (gndalt == NULL || num_elevations < 1
+        || num_elevations > MAX_NUM_ELEVATIONS)
     {
-        status = fscanf(modtran_elevation_fd, "%lf\n", &gndalt[index]);
-        if (status <= 0)
-        {
-            RETURN_ERROR(errmsg, FUNC_NAME, FAILURE);
-        }
+        close_store(&elevation_store);
+        RETURN_ERROR("Failed reading the MODTRAN elevations", FUNC_NAME,
+                     FAILURE);
     }
 
-    fclose(modtran_elevation_fd);
-
-    modtran_points->count = grid_points->count;
+    values = (long) count * num_elevations;
 
-    modtran_points->points = malloc(modtran_points->count *
-                                    sizeof(MODTRAN_POINT));
-    if (modtran_points->points == NULL)
+    /* The double arrays are placed first, so every array is aligned */
+    atmos_table->arena = malloc((4 * (long) count
+                                 + (2 + 3 * (long) num_bands) * values)
+                                * sizeof(double)
+                                + count * sizeof(int8_t));
+    if (atmos_table->arena == NULL)
     {
-        RETURN_ERROR("Failed allocating memory for modtran points",
+        close_store(&elevation_store);
+        RETURN_ERROR("Failed allocating memory for the atmospheric table",
                      FUNC_NAME, FAILURE);
     }
 
-    for (index = 0; index < modtran_points->count; index++)
-    {
-        modtran_points->points[index].count = num_elevations;
-        modtran_points->points[index].ran_modtran =
-            grid_points->points[index].run_modtran;
-        modtran_points->points[index].row = grid_points->points[index].row;
-        modtran_points->points[index].col = grid_points->points[index].col;
-        modtran_points->points[index].narr_row =
-            grid_points->points[index].narr_row;
-        modtran_points->points[index].narr_col =
-            grid_points->points[index].narr_col;
-        modtran_points->points[index].lon = grid_points->points[index].lon;
-        modtran_points->points[index].lat = grid_points->points[index].lat;
-        modtran_points->points[index].map_x = grid_points->points[index].map_x;
-        modtran_points->points[index].map_y = grid_points->points[index].map_y;
-
-        modtran_points->points[index].elevations =
-            malloc(num_elevations * sizeof(MODTRAN_ELEVATION));
-        if (modtran_points->points[index].elevations == NULL)
+    atmos_table->count = count;
+    atmos_table->num_elevations = num_elevations;
+    atmos_table->num_bands = num_bands;
+
+    next = atmos_table->arena;
+    atmos_table->lon = next;
+    next += count;
+    atmos_table->lat = next;
+    next += count;
+    atmos_table->map_x = next;
+    next += count;
+    atmos_table->map_y = next;
+    next += count;
+    atmos_table->elevation = next;
+    next += values;
+    atmos_table->elevation_directory = next;
+    next += values;
+    for (band = 0; band < MAX_THERMAL_BANDS; band++)
+    {
+        if (band >= num_bands)
         {
-            RETURN_ERROR("Failed allocating memory for modtran point"
-                         " elevations", FUNC_NAME, FAILURE);
+            atmos_table->transmission[band] = NULL;
+            atmos_table->upwelled_radiance[band] = NULL;
+            atmos_table->downwelled_radiance[band] = NULL;
+            continue;
         }
 
-        /* Iterate over the elevations and assign the elevation values. */
+        atmos_table->transmission[band] = next;
+        next += values;
+        atmos_table->upwelled_radiance[band] = next;
+        next += values;
+        atmos_table->downwelled_radiance[band] = next;
+        next += values;
+    }
+    atmos_table->ran_modtran = (int8_t *) next;
+
+    for (index = 0; index < count; index++)
+    {
+        atmos_table->ran_modtran[index] =
+            grid_points->points[index].run_modtran;
+        atmos_table->lon[index] = grid_points->points[index].lon;
+        atmos_table->lat[index] = grid_points->points[index].lat;
+        atmos_table->map_x[index] = grid_points->points[index].map_x;
+        atmos_table->map_y[index] = grid_points->points[index].map_y;
+
+        /* Iterate over the elevations and assign the elevation values.
+           Points MODTRAN was not run for keep the fill parameters, which
+           the pixel stage recognizes. */
         for (elevation_index = 0; elevation_index < num_elevations; 
             elevation_index++)
         {
-            modtran_points->points[index].elevations[elevation_index]
-                .elevation = gndalt[elevation_index];
-            modtran_points->points[index].elevations[elevation_index]
-                .elevation_directory = gndalt[elevation_index];
+            location = (long) index * num_elevations + elevation_index;
+
+            atmos_table->elevation[location] = gndalt[elevation_index];
+            atmos_table->elevation_directory[location] =
+                gndalt[elevation_index];
+
+            for (band = 0; band < num_bands; band++)
+            {
+                atmos_table->transmission[band][location] = ST_NO_DATA_VALUE;
+                atmos_table->upwelled_radiance[band][location] =
+                    ST_NO_DATA_VALUE;
+                atmos_table->downwelled_radiance[band][location] =
+                    ST_NO_DATA_VALUE;
+            }
         }
     }
 
     /* Load the first elevation values if needed. */
-    if (load_elevations(modtran_points) != SUCCESS)
+    if (load_elevations(&elevation_store, atmos_table) != SUCCESS)
     {
+        close_store(&elevation_store);
         RETURN_ERROR("calling load_elevations", FUNC_NAME, EXIT_FAILURE);
     }
 
+    close_store(&elevation_store);
+
     return SUCCESS;
 }
 
@@ -2173,12 +1474,29 @@ void usage()
     printf("\n");
     printf("usage: st_atmospheric_parameters"
            " --xml=<filename>"
+           " [--point-parameters=<filename>]"
+           " [--all-thermal-bands]"
+           " [--geometry-cache=<directory>]"
+           " [--map-space-cells]"
            " [--debug]\n");
     printf("\n");
     printf ("where the following parameters are required:\n");
     printf ("    --xml: name of the input XML file\n");
     printf ("\n");
     printf ("where the following parameters are optional:\n");
+    printf ("    --point-parameters: use the transmission and radiances at"
+            " the grid points\n"
+            "        from this file instead of the MODTRAN results\n");
+    printf ("    --all-thermal-bands: also generate the parameters for"
+            " Landsat 8 band 11\n"
+            "        (requires L8_B11_Spectral_Response.txt in"
+            " ST_DATA_DIR)\n");
+    printf ("    --geometry-cache: directory keeping the interpolation cell"
+            " of each pixel\n"
+            "        for the scenes of the same footprint\n");
+    printf ("    --map-space-cells: select the interpolation cell of each"
+            " pixel in map\n"
+            "        coordinates instead of longitude and latitude\n");
     printf ("    --debug: should debug output be generated?"
             " (default is false)\n");
     printf ("\n");
@@ -2215,18 +1533,30 @@ int get_args
     int argc,           /* I: number of cmd-line args */
     char *argv[],       /* I: string of cmd-line args */
     char *xml_filename, /* I: address of input XML metadata filename  */
+    char *parameters_filename, /* O: point parameters filename, empty to
+                                  use the MODTRAN results */
+    bool *all_thermal_bands, /* O: process every thermal band */
+    char *geometry_cache, /* O: geometry cache footprint directory, empty
+                                when not used */
+    bool *map_space_cells, /* O: select the cells in map coordinates */
     bool *debug         /* O: debug flag */
 )
 {
     int c;                         /* current argument index */
     int option_index;              /* index of the command line option */
     static int debug_flag = 0;     /* debug flag */
+    static int all_thermal_bands_flag = 0; /* all thermal bands flag */
+    static int map_space_cells_flag = 0; /* map space cells flag */
     char errmsg[MAX_STR_LEN];      /* error message */
     char FUNC_NAME[] = "get_args"; /* function name */
 
     static struct option long_options[] = {
         {"debug", no_argument, &debug_flag, 1},
+        {"all-thermal-bands", no_argument, &all_thermal_bands_flag, 1},
+        {"map-space-cells", no_argument, &map_space_cells_flag, 1},
         {"xml", required_argument, 0, 'i'},
+        {"point-parameters", required_argument, 0, 'p'},
+        {"geometry-cache", required_argument, 0, 'g'},
         {"help", no_argument, 0, 'h'},
         {0, 0, 0, 0}
     };
@@ -2260,6 +1590,14 @@ int get_args
                 snprintf(xml_filename, PATH_MAX, "%s", optarg);
                 break;
 
+            case 'p':              /* point parameters infile */
+                snprintf(parameters_filename, PATH_MAX, "%s", optarg);
+                break;
+
+            case 'g':              /* geometry cache directory */
+                snprintf(geometry_cache, PATH_MAX, "%s", optarg);
+                break;
+
             case '?':
             default:
                 snprintf(errmsg, sizeof(errmsg),
@@ -2284,6 +1622,16 @@ int get_args
     else
         *debug = false;
 
+    if (all_thermal_bands_flag)
+        *all_thermal_bands = true;
+    else
+        *all_thermal_bands = false;
+
+    if (map_space_cells_flag)
+        *map_space_cells = true;
+    else
+        *map_space_cells = false;
+
     return SUCCESS;
 }
 
@@ -2299,20 +1647,33 @@ int main(int argc, char *argv[])
 
     Espa_internal_meta_t xml_metadata;  /* XML metadata structure */
     char xml_filename[PATH_MAX];        /* Input XML filename */
+    char parameters_filename[PATH_MAX] = ""; /* Point parameters filename,
+                                                when MODTRAN was not run */
+    char geometry_cache[PATH_MAX] = ""; /* Geometry cache footprint
+                                           directory */
+    bool all_thermal_bands;             /* Process every thermal band */
+    bool map_space_cells;               /* Select the cells in map
+                                           coordinates */
     bool debug;                         /* Debug flag for debug output */
     Input_Data_t *input = NULL;         /* Input data and meta data */
     GRID_POINTS grid_points;            /* NARR grid points */
-    MODTRAN_POINTS modtran_points;      /* Points that are processed through
+    ATMOS_TABLE atmos_table;            /* Atmospheric parameters of the
+                                           points processed through
                                            MODTRAN */
+    double phase_start;                 /* Start of the phase being traced */
+
+    trace_open("st_atmospheric_parameters");
 
     /* Read the command-line arguments */
-    if (get_args(argc, argv, xml_filename, &debug)
-        != SUCCESS)
+    if (get_args(argc, argv, xml_filename, parameters_filename,
+                 &all_thermal_bands, geometry_cache, &map_space_cells,
+                 &debug) != SUCCESS)
     {
         RETURN_ERROR("calling get_args", FUNC_NAME, EXIT_FAILURE);
     }
 
     /* Validate the input metadata file */
+    phase_start = trace_time();
     if (validate_xml_file(xml_filename) != SUCCESS)
     {
         /* Error messages already written */
@@ -2332,33 +1693,80 @@ int main(int argc, char *argv[])
     }
 
     /* Open input file, read metadata, and set up buffers */
-    input = open_input(&xml_metadata);
+    input = open_input(&xml_metadata, all_thermal_bands);
     if (input == NULL)
     {
         RETURN_ERROR("opening input files", FUNC_NAME, EXIT_FAILURE);
     }
+    trace_span("read_input", phase_start);
+
+    /* The point parameters files only hold the reference thermal band */
+    if (strlen(parameters_filename) > 0 && input->num_thermal_bands > 1)
+    {
+        RETURN_ERROR("--point-parameters only supports the reference"
+            " thermal band", FUNC_NAME, EXIT_FAILURE);
+    }
 
     /* Load the grid points */
+    phase_start = trace_time();
     if (load_grid_points(&grid_points) != SUCCESS)
     {
         RETURN_ERROR("calling load_grid_points", FUNC_NAME, EXIT_FAILURE);
     }
 
     /* Allocate and initialize the memory need to hold the MODTRAN results */
-    if (initialize_modtran_points(&grid_points, &modtran_points) != SUCCESS)
+    if (initialize_atmos_table(&grid_points, input->num_thermal_bands,
+        &atmos_table) != SUCCESS)
     {
-        RETURN_ERROR("calling initializing_modtran_points", FUNC_NAME, 
+        RETURN_ERROR("calling initialize_atmos_table", FUNC_NAME,
             EXIT_FAILURE);
     }
+    trace_span("load_grid_points", phase_start);
 
     /* Generate parameters for each height and NARR point */
-    if (calculate_point_atmospheric_parameters(input, &grid_points, 
-        &modtran_points) != SUCCESS)
+    phase_start = trace_time();
+    if (strlen(parameters_filename) > 0)
+    {
+        if (load_point_atmospheric_parameters(parameters_filename,
+            &grid_points, &atmos_table) != SUCCESS)
+        {
+            RETURN_ERROR("calling load_point_atmospheric_parameters",
+                FUNC_NAME, EXIT_FAILURE);
+        }
+    }
+    else if (calculate_point_atmospheric_parameters(input, &grid_points, 
+        &atmos_table) != SUCCESS)
     {
         RETURN_ERROR("calling calculate_point_atmospheric_parameters",
             FUNC_NAME, EXIT_FAILURE);
     }
 
+    /* Hand the point parameters on in the scene atmosphere store */
+    if (write_scene_atmosphere(&grid_points, &atmos_table) != SUCCESS)
+    {
+        RETURN_ERROR("calling write_scene_atmosphere", FUNC_NAME,
+            EXIT_FAILURE);
+    }
+
+    /* The point parameters and the points used as text, for inspecting and
+       plotting them.  Nothing in the processing reads them. */
+    if (debug)
+    {
+        if (write_point_atmospheric_parameters(&grid_points, &atmos_table)
+            != SUCCESS)
+        {
+            RETURN_ERROR("calling write_point_atmospheric_parameters",
+                FUNC_NAME, EXIT_FAILURE);
+        }
+
+        if (write_used_points(&grid_points, &atmos_table) != SUCCESS)
+        {
+            RETURN_ERROR("calling write_used_points", FUNC_NAME,
+                EXIT_FAILURE);
+        }
+    }
+    trace_span("point_parameters", phase_start);
+
     /* Process the grid points */
     printf("%d %d %d\n", grid_points.count, grid_points.rows, grid_points.cols);
     printf("%d %d %d\n", grid_points.points[0].index, grid_points.points[0].row,
@@ -2374,22 +1782,27 @@ int main(int argc, char *argv[])
 
     /* Using the values made at the grid points, generate atmospheric 
        parameters for each Landsat pixel */ 
+    phase_start = trace_time();
     if (calculate_pixel_atmospheric_parameters(input, &grid_points, 
-        xml_filename, xml_metadata, &modtran_points) != SUCCESS)
+        xml_filename, xml_metadata, &atmos_table, geometry_cache,
+        map_space_cells) != SUCCESS)
     {
         RETURN_ERROR("calling calculate_pixel_atmospheric_parameters", 
             FUNC_NAME, EXIT_FAILURE);
     }
+    trace_span("pixel_parameters", phase_start);
 
     /* Free metadata */
     free_metadata(&xml_metadata);
 
-    /* Free the grid and MODTRAN points */
+    /* Free the grid points and the atmospheric table */
     free_grid_points(&grid_points);
-    free_modtran_points(&modtran_points);
+    free_atmos_table(&atmos_table);
 
     /* Close the input file and free the structure */
     close_input(input);
 
+    trace_close();
+
     return EXIT_SUCCESS;
 }
@@ -31,6 +31,13 @@
 #define ST_DOWNWELLED_RADIANCE_SHORT_NAME "ST_DOWNWELLED_RADIANCE"
 #define ST_DOWNWELLED_RADIANCE_LONG_NAME "downwelled radiance"
 
+/* Number of intermediate bands added by st_atmospheric_parameters for each
+   thermal band */
+#define ST_INTERMEDIATE_BAND_COUNT 4
+
+/* Thermal bands processed together (Landsat 8 bands 10 and 11) */
+#define MAX_THERMAL_BANDS 2
+
 
 #define TWO_PI (2.0 * PI)
 #define HALF_PI (PI / 2.0)
@@ -102,6 +109,7 @@ typedef enum
 {
     I_BAND_THERMAL,
     I_BAND_ELEVATION, /* This band and above are all from the XML */
+    I_BAND_SECOND_THERMAL, /* Only opened when both TIRS bands are used */
     MAX_INPUT_BANDS
 } Input_Bands_e;
 
@@ -0,0 +1,213 @@
+
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include "const.h"
+#include "utilities.h"
+#include "input.h"
+#include "st_types.h"
+#include "atmospheric_engine.h"
+#include "geometry_cache.h"
+
+
+/*****************************************************************************
+ NAME:  build_geometry_cache_header
+
+ PURPOSE: Describe the scene framing and grid points of the current scene.
+*****************************************************************************/
+static void build_geometry_cache_header
+(
+    Input_Data_t *input,
+    GRID_POINTS *points,
+    Geometry_Cache_Header_t *header
+)
+{
+    /* Clear the padding too, so headers can be compared as a whole */
+    memset(header, 0, sizeof(*header));
+
+    memcpy(header->magic, GEOMETRY_CACHE_MAGIC, sizeof(header->magic));
+    header->lines = input->lines;
+    header->samples = input->samples;
+    header->ul_map_x = input->meta.ul_map_corner.x;
+    header->ul_map_y = input->meta.ul_map_corner.y;
+    header->x_pixel_size = input->x_pixel_size;
+    header->y_pixel_size = input->y_pixel_size;
+    header->grid_count = points->count;
+    header->grid_rows = points->rows;
+    header->grid_cols = points->cols;
+    header->first_narr_row = points->points[0].narr_row;
+    header->first_narr_col = points->points[0].narr_col;
+}
+
+
+/*****************************************************************************
+ NAME:  read_geometry_cache
+
+ PURPOSE: Read the interpolation cell of each pixel from the geometry cache.
+          Every cell is ST_CELL_UNKNOWN when there are no cells yet for the
+          footprint, or when they were made for another scene framing or
+          other grid points.
+
+ RETURN VALUE: SUCCESS
+               FAILURE
+*****************************************************************************/
+int read_geometry_cache
+(
+    char *directory,           /* I: footprint directory of the cache */
+    bool map_space_cells,      /* I: the cells are selected in map
+                                     coordinates */
+    Input_Data_t *input,       /* I: input structure */
+    GRID_POINTS *points,       /* I: the grid points */
+    int16_t *cells             /* O: cell of each pixel */
+)
+{
+    char *FUNC_NAME = "read_geometry_cache";
+    char filename[PATH_MAX];
+    char msg[PATH_MAX + 100];
+    FILE *fd = NULL;
+    long pixel_count = (long) input->lines * input->samples;
+    long index;
+    size_t count;
+    Geometry_Cache_Header_t expected;
+    Geometry_Cache_Header_t header;
+
+    for (index = 0; index < pixel_count; index++)
+    {
+        cells[index] = ST_CELL_UNKNOWN;
+    }
+
+    snprintf(filename, sizeof(filename), "%s/%s", directory,
+             map_space_cells ? GEOMETRY_CACHE_MAP_FILENAME
+                             : GEOMETRY_CACHE_FILENAME);
+
+    fd = fopen(filename, "rb");
+    if (fd == NULL)
+    {
+        snprintf(msg, sizeof(msg), "No pixel cells cached in %s", directory);
+        LOG_MESSAGE(msg, FUNC_NAME);
+        return SUCCESS;
+    }
+
+    build_geometry_cache_header(input, points, &expected);
+
+    if (fread(&header, sizeof(header), 1, fd) != 1
+        || memcmp(&header, &expected, sizeof(header)) != 0)
+    {
+        fclose(fd);
+
+        snprintf(msg, sizeof(msg), "Cached pixel cells %s are not for this"
+                 " scene framing and grid, they will be replaced", filename);
+        WARNING_MESSAGE(msg, FUNC_NAME);
+        return SUCCESS;
+    }
+
+    count = fread(cells, sizeof(int16_t), pixel_count, fd);
+    fclose(fd);
+    if (count != (size_t) pixel_count)
+    {
+        for (index = 0; index < pixel_count; index++)
+        {
+            cells[index] = ST_CELL_UNKNOWN;
+        }
+
+        snprintf(msg, sizeof(msg), "Cached pixel cells %s are truncated,"
+                 " they will be replaced", filename);
+        WARNING_MESSAGE(msg, FUNC_NAME);
+        return SUCCESS;
+    }
+
+    snprintf(msg, sizeof(msg), "Read cached pixel cells %s", filename);
+    LOG_MESSAGE(msg, FUNC_NAME);
+
+    return SUCCESS;
+}
+
+
+/*****************************************************************************
+ NAME:  write_geometry_cache
+
+ PURPOSE: Write the interpolation cell of each pixel to the geometry cache.
+          Scenes of the same footprint may be processed at the same time, so
+          the file is written under a name of its own and renamed into place.
+
+ RETURN VALUE: SUCCESS
+               FAILURE
+*****************************************************************************/
+int write_geometry_cache
+(
+    char *directory,           /* I: footprint directory of the cache */
+    bool map_space_cells,      /* I: the cells are selected in map
+                                     coordinates */
+    Input_Data_t *input,       /* I: input structure */
+    GRID_POINTS *points,       /* I: the grid points */
+    int16_t *cells             /* I: cell of each pixel */
+)
+{
+    char *FUNC_NAME = "write_geometry_cache";
+    char filename[PATH_MAX];
+    char temporary_filename[PATH_MAX];
+    char msg[PATH_MAX + 100];
+    FILE *fd = NULL;
+    long pixel_count = (long) input->lines * input->samples;
+    int status;
+    Geometry_Cache_Header_t header;
+
+    if (mkdir(directory, 0775) != 0 && errno != EEXIST)
+    {
+        snprintf(msg, sizeof(msg), "Creating geometry cache directory %s",
+                 directory);
+        RETURN_ERROR(msg, FUNC_NAME, FAILURE);
+    }
+
+    snprintf(filename, sizeof(filename), "%s/%s", directory,
+             map_space_cells ? GEOMETRY_CACHE_MAP_FILENAME
+                             : GEOMETRY_CACHE_FILENAME);
+    snprintf(temporary_filename, sizeof(temporary_filename), "%s.%ld",
+             filename, (long) getpid());
+
+    fd = fopen(temporary_filename, "wb");
+    if (fd == NULL)
+    {
+        snprintf(msg, sizeof(msg), "Opening geometry cache file: %s",
+                 temporary_filename);
+        RETURN_ERROR(msg, FUNC_NAME, FAILURE);
+    }
+
+    build_geometry_cache_header(input, points, &header);
+
+    status = SUCCESS;
+    if (fwrite(&header, sizeof(header), 1, fd) != 1
+        || fwrite(cells, sizeof(int16_t), pixel_count, fd)
+           != (size_t) pixel_count)
+    {
+        status = FAILURE;
+    }
+    if (fclose(fd) != 0)
+    {
+        status = FAILURE;
+    }
+
+    if (status != SUCCESS)
+    {
+        unlink(temporary_filename);
+
+        snprintf(msg, sizeof(msg), "Writing to %s", temporary_filename);
+        RETURN_ERROR(msg, FUNC_NAME, FAILURE);
+    }
+
+    if (rename(temporary_filename, filename) != 0)
+    {
+        unlink(temporary_filename);
+
+        snprintf(msg, sizeof(msg), "Renaming %s", temporary_filename);
+        RETURN_ERROR(msg, FUNC_NAME, FAILURE);
+    }
+
+    snprintf(msg, sizeof(msg), "Wrote cached pixel cells %s", filename);
+    LOG_MESSAGE(msg, FUNC_NAME);
+
+    return SUCCESS;
+}
@@ -0,0 +1,58 @@
+#ifndef GEOMETRY_CACHE_H
+#define GEOMETRY_CACHE_H
+
+
+#include <stdint.h>
+
+#include "input.h"
+#include "st_types.h"
+
+
+/* The interpolation cell of each pixel only depends on the scene framing and
+   the grid points, so scenes of the same footprint share them.  The file is
+   kept in the footprint directory of the geometry cache, with the cells
+   selected in map coordinates kept apart from the geodetic ones. */
+#define GEOMETRY_CACHE_FILENAME "pixel_cells.bin"
+#define GEOMETRY_CACHE_MAP_FILENAME "pixel_cells_map.bin"
+#define GEOMETRY_CACHE_MAGIC "STCELLS1"
+
+
+/* Identifies the scene framing and grid points the cells are for.  It is at
+   the start of the file so the file can be replaced in one rename. */
+typedef struct
+{
+    char magic[8];              /* GEOMETRY_CACHE_MAGIC, not terminated */
+    int32_t lines;
+    int32_t samples;
+    double ul_map_x;
+    double ul_map_y;
+    double x_pixel_size;
+    double y_pixel_size;
+    int32_t grid_count;
+    int32_t grid_rows;
+    int32_t grid_cols;
+    int32_t first_narr_row;     /* NARR location of the first grid point */
+    int32_t first_narr_col;
+} Geometry_Cache_Header_t;
+
+
+int read_geometry_cache
+(
+    char *directory,
+    bool map_space_cells,
+    Input_Data_t *input,
+    GRID_POINTS *points,
+    int16_t *cells
+);
+
+int write_geometry_cache
+(
+    char *directory,
+    bool map_space_cells,
+    Input_Data_t *input,
+    GRID_POINTS *points,
+    int16_t *cells
+);
+
+
+#endif /* GEOMETRY_CACHE_H */
@@ -49,6 +49,7 @@ Description: 'open_input' sets up the 'input' data structure, opens the
 
 Input Parameters:
     metadata     'Espa_internal_meta_t' data structure with XML info
+    all_thermal_bands  open both TIRS bands of Landsat 8, not only band 10
 
 Output Parameters:
     (returns)      'input' data structure or NULL when an error occurs
@@ -56,7 +57,8 @@ Output Parameters:
 *****************************************************************************/
 Input_Data_t *open_input
 (
-    Espa_internal_meta_t *metadata
+    Espa_internal_meta_t *metadata,
+    bool all_thermal_bands
 )
 {
     char FUNC_NAME[] = "open_input";
@@ -81,7 +83,7 @@ Input_Data_t *open_input
     input->samples = 0;
 
     /* Open the input images from the XML file */
-    if (!GetXMLInput(input, metadata))
+    if (!GetXMLInput(input, metadata, all_thermal_bands))
     {
         free(input);
         input = NULL;
@@ -118,8 +120,12 @@ int close_input
     had_issue = false;
     for (index = 0; index < MAX_INPUT_BANDS; index++)
     {
-        if (input->band_fd[index] == NULL &&
-            input->band_name[index] == NULL)
+        /* Bands which are only used for some scenes may not be open */
+        if (input->band_fd[index] == NULL)
+        {
+            free (input->band_name[index]);
+        }
+        else if (input->band_name[index] != NULL)
         {
             status = fclose (input->band_fd[index]);
             if (status != 0)
@@ -152,29 +158,37 @@ int close_input
 
 
 /*****************************************************************************
-  NAME: read_input
+  NAME: read_thermal_band
 
-  PURPOSE: To read the specified input bands into memory for later processing.
+  PURPOSE: To read a thermal band into memory as radiance.
 
-  RETURN VALUE:  Type = bool
+  RETURN VALUE:  Type = int
       Value    Description
       -------  ---------------------------------------------------------------
-      true     Success with reading all of the bands into memory.
-      false    Failed to read a band into memory.
+      SUCCESS  Success with reading the band into memory.
+      FAILURE  Failed to read the band into memory.
 *****************************************************************************/
-int read_input
+static int read_thermal_band
 (
     Input_Data_t *input,
+    int thermal_band,
     float *band_thermal,
-    int16_t *band_elevation,
     int pixel_count
 )
 {
-    char FUNC_NAME[] = "read_input";
+    char FUNC_NAME[] = "read_thermal_band";
     int count;
     int index;
     uint8_t *thermal_uint8 = NULL;
     uint16_t *thermal_uint16 = NULL;
+    Input_Bands_e band_index = I_BAND_THERMAL;
+    float gain = input->thermal_rad_gain[thermal_band];
+    float bias = input->thermal_rad_bias[thermal_band];
+
+    if (thermal_band > 0)
+    {
+        band_index = I_BAND_SECOND_THERMAL;
+    }
 
     if (input->meta.instrument == INST_OLI_TIRS
         && input->meta.satellite == SAT_LANDSAT_8)
@@ -187,7 +201,7 @@ int read_input
         }
 
         count = fread(thermal_uint16, sizeof(uint16_t), pixel_count,
-                      input->band_fd[I_BAND_THERMAL]);
+                      input->band_fd[band_index]);
         if (count != pixel_count)
         {
             free(thermal_uint16);
@@ -200,15 +214,14 @@ int read_input
            radiance and float */
         for (index = 0; index < pixel_count; index++)
         {
-            if (thermal_uint16[index] == input->fill_value[I_BAND_THERMAL])
+            if (thermal_uint16[index] == input->fill_value[band_index])
             {
                 band_thermal[index] = ST_NO_DATA_VALUE;
             }
             else
             {
                 band_thermal[index] =
-                    (float)((input->thermal_rad_gain * thermal_uint16[index])
-                            + input->thermal_rad_bias);
+                    (float)((gain * thermal_uint16[index]) + bias);
             }
         }
 
@@ -236,7 +249,7 @@ int read_input
         }
 
         count = fread(thermal_uint8, sizeof(uint8_t), pixel_count,
-                      input->band_fd[I_BAND_THERMAL]);
+                      input->band_fd[band_index]);
         if (count != pixel_count)
         {
             free(thermal_uint8);
@@ -249,15 +262,14 @@ int read_input
            radiance and float */
         for (index = 0; index < pixel_count; index++)
         {
-            if (thermal_uint8[index] == input->fill_value[I_BAND_THERMAL])
+            if (thermal_uint8[index] == input->fill_value[band_index])
             {
                 band_thermal[index] = ST_NO_DATA_VALUE;
             }
             else
             {
                 band_thermal[index] =
-                    (float)((input->thermal_rad_gain * thermal_uint8[index])
-                            + input->thermal_rad_bias);
+                    (float)((gain * thermal_uint8[index]) + bias);
 
                 /* Adjustment from above for L5 or 0.0 */
                 band_thermal[index] += adjustment;
@@ -267,6 +279,44 @@ int read_input
         free(thermal_uint8);
     }
 
+    return SUCCESS;
+}
+
+
+/*****************************************************************************
+  NAME: read_input
+
+  PURPOSE: To read the specified input bands into memory for later processing.
+
+  RETURN VALUE:  Type = bool
+      Value    Description
+      -------  ---------------------------------------------------------------
+      true     Success with reading all of the bands into memory.
+      false    Failed to read a band into memory.
+*****************************************************************************/
+int read_input
+(
+    Input_Data_t *input,
+    float **band_thermal,    /* O: radiance of each thermal band */
+    int16_t *band_elevation,
+    int pixel_count
+)
+{
+    char FUNC_NAME[] = "read_input";
+    int count;
+    int thermal_band;
+
+    for (thermal_band = 0; thermal_band < input->num_thermal_bands;
+         thermal_band++)
+    {
+        if (read_thermal_band(input, thermal_band,
+                              band_thermal[thermal_band], pixel_count)
+            != SUCCESS)
+        {
+            RETURN_ERROR("Failed reading thermal band", FUNC_NAME, FAILURE);
+        }
+    }
+
     count = fread(band_elevation, sizeof(int16_t), pixel_count,
                   input->band_fd[I_BAND_ELEVATION]);
     if (count != pixel_count)
@@ -287,6 +337,7 @@ Description: 'GetXMLInput' pulls input values from the XML structure.
 Input Parameters:
     input        'Input_t' data structure to be populated
     metadata     'Espa_internal_meta_t' data structure with XML info
+    all_thermal_bands  use both TIRS bands of Landsat 8, not only band 10
 
 Output Parameters:
     (returns)      status:
@@ -300,20 +351,27 @@ Design Notes:
 bool GetXMLInput
 (
     Input_Data_t *input, 
-    Espa_internal_meta_t *metadata
+    Espa_internal_meta_t *metadata,
+    bool all_thermal_bands
 )
 {
     char FUNC_NAME[] = "GetXMLInput";
     char msg[MAX_STR_LEN];
     int index;
+    int thermal_band;
     Espa_global_meta_t *global = &metadata->global; /* pointer to global meta */
 
     /* Initialize the input fields.  Set file type to binary, since that is
        the ESPA internal format for the input L1G/T products. */
     input->meta.satellite = SAT_NULL;
     input->meta.instrument = INST_NULL;
-    input->thermal_rad_gain = GAIN_BIAS_FILL;
-    input->thermal_rad_bias = GAIN_BIAS_FILL;
+    input->num_thermal_bands = 1;
+    for (thermal_band = 0; thermal_band < MAX_THERMAL_BANDS; thermal_band++)
+    {
+        input->thermal_band_name[thermal_band][0] = '\0';
+        input->thermal_rad_gain[thermal_band] = GAIN_BIAS_FILL;
+        input->thermal_rad_bias[thermal_band] = GAIN_BIAS_FILL;
+    }
 
     /* Determine satellite */
     if (strcmp (global->satellite, "LANDSAT_4") == 0)
@@ -393,8 +451,20 @@ bool GetXMLInput
         /* Specify the band name for the thermal band to use */
         snprintf (input->reference_band_name,
                   sizeof (input->reference_band_name), "b10");
+
+        /* Band 11 shares the geometry work with band 10 when requested */
+        if (all_thermal_bands)
+        {
+            input->num_thermal_bands = 2;
+            snprintf (input->thermal_band_name[1],
+                      sizeof (input->thermal_band_name[1]), "b11");
+        }
     }
 
+    snprintf (input->thermal_band_name[0],
+              sizeof (input->thermal_band_name[0]), "%s",
+              input->reference_band_name);
+
     for (index = 0; index < metadata->nbands; index++)
     {
         /* Only look at the ones with the product name we are looking for */
@@ -421,13 +491,30 @@ bool GetXMLInput
                 input->x_pixel_size = metadata->band[index].pixel_size[0];
                 input->y_pixel_size = metadata->band[index].pixel_size[1];
 
-                input->thermal_rad_gain = metadata->band[index].rad_gain;
-                input->thermal_rad_bias = metadata->band[index].rad_bias;
+                input->thermal_rad_gain[0] = metadata->band[index].rad_gain;
+                input->thermal_rad_bias[0] = metadata->band[index].rad_bias;
 
                 /* Grab the fill value for this band */
                 input->fill_value[I_BAND_THERMAL] =
                     metadata->band[index].fill_value;
             }
+            else if (input->num_thermal_bands > 1
+                     && strcmp (metadata->band[index].name,
+                                input->thermal_band_name[1]) == 0)
+            {
+                if (open_band(metadata->band[index].file_name,
+                              input, I_BAND_SECOND_THERMAL) != SUCCESS)
+                {
+                    RETURN_ERROR("Error opening second thermal", FUNC_NAME,
+                                 false);
+                }
+
+                input->thermal_rad_gain[1] = metadata->band[index].rad_gain;
+                input->thermal_rad_bias[1] = metadata->band[index].rad_bias;
+
+                input->fill_value[I_BAND_SECOND_THERMAL] =
+                    metadata->band[index].fill_value;
+            }
         }
 
         /* Only look at the ones with the product name we are looking for */
@@ -448,6 +535,14 @@ bool GetXMLInput
         }
     }
 
+    if (input->num_thermal_bands > 1
+        && input->band_fd[I_BAND_SECOND_THERMAL] == NULL)
+    {
+        snprintf (msg, sizeof (msg), "Thermal band %s was not found",
+                  input->thermal_band_name[1]);
+        RETURN_ERROR (msg, FUNC_NAME, false);
+    }
+
     /* Get the product ID */
     input->meta.product_id = strdup(metadata->global.product_id);
 
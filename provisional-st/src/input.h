@@ -81,18 +81,22 @@ typedef struct
     float x_pixel_size;
     float y_pixel_size;
     char reference_band_name[30];
+    int num_thermal_bands;        /* Thermal bands processed */
+    char thermal_band_name[MAX_THERMAL_BANDS][30]; /* The first is the
+                                                      reference band */
     char *band_name[MAX_INPUT_BANDS];
     FILE *band_fd[MAX_INPUT_BANDS];
     int fill_value[MAX_INPUT_BANDS];
-    float thermal_rad_gain;       /* Thermal radiance gain */
-    float thermal_rad_bias;       /* Thermal radiance bias */
+    float thermal_rad_gain[MAX_THERMAL_BANDS]; /* Thermal radiance gain */
+    float thermal_rad_bias[MAX_THERMAL_BANDS]; /* Thermal radiance bias */
 } Input_Data_t;
 
 
 /* Prototypes */
 Input_Data_t *open_input
 (
-    Espa_internal_meta_t *metadata
+    Espa_internal_meta_t *metadata,
+    bool all_thermal_bands
 );
 
 int close_input
@@ -103,7 +107,7 @@ int close_input
 int read_input
 (
     Input_Data_t *input_data,
-    float *band_thermal,
+    float **band_thermal,
     int16_t *band_elevation,
     int pixel_count
 );
@@ -111,7 +115,8 @@ int read_input
 bool GetXMLInput
 (
     Input_Data_t *input,
-    Espa_internal_meta_t *metadata
+    Espa_internal_meta_t *metadata,
+    bool all_thermal_bands
 );
 
 
@@ -8,7 +8,9 @@
  NAME:  open_intermediate
 
  PURPOSE: Open intermediate files (thermal radiance, upwelled radiance,
-          downwelled radiance, and transmittance). 
+          downwelled radiance, and transmittance) for one of the thermal
+          bands.  The bands after the reference thermal band are named with
+          their band name appended.
 
  RETURN VALUE: SUCCESS
                FAILURE
@@ -16,33 +18,45 @@
 int open_intermediate
 (
     Input_Data_t *input,
+    int thermal_band,
     Intermediate_Data_t *inter
 )
 {
     char *FUNC_NAME = "open_intermediate";
     char msg[PATH_MAX];
 
+    inter->band_suffix[0] = '\0';
+    if (thermal_band > 0)
+    {
+        snprintf(inter->band_suffix, sizeof(inter->band_suffix), "_%s",
+                 input->thermal_band_name[thermal_band]);
+    }
+
     /* First figure out and assign the filenames */
     snprintf(inter->thermal_filename,
              sizeof(inter->thermal_filename),
-             "%s_%s.img",
+             "%s_%s%s.img",
              input->meta.product_id,
-             ST_THERMAL_RADIANCE_BAND_NAME);
+             ST_THERMAL_RADIANCE_BAND_NAME,
+             inter->band_suffix);
     snprintf(inter->upwelled_filename,
              sizeof(inter->upwelled_filename),
-             "%s_%s.img",
+             "%s_%s%s.img",
              input->meta.product_id,
-             ST_UPWELLED_RADIANCE_BAND_NAME);
+             ST_UPWELLED_RADIANCE_BAND_NAME,
+             inter->band_suffix);
     snprintf(inter->downwelled_filename,
              sizeof(inter->downwelled_filename),
-             "%s_%s.img",
+             "%s_%s%s.img",
              input->meta.product_id,
-             ST_DOWNWELLED_RADIANCE_BAND_NAME);
+             ST_DOWNWELLED_RADIANCE_BAND_NAME,
+             inter->band_suffix);
     snprintf(inter->transmittance_filename,
              sizeof(inter->transmittance_filename),
-             "%s_%s.img",
+             "%s_%s%s.img",
              input->meta.product_id,
-             ST_ATMOS_TRANS_BAND_NAME);
+             ST_ATMOS_TRANS_BAND_NAME,
+             inter->band_suffix);
 
     /* Now open the file descriptors */
     inter->thermal_fd = fopen(inter->thermal_filename, "wb");
@@ -86,8 +100,9 @@ int open_intermediate
 #if OUTPUT_CELL_DESIGNATION_BAND
     snprintf(inter->cell_filename,
              sizeof(inter->cell_filename),
-             "%s_cellnumbers.img",
-             input->meta.product_id);
+             "%s_cellnumbers%s.img",
+             input->meta.product_id,
+             inter->band_suffix);
 
     inter->cell_fd = fopen(inter->cell_filename, "wb");
     if (inter->cell_fd == NULL)
@@ -14,6 +14,8 @@
 /* Structure for the intermediate data */
 typedef struct
 {
+    char band_suffix[32];       /* Empty for the reference thermal band,
+                                   otherwise "_" and the band name */
     char thermal_filename[PATH_MAX];
     char transmittance_filename[PATH_MAX];
     char upwelled_filename[PATH_MAX];
@@ -38,6 +40,7 @@ typedef struct
 int open_intermediate
 (
     Input_Data_t *input,
+    int thermal_band,
     Intermediate_Data_t *inter
 );
 
@@ -4,6 +4,7 @@
 #include <stdbool.h>
 #include <stdint.h>
 #include <limits.h>
+#include <string.h>
 #include <time.h>
 
 
@@ -16,16 +17,15 @@
 
 #include "const.h"
 #include "utilities.h"
-
-
-#define MAX_DATE_LEN 28
+#include "output.h"
 
 
 /******************************************************************************
-  NAME:  add_st_band_product
+  NAME:  begin_st_metadata_transaction
 
-  PURPOSE:  Create a new envi output file including envi header and add the
-            associated information to the XML metadata file.
+  PURPOSE:  Parse the XML metadata file and prepare to collect up to
+            max_bands band additions, which are appended to the file together
+            by commit_st_metadata_transaction.
 
   RETURN VALUE:  Type = int
       Value    Description
@@ -33,70 +33,61 @@
       SUCCESS  No errors were encountered.
       ERROR    An error was encountered.
 ******************************************************************************/
-int add_st_band_product
+int begin_st_metadata_transaction
 (
+    St_metadata_transaction_t *transaction,
     char *xml_filename,
     char *reference_band_name,
-    char *image_filename,
-    char *product_name,
-    char *band_name,
-    char *short_name,
-    char *long_name,
-    char *data_units,
-    int min_range,
-    int max_range
+    int max_bands
 )
 {
-    char FUNC_NAME[] = "add_st_band_product";
+    char FUNC_NAME[] = "begin_st_metadata_transaction";
 
     int band_index = -1;
-    int src_index = -1;
-    char scene_name[PATH_MAX];
-    char *tmp_char = NULL;
-    Espa_internal_meta_t in_meta;
-    Espa_internal_meta_t tmp_meta;
-    Espa_band_meta_t *bmeta = NULL; /* pointer to the band metadata array
-                                       within the output structure */
     time_t tp;                   /* time structure */
     struct tm *tm = NULL;        /* time structure for UTC time */
-    char production_date[MAX_DATE_LEN+1]; /* current date/time for production */
-    Envi_header_t envi_hdr;   /* output ENVI header information */
-    char envi_file[PATH_MAX];
 
-    /* Initialize the input metadata structure */
-    init_metadata_struct (&in_meta);
+    transaction->xml_filename = xml_filename;
+    transaction->src_index = -1;
+    transaction->nbands = 0;
+    transaction->max_bands = max_bands;
+
+    /* Initialize the metadata structures so they can always be freed */
+    init_metadata_struct (&transaction->in_meta);
+    init_metadata_struct (&transaction->out_meta);
 
     /* Parse the metadata file into our internal metadata structure; also
        allocates space as needed for various pointers in the global and band
        metadata */
-    if (parse_metadata (xml_filename, &in_meta) != SUCCESS)
+    if (parse_metadata (xml_filename, &transaction->in_meta) != SUCCESS)
     {
         /* Error messages already written */
         return ERROR;
     }
 
     /* Find the representative band for metadata information */
-    for (band_index = 0; band_index < in_meta.nbands; band_index++)
+    for (band_index = 0; band_index < transaction->in_meta.nbands;
+         band_index++)
     {
-        if (((strcmp (in_meta.band[band_index].product, "L1T") == 0)
-             || (strcmp (in_meta.band[band_index].product, "L1G") == 0)
-             || (strcmp (in_meta.band[band_index].product, "L1TP") == 0)
-             || (strcmp (in_meta.band[band_index].product, "L1GT") == 0)
-             || (strcmp (in_meta.band[band_index].product, "L1GS") == 0))
-            && (strcmp (in_meta.band[band_index].name, reference_band_name)
-                == 0))
+        Espa_band_meta_t *band = &transaction->in_meta.band[band_index];
+
+        if (((strcmp (band->product, "L1T") == 0)
+             || (strcmp (band->product, "L1G") == 0)
+             || (strcmp (band->product, "L1TP") == 0)
+             || (strcmp (band->product, "L1GT") == 0)
+             || (strcmp (band->product, "L1GS") == 0))
+            && (strcmp (band->name, reference_band_name) == 0))
         {
             /* this is the index we'll use for output band information */
-            src_index = band_index;
+            transaction->src_index = band_index;
             break;
         }
     }
 
-    /* Figure out the scene name */
-    strcpy (scene_name, in_meta.band[src_index].file_name);
-    tmp_char = strchr (scene_name, '_');
-    if (tmp_char != NULL)
-        *tmp_char = '\0';
+    if (transaction->src_index == -1)
+    {
+        RETURN_ERROR ("Failed to find the reference band", FUNC_NAME, ERROR);
+    }
 
     /* Get the current date/time (UTC) for the production date of each band */
     if (time (&tp) == -1)
@@ -110,61 +101,104 @@ int add_st_band_product
         RETURN_ERROR ("converting time to UTC", FUNC_NAME, ERROR);
     }
 
-    if (strftime (production_date, MAX_DATE_LEN, "%Y-%m-%dT%H:%M:%SZ", tm) == 0)
+    if (strftime (transaction->production_date, MAX_DATE_LEN,
+                  "%Y-%m-%dT%H:%M:%SZ", tm) == 0)
     {
         RETURN_ERROR ("formatting the production date/time", FUNC_NAME, ERROR);
     }
 
-    /* Gather all the band information from the representative band */
+    /* The global metadata of the output won't be updated, only the band
+       metadata which is appended to the original XML file */
+    if (allocate_band_metadata (&transaction->out_meta, max_bands) != SUCCESS)
+        RETURN_ERROR("allocating band metadata", FUNC_NAME, ERROR);
+
+    return SUCCESS;
+}
 
-    /* Initialize the internal metadata for the output product. The global
-       metadata won't be updated, however the band metadata will be updated
-       and used later for appending to the original XML file. */
-    init_metadata_struct (&tmp_meta);
 
-    /* Allocate memory for the output band */
-    if (allocate_band_metadata (&tmp_meta, 1) != SUCCESS)
-        RETURN_ERROR("allocating band metadata", FUNC_NAME, ERROR);
-    bmeta = tmp_meta.band;
+/******************************************************************************
+  NAME:  add_st_band_to_transaction
 
-    snprintf (bmeta[0].short_name, sizeof (bmeta[0].short_name),
-              "%s", in_meta.global.product_id);
-    bmeta[0].short_name[4] = '\0';
-    strcat (bmeta[0].short_name, short_name);
-    snprintf (bmeta[0].product, sizeof (bmeta[0].product), "%s",
+  PURPOSE:  Create the envi header for a new output file and add the
+            associated band information to the transaction.
+
+  RETURN VALUE:  Type = int
+      Value    Description
+      -------  ---------------------------------------------------------------
+      SUCCESS  No errors were encountered.
+      ERROR    An error was encountered.
+******************************************************************************/
+int add_st_band_to_transaction
+(
+    St_metadata_transaction_t *transaction,
+    char *image_filename,
+    char *product_name,
+    char *band_name,
+    char *short_name,
+    char *long_name,
+    char *data_units,
+    float min_range,
+    float max_range
+)
+{
+    char FUNC_NAME[] = "add_st_band_to_transaction";
+
+    char *tmp_char = NULL;
+    Espa_internal_meta_t *in_meta = &transaction->in_meta;
+    Espa_band_meta_t *src_band = NULL;
+    Espa_band_meta_t *bmeta = NULL; /* pointer to the band metadata within
+                                       the output structure */
+    Envi_header_t envi_hdr;   /* output ENVI header information */
+    char envi_file[PATH_MAX];
+
+    if (transaction->nbands >= transaction->max_bands)
+    {
+        RETURN_ERROR ("Too many bands for the metadata transaction",
+                      FUNC_NAME, ERROR);
+    }
+
+    src_band = &in_meta->band[transaction->src_index];
+    bmeta = &transaction->out_meta.band[transaction->nbands];
+
+    /* Gather all the band information from the representative band */
+    snprintf (bmeta->short_name, sizeof (bmeta->short_name),
+              "%s", in_meta->global.product_id);
+    bmeta->short_name[4] = '\0';
+    strcat (bmeta->short_name, short_name);
+    snprintf (bmeta->product, sizeof (bmeta->product), "%s",
               product_name);
-    snprintf (bmeta[0].source, sizeof (bmeta[0].source), "level1");
-    snprintf (bmeta[0].category, sizeof (bmeta[0].category), "image");
-    bmeta[0].nlines = in_meta.band[src_index].nlines;
-    bmeta[0].nsamps = in_meta.band[src_index].nsamps;
-    bmeta[0].pixel_size[0] = in_meta.band[src_index].pixel_size[0];
-    bmeta[0].pixel_size[1] = in_meta.band[src_index].pixel_size[1];
-    snprintf (bmeta[0].pixel_units, sizeof (bmeta[0].pixel_units), "meters");
-    snprintf (bmeta[0].app_version, sizeof (bmeta[0].app_version),
+    snprintf (bmeta->source, sizeof (bmeta->source), "level1");
+    snprintf (bmeta->category, sizeof (bmeta->category), "image");
+    bmeta->nlines = src_band->nlines;
+    bmeta->nsamps = src_band->nsamps;
+    bmeta->pixel_size[0] = src_band->pixel_size[0];
+    bmeta->pixel_size[1] = src_band->pixel_size[1];
+    snprintf (bmeta->pixel_units, sizeof (bmeta->pixel_units), "meters");
+    snprintf (bmeta->app_version, sizeof (bmeta->app_version),
               "st_%s", ST_VERSION);
-    snprintf (bmeta[0].production_date, sizeof (bmeta[0].production_date),
-              "%s", production_date);
-    bmeta[0].data_type = ESPA_FLOAT32;
-    bmeta[0].fill_value = ST_NO_DATA_VALUE;
-    bmeta[0].valid_range[0] = min_range;
-    bmeta[0].valid_range[1] = max_range;
-    snprintf (bmeta[0].name, sizeof (bmeta[0].name), "%s", band_name);
-    snprintf (bmeta[0].long_name, sizeof (bmeta[0].long_name), "%s",
+    snprintf (bmeta->production_date, sizeof (bmeta->production_date),
+              "%s", transaction->production_date);
+    bmeta->data_type = ESPA_FLOAT32;
+    bmeta->fill_value = ST_NO_DATA_VALUE;
+    bmeta->valid_range[0] = min_range;
+    bmeta->valid_range[1] = max_range;
+    snprintf (bmeta->name, sizeof (bmeta->name), "%s", band_name);
+    snprintf (bmeta->long_name, sizeof (bmeta->long_name), "%s",
               long_name);
-    snprintf (bmeta[0].data_units, sizeof (bmeta[0].data_units), "%s",
+    snprintf (bmeta->data_units, sizeof (bmeta->data_units), "%s",
               data_units);
-    snprintf (bmeta[0].file_name, sizeof (bmeta[0].file_name), "%s",
+    snprintf (bmeta->file_name, sizeof (bmeta->file_name), "%s",
               image_filename);
 
     /* Create the ENVI header file for this band */
-    if (create_envi_struct (&bmeta[0], &in_meta.global, &envi_hdr) != SUCCESS)
+    if (create_envi_struct (bmeta, &in_meta->global, &envi_hdr) != SUCCESS)
     {
         RETURN_ERROR ("Failed to create ENVI header structure.", FUNC_NAME,
                       ERROR);
     }
 
     /* Write the ENVI header */
-    snprintf (envi_file, sizeof(envi_file), "%s", bmeta[0].file_name);
+    snprintf (envi_file, sizeof(envi_file), "%s", bmeta->file_name);
     tmp_char = strchr (envi_file, '.');
     if (tmp_char == NULL)
     {
@@ -178,16 +212,109 @@ int add_st_band_product
         RETURN_ERROR ("Failed writing ENVI header file", FUNC_NAME, ERROR);
     }
 
-    /* Append the ST band to the XML file */
-    if (append_metadata (1, bmeta, xml_filename)
-        != SUCCESS)
+    transaction->nbands++;
+
+    return SUCCESS;
+}
+
+
+/******************************************************************************
+  NAME:  commit_st_metadata_transaction
+
+  PURPOSE:  Append all of the bands added to the transaction to the XML
+            metadata file, which is written and validated once.
+
+  RETURN VALUE:  Type = int
+      Value    Description
+      -------  ---------------------------------------------------------------
+      SUCCESS  No errors were encountered.
+      ERROR    An error was encountered.
+******************************************************************************/
+int commit_st_metadata_transaction
+(
+    St_metadata_transaction_t *transaction
+)
+{
+    char FUNC_NAME[] = "commit_st_metadata_transaction";
+
+    if (transaction->nbands == 0)
+        return SUCCESS;
+
+    /* Append the ST bands to the XML file */
+    if (append_metadata (transaction->nbands, transaction->out_meta.band,
+                         transaction->xml_filename) != SUCCESS)
     {
-        RETURN_ERROR ("Appending spectral index bands to XML file",
-                       FUNC_NAME, ERROR);
+        RETURN_ERROR ("Appending ST bands to XML file", FUNC_NAME, ERROR);
     }
 
-    free_metadata (&in_meta);
-    free_metadata (&tmp_meta);
+    transaction->nbands = 0;
 
     return SUCCESS;
 }
+
+
+/******************************************************************************
+  NAME:  free_st_metadata_transaction
+
+  PURPOSE:  Release the metadata held by the transaction.  Bands which were
+            not committed are discarded.
+******************************************************************************/
+void free_st_metadata_transaction
+(
+    St_metadata_transaction_t *transaction
+)
+{
+    free_metadata (&transaction->in_meta);
+    free_metadata (&transaction->out_meta);
+    transaction->nbands = 0;
+}
+
+
+/******************************************************************************
+  NAME:  add_st_band_product
+
+  PURPOSE:  Create a new envi output file including envi header and add the
+            associated information to the XML metadata file.
+
+  RETURN VALUE:  Type = int
+      Value    Description
+      -------  ---------------------------------------------------------------
+      SUCCESS  No errors were encountered.
+      ERROR    An error was encountered.
+******************************************************************************/
+int add_st_band_product
+(
+    char *xml_filename,
+    char *reference_band_name,
+    char *image_filename,
+    char *product_name,
+    char *band_name,
+    char *short_name,
+    char *long_name,
+    char *data_units,
+    float min_range,
+    float max_range
+)
+{
+    int status = SUCCESS;
+    St_metadata_transaction_t transaction;
+
+    status = begin_st_metadata_transaction (&transaction, xml_filename,
+                                            reference_band_name, 1);
+
+    if (status == SUCCESS)
+    {
+        status = add_st_band_to_transaction (&transaction, image_filename,
+                                             product_name, band_name,
+                                             short_name, long_name,
+                                             data_units, min_range,
+                                             max_range);
+    }
+
+    if (status == SUCCESS)
+        status = commit_st_metadata_transaction (&transaction);
+
+    free_st_metadata_transaction (&transaction);
+
+    return status;
+}
@@ -1,8 +1,62 @@
-
 #ifndef OUTPUT_H
 #define OUTPUT_H
 
 
+#include "espa_metadata.h"
+
+
+#define MAX_DATE_LEN 28
+
+
+/* Band additions to the XML metadata file which are collected and then
+   appended to the file with a single write */
+typedef struct
+{
+    char *xml_filename;             /* XML file being updated */
+    Espa_internal_meta_t in_meta;   /* metadata parsed from the XML file */
+    Espa_internal_meta_t out_meta;  /* bands to append to the XML file */
+    int src_index;                  /* representative band within in_meta */
+    int nbands;                     /* bands added to out_meta */
+    int max_bands;                  /* bands allocated in out_meta */
+    char production_date[MAX_DATE_LEN+1]; /* production date for the bands */
+} St_metadata_transaction_t;
+
+
+int begin_st_metadata_transaction
+(
+    St_metadata_transaction_t *transaction,
+    char *xml_filename,
+    char *reference_band_name,
+    int max_bands
+);
+
+
+int add_st_band_to_transaction
+(
+    St_metadata_transaction_t *transaction,
+    char *image_filename,
+    char *product_name,
+    char *band_name,
+    char *short_name,
+    char *long_name,
+    char *data_units,
+    float min_range,
+    float max_range
+);
+
+
+int commit_st_metadata_transaction
+(
+    St_metadata_transaction_t *transaction
+);
+
+
+void free_st_metadata_transaction
+(
+    St_metadata_transaction_t *transaction
+);
+
+
 int add_st_band_product
 (
     char *xml_filename,
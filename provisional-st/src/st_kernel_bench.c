@@ -0,0 +1,813 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <getopt.h>
+
+/* The kernels are static within the engine, so the engine is compiled into
+   the benchmark instead of being linked */
+#include "atmospheric_engine.c"
+
+
+/*****************************************************************************
+DESCRIPTION: Microbenchmarks of the numerical kernels of the atmospheric
+engine, on inputs the size of those of a Landsat scene.  Each kernel is run
+until a measurement lasts long enough to time, which also warms the caches,
+and then measured a number of times.  The fastest and the median nanoseconds
+per call are reported, along with the throughput in the items each call
+processes.
+
+A kernel which has an optimized replacement is listed once for each, under
+the same name, so the two are compared side by side.
+*****************************************************************************/
+
+
+/* Input sizes, matching the spectral response files, the MODTRAN runs of
+   modtran_tail.txt, and the grid points of a scene */
+#define NUM_SRS (101)
+#define NUM_MODTRAN (101)
+#define GRID_ROWS (16)
+#define GRID_COLS (16)
+#define NUM_GRID_POINTS (GRID_ROWS * GRID_COLS)
+#define NUM_ELEVATIONS (9)
+
+/* Points searched for the center point after the first pixel of a line */
+#define NUM_NEIGHBOR_POINTS (9)
+
+/* Pixels the per pixel kernels cycle through, a power of two */
+#define NUM_PIXELS (4096)
+
+/* Spacing of the grid points */
+#define GRID_DEGREES (0.3)
+#define GRID_METERS (32463.0)
+
+#define DEFAULT_REPETITIONS (7)
+
+/* Shortest measurement which is timed */
+#define MIN_MEASURE_SECONDS (0.05)
+
+#define MAX_KERNEL_NAME (48)
+
+
+/* Inputs of the kernels, the same for every measurement */
+typedef struct
+{
+    double srs_wavelength[NUM_SRS];
+    double srs_response[NUM_SRS];
+    double modtran[NUM_MODTRAN * MODTRAN_NUM_COLUMNS];
+
+    double lon[NUM_GRID_POINTS];
+    double lat[NUM_GRID_POINTS];
+    double map_x[NUM_GRID_POINTS];
+    double map_y[NUM_GRID_POINTS];
+    double elevation[NUM_GRID_POINTS * NUM_ELEVATIONS];
+    double transmission[NUM_GRID_POINTS * NUM_ELEVATIONS];
+    double upwelled_radiance[NUM_GRID_POINTS * NUM_ELEVATIONS];
+    double downwelled_radiance[NUM_GRID_POINTS * NUM_ELEVATIONS];
+    ST_ATMOS_GRID grid;
+
+    double pixel_lon[NUM_PIXELS];
+    double pixel_lat[NUM_PIXELS];
+    double pixel_height[NUM_PIXELS];
+    int pixel_point[NUM_PIXELS];
+    int pixel_below[NUM_PIXELS];
+    int pixel_above[NUM_PIXELS];
+    double pixel_weights[NUM_PIXELS][NUM_CELL_POINTS];
+    double pixel_at_height[NUM_PIXELS][NUM_CELL_POINTS][AHP_NUM_PARAMETERS];
+} BENCH_DATA;
+
+
+/* Runs a kernel calls times and returns the number of items processed */
+typedef long (*BENCH_KERNEL)
+(
+    const BENCH_DATA *data,
+    long calls
+);
+
+
+typedef struct
+{
+    const char *name;     /* Kernel measured */
+    const char *variant;  /* reference, or the replacement */
+    const char *items;    /* What the throughput counts */
+    BENCH_KERNEL kernel;
+} BENCH_ENTRY;
+
+
+/* Results are accumulated here so the calls are not optimized away */
+static volatile double bench_sink = 0.0;
+
+
+/*****************************************************************************
+ NAME:  bench_time
+
+ PURPOSE: Monotonic time in seconds.
+*****************************************************************************/
+static double bench_time()
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return now.tv_sec + now.tv_nsec / 1000000000.0;
+}
+
+
+/*****************************************************************************
+ NAME:  initialize_bench_data
+
+ PURPOSE: Fill in the kernel inputs.  The spectral response is a band
+          centered at 10.9 microns, the MODTRAN radiances follow Planck's
+          equation through a simple atmosphere, and the grid is a regular
+          grid of points with parameters which vary with elevation.
+*****************************************************************************/
+static void initialize_bench_data
+(
+    BENCH_DATA *data  /* O: the inputs */
+)
+{
+    int i;
+    int point;
+    int elevation;
+    int vertex;
+    int row;
+    int col;
+    double wavelength;
+    double tau;
+    double blackbody[3];
+    double temperatures[3] = {273.0, 310.0, 295.0};
+    int columns[3] = {MODTRAN_RADIANCE_273, MODTRAN_RADIANCE_310,
+                      MODTRAN_RADIANCE_000};
+    int index;
+    unsigned int seed = 1;
+
+    for (i = 0; i < NUM_SRS; i++)
+    {
+        wavelength = 9.0 + i * 0.05;
+        data->srs_wavelength[i] = wavelength;
+        data->srs_response[i] = exp(-((wavelength - 10.9)
+                                      * (wavelength - 10.9)) / 0.18);
+    }
+
+    /* MODTRAN writes decreasing wavelengths */
+    for (i = 0; i < NUM_MODTRAN; i++)
+    {
+        wavelength = 14.0 - i * 0.05;
+        tau = exp(-0.3 * (1.0 + 0.8 * ((wavelength - 10.8) / 2.5)
+                                    * ((wavelength - 10.8) / 2.5)));
+
+        data->modtran[i * MODTRAN_NUM_COLUMNS + MODTRAN_WAVELENGTH] =
+            wavelength;
+        for (index = 0; index < 3; index++)
+        {
+            planck_eq(&wavelength, 1, temperatures[index],
+                      &blackbody[index]);
+            data->modtran[i * MODTRAN_NUM_COLUMNS + columns[index]] =
+                tau * blackbody[index] + (1.0 - tau) * 0.8 * blackbody[0];
+        }
+    }
+
+    for (row = 0; row < GRID_ROWS; row++)
+    {
+        for (col = 0; col < GRID_COLS; col++)
+        {
+            point = row * GRID_COLS + col;
+
+            data->lon[point] = -100.0 + col * GRID_DEGREES;
+            data->lat[point] = 40.0 + row * GRID_DEGREES;
+            data->map_x[point] = 300000.0 + col * GRID_METERS;
+            data->map_y[point] = 4400000.0 + row * GRID_METERS;
+
+            for (elevation = 0; elevation < NUM_ELEVATIONS; elevation++)
+            {
+                index = point * NUM_ELEVATIONS + elevation;
+
+                data->elevation[index] = elevation * 0.5;
+                data->transmission[index] = 0.7 + 0.03 * elevation
+                                            + 0.001 * point;
+                data->upwelled_radiance[index] = 0.00015
+                                                 - 0.00001 * elevation;
+                data->downwelled_radiance[index] = 0.00025
+                                                   - 0.00002 * elevation;
+            }
+        }
+    }
+
+    data->grid.count = NUM_GRID_POINTS;
+    data->grid.rows = GRID_ROWS;
+    data->grid.cols = GRID_COLS;
+    data->grid.num_elevations = NUM_ELEVATIONS;
+    data->grid.lon = data->lon;
+    data->grid.lat = data->lat;
+    data->grid.map_x = data->map_x;
+    data->grid.map_y = data->map_y;
+    data->grid.elevation = data->elevation;
+    data->grid.transmission = data->transmission;
+    data->grid.upwelled_radiance = data->upwelled_radiance;
+    data->grid.downwelled_radiance = data->downwelled_radiance;
+
+    /* Pixels scattered over the interior of the grid */
+    for (i = 0; i < NUM_PIXELS; i++)
+    {
+        double col_fraction = (rand_r(&seed) / (double)RAND_MAX)
+                              * (GRID_COLS - 3) + 1.0;
+        double row_fraction = (rand_r(&seed) / (double)RAND_MAX)
+                              * (GRID_ROWS - 3) + 1.0;
+        double x = 300000.0 + col_fraction * GRID_METERS;
+        double y = 4400000.0 + row_fraction * GRID_METERS;
+        int vertices[NUM_CELL_POINTS];
+
+        data->pixel_lon[i] = -100.0 + col_fraction * GRID_DEGREES;
+        data->pixel_lat[i] = 40.0 + row_fraction * GRID_DEGREES;
+        data->pixel_height[i] = (rand_r(&seed) / (double)RAND_MAX) * 3.5;
+
+        point = (int)row_fraction * GRID_COLS + (int)col_fraction;
+        data->pixel_point[i] = point;
+        determine_height_bracket(&data->grid, point, data->pixel_height[i],
+                                 &data->pixel_below[i],
+                                 &data->pixel_above[i]);
+
+        vertices[LL_POINT] = point;
+        vertices[UL_POINT] = point + GRID_COLS;
+        vertices[UR_POINT] = point + GRID_COLS + 1;
+        vertices[LR_POINT] = point + 1;
+        determine_location_weights(&data->grid, vertices, x, y,
+                                   data->pixel_weights[i]);
+
+        for (vertex = 0; vertex < NUM_CELL_POINTS; vertex++)
+        {
+            interpolate_to_height(&data->grid, vertices[vertex],
+                                  data->pixel_below[i], data->pixel_above[i],
+                                  data->pixel_height[i],
+                                  data->pixel_at_height[i][vertex]);
+        }
+    }
+}
+
+
+/*****************************************************************************
+ The kernels, each run calls times.  The inputs which vary between calls are
+ cycled through so the results are not the same every call.
+*****************************************************************************/
+static long bench_planck_eq
+(
+    const BENCH_DATA *data,
+    long calls
+)
+{
+    long call;
+    double radiance[NUM_SRS];
+
+    for (call = 0; call < calls; call++)
+    {
+        planck_eq(data->srs_wavelength, NUM_SRS, 250.0 + (call & 63),
+                  radiance);
+        bench_sink += radiance[call % NUM_SRS];
+    }
+
+    return calls * NUM_SRS;
+}
+
+
+static long bench_spline
+(
+    const BENCH_DATA *data,
+    long calls
+)
+{
+    long call;
+    double y2[NUM_SRS];
+
+    for (call = 0; call < calls; call++)
+    {
+        spline(data->srs_wavelength, data->srs_response, NUM_SRS,
+               1e30, 1e30, y2);
+        bench_sink += y2[call % NUM_SRS];
+    }
+
+    return calls * NUM_SRS;
+}
+
+
+/* Each call interpolates the spline at the increasing locations
+   int_tabulated uses, keeping the search bracket between them */
+#define NUM_SPLINT_LOCATIONS (101)
+static long splint_calls
+(
+    const BENCH_DATA *data,
+    long calls,
+    bool keep_bracket
+)
+{
+    long call;
+    int i;
+    int klo;
+    int khi;
+    double y;
+    double y2[NUM_SRS];
+    double step = (data->srs_wavelength[NUM_SRS - 1]
+                   - data->srs_wavelength[0]) / (NUM_SPLINT_LOCATIONS - 1);
+
+    spline(data->srs_wavelength, data->srs_response, NUM_SRS, 1e30, 1e30,
+           y2);
+
+    for (call = 0; call < calls; call++)
+    {
+        klo = -1;
+        khi = -1;
+        for (i = 0; i < NUM_SPLINT_LOCATIONS; i++)
+        {
+            if (!keep_bracket)
+            {
+                klo = -1;
+                khi = -1;
+            }
+
+            splint(data->srs_wavelength, data->srs_response, y2, NUM_SRS,
+                   data->srs_wavelength[0] + i * step, &klo, &khi, &y);
+            bench_sink += y;
+        }
+    }
+
+    return calls * NUM_SPLINT_LOCATIONS;
+}
+
+
+static long bench_splint
+(
+    const BENCH_DATA *data,
+    long calls
+)
+{
+    return splint_calls(data, calls, false);
+}
+
+
+static long bench_splint_bracket
+(
+    const BENCH_DATA *data,
+    long calls
+)
+{
+    return splint_calls(data, calls, true);
+}
+
+
+static long bench_int_tabulated
+(
+    const BENCH_DATA *data,
+    long calls
+)
+{
+    long call;
+    double result;
+
+    for (call = 0; call < calls; call++)
+    {
+        int_tabulated(data->srs_wavelength, data->srs_response, NUM_SRS,
+                      &result);
+        bench_sink += result;
+    }
+
+    return calls * NUM_SRS;
+}
+
+
+static long bench_calculate_lt
+(
+    const BENCH_DATA *data,
+    long calls
+)
+{
+    long call;
+    double radiance;
+
+    for (call = 0; call < calls; call++)
+    {
+        calculate_lt(250.0 + (call & 63), data->srs_wavelength,
+                     data->srs_response, NUM_SRS, &radiance);
+        bench_sink += radiance;
+    }
+
+    return calls;
+}
+
+
+static long bench_calculate_lobs
+(
+    const BENCH_DATA *data,
+    long calls
+)
+{
+    long call;
+    double radiance;
+
+    for (call = 0; call < calls; call++)
+    {
+        calculate_lobs(data->modtran, data->srs_wavelength,
+                       data->srs_response, NUM_MODTRAN, NUM_SRS,
+                       MODTRAN_RADIANCE_273 + (call % 3), &radiance);
+        bench_sink += radiance;
+    }
+
+    return calls;
+}
+
+
+static long bench_linear_interpolate_over_modtran
+(
+    const BENCH_DATA *data,
+    long calls
+)
+{
+    long call;
+    double radiance[NUM_SRS];
+
+    for (call = 0; call < calls; call++)
+    {
+        linear_interpolate_over_modtran(data->modtran,
+                                        MODTRAN_RADIANCE_273 + (call % 3),
+                                        data->srs_wavelength, NUM_MODTRAN,
+                                        NUM_SRS, radiance);
+        bench_sink += radiance[call % NUM_SRS];
+    }
+
+    return calls * NUM_SRS;
+}
+
+
+static long bench_haversine_distance
+(
+    const BENCH_DATA *data,
+    long calls
+)
+{
+    long call;
+    int pixel;
+    int point;
+    double total = 0.0;
+
+    for (call = 0; call < calls; call++)
+    {
+        pixel = call & (NUM_PIXELS - 1);
+        point = data->pixel_point[pixel];
+        total += haversine_distance(data->lon[point], data->lat[point],
+                                    data->pixel_lon[pixel],
+                                    data->pixel_lat[pixel]);
+    }
+    bench_sink += total;
+
+    return calls;
+}
+
+
+/* The center point from all of the points, as for the first pixel of a
+   line, or from the points around the previous center */
+static long center_grid_point_calls
+(
+    const BENCH_DATA *data,
+    long calls,
+    bool map_space,
+    int num_points
+)
+{
+    long call;
+    int pixel;
+    int point;
+    int row;
+    int col;
+    int count;
+    GRID_ITEM grid_points[NUM_GRID_POINTS];
+
+    for (call = 0; call < calls; call++)
+    {
+        pixel = call & (NUM_PIXELS - 1);
+
+        if (num_points == NUM_GRID_POINTS)
+        {
+            for (point = 0; point < NUM_GRID_POINTS; point++)
+                grid_points[point].index = point;
+            count = NUM_GRID_POINTS;
+        }
+        else
+        {
+            count = 0;
+            for (row = -1; row <= 1; row++)
+            {
+                for (col = -1; col <= 1; col++)
+                {
+                    grid_points[count].index = data->pixel_point[pixel]
+                                               + row * GRID_COLS + col;
+                    count++;
+                }
+            }
+        }
+
+        if (map_space)
+        {
+            bench_sink += determine_center_grid_point(&data->grid, true,
+                300000.0 + (data->pixel_lon[pixel] + 100.0)
+                           / GRID_DEGREES * GRID_METERS,
+                4400000.0 + (data->pixel_lat[pixel] - 40.0)
+                            / GRID_DEGREES * GRID_METERS,
+                count, grid_points);
+        }
+        else
+        {
+            bench_sink += determine_center_grid_point(&data->grid, false,
+                data->pixel_lon[pixel], data->pixel_lat[pixel], count,
+                grid_points);
+        }
+    }
+
+    return calls;
+}
+
+
+static long bench_center_all_points
+(
+    const BENCH_DATA *data,
+    long calls
+)
+{
+    return center_grid_point_calls(data, calls, false, NUM_GRID_POINTS);
+}
+
+
+static long bench_center_neighbors
+(
+    const BENCH_DATA *data,
+    long calls
+)
+{
+    return center_grid_point_calls(data, calls, false, NUM_NEIGHBOR_POINTS);
+}
+
+
+static long bench_center_neighbors_map
+(
+    const BENCH_DATA *data,
+    long calls
+)
+{
+    return center_grid_point_calls(data, calls, true, NUM_NEIGHBOR_POINTS);
+}
+
+
+static long bench_interpolate_to_height
+(
+    const BENCH_DATA *data,
+    long calls
+)
+{
+    long call;
+    int pixel;
+    double at_height[AHP_NUM_PARAMETERS];
+
+    for (call = 0; call < calls; call++)
+    {
+        pixel = call & (NUM_PIXELS - 1);
+        interpolate_to_height(&data->grid, data->pixel_point[pixel],
+                              data->pixel_below[pixel],
+                              data->pixel_above[pixel],
+                              data->pixel_height[pixel], at_height);
+        bench_sink += at_height[AHP_TRANSMISSION];
+    }
+
+    return calls;
+}
+
+
+static long bench_interpolate_to_location
+(
+    const BENCH_DATA *data,
+    long calls
+)
+{
+    long call;
+    int pixel;
+    double parameters[AHP_NUM_PARAMETERS];
+
+    for (call = 0; call < calls; call++)
+    {
+        pixel = call & (NUM_PIXELS - 1);
+        interpolate_to_location(
+            data->pixel_weights[pixel],
+            (double (*)[AHP_NUM_PARAMETERS])data->pixel_at_height[pixel],
+            parameters);
+        bench_sink += parameters[AHP_TRANSMISSION];
+    }
+
+    return calls;
+}
+
+
+static const BENCH_ENTRY bench_entries[] =
+{
+    {"planck_eq", "reference", "wavelengths", bench_planck_eq},
+    {"spline", "reference", "points", bench_spline},
+    {"splint", "reference", "locations", bench_splint},
+    {"splint", "kept bracket", "locations", bench_splint_bracket},
+    {"int_tabulated", "reference", "points", bench_int_tabulated},
+    {"calculate_lt", "reference", "bands", bench_calculate_lt},
+    {"calculate_lobs", "reference", "bands", bench_calculate_lobs},
+    {"linear_interpolate_over_modtran", "reference", "wavelengths",
+     bench_linear_interpolate_over_modtran},
+    {"haversine_distance", "reference", "distances",
+     bench_haversine_distance},
+    {"determine_center_grid_point", "all points", "pixels",
+     bench_center_all_points},
+    {"determine_center_grid_point", "neighbors", "pixels",
+     bench_center_neighbors},
+    {"determine_center_grid_point", "neighbors map", "pixels",
+     bench_center_neighbors_map},
+    {"interpolate_to_height", "reference", "vertices",
+     bench_interpolate_to_height},
+    {"interpolate_to_location", "reference", "pixels",
+     bench_interpolate_to_location},
+    {NULL, NULL, NULL, NULL}
+};
+
+
+/*****************************************************************************
+ NAME:  compare_doubles
+
+ PURPOSE: qsort comparison of the measurements.
+*****************************************************************************/
+static int compare_doubles
+(
+    const void *a,
+    const void *b
+)
+{
+    double value_a = *(const double *)a;
+    double value_b = *(const double *)b;
+
+    if (value_a < value_b)
+        return -1;
+    else if (value_b < value_a)
+        return 1;
+
+    return 0;
+}
+
+
+/*****************************************************************************
+ NAME:  run_entry
+
+ PURPOSE: Measure a kernel and print its line of the report.  The number of
+          calls is doubled until a measurement lasts MIN_MEASURE_SECONDS,
+          which is the warm-up, and then repetitions measurements are made.
+*****************************************************************************/
+static void run_entry
+(
+    const BENCH_ENTRY *entry, /* I: the kernel */
+    const BENCH_DATA *data,   /* I: the inputs */
+    int repetitions           /* I: number of measurements */
+)
+{
+    long calls = 1;
+    long items = 0;
+    int repetition;
+    double start_time;
+    double seconds;
+    double ns_per_call[repetitions];
+
+    while (1)
+    {
+        start_time = bench_time();
+        entry->kernel(data, calls);
+        seconds = bench_time() - start_time;
+
+        if (seconds >= MIN_MEASURE_SECONDS)
+            break;
+
+        calls *= 2;
+    }
+
+    for (repetition = 0; repetition < repetitions; repetition++)
+    {
+        start_time = bench_time();
+        items = entry->kernel(data, calls);
+        seconds = bench_time() - start_time;
+
+        ns_per_call[repetition] = seconds * 1000000000.0 / calls;
+    }
+
+    qsort(ns_per_call, repetitions, sizeof(double), compare_doubles);
+
+    /* Throughput from the fastest measurement */
+    printf("%-32s %-14s %12ld %12.1f %12.1f %12.3f M%s/s\n",
+           entry->name, entry->variant, calls, ns_per_call[0],
+           ns_per_call[repetitions / 2],
+           (double)items / calls * 1000.0 / ns_per_call[0], entry->items);
+}
+
+
+/****************************************************************************
+Method: usage
+
+Description: Display help/usage information to the user.
+****************************************************************************/
+void usage()
+{
+    printf("Surface Temperature - st_kernel_bench\n");
+    printf("\n");
+    printf("Times the numerical kernels of the atmospheric engine.\n");
+    printf("\n");
+    printf("usage: st_kernel_bench"
+           " [--repetitions=<count>]"
+           " [--kernel=<name>]\n");
+    printf("\n");
+    printf ("where the following parameters are optional:\n");
+    printf ("    --repetitions: number of measurements of each kernel"
+            " (default is %d)\n", DEFAULT_REPETITIONS);
+    printf ("    --kernel: only measure the kernels whose name contains"
+            " this\n");
+    printf ("\n");
+    printf ("st_kernel_bench --help will print the usage statement\n");
+    printf ("\n");
+}
+
+
+/*****************************************************************************
+Method:  main
+
+Description:  Main for the application.
+*****************************************************************************/
+int main(int argc, char *argv[])
+{
+    char FUNC_NAME[] = "main";
+    char kernel[MAX_KERNEL_NAME] = "";
+    int repetitions = DEFAULT_REPETITIONS;
+    int c;
+    int option_index;
+    const BENCH_ENTRY *entry;
+    BENCH_DATA *data;
+
+    static struct option long_options[] = {
+        {"repetitions", required_argument, 0, 'r'},
+        {"kernel", required_argument, 0, 'k'},
+        {"help", no_argument, 0, 'h'},
+        {0, 0, 0, 0}
+    };
+
+    opterr = 0; /* turn off getopt_long error msgs as we'll print our own */
+    while (1)
+    {
+        c = getopt_long(argc, argv, "", long_options, &option_index);
+        if (c == -1)
+            break;
+
+        switch (c)
+        {
+            case 'r':
+                repetitions = atoi(optarg);
+                break;
+
+            case 'k':
+                snprintf(kernel, sizeof(kernel), "%s", optarg);
+                break;
+
+            case 'h':
+                usage();
+                return EXIT_SUCCESS;
+
+            case '?':
+            default:
+                usage();
+                RETURN_ERROR("Unknown option", FUNC_NAME, EXIT_FAILURE);
+        }
+    }
+
+    if (repetitions < 1)
+    {
+        usage();
+        RETURN_ERROR("--repetitions must be at least 1", FUNC_NAME,
+                     EXIT_FAILURE);
+    }
+
+    /* Too large for the stack */
+    data = malloc(sizeof(BENCH_DATA));
+    if (data == NULL)
+    {
+        RETURN_ERROR("Allocating the benchmark inputs", FUNC_NAME,
+                     EXIT_FAILURE);
+    }
+    initialize_bench_data(data);
+
+    printf("%-32s %-14s %12s %12s %12s %12s\n", "kernel", "variant",
+           "calls", "min ns/call", "median ns", "throughput");
+
+    for (entry = bench_entries; entry->name != NULL; entry++)
+    {
+        if (strstr(entry->name, kernel) == NULL)
+            continue;
+
+        run_entry(entry, data, repetitions);
+    }
+
+    free(data);
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,542 @@
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include "const.h"
+#include "utilities.h"
+#include "st_store.h"
+
+
+/* CRC-32 of each byte value, for the polynomial zlib uses */
+static uint32_t crc_table[256];
+static bool crc_table_ready = false;
+
+
+/*****************************************************************************
+ NAME:  store_crc32
+
+ PURPOSE: The CRC-32 of some bytes, the same as zlib.crc32 gives.
+*****************************************************************************/
+static uint32_t store_crc32
+(
+    const unsigned char *bytes,
+    size_t size
+)
+{
+    uint32_t crc;
+    uint32_t value;
+    size_t index;
+    int bit;
+
+    if (!crc_table_ready)
+    {
+        for (index = 0; index < 256; index++)
+        {
+            value = (uint32_t) index;
+            for (bit = 0; bit < 8; bit++)
+            {
+                value = (value & 1) ? 0xedb88320 ^ (value >> 1)
+                                    : value >> 1;
+            }
+            crc_table[index] = value;
+        }
+        crc_table_ready = true;
+    }
+
+    crc = 0xffffffff;
+    for (index = 0; index < size; index++)
+    {
+        crc = crc_table[(crc ^ bytes[index]) & 0xff] ^ (crc >> 8);
+    }
+
+    return crc ^ 0xffffffff;
+}
+
+
+/* Little-endian fields of the header and section table */
+static uint32_t get_uint32(const unsigned char *bytes)
+{
+    return (uint32_t) bytes[0] | (uint32_t) bytes[1] << 8
+           | (uint32_t) bytes[2] << 16 | (uint32_t) bytes[3] << 24;
+}
+
+static uint64_t get_uint64(const unsigned char *bytes)
+{
+    return (uint64_t) get_uint32(bytes)
+           | (uint64_t) get_uint32(bytes + 4) << 32;
+}
+
+static void put_uint32(unsigned char *bytes, uint32_t value)
+{
+    bytes[0] = value & 0xff;
+    bytes[1] = (value >> 8) & 0xff;
+    bytes[2] = (value >> 16) & 0xff;
+    bytes[3] = (value >> 24) & 0xff;
+}
+
+static void put_uint64(unsigned char *bytes, uint64_t value)
+{
+    put_uint32(bytes, value & 0xffffffff);
+    put_uint32(bytes + 4, value >> 32);
+}
+
+
+/*****************************************************************************
+ NAME:  host_is_little_endian
+
+ PURPOSE: The sections are used in place, so their values must already be
+          in the byte order of the host.
+*****************************************************************************/
+static bool host_is_little_endian()
+{
+    uint32_t probe = STORE_BYTE_ORDER_MARK;
+
+    return *(unsigned char *) &probe == (STORE_BYTE_ORDER_MARK & 0xff);
+}
+
+
+static size_t store_type_size(STORE_TYPE type)
+{
+    switch (type)
+    {
+        case STORE_INT32:
+            return sizeof(int32_t);
+        case STORE_FLOAT32:
+            return sizeof(float);
+        case STORE_FLOAT64:
+            return sizeof(double);
+    }
+
+    return 0;
+}
+
+
+static uint64_t store_aligned(uint64_t offset)
+{
+    return (offset + STORE_ALIGNMENT - 1) / STORE_ALIGNMENT * STORE_ALIGNMENT;
+}
+
+
+/*****************************************************************************
+ NAME:  open_store
+
+ PURPOSE: Map a store, and check its header, section table, and the CRC-32
+          of every section.
+
+ RETURN VALUE: SUCCESS
+               FAILURE
+*****************************************************************************/
+int open_store
+(
+    const char *filename,        /* I: the store */
+    STORE *store                 /* O: the mapped and checked store */
+)
+{
+    char *FUNC_NAME = "open_store";
+    char msg[PATH_MAX + 100];
+    const char *reason = NULL;
+    const unsigned char *bytes;
+    const unsigned char *entry;
+    STORE_SECTION *section;
+    struct stat status;
+    uint64_t table_end;
+    size_t type_size;
+    int fd;
+    int index;
+
+    memset(store, 0, sizeof(*store));
+    snprintf(store->filename, sizeof(store->filename), "%s", filename);
+
+    if (!host_is_little_endian())
+    {
+        RETURN_ERROR("Stores are only read on little-endian hosts",
+                     FUNC_NAME, FAILURE);
+    }
+
+    fd = open(filename, O_RDONLY);
+    if (fd < 0)
+    {
+        snprintf(msg, sizeof(msg), "Opening store %s", filename);
+        RETURN_ERROR(msg, FUNC_NAME, FAILURE);
+    }
+
+    if (fstat(fd, &status) != 0 || status.st_size < STORE_HEADER_SIZE)
+    {
+        close(fd);
+        snprintf(msg, sizeof(msg), "Store %s is too short for a store",
+                 filename);
+        RETURN_ERROR(msg, FUNC_NAME, FAILURE);
+    }
+
+    store->size = status.st_size;
+    store->map = mmap(NULL, store->size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (store->map == MAP_FAILED)
+    {
+        store->map = NULL;
+        snprintf(msg, sizeof(msg), "Mapping store %s", filename);
+        RETURN_ERROR(msg, FUNC_NAME, FAILURE);
+    }
+
+    bytes = store->map;
+    store->count = get_uint32(bytes + 16);
+    table_end = STORE_HEADER_SIZE + (uint64_t) STORE_SECTION_SIZE
+                                    * store->count;
+
+    if (memcmp(bytes, STORE_MAGIC, 8) != 0)
+    {
+        reason = "is not a store";
+    }
+    else if (get_uint32(bytes + 8) != STORE_VERSION)
+    {
+        reason = "is not of a version this program reads";
+    }
+    else if (get_uint32(bytes + 12) != STORE_BYTE_ORDER_MARK)
+    {
+        reason = "has an unknown byte order";
+    }
+    else if (get_uint64(bytes + 24) != store->size)
+    {
+        reason = "is not the size its header gives";
+    }
+    else if (table_end > store->size)
+    {
+        reason = "is too short for its section table";
+    }
+    else if (store_crc32(bytes + STORE_HEADER_SIZE,
+                         table_end - STORE_HEADER_SIZE)
+             != get_uint32(bytes + 20))
+    {
+        reason = "has a corrupt section table";
+    }
+
+    if (reason == NULL)
+    {
+        store->sections = calloc(store->count > 0 ? store->count : 1,
+                                 sizeof(STORE_SECTION));
+        if (store->sections == NULL)
+        {
+            close_store(store);
+            RETURN_ERROR("Allocating the store sections", FUNC_NAME,
+                         FAILURE);
+        }
+    }
+
+    for (index = 0; reason == NULL && index < store->count; index++)
+    {
+        section = &store->sections[index];
+        entry = bytes + STORE_HEADER_SIZE + STORE_SECTION_SIZE * index;
+
+        memcpy(section->name, entry, STORE_NAME_SIZE);
+        section->type = get_uint32(entry + STORE_NAME_SIZE);
+        section->crc = get_uint32(entry + STORE_NAME_SIZE + 4);
+        section->offset = get_uint64(entry + STORE_NAME_SIZE + 8);
+        section->count = get_uint64(entry + STORE_NAME_SIZE + 16);
+
+        type_size = store_type_size(section->type);
+        if (section->name[STORE_NAME_SIZE - 1] != '\0')
+        {
+            reason = "has an unterminated section name";
+        }
+        else if (type_size == 0)
+        {
+            reason = "has a section of an unknown type";
+        }
+        else if (section->offset % STORE_ALIGNMENT != 0
+                 || section->offset > store->size
+                 || section->count > (store->size - section->offset)
+                                     / type_size)
+        {
+            reason = "has a section outside the store";
+        }
+        else if (store_crc32(bytes + section->offset,
+                             section->count * type_size) != section->crc)
+        {
+            reason = "has a corrupt section";
+        }
+
+        section->values = bytes + section->offset;
+    }
+
+    if (reason != NULL)
+    {
+        close_store(store);
+        snprintf(msg, sizeof(msg), "Store %s %s", filename, reason);
+        RETURN_ERROR(msg, FUNC_NAME, FAILURE);
+    }
+
+    return SUCCESS;
+}
+
+
+/*****************************************************************************
+ NAME:  store_section_count
+
+ PURPOSE: The number of values in a section of a store, or -1 when the
+          store does not have the section.
+*****************************************************************************/
+long store_section_count
+(
+    STORE *store,                /* I: the store */
+    const char *name             /* I: the section */
+)
+{
+    int index;
+
+    for (index = 0; index < store->count; index++)
+    {
+        if (strcmp(store->sections[index].name, name) == 0)
+        {
+            return (long) store->sections[index].count;
+        }
+    }
+
+    return -1;
+}
+
+
+/*****************************************************************************
+ NAME:  store_section
+
+ PURPOSE: The values of a section of a store, which are only valid until the
+          store is closed.
+
+ RETURN VALUE: The values, or NULL when the store has no such section
+*****************************************************************************/
+const void *store_section
+(
+    STORE *store,                /* I: the store */
+    const char *name,            /* I: the section */
+    STORE_TYPE type,             /* I: type of the values expected */
+    long count                   /* I: number of values expected, or -1 for
+                                       any */
+)
+{
+    char *FUNC_NAME = "store_section";
+    char msg[PATH_MAX + 100];
+    STORE_SECTION *section;
+    int index;
+
+    for (index = 0; index < store->count; index++)
+    {
+        section = &store->sections[index];
+        if (strcmp(section->name, name) != 0)
+        {
+            continue;
+        }
+
+        if (section->type != type)
+        {
+            snprintf(msg, sizeof(msg), "Store %s section %s is of type %d,"
+                     " not %d", store->filename, name, section->type, type);
+            ERROR_MESSAGE(msg, FUNC_NAME);
+            return NULL;
+        }
+
+        if (count >= 0 && section->count != (uint64_t) count)
+        {
+            snprintf(msg, sizeof(msg), "Store %s section %s has %ld values,"
+                     " not %ld", store->filename, name,
+                     (long) section->count, count);
+            ERROR_MESSAGE(msg, FUNC_NAME);
+            return NULL;
+        }
+
+        return section->values;
+    }
+
+    snprintf(msg, sizeof(msg), "Store %s has no %s section", store->filename,
+             name);
+    ERROR_MESSAGE(msg, FUNC_NAME);
+
+    return NULL;
+}
+
+
+/*****************************************************************************
+ NAME:  close_store
+
+ PURPOSE: Unmap a store.
+*****************************************************************************/
+void close_store
+(
+    STORE *store                 /* I: the store */
+)
+{
+    if (store->map != NULL)
+    {
+        munmap(store->map, store->size);
+        store->map = NULL;
+    }
+
+    free(store->sections);
+    store->sections = NULL;
+    store->count = 0;
+}
+
+
+/*****************************************************************************
+ NAME:  set_store_section
+
+ PURPOSE: Describe a section to write.
+*****************************************************************************/
+void set_store_section
+(
+    STORE_SECTION *section,      /* O: the section to write */
+    const char *name,            /* I: name of the section */
+    STORE_TYPE type,             /* I: type of the values */
+    long count,                  /* I: number of values */
+    const void *values           /* I: the values */
+)
+{
+    memset(section, 0, sizeof(*section));
+
+    snprintf(section->name, sizeof(section->name), "%s", name);
+    section->type = type;
+    section->count = count;
+    section->values = values;
+}
+
+
+/*****************************************************************************
+ NAME:  write_store
+
+ PURPOSE: Write a store.  It is written under a name of its own and renamed
+          into place, so a reader never sees part of one.
+
+ RETURN VALUE: SUCCESS
+               FAILURE
+*****************************************************************************/
+int write_store
+(
+    const char *filename,        /* I: the store */
+    STORE_SECTION *sections,     /* I: the sections, from set_store_section */
+    int count                    /* I: number of sections */
+)
+{
+    char *FUNC_NAME = "write_store";
+    char temporary_filename[PATH_MAX];
+    char msg[PATH_MAX + 100];
+    unsigned char header[STORE_HEADER_SIZE];
+    unsigned char *table = NULL;
+    unsigned char *entry;
+    static const unsigned char padding[STORE_ALIGNMENT];
+    FILE *fd = NULL;
+    uint64_t offset;
+    uint64_t position;
+    uint64_t size;
+    int status;
+    int index;
+
+    if (!host_is_little_endian())
+    {
+        RETURN_ERROR("Stores are only written on little-endian hosts",
+                     FUNC_NAME, FAILURE);
+    }
+
+    table = calloc(count > 0 ? count : 1, STORE_SECTION_SIZE);
+    if (table == NULL)
+    {
+        RETURN_ERROR("Allocating the store section table", FUNC_NAME,
+                     FAILURE);
+    }
+
+    /* Place the values of each section after the table */
+    offset = store_aligned(STORE_HEADER_SIZE
+                           + (uint64_t) STORE_SECTION_SIZE * count);
+    for (index = 0; index < count; index++)
+    {
+        size = sections[index].count * store_type_size(sections[index].type);
+
+        sections[index].offset = offset;
+        sections[index].crc = store_crc32(sections[index].values, size);
+
+        entry = table + STORE_SECTION_SIZE * index;
+        memcpy(entry, sections[index].name, STORE_NAME_SIZE);
+        put_uint32(entry + STORE_NAME_SIZE, sections[index].type);
+        put_uint32(entry + STORE_NAME_SIZE + 4, sections[index].crc);
+        put_uint64(entry + STORE_NAME_SIZE + 8, sections[index].offset);
+        put_uint64(entry + STORE_NAME_SIZE + 16, sections[index].count);
+
+        offset = store_aligned(offset + size);
+    }
+
+    memcpy(header, STORE_MAGIC, 8);
+    put_uint32(header + 8, STORE_VERSION);
+    put_uint32(header + 12, STORE_BYTE_ORDER_MARK);
+    put_uint32(header + 16, count);
+    put_uint32(header + 20, store_crc32(table, STORE_SECTION_SIZE * count));
+    put_uint64(header + 24, offset);
+
+    snprintf(temporary_filename, sizeof(temporary_filename), "%s.%ld",
+             filename, (long) getpid());
+
+    fd = fopen(temporary_filename, "wb");
+    if (fd == NULL)
+    {
+        free(table);
+        snprintf(msg, sizeof(msg), "Opening store %s", temporary_filename);
+        RETURN_ERROR(msg, FUNC_NAME, FAILURE);
+    }
+
+    /* The padding before each section is less than the alignment */
+    status = SUCCESS;
+    position = STORE_HEADER_SIZE + (uint64_t) STORE_SECTION_SIZE * count;
+    if (fwrite(header, STORE_HEADER_SIZE, 1, fd) != 1
+        || (count > 0
+            && fwrite(table, STORE_SECTION_SIZE, count, fd)
+               != (size_t) count))
+    {
+        status = FAILURE;
+    }
+
+    for (index = 0; status == SUCCESS && index < count; index++)
+    {
+        size = sections[index].count * store_type_size(sections[index].type);
+
+        if (fwrite(padding, 1, sections[index].offset - position, fd)
+                != sections[index].offset - position
+            || (size > 0
+                && fwrite(sections[index].values, size, 1, fd) != 1))
+        {
+            status = FAILURE;
+        }
+        position = sections[index].offset + size;
+    }
+
+    if (status == SUCCESS
+        && fwrite(padding, 1, offset - position, fd) != offset - position)
+    {
+        status = FAILURE;
+    }
+    if (fclose(fd) != 0)
+    {
+        status = FAILURE;
+    }
+    free(table);
+
+    if (status != SUCCESS)
+    {
+        unlink(temporary_filename);
+
+        snprintf(msg, sizeof(msg), "Writing to %s", temporary_filename);
+        RETURN_ERROR(msg, FUNC_NAME, FAILURE);
+    }
+
+    if (rename(temporary_filename, filename) != 0)
+    {
+        unlink(temporary_filename);
+
+        snprintf(msg, sizeof(msg), "Renaming %s", temporary_filename);
+        RETURN_ERROR(msg, FUNC_NAME, FAILURE);
+    }
+
+    return SUCCESS;
+}
@@ -0,0 +1,129 @@
+#ifndef ST_STORE_H
+#define ST_STORE_H
+
+
+#include <stddef.h>
+#include <stdint.h>
+#include <limits.h>
+
+
+/* The binary stores the processing stages hand the grid points, their
+   elevations, and the atmospheric parameters to each other in.  The layout
+   is described in st_store.py, which reads and writes the same stores, and
+   the two must be kept in step.  The header and section table are decoded
+   byte by byte, and the sections are used in place in the mapped store. */
+#define STORE_MAGIC "ST_STORE"
+#define STORE_VERSION 1
+#define STORE_BYTE_ORDER_MARK 0x01020304
+#define STORE_ALIGNMENT 8
+#define STORE_HEADER_SIZE 32
+#define STORE_SECTION_SIZE 48
+#define STORE_NAME_SIZE 24      /* Names are terminated within the field */
+
+/* The stores handed between the stages */
+#define GRID_POINT_STORE_NAME "grid_points.store"
+#define ELEVATION_STORE_NAME "elevations.store"
+#define SCENE_ATMOSPHERE_STORE_NAME "scene_atmosphere.store"
+
+/* The grid, as the point count, rows, and columns */
+#define SECTION_GRID "grid"
+/* Values of each grid point */
+#define SECTION_INDEX "index"
+#define SECTION_RUN_MODTRAN "run_modtran"
+#define SECTION_ROW "row"
+#define SECTION_COL "col"
+#define SECTION_NARR_ROW "narr_row"
+#define SECTION_NARR_COL "narr_col"
+#define SECTION_LON "lon"
+#define SECTION_LAT "lat"
+#define SECTION_MAP_X "map_x"
+#define SECTION_MAP_Y "map_y"
+/* The standard elevations MODTRAN is run at, the first replaced by the
+   ground elevation of each point */
+#define SECTION_ALTITUDES "altitudes"
+#define SECTION_GROUND_ELEVATION "ground_elevation"
+#define SECTION_GROUND_DIRECTORY "ground_directory"
+/* The atmosphere, as the point count, elevations, and thermal bands */
+#define SECTION_ATMOSPHERE "atmosphere"
+/* Values of each elevation of each point, all of a point together */
+#define SECTION_ELEVATION "elevation"
+#define SECTION_ELEVATION_DIRECTORY "elevation_directory"
+/* printf formats completed with the thermal band number */
+#define SECTION_TRANSMISSION "transmission_%d"
+#define SECTION_UPWELLED_RADIANCE "upwelled_radiance_%d"
+#define SECTION_DOWNWELLED_RADIANCE "downwelled_radiance_%d"
+
+
+typedef enum
+{
+    STORE_INT32 = 1,
+    STORE_FLOAT32 = 2,
+    STORE_FLOAT64 = 3
+} STORE_TYPE;
+
+
+typedef struct
+{
+    char name[STORE_NAME_SIZE];
+    STORE_TYPE type;
+    uint32_t crc;                /* CRC-32 of the values */
+    uint64_t offset;             /* Of the values in the store */
+    uint64_t count;              /* Number of values */
+    const void *values;          /* In the mapped store, or to be written */
+} STORE_SECTION;
+
+
+typedef struct
+{
+    char filename[PATH_MAX];
+    void *map;                   /* The mapped store */
+    size_t size;
+    int count;                   /* Number of sections */
+    STORE_SECTION *sections;
+} STORE;
+
+
+int open_store
+(
+    const char *filename,        /* I: the store */
+    STORE *store                 /* O: the mapped and checked store */
+);
+
+const void *store_section
+(
+    STORE *store,                /* I: the store */
+    const char *name,            /* I: the section */
+    STORE_TYPE type,             /* I: type of the values expected */
+    long count                   /* I: number of values expected, or -1 for
+                                       any */
+);
+
+long store_section_count
+(
+    STORE *store,                /* I: the store */
+    const char *name             /* I: the section */
+);
+
+void close_store
+(
+    STORE *store                 /* I: the store */
+);
+
+void set_store_section
+(
+    STORE_SECTION *section,      /* O: the section to write */
+    const char *name,            /* I: name of the section */
+    STORE_TYPE type,             /* I: type of the values */
+    long count,                  /* I: number of values */
+    const void *values           /* I: the values */
+);
+
+int write_store
+(
+    const char *filename,        /* I: the store */
+    STORE_SECTION *sections,     /* I: the sections, from set_store_section */
+    int count                    /* I: number of sections */
+);
+
+
+#endif /* ST_STORE_H */
@@ -0,0 +1,85 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "const.h"
+#include "utilities.h"
+#include "st_store.h"
+
+
+/*****************************************************************************
+DESCRIPTION: Reads a store and writes its sections to another store, both
+through st_store.c.  The unit tests of the stores use it to check the C
+reader and writer against st_store.py, so it is not built or installed with
+the application.
+*****************************************************************************/
+
+
+/*****************************************************************************
+Method: usage
+
+Description: Display help/usage information to the user.
+****************************************************************************/
+void usage()
+{
+    printf("Surface Temperature - st_store_copy\n");
+    printf("\n");
+    printf("Copies a store, section by section.\n");
+    printf("\n");
+    printf("usage: st_store_copy <input store> <output store>\n");
+    printf("\n");
+}
+
+
+/*****************************************************************************
+Method:  main
+
+Description:  Main for the application.
+*****************************************************************************/
+int main(int argc, char *argv[])
+{
+    char FUNC_NAME[] = "main";
+    STORE store;
+    STORE_SECTION *sections;
+    int index;
+
+    if (argc != 3)
+    {
+        usage();
+        return EXIT_FAILURE;
+    }
+
+    if (open_store(argv[1], &store) != SUCCESS)
+    {
+        RETURN_ERROR("Opening the input store", FUNC_NAME, EXIT_FAILURE);
+    }
+
+    sections = calloc(store.count > 0 ? store.count : 1,
+                      sizeof(STORE_SECTION));
+    if (sections == NULL)
+    {
+        close_store(&store);
+        RETURN_ERROR("Allocating the output sections", FUNC_NAME,
+                     EXIT_FAILURE);
+    }
+
+    for (index = 0; index < store.count; index++)
+    {
+        set_store_section(&sections[index], store.sections[index].name,
+                          store.sections[index].type,
+                          store.sections[index].count,
+                          store.sections[index].values);
+    }
+
+    if (write_store(argv[2], sections, store.count) != SUCCESS)
+    {
+        free(sections);
+        close_store(&store);
+        RETURN_ERROR("Writing the output store", FUNC_NAME, EXIT_FAILURE);
+    }
+
+    free(sections);
+    close_store(&store);
+
+    return EXIT_SUCCESS;
+}
@@ -4,6 +4,8 @@
 
 #include <limits.h>
 
+#include "const.h"
+
 typedef struct {
     int16_t index;
     int8_t run_modtran;
@@ -26,33 +28,28 @@ typedef struct {
 } GRID_POINTS;
 
 
+/* Atmospheric parameters at each elevation of each grid point, as arrays
+   carved from one arena.  The point arrays hold count values.  The
+   elevation arrays hold count * num_elevations values, all of the
+   elevations of a point together, which is the layout the atmospheric
+   engine reads.  The parameters are held for each thermal band, and are
+   ST_NO_DATA_VALUE for the points MODTRAN was not run for. */
 typedef struct {
-    double elevation;
-    double elevation_directory;
-    double transmission;
-    double upwelled_radiance;
-    double downwelled_radiance;
-} MODTRAN_ELEVATION;
-
-
-typedef struct {
-    int count;
-    int ran_modtran;
-    uint8_t row;
-    uint8_t col;
-    uint16_t narr_row;
-    uint16_t narr_col;
-    double lon;
-    double lat;
-    double map_x;
-    double map_y;
-    MODTRAN_ELEVATION *elevations;
-} MODTRAN_POINT;
-
-
-typedef struct {
-    int count;
-    MODTRAN_POINT *points;
-} MODTRAN_POINTS;
+    int count;                   /* Number of grid points */
+    int num_elevations;          /* Number of elevations for each point */
+    int num_bands;               /* Number of thermal bands */
+    int8_t *ran_modtran;         /* MODTRAN was run for the point */
+    double *lon;                 /* Point longitude in degrees */
+    double *lat;                 /* Point latitude in degrees */
+    double *map_x;               /* Point map projection x */
+    double *map_y;               /* Point map projection y */
+    double *elevation;           /* Elevation in km */
+    double *elevation_directory; /* Elevation the MODTRAN run directory is
+                                    named for */
+    double *transmission[MAX_THERMAL_BANDS];
+    double *upwelled_radiance[MAX_THERMAL_BANDS];
+    double *downwelled_radiance[MAX_THERMAL_BANDS];
+    void *arena;                 /* The allocation holding the arrays */
+} ATMOS_TABLE;
 
 #endif /* ST_TYPES_H */
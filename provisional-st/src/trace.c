@@ -0,0 +1,136 @@
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <limits.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <sys/resource.h>
+#include <unistd.h>
+
+#include "utilities.h"
+#include "trace.h"
+
+
+/* Events file of this process, NULL when not tracing */
+static FILE *trace_fd = NULL;
+
+/* The category of the spans */
+static char trace_category[PATH_MAX];
+
+
+/*****************************************************************************
+ NAME:  trace_open
+
+ PURPOSE: Start recording spans, if the processing is being traced.  A
+          failure to open the events file only turns tracing off.
+*****************************************************************************/
+void trace_open
+(
+    const char *process_name  /* I: name the process is shown under */
+)
+{
+    char FUNC_NAME[] = "trace_open";
+    char filename[PATH_MAX];
+    char msg[PATH_MAX + 64];
+    const char *directory;
+    int count;
+
+    directory = getenv(TRACE_ENV);
+    if (directory == NULL || directory[0] == '\0')
+        return;
+
+    count = snprintf(filename, sizeof(filename), "%s/trace.%d.jsonl",
+                     directory, (int)getpid());
+    if (count < 0 || count >= (int)sizeof(filename))
+    {
+        WARNING_MESSAGE("Trace directory name is too long", FUNC_NAME);
+        return;
+    }
+
+    trace_fd = fopen(filename, "a");
+    if (trace_fd == NULL)
+    {
+        snprintf(msg, sizeof(msg), "Unable to open trace file %s", filename);
+        WARNING_MESSAGE(msg, FUNC_NAME);
+        return;
+    }
+
+    snprintf(trace_category, sizeof(trace_category), "%s", process_name);
+
+    fprintf(trace_fd, "{\"name\": \"process_name\", \"ph\": \"M\","
+            " \"pid\": %d, \"tid\": %d, \"args\": {\"name\": \"%s\"}}\n",
+            (int)getpid(), (int)getpid(), trace_category);
+    fflush(trace_fd);
+}
+
+
+/*****************************************************************************
+ NAME:  trace_time
+
+ PURPOSE: The current time, in seconds since the epoch, as the scripts
+          record it.
+
+ RETURN VALUE: Type = double
+*****************************************************************************/
+double trace_time()
+{
+    struct timeval now;
+
+    gettimeofday(&now, NULL);
+
+    return now.tv_sec + now.tv_usec / 1000000.0;
+}
+
+
+/*****************************************************************************
+ NAME:  trace_span
+
+ PURPOSE: Record a span which ends now.
+*****************************************************************************/
+void trace_span
+(
+    const char *name,         /* I: the span */
+    double start_time         /* I: start of the span, from trace_time */
+)
+{
+    double end_time;
+
+    if (trace_fd == NULL)
+        return;
+
+    end_time = trace_time();
+
+    fprintf(trace_fd, "{\"name\": \"%s\", \"cat\": \"%s\", \"ph\": \"X\","
+            " \"ts\": %.0f, \"dur\": %.0f, \"pid\": %d, \"tid\": %d,"
+            " \"args\": {}}\n",
+            name, trace_category, start_time * 1000000.0,
+            (end_time - start_time) * 1000000.0,
+            (int)getpid(), (int)getpid());
+    fflush(trace_fd);
+}
+
+
+/*****************************************************************************
+ NAME:  trace_close
+
+ PURPOSE: Record the peak resident set size of the process, in kilobytes,
+          and stop recording.
+*****************************************************************************/
+void trace_close()
+{
+    struct rusage usage;
+
+    if (trace_fd == NULL)
+        return;
+
+    getrusage(RUSAGE_SELF, &usage);
+
+    fprintf(trace_fd, "{\"name\": \"peak_rss\", \"ph\": \"C\","
+            " \"ts\": %.0f, \"pid\": %d, \"tid\": %d,"
+            " \"args\": {\"self_kb\": %ld, \"children_kb\": 0}}\n",
+            trace_time() * 1000000.0, (int)getpid(), (int)getpid(),
+            usage.ru_maxrss);
+
+    fclose(trace_fd);
+    trace_fd = NULL;
+}
@@ -0,0 +1,29 @@
+
+#ifndef TRACE_H
+#define TRACE_H
+
+
+/* The processing is traced when this environment variable names a
+   directory.  The events are appended to a file of this process there, as
+   Chrome trace events, one per line, which the script running the
+   processing merges into one trace. */
+#define TRACE_ENV "ST_TRACE_DIR"
+
+
+void trace_open
+(
+    const char *process_name  /* I: name the process is shown under */
+);
+
+double trace_time();
+
+void trace_span
+(
+    const char *name,         /* I: the span */
+    double start_time         /* I: start of the span, from trace_time */
+);
+
+void trace_close();
+
+
+#endif /* TRACE_H */